@@ -0,0 +1,106 @@
+/*
+**  bench-alloc.c
+**
+**  Localite de l'allocation : un disque est vieilli (creations de
+**  fichiers entrelacees, destructions, nouvelles creations), puis
+**  chaque fichier est ouvert et relu. On compare l'allocation au
+**  premier bloc libre (ALLOC_FIRST_FIT) a l'allocation dirigee
+**  (ALLOC_NEAR_GOAL) par le deplacement moyen de la tete simulee.
+**
+**  sgf-bench-alloc [fichiers]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE      "bench-alloc.img"
+#define DISK_SIZE  (40000)
+#define BATCH      (8)          /* fichiers ecrits en meme temps */
+
+/* Ecrire les fichiers [from, to[ par groupes de BATCH fichiers entrelaces */
+static void create_files(int from, int to, int* sizes) {
+	OFILE* f[BATCH];
+	char name[16];
+	int i, k, n, done;
+
+	for (i = from; i < to; i += BATCH) {
+		n = (to - i < BATCH) ? to - i : BATCH;
+		for (k = 0; k < n; k++) {
+			sprintf(name, "f%d", i + k);
+			f[k] = sgf_open(name, WRITE_MODE);
+		}
+		for (done = 0; done < 16 * BLOCK_SIZE; done++)
+			for (k = 0; k < n; k++)
+				if (done < sizes[i + k]) sgf_putc(f[k], 'a' + done % 26);
+		for (k = 0; k < n; k++)
+			sgf_close(f[k]);
+	}
+}
+
+static void report(const char* phase, int ops) {
+	DISK_COUNTERS c;
+
+	get_disk_counters(&c);
+	printf("  %-12s %8.1f blocs/op %8.2f seeks/op %10.1f deplacement/op %10.1f deplacement/seek\n",
+	       phase, (double) (c.nb_reads + c.nb_writes) / ops,
+	       (double) c.nb_seeks / ops, (double) c.seek_distance / ops,
+	       c.nb_seeks ? (double) c.seek_distance / c.nb_seeks : 0.0);
+}
+
+static void run(int policy, int nb_files) {
+	int* sizes = malloc(2 * nb_files * sizeof(int));
+	char name[16];
+	OFILE* f;
+	int i;
+
+	sgf_alloc_policy = policy;
+	format_image(IMAGE, DISK_SIZE);
+	srand(42);
+	for (i = 0; i < 2 * nb_files; i++)
+		sizes[i] = 1 + rand() % (16 * BLOCK_SIZE);
+
+	printf("%s\n", (policy == ALLOC_FIRST_FIT) ? "ALLOC_FIRST_FIT" : "ALLOC_NEAR_GOAL");
+
+	/* vieillissement : creations, destruction d'un fichier sur trois, creations */
+	reset_disk_counters();
+	create_files(0, nb_files, sizes);
+	for (i = 0; i < nb_files; i += 3) {
+		sprintf(name, "f%d", i);
+		sgf_unlink(name);
+	}
+	create_files(nb_files, 2 * nb_files, sizes);
+	report("ecriture", 2 * nb_files);
+
+	/* relecture : ouverture + lecture complete de chaque fichier */
+	reset_disk_counters();
+	for (i = 0; i < 2 * nb_files; i++) {
+		sprintf(name, "f%d", i);
+		f = sgf_open(name, READ_MODE);
+		if (f == NULL) continue;
+		while (sgf_getc(f) != -1) ;
+		sgf_close(f);
+	}
+	report("open+lecture", 2 * nb_files - (nb_files + 2) / 3);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	free(sizes);
+}
+
+int main(int argc, char* argv[]) {
+	int nb_files = (argc > 1) ? atoi(argv[1]) : 400;
+
+	run(ALLOC_FIRST_FIT, nb_files);
+	run(ALLOC_NEAR_GOAL, nb_files);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,85 @@
+/*
+**  bench-append.c
+**
+**  Ajouts frequents : un journal recoit des milliers de petits
+**  enregistrements, chacun par un cycle ouverture en APPEND_MODE,
+**  ecriture, fermeture (comme la boucle de main.c). On compare le
+**  vidage a chaque fermeture (sgf_tail_cache_files = 0) au cache des
+**  fins de fichiers, avec un ou plusieurs journaux alimentes a tour
+**  de role.
+**
+**  sgf-bench-append [cycles [octets_par_ajout]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-append.img"
+
+static void run(int cache, int nb_logs, int cycles, int record) {
+	struct timespec t0, t1;
+	DISK_COUNTERS c;
+	char name[16];
+	OFILE* f;
+	int i, j, n;
+
+	format_image(IMAGE, (cycles * record / BLOCK_SIZE) * 2 + 4096);
+	sgf_tail_cache_files = cache;
+	for (i = 0; i < nb_logs; i++) {
+		sprintf(name, "log%d", i);
+		sgf_close(sgf_open(name, WRITE_MODE));
+	}
+
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < cycles; i++) {
+		sprintf(name, "log%d", i % nb_logs);
+		f = sgf_open(name, APPEND_MODE);
+		for (j = 0; j < record; j++)
+			sgf_putc(f, 'a' + (i + j) % 26);
+		sgf_close(f);
+	}
+	sgf_sync();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+
+	/* verification : les journaux ont la bonne taille */
+	for (i = 0, n = 0; i < nb_logs; i++) {
+		sprintf(name, "log%d", i);
+		f = sgf_open(name, READ_MODE);
+		n += f->length;
+		sgf_close(f);
+	}
+
+	printf("cache %2d  %2d journal(aux) %8.2f us/ajout %6.3f lectures/ajout %6.3f ecritures/ajout%s\n",
+	       cache, nb_logs, elapsed_ms(&t0, &t1) * 1e3 / cycles,
+	       (double) c.nb_reads / cycles, (double) c.nb_writes / cycles,
+	       (n == cycles * record) ? "" : "  TAILLE INCORRECTE");
+
+	close_sgf_disk();
+	remove(IMAGE);
+}
+
+int main(int argc, char* argv[]) {
+	int cycles = (argc > 1) ? atoi(argv[1]) : 10000;
+	int record = (argc > 2) ? atoi(argv[2]) : 20;
+
+	printf("%d ajouts de %d octets\n", cycles, record);
+	run(0, 1, cycles, record);
+	run(TAIL_CACHE_FILES, 1, cycles, record);
+	run(0, 8, cycles, record);
+	run(TAIL_CACHE_FILES, 8, cycles, record);
+	run(TAIL_CACHE_FILES, 4 * TAIL_CACHE_FILES, cycles, record);
+
+	return (EXIT_SUCCESS);
+}
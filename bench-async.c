@@ -0,0 +1,206 @@
+/*
+**  bench-async.c
+**
+**  E/S asynchrones (sgf-async.h) : 64 flux ecrivent chacun un fichier
+**  par requetes de 4 Ko, tous en cours en meme temps, puis les
+**  fichiers sont relus un par un par sgf_read ou par 64 flux de
+**  lectures asynchrones. Les etapes des requetes en cours sont faites
+**  dans l'ordre des adresses : les extents des differents fichiers,
+**  entrelaces sur le disque, se lisent dans l'ordre du disque. Temps
+**  simule sur le disque rotatif et la memoire flash.
+**
+**  sgf-bench-async [flux [octets_par_flux]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-device.h"
+#include "sgf-async.h"
+#include "bench.h"
+
+#define IMAGE       "bench-async.img"
+#define REQUEST     (4096)
+#define MAX_STREAMS (1024)
+
+typedef struct STREAM {
+	char   name[16];
+	OFILE* f;
+	char   buf[REQUEST];
+	int    pos;
+	int    total;
+	long   sum;
+} STREAM;
+
+static STREAM streams[MAX_STREAMS];
+static int nb_done, nb_errors;
+
+static long sum(const char* p, int n) {
+	long s = 0;
+	int i;
+
+	for (i = 0; i < n; i++)
+		s += (unsigned char) p[i];
+	return (s);
+}
+
+/* requete suivante d'un flux, ou fermeture a la fin du fichier */
+static void next_write(STREAM* s);
+static void next_read(STREAM* s);
+
+static void finish(STREAM* s, int error) {
+	if (error) nb_errors++;
+	sgf_close(s->f);
+	nb_done++;
+}
+
+static void written(SGF_AIO* r, void* arg) {
+	STREAM* s = arg;
+
+	if (r->result < 0) finish(s, 1);
+	else {
+		s->pos += r->result;
+		next_write(s);
+	}
+}
+
+static void next_write(STREAM* s) {
+	int i, n = (s->total - s->pos < REQUEST) ? s->total - s->pos : REQUEST;
+
+	if (n == 0) {
+		finish(s, 0);
+		return;
+	}
+	for (i = 0; i < n; i++)
+		s->buf[i] = 'a' + (s->pos + i + s->name[1]) % 26;
+	s->sum += sum(s->buf, n);
+	if (sgf_write_async(s->f, s->buf, n, written, s) == NULL) finish(s, 1);
+}
+
+static void got(SGF_AIO* r, void* arg) {
+	STREAM* s = arg;
+
+	if (r->result <= 0) finish(s, r->result < 0 || s->pos != s->total);
+	else {
+		s->sum -= sum(s->buf, r->result);
+		s->pos += r->result;
+		next_read(s);
+	}
+}
+
+static void next_read(STREAM* s) {
+	if (sgf_read_async(s->f, s->buf, REQUEST, got, s) == NULL) finish(s, 1);
+}
+
+static void opened(SGF_AIO* r, void* arg) {
+	STREAM* s = arg;
+
+	s->f = r->file;
+	s->pos = 0;
+	if (s->f == NULL) {
+		nb_errors++;
+		nb_done++;
+	} else if (r->mode == WRITE_MODE) next_write(s);
+	else next_read(s);
+}
+
+/* tous les flux a la fois : ouverture, requetes de REQUEST octets, fermeture */
+static void run_async(int nb, int mode) {
+	int i;
+
+	nb_done = 0;
+	for (i = 0; i < nb; i++)
+		sgf_open_async(streams[i].name, mode, opened, &streams[i]);
+	while (sgf_async_run() > 0)
+		;
+	if (nb_done != nb) nb_errors++;
+}
+
+/* les fichiers l'un apres l'autre */
+static void run_blocking(int nb) {
+	int i, n;
+
+	for (i = 0; i < nb; i++) {
+		streams[i].f = sgf_open(streams[i].name, READ_MODE);
+		while ((n = sgf_read(streams[i].f, streams[i].buf, REQUEST)) > 0)
+			streams[i].sum -= sum(streams[i].buf, n);
+		sgf_close(streams[i].f);
+	}
+}
+
+static void report(const char* model, const char* what, struct timespec* t0) {
+	struct timespec t1;
+	DEVICE_COUNTERS d;
+	DISK_COUNTERS c;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_device_counters(&d);
+	get_disk_counters(&c);
+	printf("%-16s %-22s %11.2f %8ld %9.2f\n", model, what, d.elapsed_ns / 1e6, c.nb_seeks,
+	       elapsed_ms(t0, &t1));
+}
+
+int main(int argc, char* argv[]) {
+	static const char* models[] = { "hdd", "ssd:qd=32:ch=8" };
+	int nb = (argc > 1) ? atoi(argv[1]) : 64;
+	int bytes = (argc > 2) ? atoi(argv[2]) : 256 * 1024;
+	struct timespec t0;
+	int i, m, saved, check = 0;
+
+	if (nb < 1 || nb > MAX_STREAMS || bytes < 1) return (EXIT_FAILURE);
+	printf("%d flux de %d octets, requetes de %d octets, etapes de %d blocs (temps simule)\n",
+	       nb, bytes, REQUEST, sgf_async_slice);
+	printf("%-16s %-22s %11s %8s %9s\n", "modele", "", "simule ms", "depl.", "reel ms");
+
+	for (m = 0; m < 2; m++) {
+		format_image(IMAGE, nb * (bytes / BLOCK_SIZE + 2) * 2 + 4096);
+		set_device_model(models[m]);
+		for (i = 0; i < nb; i++) {
+			sprintf(streams[i].name, "f%d", i);
+			streams[i].total = bytes;
+			streams[i].sum = 0;
+		}
+
+		saved = mute(-1);
+		reset_disk_counters();
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		run_async(nb, WRITE_MODE);
+		sgf_sync();
+		mute(saved);
+		report(models[m], "ecriture asynchrone", &t0);
+
+		for (i = 0; i < nb; i++)
+			streams[i].sum *= 2;
+		saved = mute(-1);
+		reset_disk_counters();
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		run_blocking(nb);
+		mute(saved);
+		report(models[m], "lecture sgf_read", &t0);
+
+		saved = mute(-1);
+		reset_disk_counters();
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		run_async(nb, READ_MODE);
+		mute(saved);
+		report(models[m], "lecture asynchrone", &t0);
+
+		/* chaque fichier a ete relu deux fois */
+		for (i = 0; i < nb; i++)
+			if (streams[i].sum != 0) check++;
+		close_sgf_disk();
+	}
+
+	remove(IMAGE);
+	if (check != 0 || nb_errors != 0)
+		printf("%d flux errone(s), %d erreur(s)\n", check, nb_errors);
+	return (check == 0 && nb_errors == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,101 @@
+/*
+**  bench-clone.c
+**
+**  Fichiers modeles : un modele est copie de nombreuses fois puis
+**  l'en-tete de chaque copie est personnalise. On compare la copie
+**  octet par octet (sgf_getc + sgf_write) au clonage (sgf_clone, avec
+**  copie sur ecriture du seul bloc modifie) : temps, blocs ecrits et
+**  place occupee.
+**
+**  sgf-bench-clone [copies [octets_du_modele]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-clone.img"
+#define HEADER  "copie personnalisee"
+
+/* Copier "src" dans "dst" par la lecture de chaque octet (-1 en cas d'echec) */
+static int copy_file(const char* src, const char* dst, char* data) {
+	OFILE* in = sgf_open(src, READ_MODE);
+	OFILE* out = sgf_open(dst, WRITE_MODE);
+	int n, c, r;
+
+	if (in == NULL || out == NULL) return (-1);
+	for (n = 0; (c = sgf_getc(in)) != -1; n++)
+		data[n] = c;
+	r = sgf_write(out, data, n);
+	if (sgf_close(out) < 0) r = -1;
+	sgf_close(in);
+	return (r < 0 ? -1 : 0);
+}
+
+static void fail(const char* what, int i) {
+	fprintf(stderr, "%s %d impossible : resultats abandonnes\n", what, i);
+	close_sgf_disk();
+	remove(IMAGE);
+	exit(EXIT_FAILURE);
+}
+
+static void run(int clone, int copies, int bytes) {
+	char* data = malloc(bytes);
+	struct timespec t0, t1;
+	DISK_COUNTERS c;
+	char name[16];
+	OFILE* f;
+	int i, free0, size;
+
+	/* les copies, et la FAT, les sommes de controle et le journal (moins de 1/4) */
+	size = (copies + 1) * (bytes / BLOCK_SIZE + 2);
+	format_image(IMAGE, size + size / 4 + 4096);
+	for (i = 0; i < bytes; i++)
+		data[i] = 'a' + i % 26;
+	f = sgf_open("modele", WRITE_MODE);
+	if (f == NULL || sgf_write(f, data, bytes) < 0 || sgf_close(f) < 0)
+		fail("modele", 0);
+	free0 = get_free_fat_blocks_count();
+
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < copies; i++) {
+		sprintf(name, "copie%d", i);
+		if ((clone ? sgf_clone("modele", name) : copy_file("modele", name, data)) < 0)
+			fail(clone ? "clone" : "copie", i);
+		f = sgf_open(name, READ_WRITE_MODE);
+		if (f == NULL || sgf_write(f, HEADER, strlen(HEADER)) < 0 || sgf_close(f) < 0)
+			fail("en-tete", i);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+
+	printf("%-8s %8.3f ms/copie %8.1f ecritures/copie %8.1f blocs occupes/copie\n",
+	       clone ? "clone" : "copie", elapsed_ms(&t0, &t1) / copies,
+	       (double) c.nb_writes / copies,
+	       (double) (free0 - (int) get_free_fat_blocks_count()) / copies);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	free(data);
+}
+
+int main(int argc, char* argv[]) {
+	int copies = (argc > 1) ? atoi(argv[1]) : 200;
+	int bytes = (argc > 2) ? atoi(argv[2]) : 64 * 1024;
+
+	printf("%d copies d'un modele de %d octets\n", copies, bytes);
+	run(0, copies, bytes);
+	run(1, copies, bytes);
+
+	return (EXIT_SUCCESS);
+}
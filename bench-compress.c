@@ -0,0 +1,142 @@
+/*
+**  bench-compress.c
+**
+**  Compression par grappes : un fichier est ecrit avec sgf_puts
+**  (lignes de texte repetees, comme celles de main.c) ou avec des
+**  octets aleatoires, sans puis avec COMPRESSED_MODE. On mesure le
+**  taux de compression (blocs occupes), les debits en ecriture et en
+**  lecture sequentielle, les blocs ecrits et lus par Ko logique, puis
+**  le cout d'un sgf_seek + sgf_getc a une position aleatoire.
+**
+**  sgf-bench-compress [octets [deplacements]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-compress.img"
+#define LINE    (128)
+
+static const char* lines[] = {
+	"Ceci est un petit texte ui occupe\n",
+	"quelques blocs sur ce disque fictif.\n",
+	"Le bloc faisant 128 octets, il faut\n",
+	"que je remplisse pour utiliser\n",
+	"Encore un peu de texte pour tester si ca marche ou pas il faut savoir si ca fonctionne ou pas\n",
+};
+
+/* le texte : des lignes de main.c numerotees ; sinon des octets aleatoires (ni 0 ni 0xFF) */
+static void fill(char* data, int bytes, int text) {
+	char line[LINE];
+	int i, n;
+
+	srand(1);
+	for (i = 0; i < bytes; i += n) {
+		if (text)
+			n = sprintf(line, "%d: %s", i / 64, lines[rand() % 5]);
+		else
+			for (n = 0; n < LINE; n++) line[n] = 1 + rand() % 254;
+		if (n > bytes - i) n = bytes - i;
+		memcpy(data + i, line, n);
+	}
+}
+
+static void run(const char* title, int compress, char* data, int bytes, int seeks) {
+	struct timespec t0, t1;
+	DISK_COUNTERS c;
+	OFILE* f;
+	char s[LINE + 1];
+	int i, n, used, free0;
+	double w_ms, r_ms, w_blocks, r_blocks;
+
+	format_image(IMAGE, 2 * bytes / BLOCK_SIZE + 4096);
+	free0 = get_free_fat_blocks_count();
+
+	/* ecriture par sgf_puts, une ligne a la fois */
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	f = sgf_open("f", compress ? WRITE_MODE | COMPRESSED_MODE : WRITE_MODE);
+	for (i = 0; i < bytes; i += LINE) {
+		n = (bytes - i < LINE) ? bytes - i : LINE;
+		memcpy(s, data + i, n);
+		s[n] = '\0';
+		sgf_puts(f, s);
+	}
+	sgf_close(f);
+	sgf_sync();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	w_ms = elapsed_ms(&t0, &t1);
+	w_blocks = c.nb_writes;
+	used = free0 - (int) get_free_fat_blocks_count();
+
+	/* lecture sequentielle */
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	f = sgf_open("f", READ_MODE);
+	for (n = 0; sgf_getc(f) != -1; n++)
+		;
+	sgf_close(f);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	r_ms = elapsed_ms(&t0, &t1);
+	r_blocks = c.nb_reads;
+
+	printf("%-18s %6d blocs (x%5.2f) ecriture %7.2f Mo/s %6.2f blocs/Ko  lecture %7.2f Mo/s %6.2f blocs/Ko%s\n",
+	       title, used, (double) (bytes / BLOCK_SIZE + 1) / used,
+	       bytes / 1e3 / w_ms, w_blocks * 1024 / bytes,
+	       bytes / 1e3 / r_ms, r_blocks * 1024 / bytes,
+	       (n == bytes) ? "" : "  TAILLE INCORRECTE");
+
+	/* deplacements aleatoires */
+	f = sgf_open("f", READ_MODE);
+	srand(2);
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < seeks; i++) {
+		n = rand() % bytes;
+		sgf_seek(f, n);
+		if (sgf_getc(f) != data[n]) {
+			printf("  lecture incorrecte en %d\n", n);
+			break;
+		}
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	sgf_close(f);
+	printf("%-18s %6d deplacements : %8.2f us et %6.2f lectures par sgf_seek + sgf_getc\n",
+	       "", seeks, elapsed_ms(&t0, &t1) * 1e3 / seeks, (double) c.nb_reads / seeks);
+
+	close_sgf_disk();
+	remove(IMAGE);
+}
+
+int main(int argc, char* argv[]) {
+	int bytes = (argc > 1) ? atoi(argv[1]) : 1024 * 1024;
+	int seeks = (argc > 2) ? atoi(argv[2]) : 20000;
+	char* data = malloc(bytes);
+
+	if (data == NULL || bytes < 1 || seeks < 1) return (EXIT_FAILURE);
+	printf("fichiers de %d octets\n", bytes);
+
+	fill(data, bytes, 1);
+	run("texte", 0, data, bytes, seeks);
+	run("texte compresse", 1, data, bytes, seeks);
+
+	fill(data, bytes, 0);
+	run("aleatoire", 0, data, bytes, seeks);
+	run("aleat. compresse", 1, data, bytes, seeks);
+
+	free(data);
+	return (EXIT_SUCCESS);
+}
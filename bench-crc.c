@@ -0,0 +1,125 @@
+/*
+**  bench-crc.c
+**
+**  Sommes de controle des blocs : debit du CRC32C (version portable
+**  et version SSE4.2) sur des blocs de BLOCK_SIZE octets, puis cout de
+**  la verification a la lecture. Un fichier est ecrit sur un disque
+**  muni de la table des sommes, puis relu (read_block sur tous ses
+**  blocs, et sgf_getc) tour a tour sans et avec verification.
+**
+**  sgf-bench-crc [octets [passes]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-crc.h"
+#include "bench.h"
+
+#define IMAGE   "bench-crc.img"
+#define KERNEL_BYTES    (1 << 20)
+#define ROUNDS  (7)
+
+static void kernel(const char* title, unsigned int (*f)(unsigned int, const char*, int), char* data, int rounds) {
+	struct timespec t0, t1;
+	unsigned int s = 0;
+	int r, k;
+	double ms;
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (r = 0; r < rounds; r++)
+		for (k = 0; k < KERNEL_BYTES; k += BLOCK_SIZE)
+			s += f(0, data + k, BLOCK_SIZE);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms = elapsed_ms(&t0, &t1);
+
+	printf("%-12s %8.1f Mo/s %7.1f ns/bloc  (controle %08x, \"123456789\" -> %08x)\n", title,
+	       (double) KERNEL_BYTES * rounds / 1e3 / ms,
+	       ms * 1e6 / ((double) rounds * KERNEL_BYTES / BLOCK_SIZE),
+	       s, f(0, "123456789", 9));
+}
+
+/* relire le fichier "f" : tous ses blocs par read_block, puis par sgf_getc (durees en ms) */
+static void reread(int passes, double* ms) {
+	struct timespec t0, t1;
+	OFILE* f;
+	BLOCK b;
+	int p, adr;
+
+	f = sgf_open("f", READ_MODE);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = 0; p < passes; p++)
+		for (adr = f->first; adr != FAT_EOF; adr = get_fat(adr))
+			read_block(adr, &b);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms[0] = elapsed_ms(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = 0; p < passes; p++) {
+		sgf_seek(f, 0);
+		while (sgf_getc(f) != -1)
+			;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms[1] = elapsed_ms(&t0, &t1);
+	sgf_close(f);
+}
+
+int main(int argc, char* argv[]) {
+	int bytes = (argc > 1) ? atoi(argv[1]) : 1024 * 1024;
+	int passes = (argc > 2) ? atoi(argv[2]) : 10;
+	double ms[2], best[2][2];
+	CRC_COUNTERS c;
+	char* data = malloc(bytes > KERNEL_BYTES ? bytes : KERNEL_BYTES);
+	OFILE* f;
+	int i, r, mode;
+
+	if (data == NULL || bytes < 1 || passes < 1) return (EXIT_FAILURE);
+	srand(1);
+	for (i = 0; i < (bytes > KERNEL_BYTES ? bytes : KERNEL_BYTES); i++)
+		data[i] = 'a' + rand() % 26;
+
+	kernel("portable", crc32c_portable, data, 100);
+	kernel(crc32c_hardware() ? "SSE4.2" : "(portable)", crc32c, data, 100);
+
+	/* le fichier, sur un disque sans table des sommes */
+	format_image(IMAGE, 2 * bytes / BLOCK_SIZE + 4096);
+	f = sgf_open("f", WRITE_MODE);
+	for (i = 0; i < bytes; i++)
+		sgf_putc(f, data[i]);
+	sgf_close(f);
+	sgf_sync();
+
+	/* les deux modes alternent, on garde la meilleure de chaque mesure */
+	create_checksum_table();
+	reset_crc_counters();
+	for (r = 0; r < ROUNDS; r++)
+		for (mode = 0; mode < 2; mode++) {
+			sgf_verify_checksums = mode ? CHECKSUM_REPORT : CHECKSUM_OFF;
+			reread(passes, ms);
+			for (i = 0; i < 2; i++)
+				if (r == 0 || ms[i] < best[mode][i]) best[mode][i] = ms[i];
+		}
+	get_crc_counters(&c);
+
+	printf("fichier de %d octets, %d passes, meilleure de %d mesures\n", bytes, passes, ROUNDS);
+	for (mode = 0; mode < 2; mode++)
+		printf("%-17s read_block %8.2f Mo/s  sgf_getc %7.2f Mo/s\n", mode ? "verification" : "sans verification",
+		       (double) bytes * passes / 1e3 / best[mode][0], (double) bytes * passes / 1e3 / best[mode][1]);
+	printf("%-17s read_block %+7.1f %%     sgf_getc %+6.1f %%      (%ld blocs verifies, %ld alteres)\n", "surcout",
+	       (best[1][0] / best[0][0] - 1) * 100, (best[1][1] / best[0][1] - 1) * 100, c.nb_verified, c.nb_errors);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	free(data);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,98 @@
+/*
+**  bench-delalloc.c
+**
+**  Allocation retardee : de nombreux fichiers ouverts en ecriture en
+**  meme temps recoivent de petits enregistrements a tour de role.
+**  On compare le placement immediat (sgf_delalloc_blocks = 1) au
+**  placement retarde (DELALLOC_BLOCKS) : temps, blocs ecrits et
+**  nombre d'extents par fichier. Un dernier essai ecrit des fichiers
+**  temporaires detruits avant leur fermeture.
+**
+**  sgf-bench-delalloc [flux [octets_par_flux]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-defrag.h"
+#include "bench.h"
+
+#define IMAGE       "bench-delalloc.img"
+#define RECORD      (100)
+#define MAX_STREAMS (256)
+
+static void run(int delalloc, int nb_streams, int bytes) {
+	static OFILE* streams[MAX_STREAMS];
+	struct timespec t0, t1;
+	DISK_COUNTERS c;
+	char name[16];
+	int i, j, done, extents = 0;
+
+	format_image(IMAGE, nb_streams * (bytes / BLOCK_SIZE + 2) * 2 + 4096);
+	sgf_delalloc_blocks = delalloc;
+
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nb_streams; i++) {
+		sprintf(name, "s%d", i);
+		streams[i] = sgf_open(name, WRITE_MODE);
+	}
+	for (done = 0; done < bytes; done += RECORD)
+		for (i = 0; i < nb_streams; i++)
+			for (j = 0; j < RECORD; j++)
+				sgf_putc(streams[i], 'a' + (i + j) % 26);
+	for (i = 0; i < nb_streams; i++)
+		sgf_close(streams[i]);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+
+	for (i = 0; i < nb_streams; i++) {
+		sprintf(name, "s%d", i);
+		extents += sgf_file_extents(find_inode(name), NULL);
+	}
+
+	printf("%-9s %3d blocs %8.2f ms %8ld ecritures %6.2f ecr./bloc %7.2f extents/fichier\n",
+	       "flux", delalloc, elapsed_ms(&t0, &t1), c.nb_writes,
+	       (double) c.nb_writes / ((double) nb_streams * done / BLOCK_SIZE),
+	       (double) extents / nb_streams);
+
+	/* fichiers temporaires : detruits avant d'etre fermes */
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < nb_streams; i++) {
+		sprintf(name, "tmp%d", i);
+		streams[i] = sgf_open(name, WRITE_MODE);
+		for (j = 0; j < 4 * BLOCK_SIZE; j++)
+			sgf_putc(streams[i], 'x');
+		sgf_unlink(name);
+		sgf_close(streams[i]);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	printf("%-9s %3d blocs %8.2f ms %8ld ecritures\n", "temp", delalloc,
+	       elapsed_ms(&t0, &t1), c.nb_writes);
+
+	close_sgf_disk();
+	remove(IMAGE);
+}
+
+int main(int argc, char* argv[]) {
+	int nb_streams = (argc > 1) ? atoi(argv[1]) : 32;
+	int bytes = (argc > 2) ? atoi(argv[2]) : 32 * 1024;
+
+	if (nb_streams < 1 || nb_streams > MAX_STREAMS) nb_streams = 32;
+	printf("%d flux de %d octets (enregistrements de %d octets)\n",
+	       nb_streams, bytes, RECORD);
+	run(1, nb_streams, bytes);
+	run(DELALLOC_BLOCKS, nb_streams, bytes);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,93 @@
+/*
+**  bench-device.c
+**
+**  Strategies d'allocation face aux modeles de peripherique : des
+**  fichiers sont ecrits en parallele (quelques octets a tour de role,
+**  comme plusieurs journaux alimentes en meme temps), puis relus l'un
+**  apres l'autre. On compare le placement immediat de chaque bloc
+**  (sgf_delalloc_blocks = 1) a l'allocation retardee, en temps simule
+**  sur le disque rotatif, la memoire flash et la memoire flash avec
+**  une file de 32 requetes sur 8 canaux.
+**
+**  sgf-bench-device [fichiers [octets_par_fichier]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-device.h"
+#include "bench.h"
+
+#define IMAGE   "bench-device.img"
+#define CHUNK   (40)
+
+static void run(const char* spec, int delalloc, int nb_files, int bytes) {
+	DEVICE_COUNTERS w, r;
+	DISK_COUNTERS dw, dr;
+	OFILE** f = malloc(nb_files * sizeof(OFILE*));
+	char name[16];
+	int i, k, j;
+
+	format_image(IMAGE, nb_files * (bytes / BLOCK_SIZE + 2) * 2 + 4096);
+	set_device_model(spec);
+	sgf_delalloc_blocks = delalloc;
+
+	reset_disk_counters();
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "f%d", i);
+		f[i] = sgf_open(name, WRITE_MODE);
+	}
+	for (k = 0; k < bytes; k += CHUNK)
+		for (i = 0; i < nb_files; i++)
+			for (j = k; j < k + CHUNK && j < bytes; j++)
+				sgf_putc(f[i], 'a' + (i + j) % 26);
+	for (i = 0; i < nb_files; i++)
+		sgf_close(f[i]);
+	sgf_sync();
+	get_device_counters(&w);
+	get_disk_counters(&dw);
+
+	reset_disk_counters();
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "f%d", i);
+		f[i] = sgf_open(name, READ_MODE);
+		while (sgf_getc(f[i]) != -1)
+			;
+		sgf_close(f[i]);
+	}
+	get_device_counters(&r);
+	get_disk_counters(&dr);
+
+	printf("%-22s %9s %11.2f %8ld %11.2f %8ld %8ld\n", spec, delalloc > 1 ? "retardee" : "immediate",
+	       w.elapsed_ns / 1e6, dw.nb_seeks, r.elapsed_ns / 1e6, dr.nb_seeks, w.nb_erases);
+
+	close_sgf_disk();
+	free(f);
+}
+
+int main(int argc, char* argv[]) {
+	static const char* models[] = { "hdd", "ssd", "ssd:qd=32:ch=8" };
+	int nb_files = (argc > 1) ? atoi(argv[1]) : 8;
+	int bytes = (argc > 2) ? atoi(argv[2]) : 64 * 1024;
+	int m;
+
+	if (nb_files < 1 || bytes < 1) return (EXIT_FAILURE);
+	printf("%d fichiers de %d octets ecrits par morceaux de %d octets (temps simule)\n",
+	       nb_files, bytes, CHUNK);
+	printf("%-22s %9s %11s %8s %11s %8s %8s\n", "modele", "placement", "ecriture ms", "depl.",
+	       "lecture ms", "depl.", "effac.");
+	for (m = 0; m < 3; m++) {
+		run(models[m], 1, nb_files, bytes);
+		run(models[m], DELALLOC_BLOCKS, nb_files, bytes);
+	}
+
+	remove(IMAGE);
+	return (EXIT_SUCCESS);
+}
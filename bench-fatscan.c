@@ -0,0 +1,183 @@
+/*
+**  bench-fatscan.c
+**
+**  Parcours de toute la FAT : une FAT d'un million de blocs est remplie
+**  de chaines fragmentees (70% des blocs environ) et de suites de blocs
+**  libres. On mesure en ns par entree, pour chaque jeu d'instructions,
+**  le bilan (fat_scan), la recherche d'une entree libre sur toute la
+**  table (fat_find_free) et la carte (fat_render), puis getDiskStats
+**  et displayFatMap (sortie jetee) face aux anciennes boucles entree
+**  par entree avec get_fat et un printf par bloc.
+**
+**  sgf-bench-fatscan [blocs [repetitions]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-scan.h"
+#include "bench.h"
+
+#define IMAGE   "bench-fatscan.img"
+
+static double elapsed_ns(struct timespec* t0, struct timespec* t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+/* chaines de 1 a 64 blocs, parfois coupees, entre des suites de blocs libres */
+static void fill(int* tab, int size, int first) {
+	int k = first, len, j, prev;
+
+	srand(1);
+	while (k < size) {
+		if (rand() % 10 < 3) {
+			for (len = 1 + rand() % 32; len > 0 && k < size; len--)
+				tab[k++] = FAT_FREE;
+			continue;
+		}
+		tab[k++] = FAT_INODE;
+		prev = -1;
+		for (len = 1 + rand() % 64, j = 0; j < len && k < size; j++, k++) {
+			if (prev >= 0) tab[prev] = k;
+			prev = k;
+			tab[k] = FAT_EOF;
+			if (rand() % 16 == 0 && k + 1 < size) tab[++k] = FAT_RESERVED;
+		}
+	}
+}
+
+/* les anciennes boucles, entree par entree */
+static unsigned old_stats(int size) {
+	unsigned nb_data = 0, nb_free = 0, nb_extents = 0, run = 0, largest = 0;
+	int i, v, previous = FAT_RESERVED;
+
+	for (i = 0; i < size; i++) {
+		v = get_fat(i);
+		if (v > 0) nb_data++;
+		else if (v == FAT_FREE) nb_free++;
+		if ((v > 0 || v == FAT_EOF) && previous != i) nb_extents++;
+		if (v == FAT_FREE) {
+			if (++run > largest) largest = run;
+		} else {
+			run = 0;
+		}
+		previous = v;
+	}
+	return (nb_data + nb_free + nb_extents + largest);
+}
+
+static void old_map(int size) {
+	int i, v;
+
+	for (i = 0; i < size; i++) {
+		if (i % 64 == 0) printf("%d ", i);
+		v = get_fat(i);
+		if (v > 0) printf("D");
+		else if (v == FAT_FREE) printf("F");
+		else if (v == FAT_RESERVED) printf("R");
+		else if (v == FAT_EOF) printf("E");
+		else if (v == FAT_INODE) printf("I");
+		else if (v == FAT_SNAPSHOT) printf("S");
+		if ((i + 1) % 64 == 0) printf("\n");
+	}
+}
+
+int main(int argc, char* argv[]) {
+	static const char* names[] = { "", "scalaire", "SSE", "AVX2" };
+	int size = (argc > 1) ? atoi(argv[1]) : 1 << 20;
+	int reps = (argc > 2) ? atoi(argv[2]) : 20;
+	struct timespec t0, t1;
+	struct DiskStats ds;
+	FAT_SCAN s;
+	int *tab, *full;
+	char* map;
+	int level, r, k, found = 0, saved;
+	unsigned check = 0;
+
+	tab = malloc((long) size * sizeof(int));
+	full = malloc((long) size * sizeof(int));
+	map = malloc(size);
+	if (tab == NULL || full == NULL || map == NULL || size < 1024 || reps < 1) return (EXIT_FAILURE);
+
+	fill(tab, size, 0);
+	/* sans entree libre : fat_find_free parcourt toute la table */
+	for (k = 0; k < size; k++)
+		full[k] = (tab[k] == FAT_FREE) ? FAT_EOF : tab[k];
+
+	printf("FAT de %d entrees, %d repetitions (ns par entree)\n", size, reps);
+	printf("%-10s %10s %12s %10s\n", "", "fat_scan", "find_free", "render");
+	for (level = SCAN_SCALAR; level <= SCAN_AVX2; level++) {
+		double scan_ns, find_ns, render_ns;
+
+		sgf_fat_scan = level;
+		if (fat_scan_level() != level) continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < reps; r++) fat_scan(tab, size, &s);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		scan_ns = elapsed_ns(&t0, &t1) / reps / size;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < reps; r++) found += fat_find_free(full, 0, size);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		find_ns = elapsed_ns(&t0, &t1) / reps / size;
+
+		clock_gettime(CLOCK_MONOTONIC, &t0);
+		for (r = 0; r < reps; r++) fat_render(tab, size, map);
+		clock_gettime(CLOCK_MONOTONIC, &t1);
+		render_ns = elapsed_ns(&t0, &t1) / reps / size;
+
+		printf("%-10s %10.3f %12.3f %10.3f   (%u libres, %u extents)\n", names[level],
+		       scan_ns, find_ns, render_ns, s.nb_free, s.nb_extents);
+	}
+	sgf_fat_scan = SCAN_AUTO;
+
+	/* la meme FAT, montee sur un disque */
+	format_image(IMAGE, size);
+	fill(full, size, get_fat_size_in_blocks() + 1024);
+	for (k = get_fat_size_in_blocks() + 1024; k < size; k++)
+		set_fat_lazy(k, full[k]);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (r = 0; r < reps; r++) check += old_stats(size);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%-24s %8.3f ns/entree\n", "boucle get_fat", elapsed_ns(&t0, &t1) / reps / size);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (r = 0; r < reps; r++) ds = getDiskStats();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%-24s %8.3f ns/entree  (%s)\n", "getDiskStats", elapsed_ns(&t0, &t1) / reps / size,
+	       names[fat_scan_level()]);
+
+	saved = mute(-1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	old_map(size);
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	mute(saved);
+	printf("%-24s %8.3f ns/entree\n", "carte, printf par bloc", elapsed_ns(&t0, &t1) / size);
+
+	saved = mute(-1);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	displayFatMap();
+	fflush(stdout);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	mute(saved);
+	printf("%-24s %8.3f ns/entree  (%u blocs libres, controle %u %d)\n", "displayFatMap",
+	       elapsed_ns(&t0, &t1) / size, ds.nb_free_blocks, check, found);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	free(tab);
+	free(full);
+	free(map);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,133 @@
+/*
+**  bench-fsck.c
+**
+**  Mesure du temps de verification (sgf_check) en fonction de la
+**  taille du disque et du nombre de threads.
+**
+**  sgf-bench-fsck [taille_en_blocs ...]
+**
+**  Pour chaque taille, une image "bench-fsck.img" est generee
+**  directement (super bloc, FAT, repertoire et INODEs) avec des
+**  fichiers de 1 a 64 blocs legerement fragmentes, puis verifiee.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-check.h"
+#include "bench.h"
+
+#define IMAGE "bench-fsck.img"
+
+static FILE* image;
+
+static void put_block(int n, void* b) {
+	fseek(image, (long) n * BLOCK_SIZE, SEEK_SET);
+	fwrite(b, 1, BLOCK_SIZE, image);
+}
+
+/* Generer une image de "size" blocs remplie a 70% environ */
+static int make_image(int size) {
+	int fat_blocks = (size * (int) sizeof(int) + BLOCK_SIZE - 1) / BLOCK_SIZE;
+	int* tab = malloc((long) fat_blocks * BLOCK_SIZE);
+	int next = fat_blocks + 1;
+	int dir, nb_files = 0, nb_entries = 0;
+	int k, inode, len, prev, adr;
+	TBLOCK b, d;
+
+	image = fopen(IMAGE, "w+b");
+	if (image == NULL || tab == NULL) return (0);
+	fseek(image, (long) size * BLOCK_SIZE - 1, SEEK_SET);
+	fputc(0, image);
+
+	for (k = 0; k < fat_blocks * (BLOCK_SIZE / (int) sizeof(int)); k++)
+		tab[k] = (k <= fat_blocks) ? FAT_RESERVED : FAT_FREE;
+
+	dir = next++;
+	tab[dir] = FAT_EOF;
+	memset(&d, 0, sizeof(d));
+	srand(size);
+
+	while (next + 2 * 64 + 2 < size * 7 / 10) {
+		if (nb_entries == BLOCK_DIR_SIZE) {
+			tab[dir] = next;
+			put_block(dir, &d);
+			dir = next++;
+			tab[dir] = FAT_EOF;
+			memset(&d, 0, sizeof(d));
+			nb_entries = 0;
+		}
+		inode = next++;
+		tab[inode] = FAT_INODE;
+		len = 1 + rand() % (64 * BLOCK_SIZE);
+		b.inode.length = len;
+		b.inode.first = b.inode.last = FAT_EOF;
+		for (prev = -1; len > 0; len -= BLOCK_SIZE) {
+			adr = next++;
+			if (rand() % 8 == 0) next++; /* un trou: fragmentation */
+			tab[adr] = FAT_EOF;
+			if (prev < 0) b.inode.first = adr;
+			else tab[prev] = adr;
+			prev = adr;
+		}
+		b.inode.last = prev;
+		put_block(inode, &b);
+		sprintf(d.dir[nb_entries].name, "f%d", nb_files++);
+		d.dir[nb_entries++].inode = inode;
+	}
+	put_block(dir, &d);
+
+	for (k = 0; k < fat_blocks; k++)
+		put_block(k + ADR_BLOCK_FAT, (char*) tab + (long) k * BLOCK_SIZE);
+	memset(&b, 0, sizeof(b));
+	b.super.signature = SIGNATURE_SUPER_BLOCK;
+	b.super.adr_dir = fat_blocks + 1;
+	put_block(ADR_BLOCK_DEF, &b);
+
+	fclose(image);
+	free(tab);
+	return (nb_files);
+}
+
+int main(int argc, char* argv[]) {
+	static int default_sizes[] = { 10000, 100000, 1000000, 4000000 };
+	static int threads[] = { 1, 2, 4, 8 };
+	struct timespec t0, t1;
+	CHECK_REPORT r;
+	int nb_sizes, size, nb_files, i, t;
+
+	nb_sizes = (argc > 1) ? argc - 1 : 4;
+
+	printf("%10s %8s %8s %10s %10s\n", "blocs", "fichiers", "threads", "ms", "ns/bloc");
+	for (i = 0; i < nb_sizes; i++) {
+		size = (argc > 1) ? atoi(argv[i + 1]) : default_sizes[i];
+		nb_files = make_image(size);
+		if (nb_files <= 0 || !test_disk(IMAGE)) {
+			fprintf(stderr, "impossible de creer l'image de %d blocs\n", size);
+			return (EXIT_FAILURE);
+		}
+		init_sgf();
+
+		for (t = 0; t < 4; t++) {
+			clock_gettime(CLOCK_MONOTONIC, &t0);
+			sgf_check(threads[t], 0, 0, &r);
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if (r.nb_errors != 0)
+				fprintf(stderr, "%d anomalie(s) inattendue(s)\n", r.nb_errors);
+			printf("%10d %8d %8d %10.3f %10.2f\n", size, nb_files, threads[t],
+			       elapsed_ms(&t0, &t1), elapsed_ms(&t0, &t1) * 1e6 / size);
+		}
+		close_sgf_disk();
+		remove(IMAGE);
+	}
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,111 @@
+/*
+**  bench-journal.c
+**
+**  Journal des meta-donnees : des fichiers sont crees puis completes
+**  par des cycles ouverture en APPEND_MODE, ecriture d'un bloc,
+**  fermeture (sans cache des fins de fichiers), sur tous les fichiers
+**  a tour de role puis sur quelques-uns seulement. On compte les blocs
+**  ecrits par operation (dont les ecritures de meta-donnees, journal
+**  compris) sans journal (sgf_journal_batch = 0), avec une validation
+**  par operation (1) et avec la validation groupee.
+**
+**  sgf-bench-journal [fichiers [cycles]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-journal.h"
+#include "bench.h"
+
+#define IMAGE   "bench-journal.img"
+#define FEW     (8)             /* fichiers du second cycle d'ajouts */
+
+static void report(const char* phase, int ops, struct timespec* t0) {
+	struct timespec t1;
+	DISK_COUNTERS c;
+	JOURNAL_COUNTERS j;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	get_journal_counters(&j);
+	printf("  %-10s %8.2f ecritures/op %8.2f dont meta-donnees %8.2f lectures/op %10.1f ms\n",
+	       phase, (double) c.nb_writes / ops, (double) j.nb_disk_writes / ops,
+	       (double) c.nb_reads / ops, elapsed_ms(t0, &t1));
+}
+
+static void start(struct timespec* t0) {
+	sgf_sync();
+	reset_disk_counters();
+	reset_journal_counters();
+	clock_gettime(CLOCK_MONOTONIC, t0);
+}
+
+static void append_cycles(int nb_files, int cycles, char* data) {
+	char name[16];
+	OFILE* f;
+	int i;
+
+	for (i = 0; i < cycles; i++) {
+		sprintf(name, "f%d", i % nb_files);
+		f = sgf_open(name, APPEND_MODE);
+		sgf_write(f, data, BLOCK_SIZE);
+		sgf_close(f);
+	}
+	sgf_sync();
+}
+
+static void run(int batch, int nb_files, int cycles) {
+	struct timespec t0;
+	char name[16], data[BLOCK_SIZE];
+	OFILE* f;
+	int i;
+
+	format_image(IMAGE, nb_files * 4 + cycles * 4 + 4096);
+	sgf_journal_batch = batch;
+	sgf_tail_cache_files = 0;
+	memset(data, 'j', sizeof(data));
+
+	if (batch == 0) printf("sans journal\n");
+	else printf("sgf_journal_batch = %d\n", batch);
+
+	start(&t0);
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "f%d", i);
+		f = sgf_open(name, WRITE_MODE);
+		sgf_write(f, data, 100);
+		sgf_close(f);
+	}
+	sgf_sync();
+	report("creation", nb_files, &t0);
+
+	start(&t0);
+	append_cycles(nb_files, cycles, data);
+	report("ajout", cycles, &t0);
+
+	start(&t0);
+	append_cycles((nb_files < FEW) ? nb_files : FEW, cycles, data);
+	report("ajout/8", cycles, &t0);
+
+	close_sgf_disk();
+	remove(IMAGE);
+}
+
+int main(int argc, char* argv[]) {
+	int nb_files = (argc > 1) ? atoi(argv[1]) : 200;
+	int cycles = (argc > 2) ? atoi(argv[2]) : 2000;
+
+	run(0, nb_files, cycles);
+	run(1, nb_files, cycles);
+	run(JOURNAL_BATCH, nb_files, cycles);
+
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,134 @@
+/*
+**  bench-map.c
+**
+**  Lecture d'un fichier par sgf_read (copie dans un tableau) ou par
+**  une vue sgf_map (sgf-map.h), d'un coup puis par fenetres de 4 Ko.
+**  Le premier fichier est place d'un seul tenant (allocation
+**  retardee), le second est ecrit en meme temps qu'un autre fichier,
+**  bloc par bloc : ses vues sont copiees. On garde la meilleure de
+**  plusieurs mesures.
+**
+**  sgf-bench-map [octets]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-map.h"
+#include "bench.h"
+
+#define IMAGE   "bench-map.img"
+#define ROUNDS  (5)
+#define WINDOW  (4096)
+
+static long sum(const char* p, int n) {
+	long s = 0;
+	int i;
+
+	for (i = 0; i < n; i += 64)
+		s += (unsigned char) p[i];
+	return (s);
+}
+
+/* lire tout le fichier (window = 0) ou par fenetres, par copie ou par vue */
+static long read_file(const char* name, int bytes, int window, int map, char* buf) {
+	OFILE* f = sgf_open(name, READ_MODE);
+	const char* v;
+	long s = 0;
+	int pos, n;
+
+	if (window == 0) window = bytes;
+	for (pos = 0; pos < bytes; pos += n) {
+		n = (bytes - pos < window) ? bytes - pos : window;
+		if (map) {
+			if ((v = sgf_map(f, pos, n)) == NULL) {
+				fprintf(stderr, "sgf_map(%s, %d, %d) impossible\n", name, pos, n);
+				exit(EXIT_FAILURE);
+			}
+			s += sum(v, n);
+			sgf_unmap(v);
+		} else {
+			sgf_read(f, buf, n);
+			s += sum(buf, n);
+		}
+	}
+	sgf_close(f);
+	return (s);
+}
+
+int main(int argc, char* argv[]) {
+	static const char* names[] = { "contigu", "morcele" };
+	static const char* modes[] = { "sgf_read", "sgf_map", "sgf_read 4 Ko", "sgf_map 4 Ko" };
+	int bytes = (argc > 1) ? atoi(argv[1]) : 4 << 20;
+	struct timespec t0, t1;
+	DISK_COUNTERS dc;
+	MAP_COUNTERS mc;
+	double ms, best;
+	long s, ref = 0;
+	char* buf;
+	OFILE* f, *g;
+	int i, k, m, r, saved;
+
+	if (bytes < 1) return (EXIT_FAILURE);
+	format_image(IMAGE, 4 * (bytes / BLOCK_SIZE) + 4096);
+	saved = mute(-1);
+	buf = malloc(bytes);
+	for (i = 0; i < bytes; i++)
+		buf[i] = (char) (i * 131 + i / 977);
+
+	/* un seul tenant : tous les blocs sont places a la fermeture */
+	sgf_delalloc_blocks = bytes / BLOCK_SIZE + 1;
+	f = sgf_open("contigu", WRITE_MODE);
+	sgf_write(f, buf, bytes);
+	sgf_close(f);
+
+	/* bloc par bloc, en alternance avec un autre fichier */
+	sgf_delalloc_blocks = 1;
+	f = sgf_open("morcele", WRITE_MODE);
+	g = sgf_open("autre", WRITE_MODE);
+	for (i = 0; i < bytes; i += BLOCK_SIZE) {
+		k = (bytes - i < BLOCK_SIZE) ? bytes - i : BLOCK_SIZE;
+		sgf_write(f, buf + i, k);
+		sgf_write(g, buf + i, k);
+	}
+	sgf_close(f);
+	sgf_close(g);
+	mute(saved);
+
+	printf("fichiers de %d octets, meilleure de %d mesures\n", bytes, ROUNDS);
+	printf("%-8s %-14s %9s %9s %8s %8s\n", "fichier", "lecture", "ms", "Mo/s", "lus", "copies");
+	for (k = 0; k < 2; k++)
+		for (m = 0; m < 4; m++) {
+			for (r = 0; r < ROUNDS; r++) {
+				reset_disk_counters();
+				reset_map_counters();
+				clock_gettime(CLOCK_MONOTONIC, &t0);
+				s = read_file(names[k], bytes, (m < 2) ? 0 : WINDOW, m & 1, buf);
+				clock_gettime(CLOCK_MONOTONIC, &t1);
+				ms = elapsed_ms(&t0, &t1);
+				if (r == 0 || ms < best) best = ms;
+				if (k == 0 && m == 0 && r == 0) ref = s;
+				if (s != ref) {
+					fprintf(stderr, "%s (%s) : contenu different\n", names[k], modes[m]);
+					return (EXIT_FAILURE);
+				}
+			}
+			get_disk_counters(&dc);
+			get_map_counters(&mc);
+			printf("%-8s %-14s %9.2f %9.1f %8ld %8ld\n", names[k], modes[m], best,
+			       bytes / (best * 1e3 * 1.048576), dc.nb_reads, mc.nb_bytes_copied);
+		}
+
+	free(buf);
+	close_sgf_disk();
+	remove(IMAGE);
+	return (EXIT_SUCCESS);
+}
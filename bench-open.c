@@ -0,0 +1,93 @@
+/*
+**  bench-open.c
+**
+**  Table des fichiers ouverts : ouvrir, lire et fermer sans cesse un
+**  petit fichier, seul puis pendant qu'une autre ouverture le garde
+**  (l'INODE et la carte de la chaine sont alors partages). Un lecteur
+**  suit ensuite un ecrivain qui ajoute des enregistrements : il voit
+**  chaque ajout des que l'ecrivain le place (sgf_flush).
+**
+**  sgf-bench-open [ouvertures]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-open.img"
+#define SIZE    (4096)
+#define RECORD  (100)
+
+/* "n" ouvertures, lectures completes et fermetures du fichier "f" */
+static void hot_opens(int n, int held) {
+	static char buf[SIZE];
+	struct timespec t0, t1;
+	DISK_COUNTERS c;
+	OFILE* keep = held ? sgf_open("f", READ_MODE) : NULL;
+	OFILE* f;
+	int i;
+
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < n; i++) {
+		f = sgf_open("f", READ_MODE);
+		sgf_read(f, buf, SIZE);
+		sgf_close(f);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	if (keep != NULL) sgf_close(keep);
+
+	printf("%-24s %8.2f us/ouverture %7.2f blocs lus/ouverture\n",
+	       held ? "deja ouvert ailleurs" : "seul", elapsed_ms(&t0, &t1) * 1e3 / n,
+	       (double) c.nb_reads / n);
+}
+
+int main(int argc, char* argv[]) {
+	static char buf[SIZE];
+	int n = (argc > 1) ? atoi(argv[1]) : 20000;
+	int i, k, seen, late = 0, saved;
+	OFILE* w, *r;
+
+	if (n < 1) return (EXIT_FAILURE);
+	format_image(IMAGE, 16384);
+	saved = mute(-1);
+	memset(buf, 'x', SIZE);
+	w = sgf_open("f", WRITE_MODE);
+	sgf_write(w, buf, SIZE);
+	sgf_close(w);
+	mute(saved);
+
+	printf("%d ouvertures d'un fichier de %d octets\n", n, SIZE);
+	hot_opens(n, 0);
+	hot_opens(n, 1);
+
+	/* le lecteur ne voit que les ajouts places, et tous ceux-la */
+	saved = mute(-1);
+	w = sgf_open("g", WRITE_MODE);
+	r = sgf_open("g", READ_MODE);
+	for (i = 0, seen = 0; i < 1000; i++) {
+		sgf_write(w, buf, RECORD);
+		if (i % 10 == 9) sgf_flush(w);
+		while ((k = sgf_read(r, buf, SIZE)) > 0)
+			seen += k;
+		if (seen != ((i % 10 == 9) ? (i + 1) : i / 10 * 10) * RECORD) late++;
+	}
+	sgf_close(w);
+	sgf_close(r);
+	mute(saved);
+	printf("lecteur pendant 1000 ajouts (vidage tous les 10) : %d octets vus, %d ecart(s)\n", seen, late);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	return (late == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,105 @@
+/*
+**  bench-stats.c
+**
+**  Cout des mesures internes : un fichier est relu par sgf_getc et
+**  reecrit bloc par bloc, tour a tour sans mesure, avec les mesures
+**  (sgf_stats_enabled) et avec en plus l'anneau d'evenements
+**  (trace_sgf_disk). On garde la meilleure de plusieurs mesures, puis
+**  on affiche le resume des mesures et les derniers evenements.
+**
+**  sgf-bench-stats [octets [passes]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-stats.h"
+#include "bench.h"
+
+#define IMAGE   "bench-stats.img"
+#define ROUNDS  (7)
+
+/* relire "f" par sgf_getc, puis reecrire ses blocs (durees en ms) */
+static void run(int passes, double* ms) {
+	struct timespec t0, t1;
+	OFILE* f;
+	BLOCK b;
+	int p, adr;
+
+	f = sgf_open("f", READ_MODE);
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = 0; p < passes; p++) {
+		sgf_seek(f, 0);
+		while (sgf_getc(f) != -1)
+			;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms[0] = elapsed_ms(&t0, &t1);
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (p = 0; p < passes; p++)
+		for (adr = f->first; adr != FAT_EOF; adr = get_fat(adr)) {
+			read_block(adr, &b);
+			write_block(adr, &b);
+		}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ms[1] = elapsed_ms(&t0, &t1);
+	sgf_close(f);
+}
+
+int main(int argc, char* argv[]) {
+	static const char* titles[] = { "sans mesure", "mesures", "mesures + anneau" };
+	int bytes = (argc > 1) ? atoi(argv[1]) : 256 * 1024;
+	int passes = (argc > 2) ? atoi(argv[2]) : 10;
+	double ms[2], best[3][2];
+	unsigned long cursor;
+	SGF_STATS s;
+	OFILE* f;
+	int i, r, mode;
+
+	if (bytes < 1 || passes < 1) return (EXIT_FAILURE);
+	format_image(IMAGE, 2 * bytes / BLOCK_SIZE + 4096);
+	f = sgf_open("f", WRITE_MODE);
+	for (i = 0; i < bytes; i++)
+		sgf_putc(f, 'a' + i % 26);
+	sgf_close(f);
+	sgf_sync();
+
+	/* les trois modes alternent, on garde la meilleure de chaque mesure */
+	for (r = 0; r < ROUNDS; r++)
+		for (mode = 0; mode < 3; mode++) {
+			sgf_stats_enabled = (mode >= 1);
+			trace_sgf_disk = (mode == 2);
+			sgf_reset_stats();
+			run(passes, ms);
+			for (i = 0; i < 2; i++)
+				if (r == 0 || ms[i] < best[mode][i]) best[mode][i] = ms[i];
+		}
+	sgf_get_stats(&s);
+	sgf_stats_enabled = 0;
+	trace_sgf_disk = 0;
+
+	printf("fichier de %d octets, %d passes, meilleure de %d mesures\n", bytes, passes, ROUNDS);
+	for (mode = 0; mode < 3; mode++)
+		printf("%-17s sgf_getc %7.2f ns/car (%+5.1f %%)   read+write_block %7.0f ns/bloc (%+5.1f %%)\n",
+		       titles[mode], best[mode][0] * 1e6 / ((double) bytes * passes), (best[mode][0] / best[0][0] - 1) * 100,
+		       best[mode][1] * 1e6 / ((double) bytes / BLOCK_SIZE * passes), (best[mode][1] / best[0][1] - 1) * 100);
+
+	printf("\nderniere mesure :\n");
+	sgf_print_stats(stdout);
+	printf("\nderniers evenements :\n");
+	cursor = s.nb_events - 4;
+	sgf_dump_events(stdout, &cursor);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,131 @@
+/*
+**  bench-stream.c
+**
+**  Lecture et ecriture octet par octet : sgf_getc/sgf_putc sur le
+**  fichier ouvert, puis les macros des flots (sgf-stream.h), comparees
+**  a une boucle sur un tableau en memoire. Les lignes sont aussi
+**  relues par sgf_getline. On garde la meilleure de plusieurs mesures.
+**
+**  sgf-bench-stream [octets]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-stream.h"
+#include "bench.h"
+
+#define IMAGE   "bench-stream.img"
+#define ROUNDS  (5)
+
+static struct timespec t0;
+
+static void start(void) {
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+}
+
+/* ns par octet, en gardant la meilleure mesure */
+static void stop(double* best, int round, int bytes) {
+	struct timespec t1;
+	double ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	ns = elapsed_ms(&t0, &t1) * 1e6 / bytes;
+	if (round == 0 || ns < *best) *best = ns;
+}
+
+/* contenu : des lignes de 1 a 80 caracteres */
+static char text(int i) {
+	return ((i * 7919) % 81 == 0) ? '\n' : 'a' + i % 26;
+}
+
+int main(int argc, char* argv[]) {
+	static const char* titles[] = {
+		"memoire (tableau)", "sgf_getc", "sgf_stream_getc", "sgf_getline",
+		"sgf_putc", "sgf_stream_putc"
+	};
+	int bytes = (argc > 1) ? atoi(argv[1]) : 1 << 20;
+	double best[6];
+	volatile long sum;
+	char* mem, *line = NULL;
+	int i, r, c, cap = 0, saved;
+	long s;
+	SGF_STREAM* st;
+	OFILE* f;
+
+	if (bytes < 1) return (EXIT_FAILURE);
+	format_image(IMAGE, 3 * bytes / BLOCK_SIZE + 4096);
+	saved = mute(-1);
+	mem = malloc(bytes);
+	for (i = 0; i < bytes; i++)
+		mem[i] = text(i);
+
+	for (r = 0; r < ROUNDS; r++) {
+		start();
+		for (s = 0, i = 0; i < bytes; i++)
+			s += (unsigned char) mem[i];
+		sum = s;
+		stop(&best[0], r, bytes);
+
+		sgf_unlink("f");
+		start();
+		f = sgf_open("f", WRITE_MODE);
+		for (i = 0; i < bytes; i++)
+			sgf_putc(f, text(i));
+		sgf_close(f);
+		stop(&best[4], r, bytes);
+
+		sgf_unlink("f");
+		start();
+		st = sgf_stream_open("f", WRITE_MODE);
+		for (i = 0; i < bytes; i++)
+			sgf_stream_putc(st, text(i));
+		sgf_stream_close(st);
+		stop(&best[5], r, bytes);
+
+		start();
+		f = sgf_open("f", READ_MODE);
+		for (s = 0; (c = sgf_getc(f)) != -1; )
+			s += c;
+		sgf_close(f);
+		sum = s;
+		stop(&best[1], r, bytes);
+
+		start();
+		st = sgf_stream_open("f", READ_MODE);
+		for (s = 0; (c = sgf_stream_getc(st)) != -1; )
+			s += c;
+		sgf_stream_close(st);
+		sum = s;
+		stop(&best[2], r, bytes);
+
+		start();
+		st = sgf_stream_open("f", READ_MODE);
+		for (s = 0; sgf_getline(st, &line, &cap) >= 0; )
+			s += line[0];
+		sgf_stream_close(st);
+		sum = s;
+		stop(&best[3], r, bytes);
+	}
+	(void) sum;
+	mute(saved);
+
+	printf("fichier de %d octets, tampon de %d blocs, meilleure de %d mesures\n",
+	       bytes, sgf_stream_blocks, ROUNDS);
+	for (i = 0; i < 6; i++)
+		printf("%-18s %7.2f ns/octet  %8.1f Mo/s\n", titles[i], best[i], 1e3 / best[i] / 1.048576);
+
+	free(mem);
+	free(line);
+	close_sgf_disk();
+	remove(IMAGE);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,306 @@
+/*
+**  bench-suite.c
+**
+**  Banc d'essai de l'API du mini SGF (cible "make bench"). Chaque
+**  charge de travail est mesuree sur un disque neuf :
+**
+**    seqwrite-N   creation d'un fichier de N octets (ouverture,
+**                 sgf_putc, fermeture)
+**    seqread-N    relecture d'un fichier de N octets par sgf_getc
+**    randread     sgf_seek a une position au hasard puis sgf_getc
+**    churn        creation d'un petit fichier, relecture, sgf_unlink
+**    append       ouverture en APPEND_MODE, ajout, fermeture
+**    lookup-N     sgf_open/sgf_close d'un fichier pris au hasard
+**                 dans un repertoire de N fichiers
+**    mount        montage du disque (test_disk et init_sgf)
+**
+**  Pour chacune : operations par seconde, Mo/s, latences (mediane,
+**  90e et 99e centiles, maximum, en microsecondes) et blocs lus ou
+**  ecrits par operation. La duree totale compte le sgf_sync final,
+**  pas les latences. Avec -o les resultats sont ajoutes a un fichier
+**  CSV (une ligne par charge, l'etiquette -l en premiere colonne) pour
+**  suivre les regressions d'une version a l'autre.
+**
+**  sgf-bench-suite [-q] [-o fichier.csv] [-l etiquette]
+**
+**    -q   charges dix fois plus petites (essai rapide)
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-suite.img"
+#define DISK_BLOCKS     (1 << 17)       /* 16 Mo, fichier creux */
+
+/* une charge de travail en cours de mesure */
+static struct {
+	const char* name;
+	long bytes;                     /* octets lus ou ecrits         */
+	double* lat;                    /* latence de chaque operation  */
+	int nb_ops, capacity;
+	struct timespec t0, op;
+} w;
+
+static FILE* csv = NULL;
+static const char* label = "-";
+static int quick = 0;
+
+static double elapsed_us(struct timespec* t0, struct timespec* t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e6 + (t1->tv_nsec - t0->tv_nsec) / 1e3;
+}
+
+static int count(int n) {
+	return (quick && n >= 20) ? n / 10 : n;
+}
+
+static void begin(const char* name, int nb_ops) {
+	w.name = name;
+	w.bytes = 0;
+	w.nb_ops = 0;
+	if (nb_ops > w.capacity) {
+		w.capacity = nb_ops;
+		w.lat = realloc(w.lat, w.capacity * sizeof(double));
+		if (w.lat == NULL) exit(EXIT_FAILURE);
+	}
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &w.t0);
+}
+
+static void op_begin(void) {
+	clock_gettime(CLOCK_MONOTONIC, &w.op);
+}
+
+static void op_end(void) {
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	w.lat[w.nb_ops++] = elapsed_us(&w.op, &t);
+}
+
+static int by_value(const void* a, const void* b) {
+	double x = *(const double*) a, y = *(const double*) b;
+	return (x < y) ? -1 : (x > y);
+}
+
+static double percentile(int p) {
+	return w.lat[(int) ((long) (w.nb_ops - 1) * p / 100)];
+}
+
+static void end(void) {
+	struct timespec t1;
+	DISK_COUNTERS c;
+	double s, ops, mbs;
+
+	sgf_sync();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_disk_counters(&c);
+	s = elapsed_us(&w.t0, &t1) / 1e6;
+	ops = w.nb_ops / s;
+	mbs = w.bytes / 1e6 / s;
+	qsort(w.lat, w.nb_ops, sizeof(double), by_value);
+
+	printf("%-15s %7d %11.0f %8.2f %9.1f %9.1f %9.1f %10.1f %9.2f %9.2f\n", w.name, w.nb_ops, ops, mbs,
+	       percentile(50), percentile(90), percentile(99), w.lat[w.nb_ops - 1],
+	       (double) c.nb_reads / w.nb_ops, (double) c.nb_writes / w.nb_ops);
+	if (csv != NULL)
+		fprintf(csv, "%s,%s,%d,%.6f,%.1f,%.3f,%.2f,%.2f,%.2f,%.2f,%.3f,%.3f\n", label, w.name, w.nb_ops, s, ops,
+		        mbs, percentile(50), percentile(90), percentile(99), w.lat[w.nb_ops - 1],
+		        (double) c.nb_reads / w.nb_ops, (double) c.nb_writes / w.nb_ops);
+}
+
+static void write_file(const char* name, int size) {
+	OFILE* f = sgf_open(name, WRITE_MODE);
+	int i;
+
+	for (i = 0; i < size; i++)
+		sgf_putc(f, 'a' + i % 26);
+	sgf_close(f);
+}
+
+static void read_file(const char* name) {
+	OFILE* f = sgf_open(name, READ_MODE);
+
+	while (sgf_getc(f) != -1)
+		w.bytes++;
+	sgf_close(f);
+}
+
+static void sequential(int size, int nb_files) {
+	char title[32], name[16];
+	int i;
+
+	format_image(IMAGE, DISK_BLOCKS);
+	sprintf(title, "seqwrite-%d", size);
+	begin(title, nb_files);
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "f%d", i);
+		op_begin();
+		write_file(name, size);
+		op_end();
+		w.bytes += size;
+	}
+	end();
+
+	sprintf(title, "seqread-%d", size);
+	begin(title, nb_files);
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "f%d", i);
+		op_begin();
+		read_file(name);
+		op_end();
+	}
+	end();
+	close_sgf_disk();
+}
+
+static void random_read(int size, int nb_ops) {
+	OFILE* f;
+	int i;
+
+	format_image(IMAGE, DISK_BLOCKS);
+	write_file("f", size);
+	srand(1);
+	f = sgf_open("f", READ_MODE);
+	begin("randread", nb_ops);
+	for (i = 0; i < nb_ops; i++) {
+		op_begin();
+		sgf_seek(f, rand() % size);
+		if (sgf_getc(f) != -1) w.bytes++;
+		op_end();
+	}
+	end();
+	sgf_close(f);
+	close_sgf_disk();
+}
+
+static void churn(int size, int nb_ops) {
+	char name[16];
+	int i, saved;
+
+	format_image(IMAGE, DISK_BLOCKS);
+	begin("churn", nb_ops);
+	saved = mute(-1);       /* sgf_remove affiche l'etat de la FAT */
+	for (i = 0; i < nb_ops; i++) {
+		sprintf(name, "t%d", i % 8);
+		op_begin();
+		write_file(name, size);
+		read_file(name);
+		sgf_unlink(name);
+		op_end();
+		w.bytes += size;
+	}
+	mute(saved);
+	end();
+	close_sgf_disk();
+}
+
+static void append(int size, int nb_ops) {
+	OFILE* f;
+	int i, j;
+
+	format_image(IMAGE, DISK_BLOCKS);
+	sgf_close(sgf_open("log", WRITE_MODE));
+	begin("append", nb_ops);
+	for (i = 0; i < nb_ops; i++) {
+		op_begin();
+		f = sgf_open("log", APPEND_MODE);
+		for (j = 0; j < size; j++)
+			sgf_putc(f, 'a' + (i + j) % 26);
+		sgf_close(f);
+		op_end();
+		w.bytes += size;
+	}
+	end();
+	close_sgf_disk();
+}
+
+/* repertoire de nb_files fichiers, puis montages successifs du disque */
+static void lookup(int nb_files, int nb_ops, int nb_mounts) {
+	char title[32], name[16];
+	int i;
+
+	format_image(IMAGE, DISK_BLOCKS);
+	for (i = 0; i < nb_files; i++) {
+		sprintf(name, "d%d", i);
+		write_file(name, 16);
+	}
+	sgf_sync();
+
+	srand(1);
+	sprintf(title, "lookup-%d", nb_files);
+	begin(title, nb_ops);
+	for (i = 0; i < nb_ops; i++) {
+		sprintf(name, "d%d", rand() % nb_files);
+		op_begin();
+		sgf_close(sgf_open(name, READ_MODE));
+		op_end();
+	}
+	end();
+
+	if (nb_mounts > 0) {
+		begin("mount", nb_mounts);
+		for (i = 0; i < nb_mounts; i++) {
+			close_sgf_disk();
+			op_begin();
+			if (!test_disk(IMAGE)) exit(EXIT_FAILURE);
+			init_sgf();
+			op_end();
+		}
+		end();
+	}
+	close_sgf_disk();
+}
+
+static void usage(void) {
+	fprintf(stderr, "usage: sgf-bench-suite [-q] [-o fichier.csv] [-l etiquette]\n");
+	exit(EXIT_FAILURE);
+}
+
+int main(int argc, char* argv[]) {
+	const char* output = NULL;
+	int i;
+
+	for (i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-q") == 0) quick = 1;
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) output = argv[++i];
+		else if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) label = argv[++i];
+		else usage();
+	}
+
+	if (output != NULL) {
+		csv = fopen(output, "a");
+		if (csv == NULL) {
+			perror(output);
+			return (EXIT_FAILURE);
+		}
+		if (ftell(csv) == 0)
+			fprintf(csv, "label,workload,ops,seconds,ops_per_s,mb_per_s,"
+			        "p50_us,p90_us,p99_us,max_us,reads_per_op,writes_per_op\n");
+	}
+
+	printf("%-15s %7s %11s %8s %9s %9s %9s %10s %9s %9s\n", "charge", "ops", "ops/s", "Mo/s",
+	       "p50 us", "p90 us", "p99 us", "max us", "lus/op", "ecrits/op");
+	sequential(4096, count(400));
+	sequential(65536, count(100));
+	sequential(1 << 20, count(8));
+	random_read(1 << 20, count(20000));
+	churn(200, count(2000));
+	append(100, count(2000));
+	lookup(100, count(5000), 0);
+	lookup(count(2000), count(5000), count(50));
+
+	remove(IMAGE);
+	free(w.lat);
+	if (csv != NULL) fclose(csv);
+	return (EXIT_SUCCESS);
+}
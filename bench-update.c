@@ -0,0 +1,106 @@
+/*
+**  bench-update.c
+**
+**  Mises a jour en place : des enregistrements de quelques octets sont
+**  modifies a des positions aleatoires d'un gros fichier. On compare
+**  la reecriture complete du fichier (seule possibilite avant
+**  READ_WRITE_MODE) a la modification en place (sgf_seek + sgf_write),
+**  puis on mesure la troncature.
+**
+**  sgf-bench-update [octets [mises_a_jour]]
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+#define IMAGE   "bench-update.img"
+#define RECORD  (16)
+
+static void report(const char* phase, int ops, struct timespec* t0, struct timespec* t1) {
+	DISK_COUNTERS c;
+
+	get_disk_counters(&c);
+	printf("  %-12s %10.3f ms/op %10.1f lectures/op %10.1f ecritures/op\n",
+	       phase, elapsed_ms(t0, t1) / ops,
+	       (double) c.nb_reads / ops, (double) c.nb_writes / ops);
+}
+
+/* Lire tout le fichier "nom" dans "data" */
+static void load(const char* nom, char* data, int bytes) {
+	OFILE* f = sgf_open(nom, READ_MODE);
+	int i;
+
+	for (i = 0; i < bytes; i++)
+		data[i] = sgf_getc(f);
+	sgf_close(f);
+}
+
+int main(int argc, char* argv[]) {
+	int bytes = (argc > 1) ? atoi(argv[1]) : 256 * 1024;
+	int updates = (argc > 2) ? atoi(argv[2]) : 200;
+	char* data = malloc(bytes);
+	struct timespec t0, t1;
+	char record[RECORD];
+	OFILE* f;
+	int i, pos;
+
+	format_image(IMAGE, 2 * bytes / BLOCK_SIZE + 4096);
+	printf("fichier de %d octets, %d mises a jour de %d octets\n", bytes, updates, RECORD);
+
+	for (i = 0; i < bytes; i++)
+		data[i] = 'a' + i % 26;
+	f = sgf_open("data", WRITE_MODE);
+	sgf_write(f, data, bytes);
+	sgf_close(f);
+
+	/* reecriture complete apres chaque modification */
+	srand(42);
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < updates / 10; i++) {
+		pos = rand() % (bytes - RECORD);
+		load("data", data, bytes);
+		memset(data + pos, '0' + i % 10, RECORD);
+		f = sgf_open("data", WRITE_MODE);
+		sgf_write(f, data, bytes);
+		sgf_close(f);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	report("reecriture", updates / 10, &t0, &t1);
+
+	/* modification en place */
+	memset(record, '#', RECORD);
+	f = sgf_open("data", READ_WRITE_MODE);
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	for (i = 0; i < updates; i++) {
+		sgf_seek(f, rand() % (bytes - RECORD));
+		sgf_write(f, record, RECORD);
+	}
+	sgf_flush(f);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	report("en place", updates, &t0, &t1);
+
+	/* troncature a la moitie : seule la fin de la chaine est liberee */
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	sgf_truncate(f, bytes / 2);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	report("troncature", 1, &t0, &t1);
+	sgf_close(f);
+
+	close_sgf_disk();
+	remove(IMAGE);
+	free(data);
+	return (EXIT_SUCCESS);
+}
@@ -0,0 +1,53 @@
+/*
+**  bench.c
+**
+**  Outils communs aux programmes de mesure.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "bench.h"
+
+void format_image(char* name, int size) {
+	int saved;
+
+	if (!create_disk(name, size)) {
+		fprintf(stderr, "impossible de creer %s\n", name);
+		exit(EXIT_FAILURE);
+	}
+	saved = mute(-1);
+	create_empty_fat();
+	init_sgf();
+	create_empty_directory();
+	mute(saved);
+}
+
+double elapsed_ms(struct timespec* t0, struct timespec* t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+int mute(int saved) {
+	int fd;
+
+	fflush(stdout);
+	if (saved >= 0) {
+		dup2(saved, 1);
+		close(saved);
+		return (-1);
+	}
+	saved = dup(1);
+	fd = open("/dev/null", O_WRONLY);
+	dup2(fd, 1);
+	close(fd);
+	return (saved);
+}
@@ -0,0 +1,23 @@
+/*
+**  bench.h
+**
+**  Outils communs aux programmes de mesure (bench-*.c).
+*/
+
+#ifndef __SGF_BENCH__
+#define __SGF_BENCH__
+
+struct timespec;
+
+/* Creer l'image creuse "name" de "size" blocs (create_disk), la formater
+   et la monter ; les messages du formatage sont masques. */
+void format_image(char* name, int size);
+
+/* Duree entre deux instants de clock_gettime, en millisecondes */
+double elapsed_ms(struct timespec* t0, struct timespec* t1);
+
+/* Masquer la sortie standard : mute(-1) renvoie de quoi la retablir
+   par mute(saved). */
+int mute(int saved);
+
+#endif
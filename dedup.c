@@ -0,0 +1,59 @@
+/*
+**  dedup.c
+**
+**  Deduplication d'un disque du mini SGF.
+**
+**  sgf-dedup [-n] [disque]
+**
+**    -n   ne rien partager, compter seulement ce qui pourrait l'etre
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-dedup.h"
+
+int main(int argc, char* argv[]) {
+	DEDUP_COUNTERS c;
+	int dry_run = 0, free0, shared;
+	char* name = NULL;
+	int i;
+
+	for(i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) dry_run = 1;
+		else if (argv[i][0] != '-' && name == NULL) name = argv[i];
+		else {
+			fprintf(stderr, "usage: sgf-dedup [-n] [disque]\n");
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (name != NULL && !test_disk(name)) {
+		fprintf(stderr, "sgf-dedup: %s n'est pas un disque utilisable\n", name);
+		return (EXIT_FAILURE);
+	}
+	init_sgf();
+
+	free0 = get_free_fat_blocks_count();
+	reset_dedup_counters();
+	shared = sgf_dedup_volume(dry_run);
+	get_dedup_counters(&c);
+
+	printf("%ld bloc(s) lu(s), %ld bloc(s) au contenu deja vu\n",
+	       c.nb_hashed_blocks, c.nb_dup_blocks);
+	printf("%d bloc(s) %s en fin de chaine%s\n", shared,
+	       dry_run ? "partageables" : "partages", dry_run ? "" : " (deja partages exclus)");
+	if (!dry_run)
+		printf("%d bloc(s) libere(s), %ld octet(s) economise(s), %ld lecture(s) de comparaison\n",
+		       (int) get_free_fat_blocks_count() - free0,
+		       (long) shared * BLOCK_SIZE, c.nb_verify_reads);
+	if (c.nb_dup_blocks > shared)
+		printf("%ld bloc(s) identique(s) ailleurs qu'en fin de chaine : non partageables par la FAT\n",
+		       c.nb_dup_blocks - shared);
+
+	return (EXIT_SUCCESS);
+}
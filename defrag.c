@@ -0,0 +1,64 @@
+/*
+**  defrag.c
+**
+**  Defragmentation d'un disque du mini SGF.
+**
+**  sgf-defrag [-n] [-m] [-r blocs_par_seconde] [disque]
+**
+**    -n   ne rien deplacer, afficher seulement la fragmentation
+**    -m   afficher la carte de la FAT coloriee par fichier
+**    -r   limiter le debit de recopie (0 par defaut : sans limite)
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-defrag.h"
+
+static void print_stats (const char* title)
+	{
+	struct DiskStats s = getDiskStats();
+
+	printf("%s: %u extent(s), %u fragment(s) en trop, "
+	       "%u suite(s) libre(s) (la plus longue: %u blocs)\n", title,
+	       s.nb_extents, s.nb_fragments, s.nb_free_extents, s.largest_free_extent);
+	}
+
+int main(int argc, char* argv[]) {
+	int dry_run = 0, map = 0, rate = 0;
+	char* name = NULL;
+	int i, moved;
+
+	for(i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-n") == 0) dry_run = 1;
+		else if (strcmp(argv[i], "-m") == 0) map = 1;
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) rate = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && name == NULL) name = argv[i];
+		else {
+			fprintf(stderr, "usage: sgf-defrag [-n] [-m] [-r blocs_par_seconde] [disque]\n");
+			return (EXIT_FAILURE);
+		}
+	}
+
+	if (name != NULL && !test_disk(name)) {
+		fprintf(stderr, "sgf-defrag: %s n'est pas un disque utilisable\n", name);
+		return (EXIT_FAILURE);
+	}
+	init_sgf();
+
+	sgf_fragmentation_report();
+	print_stats("avant");
+	if (!dry_run) {
+		moved = sgf_defrag(rate);
+		printf("%d fichier(s) defragmente(s)\n", moved);
+		sgf_fragmentation_report();
+		print_stats("apres");
+	}
+	if (map) sgf_display_fat_map_by_file();
+
+	return (EXIT_SUCCESS);
+}
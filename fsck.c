@@ -0,0 +1,76 @@
+/*
+**  fsck.c
+**
+**  Verification de la coherence d'un disque du mini SGF.
+**
+**  sgf-fsck [-r] [-q] [-j threads] [disque]
+**
+**    -r          reparer les anomalies trouvees
+**    -q          n'afficher que le bilan
+**    -j threads  nombre de threads (1 par defaut)
+**
+**  Code de retour : 0 disque sain, 1 anomalies corrigees,
+**                   4 anomalies non corrigees.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-check.h"
+
+static void usage (void)
+	{
+	fprintf(stderr, "usage: sgf-fsck [-r] [-q] [-j threads] [disque]\n");
+	exit(8);
+	}
+
+int main(int argc, char* argv[]) {
+	CHECK_REPORT r;
+	struct timespec t0, t1;
+	int repair = 0, verbose = 1, nb_threads = 1;
+	char* name = NULL;
+	int i;
+
+	for(i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0) repair = 1;
+		else if (strcmp(argv[i], "-q") == 0) verbose = 0;
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) nb_threads = atoi(argv[++i]);
+		else if (argv[i][0] == '-' || name != NULL) usage();
+		else name = argv[i];
+	}
+
+	if (name != NULL && !test_disk(name)) {
+		fprintf(stderr, "sgf-fsck: %s n'est pas un disque utilisable\n", name);
+		return (8);
+	}
+	init_sgf();
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	sgf_check(nb_threads, repair, verbose, &r);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	printf("%d fichier(s), %d bloc(s) chaine(s) sur %d\n",
+	       r.nb_files, r.nb_blocks, get_disk_size());
+	printf("%d entree(s) invalide(s), %d inode(s) incoherent(s), "
+	       "%d chainage(s) invalide(s)\n",
+	       r.nb_dangling_entries, r.nb_bad_inodes, r.nb_bad_links);
+	printf("%d cycle(s), %d chainage(s) croise(s), %d inode(s) perdu(s), "
+	       "%d bloc(s) orphelin(s), %d entree(s) de FAT invalide(s)\n",
+	       r.nb_cycles, r.nb_cross_links, r.nb_leaked_inodes,
+	       r.nb_orphan_blocks, r.nb_bad_entries);
+	if (repair)
+		printf("%d correction(s)\n", r.nb_repaired);
+	printf("verification en %.3f ms (%d thread(s))\n",
+	       (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6,
+	       nb_threads);
+
+	if (r.nb_errors == 0) return (0);
+	return (repair ? 1 : 4);
+}
@@ -0,0 +1,54 @@
+/*
+**  import.c
+**
+**  Copie de fichiers et d'arborescences du systeme hote dans un disque
+**  du mini SGF.
+**
+**  sgf-import [-j threads] [-b fichiers] disque chemin...
+**
+**    -j threads   lecteurs du systeme hote (4 par defaut)
+**    -b fichiers  fichiers par validation du journal (256 par defaut)
+**
+**  Code de retour : 0 tout est copie, 1 des fichiers ne l'ont pas ete.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-io.h"
+#include "sgf-bulk.h"
+
+static void usage (void)
+	{
+	fprintf(stderr, "usage: sgf-import [-j threads] [-b fichiers] disque chemin...\n");
+	exit(8);
+	}
+
+int main(int argc, char* argv[]) {
+	BULK_REPORT r;
+	int nb_threads = BULK_THREADS, i, ret;
+
+	for (i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) nb_threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) sgf_bulk_batch = atoi(argv[++i]);
+		else usage();
+	}
+	if (argc - i < 2 || nb_threads < 1 || sgf_bulk_batch < 1) usage();
+
+	if (!test_disk(argv[i])) {
+		fprintf(stderr, "sgf-import: %s n'est pas un disque utilisable\n", argv[i]);
+		return (8);
+	}
+	init_sgf();
+
+	ret = sgf_import(argv + i + 1, argc - i - 1, nb_threads, &r);
+	close_sgf_disk();
+
+	printf("%d fichier(s), %.1f Mo en %.1f ms (%.1f Mo/s), %d validation(s), %d erreur(s)\n",
+	       r.nb_files, r.nb_bytes / 1048576.0, r.elapsed_ms,
+	       (r.elapsed_ms > 0) ? r.nb_bytes / 1048576.0 / (r.elapsed_ms / 1e3) : 0.0,
+	       r.nb_commits, r.nb_errors);
+	return ((ret < 0) ? 1 : 0);
+}
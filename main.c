@@ -101,6 +101,7 @@ int main() {
 	printf("%d data block(s)\n", diskStats.nb_data_blocks);
 	printf("%d free block(s) left\n", diskStats.nb_free_blocks);
 	printf("%f kib(s) left, %d byte(s) left\n", diskStats.nb_free_bytes/1024.0, diskStats.nb_free_bytes);
+	printf("%d extent(s), %d extra fragment(s), largest free run %d block(s)\n", diskStats.nb_extents, diskStats.nb_fragments, diskStats.largest_free_extent);
 	displayFatMap();
 	sgf_close(file);
 	
@@ -0,0 +1,135 @@
+/*
+**  mkfs.c
+**
+**  Formatage d'un disque du mini SGF (remplace l'executable "format").
+**
+**  sgf-mkfs [-b octets] [-w bits] [-d blocs] [-c] [-p] disque taille
+**
+**    taille      en blocs, ou en octets suivie de K, M ou G
+**    -b octets   taille des blocs (celle du SGF compile : 128)
+**    -w bits     largeur des entrees de la FAT (celle du SGF : 32)
+**    -d blocs    blocs du repertoire alloues d'avance, contigus
+**                (1 par defaut, le repertoire grandit ensuite)
+**    -c          creer la table des sommes de controle
+**    -p          allouer d'avance la place de tout le disque
+**                (l'image est creuse par defaut)
+**
+**  Seules les meta-donnees sont ecrites (super bloc, FAT par grands
+**  morceaux, en-tete du journal, repertoire) : le temps ne depend
+**  que de la taille de la FAT.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-crc.h"
+
+static void usage(void) {
+	fprintf(stderr, "usage: sgf-mkfs [-b octets] [-w bits] [-d blocs] [-c] [-p] disque taille\n");
+	exit(8);
+}
+
+/* taille en blocs ("1000", "64K", "512M", "2G") */
+static long parse_size(const char* s) {
+	char* end;
+	double v = strtod(s, &end);
+
+	switch (*end) {
+	case 'k': case 'K': v *= 1024.0; break;
+	case 'm': case 'M': v *= 1024.0 * 1024.0; break;
+	case 'g': case 'G': v *= 1024.0 * 1024.0 * 1024.0; break;
+	case '\0': return ((v > 0) ? (long) v : -1);
+	default: return (-1);
+	}
+	if (end[1] != '\0' && strcmp(end + 1, "B") != 0 && strcmp(end + 1, "o") != 0) return (-1);
+	return ((long) (v / BLOCK_SIZE));
+}
+
+int main(int argc, char* argv[]) {
+	struct timespec t0, t1;
+	TBLOCK b;
+	char* name = NULL;
+	long size = -1;
+	int block_size = BLOCK_SIZE, width = 8 * sizeof(int), dir_blocks = 1;
+	int checksums = 0, prealloc = 0, fat_blocks, adr, k;
+
+	for (k = 1; k < argc; k++) {
+		if (strcmp(argv[k], "-b") == 0 && k + 1 < argc) block_size = atoi(argv[++k]);
+		else if (strcmp(argv[k], "-w") == 0 && k + 1 < argc) width = atoi(argv[++k]);
+		else if (strcmp(argv[k], "-d") == 0 && k + 1 < argc) dir_blocks = atoi(argv[++k]);
+		else if (strcmp(argv[k], "-c") == 0) checksums = 1;
+		else if (strcmp(argv[k], "-p") == 0) prealloc = 1;
+		else if (argv[k][0] == '-') usage();
+		else if (name == NULL) name = argv[k];
+		else if (size < 0) {
+			if ((size = parse_size(argv[k])) < 0) usage();
+		}
+		else usage();
+	}
+	if (name == NULL || size < 0 || dir_blocks < 1) usage();
+
+	/* la geometrie est fixee a la compilation du SGF */
+	if (block_size != BLOCK_SIZE) {
+		fprintf(stderr, "sgf-mkfs: ce SGF utilise des blocs de %d octets\n", BLOCK_SIZE);
+		return (8);
+	}
+	if (width != 8 * (int) sizeof(int)) {
+		fprintf(stderr, "sgf-mkfs: ce SGF utilise une FAT de %d bits\n", 8 * (int) sizeof(int));
+		return (8);
+	}
+	if (size > MAX_DISK_SIZE) {
+		fprintf(stderr, "sgf-mkfs: %ld blocs, au plus %d\n", size, MAX_DISK_SIZE);
+		return (8);
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	if (!create_disk(name, (int) size)) {
+		fprintf(stderr, "sgf-mkfs: impossible de creer %s\n", name);
+		return (8);
+	}
+	create_empty_fat();
+	init_sgf();
+	create_empty_directory();
+
+	/* repertoire de plusieurs blocs : des blocs nuls (image creuse) chaines */
+	read_block(ADR_BLOCK_DEF, &b.data);
+	adr = b.super.adr_dir;
+	if (dir_blocks > 1) {
+		if (adr + dir_blocks > size) {
+			fprintf(stderr, "sgf-mkfs: pas de place pour %d blocs de repertoire\n", dir_blocks);
+			return (8);
+		}
+		for (k = 1; k < dir_blocks; k++)
+			set_fat_lazy(adr + k - 1, adr + k);
+		set_fat_lazy(adr + dir_blocks - 1, FAT_EOF);
+		save_fat();
+		printf("directory (block %d to %d)\n", adr, adr + dir_blocks - 1);
+	}
+
+	if (checksums && create_checksum_table() < 0) {
+		fprintf(stderr, "sgf-mkfs: pas de place pour la table des sommes\n");
+		return (8);
+	}
+
+	/* apres le formatage, qui rend au systeme hote les blocs inutilises */
+	if (prealloc && reserve_blocks(0, (int) size) < 0)
+		fprintf(stderr, "sgf-mkfs: allocation d'avance impossible, image creuse\n");
+
+	fat_blocks = get_fat_size_in_blocks();
+	close_sgf_disk();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	printf("%s : %ld blocs de %d octets (%.1f Mo), FAT de %d blocs, formate en %.1f ms\n",
+	       name, size, BLOCK_SIZE, size * (double) BLOCK_SIZE / (1024.0 * 1024.0),
+	       fat_blocks,
+	       (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6);
+	return (0);
+}
@@ -0,0 +1,369 @@
+/*
+**  replay.c
+**
+**  Rejouer des traces enregistrees (voir sgf-record.h) sur des disques
+**  neufs.
+**
+**  sgf-replay [-p] [-j fils] [-s blocs] [-d] trace...
+**
+**    -p        respecter les delais enregistres entre les appels
+**              (par defaut les appels s'enchainent au plus vite)
+**    -j fils   nombre de traces rejouees en parallele (1 par defaut)
+**    -s blocs  taille des disques (par defaut celle de la trace)
+**    -d        afficher les traces au lieu de les rejouer
+**
+**  Le SGF n'est pas partage entre fils d'execution : chaque trace est
+**  rejouee par un processus sur son propre disque (sgf-replay-N.img,
+**  detruit ensuite). Une trace peut etre donnee plusieurs fois pour
+**  faire travailler plusieurs rejoueurs sur la meme charge.
+**
+**  Un fichier ouvert en lecture pendant l'enregistrement mais absent
+**  du disque neuf y est d'abord cree avec la taille notee. Les appels
+**  sur un fichier que le rejeu n'a pas pu ouvrir sont ignores.
+**
+**  Code de retour : 0, ou 8 si une trace est illisible.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-record.h"
+
+/* le bilan d'un rejeu, renvoye par le processus fils */
+typedef struct REPLAY_RESULT {
+	long nb_records;
+	long nb_calls;
+	long nb_skipped;                /* appels sur un fichier non ouvert */
+	long nb_created;                /* fichiers crees avant le rejeu    */
+	long bytes;                     /* octets lus ou ecrits             */
+	double ms;                      /* duree du rejeu                   */
+	double recorded_ms;             /* duree enregistree                */
+	DISK_COUNTERS disk;
+	int status;                     /* 0, ou 8 : trace illisible        */
+} REPLAY_RESULT;
+
+static int paced = 0, disk_blocks = 0;
+
+static void usage(void) {
+	fprintf(stderr, "usage: sgf-replay [-p] [-j fils] [-s blocs] [-d] trace...\n");
+	exit(8);
+}
+
+static double elapsed_ms(struct timespec* t0, struct timespec* t1) {
+	return (t1->tv_sec - t0->tv_sec) * 1e3 + (t1->tv_nsec - t0->tv_nsec) / 1e6;
+}
+
+/* lire toute la trace en memoire (NULL si elle est illisible) */
+static char* load(const char* path, long* size) {
+	FILE* f = fopen(path, "rb");
+	SGF_TRACE_HEADER* h;
+	char* data;
+
+	if (f == NULL) return (NULL);
+	fseek(f, 0, SEEK_END);
+	*size = ftell(f);
+	rewind(f);
+	data = malloc(*size + 1);
+	if (data == NULL || *size < (long) sizeof(SGF_TRACE_HEADER)
+	    || fread(data, 1, *size, f) != (size_t) *size) {
+		fclose(f);
+		free(data);
+		return (NULL);
+	}
+	fclose(f);
+	h = (SGF_TRACE_HEADER*) data;
+	if (memcmp(h->magic, SGF_TRACE_MAGIC, sizeof(h->magic)) != 0 || h->version != SGF_TRACE_VERSION) {
+		free(data);
+		return (NULL);
+	}
+	return (data);
+}
+
+/* enregistrement suivant de la trace (NULL a la fin), et ses noms */
+static SGF_TRACE_REC* next(char* data, long size, long* pos, char** name, char** name2) {
+	SGF_TRACE_REC* r;
+
+	if (*pos + (long) sizeof(SGF_TRACE_REC) > size) return (NULL);
+	r = (SGF_TRACE_REC*) (data + *pos);
+	*pos += sizeof(SGF_TRACE_REC);
+	if (*pos + r->name_len > size) return (NULL);
+	*name = *name2 = NULL;
+	if (r->name_len > 0) {
+		*name = data + *pos;
+		*name2 = *name + strlen(*name) + 1;
+		if (*name2 >= data + *pos + r->name_len) *name2 = NULL;
+	}
+	*pos += r->name_len;
+	return (r);
+}
+
+static int dump(const char* path) {
+	SGF_TRACE_REC* r;
+	char *data, *name, *name2;
+	long size, pos = sizeof(SGF_TRACE_HEADER);
+
+	if ((data = load(path, &size)) == NULL) {
+		fprintf(stderr, "sgf-replay: %s n'est pas une trace\n", path);
+		return (8);
+	}
+	printf("# %s : disque de %d blocs\n", path, ((SGF_TRACE_HEADER*) data)->disk_size);
+	printf("%10s %-14s %6s %10s %10s %8s %10s  %s\n", "delai us", "appel", "fich.", "a", "b", "resultat",
+	       "duree ns", "noms");
+	while ((r = next(data, size, &pos, &name, &name2)) != NULL)
+		printf("%10u %-14s %6u %10d %10d %8d %10u  %s %s\n", r->delay_us, sgf_trace_op_name(r->op),
+		       r->handle, r->a, r->b, r->result, r->duration_ns, name ? name : "", name2 ? name2 : "");
+	free(data);
+	return (0);
+}
+
+/* creer "name" avec "size" octets */
+static void create(const char* name, int size) {
+	OFILE* f = sgf_open(name, WRITE_MODE);
+	int k;
+
+	if (f == NULL) return;
+	for (k = 0; k < size; k++)
+		sgf_putc(f, 'a' + k % 26);
+	sgf_close(f);
+}
+
+static void replay(const char* path, int worker, REPLAY_RESULT* res) {
+	static OFILE* files[TRACE_MAX_HANDLES + 1];
+	struct timespec t0, t1, target, pause;
+	SGF_TRACE_REC* r;
+	char *data, *name, *name2, *buf = NULL, image[32];
+	long size, pos = sizeof(SGF_TRACE_HEADER), at_us = 0;
+	int capacity = 0, k, blocks, c;
+	OFILE* f;
+
+	memset(res, 0, sizeof(*res));
+	if ((data = load(path, &size)) == NULL) {
+		res->status = 8;
+		return;
+	}
+	blocks = disk_blocks > 0 ? disk_blocks : ((SGF_TRACE_HEADER*) data)->disk_size;
+
+	sprintf(image, "sgf-replay-%d.img", worker);
+	if (!create_disk(image, blocks)) {
+		res->status = 8;
+		return;
+	}
+	create_empty_fat();
+	init_sgf();
+	create_empty_directory();
+	memset(files, 0, sizeof(files));
+
+	reset_disk_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	while ((r = next(data, size, &pos, &name, &name2)) != NULL) {
+		res->nb_records++;
+		at_us += r->delay_us;
+
+		/* attendre le moment de l'appel */
+		if (paced) {
+			target = t0;
+			target.tv_sec += at_us / 1000000;
+			target.tv_nsec += (at_us % 1000000) * 1000;
+			if (target.tv_nsec >= 1000000000L) {
+				target.tv_sec++;
+				target.tv_nsec -= 1000000000L;
+			}
+			clock_gettime(CLOCK_MONOTONIC, &t1);
+			if (elapsed_ms(&t1, &target) > 0) {
+				pause.tv_sec = target.tv_sec - t1.tv_sec;
+				pause.tv_nsec = target.tv_nsec - t1.tv_nsec;
+				if (pause.tv_nsec < 0) {
+					pause.tv_sec--;
+					pause.tv_nsec += 1000000000L;
+				}
+				nanosleep(&pause, NULL);
+			}
+		}
+
+		f = (r->handle > 0 && r->handle <= TRACE_MAX_HANDLES) ? files[r->handle] : NULL;
+		if (f == NULL && ((r->op >= TRACE_CLOSE && r->op <= TRACE_FLUSH) || r->op == TRACE_READ)) {
+			res->nb_skipped += (r->op == TRACE_GETC || r->op == TRACE_PUTC) ? r->a : 1;
+			continue;
+		}
+		res->nb_calls += (r->op == TRACE_GETC || r->op == TRACE_PUTC) ? r->a : 1;
+
+		/* tampon de donnees pour sgf_puts, sgf_write et sgf_read */
+		if ((r->op == TRACE_PUTS || r->op == TRACE_WRITE || r->op == TRACE_READ) && r->a >= capacity) {
+			capacity = r->a + 1;
+			buf = realloc(buf, capacity);
+			if (buf == NULL) exit(EXIT_FAILURE);
+			for (k = 0; k < capacity; k++)
+				buf[k] = 'a' + k % 26;
+		}
+
+		switch (r->op) {
+		case TRACE_OPEN:
+			if (name == NULL) break;
+			f = sgf_open(name, r->a);
+			if (f == NULL && r->b >= 0 && (r->a & ~COMPRESSED_MODE) != WRITE_MODE) {
+				create(name, r->b);
+				res->nb_created++;
+				f = sgf_open(name, r->a);
+			}
+			if (r->handle > 0 && r->handle <= TRACE_MAX_HANDLES) files[r->handle] = f;
+			break;
+		case TRACE_CLOSE:
+			sgf_close(f);
+			files[r->handle] = NULL;
+			break;
+		case TRACE_GETC:
+			for (k = 0; k < r->a; k++)
+				if ((c = sgf_getc(f)) != -1) res->bytes++;
+			break;
+		case TRACE_PUTC:
+			for (k = 0; k < r->a; k++)
+				sgf_putc(f, 'a' + k % 26);
+			res->bytes += r->a;
+			break;
+		case TRACE_PUTS:
+			buf[r->a] = '\0';
+			sgf_puts(f, buf);
+			buf[r->a] = 'a' + r->a % 26;
+			res->bytes += r->a;
+			break;
+		case TRACE_WRITE:
+			sgf_write(f, buf, r->a);
+			res->bytes += r->a;
+			break;
+		case TRACE_READ:
+			res->bytes += sgf_read(f, buf, r->a);
+			break;
+		case TRACE_SEEK:        sgf_seek(f, r->a);              break;
+		case TRACE_SEEK_DATA:   sgf_seek_data(f, r->a);         break;
+		case TRACE_SEEK_HOLE:   sgf_seek_hole(f, r->a);         break;
+		case TRACE_PUNCH_HOLE:  sgf_punch_hole(f, r->a, r->b);  break;
+		case TRACE_TRUNCATE:    sgf_truncate(f, r->a);          break;
+		case TRACE_FLUSH:       sgf_flush(f);                   break;
+		case TRACE_UNLINK:      if (name) sgf_unlink(name);     break;
+		case TRACE_CLONE:       if (name2) sgf_clone(name, name2); break;
+		case TRACE_SYNC:        sgf_sync();                     break;
+		case TRACE_FIND_INODE:  if (name) find_inode(name);     break;
+		case TRACE_LIST_DIRECTORY: list_directory();            break;
+		default:                res->nb_calls--;                break;
+		}
+	}
+	sgf_sync();
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	res->ms = elapsed_ms(&t0, &t1);
+	res->recorded_ms = at_us / 1e3;
+	get_disk_counters(&res->disk);
+
+	close_sgf_disk();
+	remove(image);
+	free(buf);
+	free(data);
+}
+
+static void print(const char* title, REPLAY_RESULT* r) {
+	printf("%-20s %9ld %9ld %9.1f %10.0f %8.2f %9ld %9ld %7ld\n", title, r->nb_records, r->nb_calls, r->ms,
+	       r->ms > 0 ? r->nb_calls / r->ms * 1e3 : 0.0, r->ms > 0 ? r->bytes / r->ms / 1e3 : 0.0,
+	       r->disk.nb_reads, r->disk.nb_writes, r->nb_skipped);
+}
+
+int main(int argc, char* argv[]) {
+	REPLAY_RESULT r, total;
+	struct timespec t0, t1;
+	int workers = 1, dumping = 0, first, next_trace, running = 0, status = 0, k;
+	int (*pipes)[2];
+	pid_t* pids;
+	pid_t pid;
+
+	for (first = 1; first < argc && argv[first][0] == '-'; first++) {
+		if (strcmp(argv[first], "-p") == 0) paced = 1;
+		else if (strcmp(argv[first], "-d") == 0) dumping = 1;
+		else if (strcmp(argv[first], "-j") == 0 && first + 1 < argc) workers = atoi(argv[++first]);
+		else if (strcmp(argv[first], "-s") == 0 && first + 1 < argc) disk_blocks = atoi(argv[++first]);
+		else usage();
+	}
+	if (first == argc || workers < 1) usage();
+
+	if (dumping) {
+		for (k = first; k < argc; k++)
+			status |= dump(argv[k]);
+		return (status);
+	}
+
+	/* le rejeu ne doit pas etre enregistre a son tour */
+	unsetenv("SGF_RECORD");
+
+	pipes = malloc(argc * sizeof(*pipes));
+	pids = malloc(argc * sizeof(pid_t));
+	if (pipes == NULL || pids == NULL) return (EXIT_FAILURE);
+
+	printf("%-20s %9s %9s %9s %10s %8s %9s %9s %7s\n", "trace", "enreg.", "appels", "ms", "appels/s",
+	       "Mo/s", "lus", "ecrits", "ignores");
+	fflush(stdout);
+	memset(&total, 0, sizeof(total));
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+
+	/* au plus "workers" processus a la fois, les bilans dans l'ordre des traces */
+	for (next_trace = first, k = first; k < argc; k++) {
+		while (next_trace < argc && running < workers) {
+			if (pipe(pipes[next_trace]) < 0 || (pid = fork()) < 0) {
+				perror("sgf-replay");
+				return (EXIT_FAILURE);
+			}
+			if (pid == 0) {
+				/* sgf_write et le formatage ecrivent sur stdout */
+				int fd = open("/dev/null", O_WRONLY);
+				dup2(fd, 1);
+				close(fd);
+				close(pipes[next_trace][0]);
+				replay(argv[next_trace], next_trace, &r);
+				if (write(pipes[next_trace][1], &r, sizeof(r)) != sizeof(r)) _exit(EXIT_FAILURE);
+				_exit(EXIT_SUCCESS);
+			}
+			close(pipes[next_trace][1]);
+			pids[next_trace++] = pid;
+			running++;
+		}
+
+		if (read(pipes[k][0], &r, sizeof(r)) != sizeof(r)) r.status = 8;
+		close(pipes[k][0]);
+		waitpid(pids[k], NULL, 0);
+		running--;
+
+		if (r.status != 0) {
+			fprintf(stderr, "sgf-replay: %s n'est pas une trace rejouable\n", argv[k]);
+			status = 8;
+			continue;
+		}
+		print(argv[k], &r);
+		total.nb_records += r.nb_records;
+		total.nb_calls += r.nb_calls;
+		total.nb_skipped += r.nb_skipped;
+		total.nb_created += r.nb_created;
+		total.bytes += r.bytes;
+		total.recorded_ms += r.recorded_ms;
+		total.disk.nb_reads += r.disk.nb_reads;
+		total.disk.nb_writes += r.disk.nb_writes;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+
+	/* le debit global se rapporte a la duree reelle de l'ensemble */
+	total.ms = elapsed_ms(&t0, &t1);
+	if (argc - first > 1) print("total", &total);
+	printf("%ld fichier(s) cree(s) avant rejeu, duree enregistree %.1f ms, %d rejoueur(s)%s\n",
+	       total.nb_created, total.recorded_ms, workers, paced ? ", delais respectes" : "");
+
+	free(pipes);
+	free(pids);
+	return (status);
+}
@@ -0,0 +1,90 @@
+/*
+**  scrub.c
+**
+**  Verification des sommes de controle d'un disque du mini SGF.
+**
+**  sgf-scrub [-c] [-r] [-t blocs/s] [disque]
+**
+**    -c          creer la table des sommes si le disque n'en a pas
+**    -r          recalculer la somme des blocs alteres
+**    -t blocs/s  debit du parcours (0 par defaut : sans limite)
+**
+**  Code de retour : 0 disque sain, 1 sommes recalculees,
+**                   4 blocs alteres.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-crc.h"
+
+static void usage (void)
+	{
+	fprintf(stderr, "usage: sgf-scrub [-c] [-r] [-t blocs/s] [disque]\n");
+	exit(8);
+	}
+
+int main(int argc, char* argv[]) {
+	CRC_COUNTERS c;
+	struct timespec t0, t1, pause;
+	int create = 0, repair = 0, rate = 0, step, bad = 0;
+	char* name = NULL;
+	double ms;
+	int i;
+
+	for(i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-c") == 0) create = 1;
+		else if (strcmp(argv[i], "-r") == 0) repair = 1;
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) rate = atoi(argv[++i]);
+		else if (argv[i][0] == '-' || name != NULL) usage();
+		else name = argv[i];
+	}
+
+	if (name != NULL && !test_disk(name)) {
+		fprintf(stderr, "sgf-scrub: %s n'est pas un disque utilisable\n", name);
+		return (8);
+	}
+	init_sgf();
+
+	if (!has_checksums()) {
+		if (!create) {
+			fprintf(stderr, "sgf-scrub: le disque n'a pas de sommes de controle (option -c)\n");
+			return (8);
+		}
+		if (create_checksum_table() < 0) {
+			fprintf(stderr, "sgf-scrub: pas de place pour la table des sommes\n");
+			return (8);
+		}
+		get_crc_counters(&c);
+		printf("table des sommes creee, %ld bloc(s) utilise(s)\n", c.nb_computed);
+	}
+
+	/* une etape par dixieme de seconde au debit demande */
+	step = (rate > 0) ? (rate + 9) / 10 : SCRUB_MAX_STEP;
+	pause.tv_sec = 0;
+	pause.tv_nsec = 100000000L;
+
+	reset_crc_counters();
+	clock_gettime(CLOCK_MONOTONIC, &t0);
+	do {
+		bad += scrub_blocks(step, repair);
+		if (rate > 0 && scrub_position() != 0) nanosleep(&pause, NULL);
+	} while (scrub_position() != 0);
+	clock_gettime(CLOCK_MONOTONIC, &t1);
+	get_crc_counters(&c);
+
+	ms = (t1.tv_sec - t0.tv_sec) * 1e3 + (t1.tv_nsec - t0.tv_nsec) / 1e6;
+	printf("%ld bloc(s) verifie(s), %d altere(s), %ld somme(s) recalculee(s)\n",
+	       c.nb_scrubbed, bad, c.nb_repaired);
+	printf("parcours en %.3f ms (crc32c %s)\n", ms, crc32c_hardware() ? "SSE4.2" : "portable");
+
+	if (bad == 0) return (0);
+	return (repair ? 1 : 4);
+}
@@ -0,0 +1,288 @@
+/*
+**  sgf-async.c
+**
+**  Requetes d'E/S asynchrones et leur moteur.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "sgf-disk.h"
+#include "sgf-io.h"
+#include "sgf-async.h"
+
+
+#define AIO_SLAB        (32)    /* requetes allouees a la fois          */
+
+int sgf_async_slice = AIO_SLICE_BLOCKS;
+
+
+/**********************************************************************
+ Les requetes en cours, dans l'ordre de depot (pending_end designe le
+ champ "next" de la derniere), les requetes terminees a retirer par
+ sgf_async_poll et la reserve. Les trois listes sont chainees par le
+ champ "next".
+ *********************************************************************/
+
+static SGF_AIO* pending = NULL;
+static SGF_AIO** pending_end = &pending;
+static int nb_pending = 0;
+
+static SGF_AIO* completed = NULL;
+static SGF_AIO** completed_end = &completed;
+
+static SGF_AIO* free_requests = NULL;
+
+/* adresse ou le moteur vient de travailler (tete de lecture) */
+static int head = 0;
+
+static int running = 0;
+
+
+static SGF_AIO* new_request (int op, OFILE* f, char* data, int size,
+                             SGF_AIO_CALLBACK callback, void* arg)
+    {
+    SGF_AIO* r;
+    int k;
+
+    if (free_requests == NULL)
+        {
+        r = malloc(AIO_SLAB * sizeof(SGF_AIO));
+        if (r == NULL) return (NULL);
+        for(k = 0; k < AIO_SLAB; k++)
+            {
+            r[k].next = free_requests;
+            free_requests = &r[k];
+            }
+        }
+    r = free_requests;
+    free_requests = r->next;
+
+    r->op = op;
+    r->state = AIO_PENDING;
+    r->file = f;
+    r->name[0] = '\0';
+    r->mode = 0;
+    r->data = data;
+    r->size = size;
+    r->done = 0;
+    r->result = 0;
+    r->callback = callback;
+    r->arg = arg;
+
+    r->next = NULL;
+    *pending_end = r;
+    pending_end = &r->next;
+    nb_pending++;
+    return (r);
+    }
+
+
+SGF_AIO* sgf_open_async (const char* nom, int mode, SGF_AIO_CALLBACK callback, void* arg)
+    {
+    SGF_AIO* r;
+
+    if (strlen(nom) >= AIO_NAME_MAX) return (NULL);
+    if ((r = new_request(AIO_OPEN, NULL, NULL, 0, callback, arg)) == NULL) return (NULL);
+    strcpy(r->name, nom);
+    r->mode = mode;
+    return (r);
+    }
+
+SGF_AIO* sgf_read_async (OFILE* f, char* data, int size, SGF_AIO_CALLBACK callback, void* arg)
+    {
+    return (new_request(AIO_READ, f, data, size, callback, arg));
+    }
+
+SGF_AIO* sgf_write_async (OFILE* f, char* data, int size, SGF_AIO_CALLBACK callback, void* arg)
+    {
+    return (new_request(AIO_WRITE, f, data, size, callback, arg));
+    }
+
+
+/**********************************************************************
+ Adresse du bloc ou la requete va travailler : le bloc qui suit le
+ bloc courant de la chaine en lecture, celui qui suit le dernier bloc
+ en ecriture.
+ *********************************************************************/
+
+static int step_key (SGF_AIO* r)
+    {
+    OFILE* f = r->file;
+
+    if (r->op == AIO_WRITE) return ((f->last >= 0) ? f->last + 1 : f->inode + 1);
+    if (f->currentBlocNum != -1  &&  f->currentBlocAdr >= 0) return (f->currentBlocAdr + 1);
+    return ((f->first >= 0) ? f->first : f->inode + 1);
+    }
+
+
+/**********************************************************************
+ Faire avancer la requete "r" d'une etape (au plus sgf_async_slice
+ blocs, arretee a une limite de bloc).
+ *********************************************************************/
+
+static void step (SGF_AIO* r)
+    {
+    OFILE* f = r->file;
+    int slice = ((sgf_async_slice > 0) ? sgf_async_slice : 1) * BLOCK_SIZE;
+    int amount, n;
+
+    if (r->op == AIO_OPEN)
+        {
+        r->file = sgf_open(r->name, r->mode);
+        r->result = (r->file == NULL) ? -1 : 0;
+        r->state = AIO_DONE;
+        return;
+        }
+
+    amount = f->compressed ? slice : slice - f->ptr % BLOCK_SIZE;
+    if (amount > r->size - r->done) amount = r->size - r->done;
+
+    if (r->op == AIO_READ)
+        {
+        n = (amount > 0) ? sgf_read(f, r->data + r->done, amount) : 0;
+        r->done += n;
+        if (n < amount  ||  r->done == r->size)
+            {
+            r->result = r->done;
+            r->state = AIO_DONE;
+            }
+        }
+    else if (amount > 0  &&  sgf_write(f, r->data + r->done, amount) < 0)
+        {
+        r->result = -1;
+        r->state = AIO_DONE;
+        }
+    else if ((r->done += amount) == r->size)
+        {
+        r->result = r->size;
+        r->state = AIO_DONE;
+        }
+    }
+
+
+/**********************************************************************
+ Une etape : une ouverture s'il y en a, sinon la requete prete (sans
+ requete plus ancienne sur son fichier) qui travaille a la plus petite
+ adresse depuis la tete, en repartant du debut du disque s'il n'y en
+ a plus (C-SCAN). Une lecture qui continue sur des blocs contigus
+ garde donc la main, puis la tete passe au fichier suivant sur le
+ disque. Une requete terminee quitte la liste avant d'etre remise
+ (son "callback" peut en deposer d'autres).
+ *********************************************************************/
+
+int sgf_async_run (void)
+    {
+    SGF_AIO** p;
+    SGF_AIO* r, *q, *best = NULL, *wrap = NULL;
+    int key, best_key = 0, wrap_key = 0;
+
+    if (running  ||  pending == NULL) return (nb_pending);
+    running = 1;
+
+    for(r = pending; r != NULL; r = r->next)
+        {
+        if (r->op == AIO_OPEN)
+            {
+            best = r;
+            break;
+            }
+        for(q = pending; q != r  &&  q->file != r->file; q = q->next)
+            ;
+        if (q != r) continue;
+
+        key = step_key(r);
+        if (key >= head  &&  (best == NULL  ||  key < best_key))
+            {
+            best = r;
+            best_key = key;
+            }
+        if (wrap == NULL  ||  key < wrap_key)
+            {
+            wrap = r;
+            wrap_key = key;
+            }
+        }
+    r = (best != NULL) ? best : wrap;
+
+    step(r);
+    if (r->file != NULL) head = step_key(r);
+
+    if (r->state == AIO_DONE)
+        {
+        for(p = &pending; *p != r; p = &(*p)->next)
+            ;
+        *p = r->next;
+        if (*p == NULL) pending_end = p;
+        nb_pending--;
+
+        r->next = NULL;
+        if (r->callback != NULL)
+            {
+            r->callback(r, r->arg);
+            r->next = free_requests;
+            free_requests = r;
+            }
+        else
+            {
+            *completed_end = r;
+            completed_end = &r->next;
+            }
+        }
+
+    running = 0;
+    return (nb_pending);
+    }
+
+int sgf_async_pending (void)
+    {
+    return (nb_pending);
+    }
+
+
+/**********************************************************************
+ Requetes terminees sans "callback".
+ *********************************************************************/
+
+static int unlink_completed (SGF_AIO* r)
+    {
+    SGF_AIO** p;
+
+    for(p = &completed; *p != NULL  &&  *p != r; p = &(*p)->next)
+        ;
+    if (*p == NULL) return (0);
+    *p = r->next;
+    if (*p == NULL) completed_end = p;
+    r->next = NULL;
+    return (1);
+    }
+
+SGF_AIO* sgf_async_poll (void)
+    {
+    SGF_AIO* r;
+
+    while (completed == NULL  &&  nb_pending > 0  &&  !running)
+        sgf_async_run();
+    if ((r = completed) != NULL) unlink_completed(r);
+    return (r);
+    }
+
+int sgf_async_wait (SGF_AIO* r)
+    {
+    assert (r->callback == NULL);
+    while (r->state != AIO_DONE  &&  !running)
+        sgf_async_run();
+    unlink_completed(r);
+    return (r->result);
+    }
+
+void sgf_async_release (SGF_AIO* r)
+    {
+    assert (r->state == AIO_DONE);
+    unlink_completed(r);
+    r->next = free_requests;
+    free_requests = r;
+    }
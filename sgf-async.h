@@ -0,0 +1,109 @@
+#ifndef __SGF_ASYNC__
+#define __SGF_ASYNC__
+
+#include "sgf-io.h"
+
+
+/**********************************************************************
+ *
+ *  E/S ASYNCHRONES SUR LES FICHIERS OUVERTS
+ *
+ *  sgf_open_async, sgf_read_async et sgf_write_async deposent une
+ *  requete et rendent la main tout de suite. Les requetes avancent
+ *  quand l'appelant fait tourner le moteur (sgf_async_run, ou
+ *  sgf_async_poll et sgf_async_wait qui l'appellent), par etapes d'au
+ *  plus sgf_async_slice blocs. Le moteur choisit a chaque etape la
+ *  requete qui travaille au plus pres devant la derniere adresse
+ *  atteinte (comme un ascenseur qui repart du debut du disque) : avec
+ *  beaucoup de requetes en cours, les blocs sont lus ou ecrits dans
+ *  l'ordre du disque, quel que soit le fichier qui les demande.
+ *
+ *  Le SGF n'a qu'un fil d'execution : le moteur tourne dans celui de
+ *  l'appelant, qui ne doit utiliser ni le fichier d'une requete en
+ *  cours ni le tampon de donnees d'une requete avant qu'elle soit
+ *  terminee. Les requetes sur un meme fichier s'executent dans leur
+ *  ordre de depot.
+ *
+ *  Une requete terminee est signalee :
+ *
+ *  - par sa fonction "callback" (si elle n'est pas NULL), appelee par
+ *    le moteur ; la requete est ensuite rendue a la reserve. La
+ *    fonction peut deposer d'autres requetes mais ne doit pas faire
+ *    tourner le moteur.
+ *
+ *  - sinon dans la file des requetes terminees, d'ou sgf_async_poll
+ *    la retire ; l'appelant la rend par sgf_async_release.
+ *
+ *********************************************************************/
+
+#define AIO_OPEN                (0)
+#define AIO_READ                (1)
+#define AIO_WRITE               (2)
+
+#define AIO_PENDING             (0)
+#define AIO_DONE                (1)
+
+#define AIO_SLICE_BLOCKS        (8)     /* blocs par etape (1 Ko)   */
+#define AIO_NAME_MAX            (64)
+
+typedef struct SGF_AIO SGF_AIO;
+
+typedef void (*SGF_AIO_CALLBACK)(SGF_AIO* r, void* arg);
+
+struct SGF_AIO
+    {
+    int    op;                  /* AIO_OPEN, AIO_READ ou AIO_WRITE  */
+    int    state;               /* AIO_PENDING ou AIO_DONE          */
+    OFILE* file;                /* fichier (ouvert par AIO_OPEN)    */
+    char   name[AIO_NAME_MAX];
+    int    mode;
+    char*  data;
+    int    size;
+    int    done;                /* octets deja lus ou ecrits        */
+    int    result;              /* octets, 0 (ouverture) ou -1      */
+    SGF_AIO_CALLBACK callback;
+    void*  arg;
+    struct SGF_AIO* next;
+    };
+
+
+/**********************************************************************
+ Taille des etapes (en blocs, AIO_SLICE_BLOCKS par defaut).
+ *********************************************************************/
+
+    extern int sgf_async_slice;
+
+/**********************************************************************
+ Deposer une requete (NULL si le nom est trop long ou s'il n'y a plus
+ de memoire). L'ouverture donne le fichier dans r->file (NULL et
+ result = -1 en cas d'echec) ; une lecture s'arrete a la fin du
+ fichier et result est le nombre d'octets lus ; une ecriture donne
+ "size" ou -1.
+ *********************************************************************/
+
+    SGF_AIO* sgf_open_async (const char* nom, int mode, SGF_AIO_CALLBACK callback, void* arg);
+    SGF_AIO* sgf_read_async (OFILE* f, char* data, int size, SGF_AIO_CALLBACK callback, void* arg);
+    SGF_AIO* sgf_write_async (OFILE* f, char* data, int size, SGF_AIO_CALLBACK callback, void* arg);
+
+/**********************************************************************
+ Faire une etape du moteur ; renvoie le nombre de requetes encore
+ en cours.
+ *********************************************************************/
+
+    int sgf_async_run (void);
+    int sgf_async_pending (void);
+
+/**********************************************************************
+ Retirer la plus ancienne requete terminee sans fonction "callback"
+ (le moteur tourne tant qu'il n'y en a pas et que des requetes sont
+ en cours ; NULL s'il n'y en a plus). sgf_async_wait fait tourner le
+ moteur jusqu'a la fin de la requete "r" (sans "callback") et renvoie
+ son resultat ; la requete reste a rendre.
+ *********************************************************************/
+
+    SGF_AIO* sgf_async_poll (void);
+    int sgf_async_wait (SGF_AIO* r);
+    void sgf_async_release (SGF_AIO* r);
+
+
+#endif
@@ -0,0 +1,553 @@
+/*
+**  sgf-bulk.c
+**
+**  Import et export en masse entre le systeme hote et le SGF.
+**
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-journal.h"
+#include "sgf-bulk.h"
+
+
+int sgf_bulk_batch = BULK_BATCH;
+
+
+/**********************************************************************
+ Un morceau de fichier en transit, et un fichier a copier avec la
+ file de ses morceaux produits mais pas encore consommes.
+ *********************************************************************/
+
+typedef struct CHUNK
+    {
+    struct CHUNK* next;
+    int  len;
+    char data [ 1 ];
+    }
+    CHUNK;
+
+typedef struct JOB
+    {
+    char* path;                 /* chemin sur le systeme hote       */
+    char  name [ LONG_FILENAME ]; /* nom dans le SGF                */
+    long  size;                 /* taille (octets produits a l'export) */
+    CHUNK* head;
+    CHUNK* tail;
+    int   done;                 /* tous les morceaux sont produits  */
+    int   failed;               /* erreur du producteur             */
+    }
+    JOB;
+
+static struct
+    {
+    JOB*  jobs;
+    int   nb_jobs, capacity;
+    int   next;                 /* prochain fichier pris par un thread  */
+    int   current;              /* fichier attendu par le thread appelant (-1) */
+    long  in_flight;            /* octets en transit                */
+    BULK_REPORT* report;
+    pthread_mutex_t lock;
+    pthread_cond_t  cond;
+    }
+    bulk = { NULL, 0, 0, 0, -1, 0, NULL, PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+
+static double elapsed_ms (struct timespec* t0)
+    {
+    struct timespec t1;
+
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    return ((t1.tv_sec - t0->tv_sec) * 1e3 + (t1.tv_nsec - t0->tv_nsec) / 1e6);
+    }
+
+
+/**********************************************************************
+ Liste des fichiers.
+ *********************************************************************/
+
+static void add_job (const char* path, const char* name, long size)
+    {
+    JOB* j;
+
+    if (strlen(name) >= LONG_FILENAME)
+        {
+        fprintf(stderr, "sgf-bulk: %s : nom trop long pour le SGF\n", name);
+        bulk.report->nb_errors++;
+        return;
+        }
+    if (bulk.nb_jobs == bulk.capacity)
+        {
+        bulk.capacity = (bulk.capacity > 0) ? 2 * bulk.capacity : 256;
+        bulk.jobs = realloc(bulk.jobs, bulk.capacity * sizeof(JOB));
+        if (bulk.jobs == NULL) panic("sgf-bulk: plus de memoire.");
+        }
+
+    j = &bulk.jobs[bulk.nb_jobs++];
+    memset(j, 0, sizeof(JOB));
+    j->path = malloc(strlen(path) + 1);
+    if (j->path == NULL) panic("sgf-bulk: plus de memoire.");
+    strcpy(j->path, path);
+    strcpy(j->name, name);
+    j->size = size;
+    }
+
+
+static void free_jobs (void)
+    {
+    int k;
+
+    for(k = 0; k < bulk.nb_jobs; k++)
+        free(bulk.jobs[k].path);
+    free(bulk.jobs);
+    bulk.jobs = NULL;
+    bulk.nb_jobs = bulk.capacity = 0;
+    }
+
+
+/**********************************************************************
+ Files de morceaux. Le producteur attend tant que BULK_BUDGET octets
+ sont en transit, sauf pour le fichier attendu par le thread appelant
+ (sinon l'import pourrait se bloquer sur un fichier qu'aucun lecteur
+ ne peut plus produire).
+ *********************************************************************/
+
+static void put_chunk (JOB* j, CHUNK* c)
+    {
+    pthread_mutex_lock(&bulk.lock);
+    while (bulk.in_flight > 0  &&  bulk.in_flight + c->len > BULK_BUDGET
+           &&  (bulk.current < 0  ||  j != &bulk.jobs[bulk.current]))
+        pthread_cond_wait(&bulk.cond, &bulk.lock);
+
+    c->next = NULL;
+    if (j->tail != NULL) j->tail->next = c; else j->head = c;
+    j->tail = c;
+    bulk.in_flight += c->len;
+    pthread_cond_broadcast(&bulk.cond);
+    pthread_mutex_unlock(&bulk.lock);
+    }
+
+
+/* prochain morceau de "j" (NULL : le fichier est fini) */
+static CHUNK* get_chunk (JOB* j)
+    {
+    CHUNK* c;
+
+    pthread_mutex_lock(&bulk.lock);
+    while (j->head == NULL  &&  !j->done)
+        pthread_cond_wait(&bulk.cond, &bulk.lock);
+
+    c = j->head;
+    if (c != NULL)
+        {
+        j->head = c->next;
+        if (j->head == NULL) j->tail = NULL;
+        bulk.in_flight -= c->len;
+        pthread_cond_broadcast(&bulk.cond);
+        }
+    pthread_mutex_unlock(&bulk.lock);
+    return (c);
+    }
+
+
+static void end_job (JOB* j, int failed)
+    {
+    pthread_mutex_lock(&bulk.lock);
+    j->done = 1;
+    j->failed |= failed;
+    pthread_cond_broadcast(&bulk.cond);
+    pthread_mutex_unlock(&bulk.lock);
+    }
+
+
+static JOB* claim_job (void)
+    {
+    int i;
+
+    pthread_mutex_lock(&bulk.lock);
+    i = bulk.next++;
+    pthread_mutex_unlock(&bulk.lock);
+    return ((i < bulk.nb_jobs) ? &bulk.jobs[i] : NULL);
+    }
+
+
+static CHUNK* new_chunk (long len)
+    {
+    CHUNK* c = malloc(sizeof(CHUNK) + len);
+
+    if (c == NULL) panic("sgf-bulk: plus de memoire.");
+    return (c);
+    }
+
+
+/**********************************************************************
+ Parcours des fichiers a importer : un fichier garde son nom de base,
+ ceux d'une arborescence leur chemin relatif a sa racine.
+ *********************************************************************/
+
+static void walk (char* path, int root_len)
+    {
+    struct stat st;
+    struct dirent* e;
+    DIR* d;
+    char* sub;
+    const char* base;
+
+    if (stat(path, &st) != 0)
+        {
+        fprintf(stderr, "sgf-bulk: %s introuvable\n", path);
+        bulk.report->nb_errors++;
+        }
+    else if (S_ISREG(st.st_mode))
+        {
+        if (st.st_size > INT_MAX)
+            {
+            fprintf(stderr, "sgf-bulk: %s trop grand pour le SGF\n", path);
+            bulk.report->nb_errors++;
+            return;
+            }
+        base = strrchr(path, '/');
+        add_job(path, (root_len > 0) ? path + root_len : (base != NULL) ? base + 1 : path,
+                (long) st.st_size);
+        }
+    else if (S_ISDIR(st.st_mode)  &&  (d = opendir(path)) != NULL)
+        {
+        if (root_len == 0) root_len = strlen(path) + 1;
+        while ((e = readdir(d)) != NULL)
+            {
+            if (strcmp(e->d_name, ".") == 0  ||  strcmp(e->d_name, "..") == 0) continue;
+            sub = malloc(strlen(path) + strlen(e->d_name) + 2);
+            if (sub == NULL) panic("sgf-bulk: plus de memoire.");
+            sprintf(sub, "%s/%s", path, e->d_name);
+            walk(sub, root_len);
+            free(sub);
+            }
+        closedir(d);
+        }
+    }
+
+
+/**********************************************************************
+ Import : lecteurs du systeme hote.
+ *********************************************************************/
+
+static void* import_reader (void* arg)
+    {
+    JOB* j;
+    CHUNK* c;
+    long remaining, want, got, n;
+    int fd, failed;
+
+    while ((j = claim_job()) != NULL)
+        {
+        failed = 0;
+        if ((fd = open(j->path, O_RDONLY)) < 0)
+            failed = 1;
+        else
+            {
+            for(remaining = j->size; remaining > 0  &&  !failed; remaining -= got)
+                {
+                want = (remaining < BULK_CHUNK) ? remaining : BULK_CHUNK;
+                c = new_chunk(want);
+                for(got = 0; got < want; got += n)
+                    if ((n = read(fd, c->data + got, want - got)) <= 0) break;
+                if (n < 0) failed = 1;
+                if (got == 0)
+                    {
+                    free(c);
+                    break;
+                    }
+                c->len = got;
+                put_chunk(j, c);
+                }
+            close(fd);
+            }
+        end_job(j, failed);
+        }
+    return (NULL);
+    }
+
+
+/**********************************************************************
+ Import : ecriture dans le SGF, dans l'ordre de la liste.
+ *********************************************************************/
+
+int sgf_import (char** paths, int nb_paths, int nb_threads, BULK_REPORT* r)
+    {
+    struct timespec t0;
+    pthread_t* threads;
+    OFILE* f;
+    JOB* j;
+    CHUNK* c;
+    int saved_delalloc = sgf_delalloc_blocks, saved_batch = sgf_journal_batch;
+    int i, blocks, failed, in_batch = 0;
+
+    memset(r, 0, sizeof(BULK_REPORT));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bulk.report = r;
+    for(i = 0; i < nb_paths; i++)
+        walk(paths[i], 0);
+
+    if (nb_threads < 1) nb_threads = 1;
+    threads = calloc(nb_threads, sizeof(pthread_t));
+    if (threads == NULL) panic("sgf-bulk: plus de memoire.");
+    bulk.next = 0;
+    bulk.current = 0;
+    bulk.in_flight = 0;
+    for(i = 0; i < nb_threads; i++)
+        if (pthread_create(&threads[i], NULL, import_reader, NULL) != 0)
+            panic("sgf-bulk: impossible de creer un thread.");
+
+    /* les lots sont valides ici, pas toutes les JOURNAL_BATCH operations */
+    if (sgf_journal_batch > 0) sgf_journal_batch = INT_MAX;
+
+    for(i = 0; i < bulk.nb_jobs; i++)
+        {
+        j = &bulk.jobs[i];
+        pthread_mutex_lock(&bulk.lock);
+        bulk.current = i;
+        pthread_cond_broadcast(&bulk.cond);
+        pthread_mutex_unlock(&bulk.lock);
+
+        /* tout le fichier (jusqu'a BULK_MAX_DELALLOC blocs) est place d'un seul tenant */
+        blocks = j->size / BLOCK_SIZE + 1;
+        sgf_delalloc_blocks = (blocks < BULK_MAX_DELALLOC) ? blocks : BULK_MAX_DELALLOC;
+
+        f = sgf_open(j->name, WRITE_MODE);
+        failed = (f == NULL);
+        while ((c = get_chunk(j)) != NULL)
+            {
+            if (!failed  &&  sgf_write(f, c->data, c->len) < 0) failed = 1;
+            if (!failed) r->nb_bytes += c->len;
+            free(c);
+            }
+        if (f != NULL) sgf_close(f);
+
+        if (failed  ||  j->failed)
+            {
+            fprintf(stderr, "sgf-bulk: %s : copie impossible\n", j->path);
+            if (f != NULL) sgf_unlink(j->name);
+            r->nb_errors++;
+            }
+        else
+            r->nb_files++;
+
+        if (++in_batch >= sgf_bulk_batch)
+            {
+            sgf_journal_commit();
+            r->nb_commits++;
+            in_batch = 0;
+            }
+        }
+
+    for(i = 0; i < nb_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+
+    if (in_batch > 0)
+        {
+        sgf_journal_commit();
+        r->nb_commits++;
+        }
+    sgf_delalloc_blocks = saved_delalloc;
+    sgf_journal_batch = saved_batch;
+    bulk.current = -1;
+    free_jobs();
+
+    r->elapsed_ms = elapsed_ms(&t0);
+    return ((r->nb_errors > 0) ? -1 : 0);
+    }
+
+
+/**********************************************************************
+ Export : ecrivains du systeme hote.
+ *********************************************************************/
+
+/* creer les repertoires du chemin "path" */
+static void make_dirs (char* path)
+    {
+    char* p;
+
+    for(p = strchr(path + 1, '/'); p != NULL; p = strchr(p + 1, '/'))
+        {
+        *p = '\0';
+        mkdir(path, 0777);
+        *p = '/';
+        }
+    }
+
+static int write_all (int fd, const char* data, int len)
+    {
+    int n;
+
+    for(; len > 0; data += n, len -= n)
+        if ((n = write(fd, data, len)) <= 0) return (-1);
+    return (0);
+    }
+
+static void* export_writer (void* arg)
+    {
+    JOB* j;
+    CHUNK* c;
+    int fd, failed;
+
+    while ((j = claim_job()) != NULL)
+        {
+        make_dirs(j->path);
+        fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        failed = (fd < 0);
+        while ((c = get_chunk(j)) != NULL)
+            {
+            if (!failed  &&  write_all(fd, c->data, c->len) < 0) failed = 1;
+            free(c);
+            }
+        if (fd >= 0  &&  close(fd) != 0) failed = 1;
+
+        pthread_mutex_lock(&bulk.lock);
+        if (failed  ||  j->failed)
+            {
+            fprintf(stderr, "sgf-bulk: %s : copie impossible\n", j->name);
+            bulk.report->nb_errors++;
+            }
+        else
+            {
+            bulk.report->nb_files++;
+            bulk.report->nb_bytes += j->size;
+            }
+        pthread_mutex_unlock(&bulk.lock);
+        }
+    return (NULL);
+    }
+
+
+/* un nom du SGF ne doit pas sortir du repertoire d'arrivee */
+static int safe_name (const char* name)
+    {
+    const char* p;
+
+    if (name[0] == '\0'  ||  name[0] == '/') return (0);
+    for(p = name; p != NULL; p = strchr(p, '/'))
+        {
+        if (*p == '/') p++;
+        if (strncmp(p, "..", 2) == 0  &&  (p[2] == '/'  ||  p[2] == '\0')) return (0);
+        }
+    return (1);
+    }
+
+static void add_export (const char* dir, const char* name)
+    {
+    char* path;
+
+    if (!safe_name(name))
+        {
+        fprintf(stderr, "sgf-bulk: %s : nom refuse\n", name);
+        bulk.report->nb_errors++;
+        return;
+        }
+    path = malloc(strlen(dir) + strlen(name) + 2);
+    if (path == NULL) panic("sgf-bulk: plus de memoire.");
+    sprintf(path, "%s/%s", dir, name);
+    add_job(path, name, 0);
+    free(path);
+    }
+
+
+/**********************************************************************
+ Export : lecture du SGF, dans l'ordre de la liste.
+ *********************************************************************/
+
+int sgf_export (const char* dir, char** names, int nb_names, int nb_threads, BULK_REPORT* r)
+    {
+    struct timespec t0;
+    pthread_t* threads;
+    char name [ LONG_FILENAME ];
+    TBLOCK b;
+    OFILE* f;
+    JOB* j;
+    CHUNK* c;
+    long remaining, n;
+    int i, k, adr;
+
+    memset(r, 0, sizeof(BULK_REPORT));
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    bulk.report = r;
+
+    /* les fichiers demandes, sinon tout le repertoire */
+    for(i = 0; i < nb_names; i++)
+        add_export(dir, names[i]);
+    if (nb_names == 0)
+        {
+        read_block(ADR_BLOCK_DEF, &b.data);
+        for(adr = b.super.adr_dir; adr != FAT_EOF; adr = get_fat(adr))
+            {
+            read_block(adr, &b.data);
+            for(k = 0; k < BLOCK_DIR_SIZE; k++)
+                if (b.dir[k].inode > 0)
+                    {
+                    strncpy(name, b.dir[k].name, LONG_FILENAME - 1);
+                    name[LONG_FILENAME - 1] = '\0';
+                    add_export(dir, name);
+                    }
+            }
+        }
+
+    if (nb_threads < 1) nb_threads = 1;
+    threads = calloc(nb_threads, sizeof(pthread_t));
+    if (threads == NULL) panic("sgf-bulk: plus de memoire.");
+    bulk.next = 0;
+    bulk.current = -1;
+    bulk.in_flight = 0;
+    for(i = 0; i < nb_threads; i++)
+        if (pthread_create(&threads[i], NULL, export_writer, NULL) != 0)
+            panic("sgf-bulk: impossible de creer un thread.");
+
+    for(i = 0; i < bulk.nb_jobs; i++)
+        {
+        j = &bulk.jobs[i];
+        if ((f = sgf_open(j->name, READ_MODE)) == NULL)
+            {
+            end_job(j, 1);
+            continue;
+            }
+        remaining = f->compressed ? f->zlength : f->length;
+        while (remaining > 0)
+            {
+            c = new_chunk((remaining < BULK_CHUNK) ? remaining : BULK_CHUNK);
+            n = sgf_read(f, c->data, (remaining < BULK_CHUNK) ? remaining : BULK_CHUNK);
+            if (n <= 0)
+                {
+                free(c);
+                break;
+                }
+            c->len = n;
+            j->size += n;
+            remaining -= n;
+            put_chunk(j, c);
+            }
+        sgf_close(f);
+        end_job(j, remaining > 0);
+        }
+
+    for(i = 0; i < nb_threads; i++)
+        pthread_join(threads[i], NULL);
+    free(threads);
+    free_jobs();
+
+    r->elapsed_ms = elapsed_ms(&t0);
+    return ((r->nb_errors > 0) ? -1 : 0);
+    }
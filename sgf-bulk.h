@@ -0,0 +1,81 @@
+#ifndef __SGF_BULK__
+#define __SGF_BULK__
+
+
+/**********************************************************************
+ *
+ *  IMPORT ET EXPORT EN MASSE (SYSTEME HOTE <-> DISQUE VIRTUEL)
+ *
+ *  Les fichiers circulent par morceaux d'au plus BULK_CHUNK octets
+ *  entre trois etages qui travaillent en meme temps :
+ *
+ *  import  des threads lecteurs lisent les fichiers du systeme hote
+ *          (plusieurs fichiers a la fois) ; le thread appelant les
+ *          ecrit dans le SGF dans l'ordre de la liste. Chaque fichier
+ *          est retenu en memoire jusqu'a BULK_MAX_DELALLOC blocs
+ *          (allocation retardee, voir sgf-io.h) pour etre place d'un
+ *          seul tenant a la suite de son INODE, et les creations sont
+ *          validees par lots de sgf_bulk_batch fichiers (une seule
+ *          transaction du journal par lot).
+ *
+ *  export  le thread appelant lit les fichiers du SGF (sgf_read) dans
+ *          l'ordre du repertoire ; des threads ecrivains les ecrivent
+ *          sur le systeme hote, plusieurs fichiers a la fois.
+ *
+ *  Le SGF n'est utilise que par le thread appelant. Les morceaux en
+ *  transit occupent au plus BULK_BUDGET octets (le fichier attendu
+ *  par l'etage suivant passe toujours).
+ *
+ *  Le repertoire du SGF n'a qu'un niveau : un fichier importe d'un
+ *  repertoire du systeme hote est nomme par son chemin relatif a ce
+ *  repertoire ("src/main.c"), et l'export recree les repertoires. Les
+ *  noms de LONG_FILENAME octets ou plus sont refuses.
+ *
+ *********************************************************************/
+
+#define BULK_THREADS            (4)
+#define BULK_CHUNK              (1 << 20)       /* 1 Mo                 */
+#define BULK_BUDGET             (64 << 20)      /* 64 Mo                */
+#define BULK_BATCH              (256)           /* fichiers par lot     */
+#define BULK_MAX_DELALLOC       (8192)          /* blocs (1 Mo)         */
+
+
+/**********************************************************************
+ Compte rendu d'un import ou d'un export.
+ *********************************************************************/
+
+typedef struct BULK_REPORT
+    {
+    int    nb_files;            /* fichiers copies                  */
+    int    nb_errors;           /* fichiers refuses ou en erreur    */
+    int    nb_commits;          /* lots valides (import)            */
+    long   nb_bytes;            /* octets copies                    */
+    double elapsed_ms;          /* duree totale                     */
+    }
+    BULK_REPORT;
+
+
+/**********************************************************************
+ Fichiers par validation du journal a l'import (BULK_BATCH).
+ *********************************************************************/
+
+    extern int sgf_bulk_batch;
+
+/**********************************************************************
+ Importer les fichiers et les arborescences "paths" du systeme hote
+ dans le SGF avec "nb_threads" lecteurs. Renvoie -1 si un fichier n'a
+ pas pu etre copie.
+ *********************************************************************/
+
+    int sgf_import (char** paths, int nb_paths, int nb_threads, BULK_REPORT* r);
+
+/**********************************************************************
+ Exporter les fichiers "names" du SGF (tous si nb_names vaut 0) dans
+ le repertoire "dir" du systeme hote avec "nb_threads" ecrivains.
+ Renvoie -1 si un fichier n'a pas pu etre copie.
+ *********************************************************************/
+
+    int sgf_export (const char* dir, char** names, int nb_names, int nb_threads, BULK_REPORT* r);
+
+
+#endif
@@ -0,0 +1,503 @@
+
+/*
+**  sgf-check.c
+**
+**  Verification (et reparation) de la coherence FAT / repertoire /
+**  INODEs.
+**
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-check.h"
+#include "sgf-refcount.h"
+#include "sgf-journal.h"
+
+
+#define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+
+#define OWNER_NONE              (0)     /* bloc sans proprietaire   */
+#define OWNER_DIR               (1)     /* chaine du repertoire     */
+#define OWNER_FILE(i)           ((i) + 2)
+
+#define CHAIN_OK                (0)
+#define CHAIN_BAD_LINK          (1)
+#define CHAIN_CYCLE             (2)
+#define CHAIN_CROSS             (3)
+
+
+/**********************************************************************
+ *
+ *  Etat d'une verification.
+ *
+ *********************************************************************/
+
+typedef struct CHECK_FILE       /* Un fichier du repertoire         */
+    {                           /* -------------------------------- */
+    char  name[LONG_FILENAME];  /* nom du fichier                   */
+    int   dir_block;            /* bloc repertoire de l'entree      */
+    int   slot;                 /* position dans ce bloc            */
+    int   inode;                /* adresse du descripteur           */
+    INODE ino;                  /* descripteur lu sur disque        */
+    int   nb_blocks;            /* blocs parcourus dans la chaine   */
+    int   end;                  /* dernier bloc valide (ou -1)      */
+    int   problem;              /* CHAIN_xxx                        */
+    int   other;                /* proprietaire rencontre (CROSS)   */
+    int   bad_inode;            /* first/last/length incoherents    */
+    }
+    CHECK_FILE;
+
+typedef struct CHECK_STATE
+    {
+    int          disk_size;     /* taille du disque en blocs        */
+    int          fat_blocks;    /* taille de la FAT en blocs        */
+    int*         owner;         /* proprietaire de chaque bloc      */
+    CHECK_FILE*  files;         /* fichiers du repertoire           */
+    int          nb_files;
+    int          next_file;     /* prochain fichier a parcourir     */
+    int          nb_threads;
+    }
+    CHECK_STATE;
+
+typedef struct CHECK_WORKER     /* Un thread de verification        */
+    {
+    CHECK_STATE* state;
+    int          id;
+    int          nb_blocks;     /* compteurs locaux (sans verrou)   */
+    int          nb_leaked_inodes;
+    int          nb_orphan_blocks;
+    int          nb_bad_entries;
+    }
+    CHECK_WORKER;
+
+
+/**********************************************************************
+ Vrai si la valeur "v" est une entree de chaine (bloc de donnees).
+ *********************************************************************/
+
+static int is_chain_entry (int v)
+    {
+    return (v >= 0  ||  v == FAT_EOF);
+    }
+
+
+/**********************************************************************
+ Nombre de blocs que doit avoir la chaine d'un fichier (les blocs de
+ ses trous n'y sont pas), -1 si ses trous sont incoherents.
+ *********************************************************************/
+
+static int chain_blocks (INODE* ino)
+    {
+    int h, n, end = 0;
+
+    n = PAR_EXCES(ino->length, BLOCK_SIZE);
+    if (ino->hole_signature != SIGNATURE_HOLES) return (n);
+    if (ino->nb_holes < 0  ||  ino->nb_holes > (int) INODE_MAX_HOLES) return (-1);
+
+    for(h = 0; h < ino->nb_holes; h++)
+        {
+        if (ino->holes[h].start < end  ||  ino->holes[h].count <= 0) return (-1);
+        end = ino->holes[h].start + ino->holes[h].count;
+        n -= ino->holes[h].count;
+        }
+
+    /* le dernier bloc n'est jamais dans un trou */
+    if (ino->nb_holes > 0  &&  end >= PAR_EXCES(ino->length, BLOCK_SIZE)) return (-1);
+    return (n);
+    }
+
+
+
+/**********************************************************************
+ Parcourir la chaine d'un fichier en revendiquant chacun de ses blocs.
+ La revendication est atomique: un bloc deja possede par un autre
+ fichier est un chainage croise, un bloc deja possede par le meme
+ fichier est un cycle. Un bloc deja possede dont le compteur de
+ references est non nul est la jonction d'un clone : la fin de la
+ chaine est parcourue sans la revendiquer.
+ *********************************************************************/
+
+static void check_chain (CHECK_STATE* st, int i)
+    {
+    CHECK_FILE* f = &st->files[i];
+    int me = OWNER_FILE(i);
+    int adr, old, v, joined, steps;
+
+    f->nb_blocks = 0;
+    f->end = -1;
+    f->problem = CHAIN_OK;
+    joined = steps = 0;
+
+    adr = f->ino.first;
+    while (adr != FAT_EOF)
+        {
+        if (adr <= 0  ||  adr >= st->disk_size)
+            {
+            f->problem = CHAIN_BAD_LINK;
+            break;
+            }
+
+        v = get_fat(adr);
+        if (!is_chain_entry(v))
+            {
+            f->problem = CHAIN_BAD_LINK;
+            break;
+            }
+
+        if (joined)
+            {
+            if (++steps > st->disk_size)
+                {
+                f->problem = CHAIN_CYCLE;
+                break;
+                }
+            }
+        else
+            {
+            old = __sync_val_compare_and_swap(&st->owner[adr], OWNER_NONE, me);
+            if (old == me)
+                {
+                f->problem = CHAIN_CYCLE;
+                break;
+                }
+            if (old != OWNER_NONE  &&  get_refcount(adr) > 0)
+                joined = 1;
+            else if (old != OWNER_NONE)
+                {
+                f->problem = CHAIN_CROSS;
+                f->other = old;
+                break;
+                }
+            }
+
+        f->nb_blocks++;
+        f->end = adr;
+        adr = v;
+        }
+
+    /* comparer la chaine avec le descripteur */
+    f->bad_inode = 0;
+    if (f->ino.length < 0)
+        f->bad_inode = 1;
+    else if (f->problem == CHAIN_OK)
+        {
+        if (f->nb_blocks != chain_blocks(&f->ino))
+            f->bad_inode = 1;
+        if (f->nb_blocks == 0  &&  f->ino.last != FAT_EOF)
+            f->bad_inode = 1;
+        if (f->nb_blocks > 0  &&  f->ino.last != f->end)
+            f->bad_inode = 1;
+        }
+    }
+
+
+/**********************************************************************
+ Travail d'un thread : parcourir les chaines des fichiers (distribues
+ dynamiquement), puis, apres la barriere, balayer sa tranche de FAT
+ a la recherche d'orphelins.
+ *********************************************************************/
+
+static pthread_barrier_t check_barrier;
+
+static void* check_worker (void* arg)
+    {
+    CHECK_WORKER* w = arg;
+    CHECK_STATE* st = w->state;
+    int i, k, v, from, to;
+
+    for(;;)
+        {
+        i = __sync_fetch_and_add(&st->next_file, 1);
+        if (i >= st->nb_files) break;
+        check_chain(st, i);
+        }
+
+    pthread_barrier_wait(&check_barrier);
+
+    from = (int) (((long) st->disk_size * w->id) / st->nb_threads);
+    to   = (int) (((long) st->disk_size * (w->id + 1)) / st->nb_threads);
+
+    for(k = from; k < to; k++)
+        {
+        v = get_fat(k);
+        if (k <= st->fat_blocks)
+            {
+            if (v != FAT_RESERVED) w->nb_bad_entries++;
+            continue;
+            }
+        if (v >= st->disk_size  ||  (v < FAT_EOF  &&  v != FAT_SNAPSHOT))
+            {
+            w->nb_bad_entries++;
+            if (st->owner[k] == OWNER_NONE) w->nb_orphan_blocks++;
+            }
+        else if (v == FAT_INODE)
+            {
+            if (st->owner[k] == OWNER_NONE) w->nb_leaked_inodes++;
+            }
+        else if (is_chain_entry(v))
+            {
+            if (st->owner[k] == OWNER_NONE) w->nb_orphan_blocks++;
+            else w->nb_blocks++;
+            }
+        }
+
+    return (NULL);
+    }
+
+
+/**********************************************************************
+ Parcourir le repertoire (sequentiellement) : revendiquer ses blocs,
+ relever les entrees et lire les INODEs.
+ *********************************************************************/
+
+static void load_directory (CHECK_STATE* st, int verbose, int repair,
+                            CHECK_REPORT* r)
+    {
+    TBLOCK b, ib;
+    CHECK_FILE* f;
+    int adr, prev, v, j, inode, capacity;
+
+    capacity = 0;
+    read_block(ADR_BLOCK_DEF, &b.data);
+
+    prev = -1;
+    adr = b.super.adr_dir;
+    while (adr != FAT_EOF)
+        {
+        if (adr <= st->fat_blocks  ||  adr >= st->disk_size  ||
+            !is_chain_entry(get_fat(adr))  ||  st->owner[adr] != OWNER_NONE)
+            {
+            if (verbose)
+                printf("repertoire: chaine invalide apres le bloc %d\n", prev);
+            r->nb_bad_links++;
+            if (repair  &&  prev > 0)
+                {
+                set_fat(prev, FAT_EOF);
+                r->nb_repaired++;
+                }
+            break;
+            }
+        st->owner[adr] = OWNER_DIR;
+
+        read_block(adr, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++)
+            {
+            if (b.dir[j].inode <= 0) continue;
+
+            inode = b.dir[j].inode;
+            if (inode >= st->disk_size  ||  get_fat(inode) != FAT_INODE  ||
+                st->owner[inode] != OWNER_NONE)
+                {
+                if (verbose)
+                    printf("entree \"%.*s\": inode %d invalide\n",
+                           (int) LONG_FILENAME - 1, b.dir[j].name, inode);
+                r->nb_dangling_entries++;
+                if (repair)
+                    {
+                    b.dir[j].inode = 0;
+                    write_meta_block(adr, &b.data);
+                    r->nb_repaired++;
+                    }
+                continue;
+                }
+
+            if (st->nb_files == capacity)
+                {
+                capacity = (capacity == 0) ? 64 : 2 * capacity;
+                st->files = realloc(st->files, capacity * sizeof(CHECK_FILE));
+                if (st->files == NULL)
+                    panic("sgf_check: plus de memoire.");
+                }
+
+            f = &st->files[st->nb_files];
+            memset(f, 0, sizeof(CHECK_FILE));
+            strncpy(f->name, b.dir[j].name, LONG_FILENAME - 1);
+            f->dir_block = adr;
+            f->slot = j;
+            f->inode = inode;
+            st->owner[inode] = OWNER_FILE(st->nb_files);
+            st->nb_files++;
+            }
+
+        v = get_fat(adr);
+        prev = adr;
+        adr = v;
+        }
+
+    for(j = 0; j < st->nb_files; j++)
+        {
+        read_block(st->files[j].inode, &ib.data);
+        st->files[j].ino = ib.inode;
+        }
+    }
+
+
+/**********************************************************************
+ Reparer un fichier : tronquer la chaine au dernier bloc valide et
+ reecrire un INODE coherent avec cette chaine.
+ *********************************************************************/
+
+static void repair_file (CHECK_STATE* st, CHECK_FILE* f)
+    {
+    TBLOCK b;
+    int keep, k, adr, next;
+
+    if (f->ino.length < 0) f->ino.length = 0;
+
+    /* des trous incoherents, ou qu'une chaine trop courte ne remplit pas, sont oublies */
+    keep = chain_blocks(&f->ino);
+    if (keep < 0  ||  keep > f->nb_blocks)
+        {
+        f->ino.hole_signature = SIGNATURE_HOLES;
+        f->ino.nb_holes = 0;
+        keep = PAR_EXCES(f->ino.length, BLOCK_SIZE);
+        }
+    if (keep > f->nb_blocks) keep = f->nb_blocks;
+
+    /* liberer la fin de chaine (elle deviendra orpheline) */
+    if (keep < f->nb_blocks)
+        {
+        adr = f->ino.first;
+        for(k = 1; k < keep; k++) adr = get_fat(adr);
+        next = (keep == 0) ? adr : get_fat(adr);
+        f->end = (keep == 0) ? -1 : adr;
+        for(k = keep; k < f->nb_blocks; k++)
+            {
+            st->owner[next] = OWNER_NONE;
+            next = get_fat(next);
+            }
+        f->nb_blocks = keep;
+        }
+
+    if (f->end > 0  &&  get_fat(f->end) != FAT_EOF)
+        set_fat(f->end, FAT_EOF);
+
+    if (chain_blocks(&f->ino) > f->nb_blocks)
+        f->ino.length = f->nb_blocks * BLOCK_SIZE;
+
+    f->ino.first = (f->nb_blocks == 0) ? FAT_EOF : f->ino.first;
+    f->ino.last  = (f->nb_blocks == 0) ? FAT_EOF : f->end;
+
+    b.inode = f->ino;
+    write_meta_block(f->inode, &b.data);
+    }
+
+
+/**********************************************************************
+ Point d'entree de la verification.
+ *********************************************************************/
+
+int sgf_check (int nb_threads, int repair, int verbose, CHECK_REPORT* r)
+    {
+    CHECK_STATE st;
+    CHECK_WORKER* workers;
+    pthread_t* threads;
+    CHECK_FILE* f;
+    int i, k, v;
+
+    memset(r, 0, sizeof(CHECK_REPORT));
+    memset(&st, 0, sizeof(CHECK_STATE));
+
+    if (nb_threads < 1) nb_threads = 1;
+    st.nb_threads = nb_threads;
+    st.disk_size = get_disk_size();
+    st.fat_blocks = get_fat_size_in_blocks();
+    st.owner = calloc(st.disk_size, sizeof(int));
+    workers = calloc(nb_threads, sizeof(CHECK_WORKER));
+    threads = calloc(nb_threads, sizeof(pthread_t));
+    if (st.owner == NULL  ||  workers == NULL  ||  threads == NULL)
+        panic("sgf_check: plus de memoire.");
+
+    /* phase 1 : repertoire et INODEs (E/S sequentielles) */
+    load_directory(&st, verbose, repair, r);
+    r->nb_files = st.nb_files;
+
+    /* phase 2 : chaines et balayage de la FAT en parallele */
+    pthread_barrier_init(&check_barrier, NULL, nb_threads);
+    for(i = 0; i < nb_threads; i++)
+        {
+        workers[i].state = &st;
+        workers[i].id = i;
+        if (i > 0  &&  pthread_create(&threads[i], NULL, check_worker, &workers[i]) != 0)
+            panic("sgf_check: impossible de creer un thread.");
+        }
+    check_worker(&workers[0]);
+    for(i = 1; i < nb_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&check_barrier);
+
+    for(i = 0; i < nb_threads; i++)
+        {
+        r->nb_blocks        += workers[i].nb_blocks;
+        r->nb_leaked_inodes += workers[i].nb_leaked_inodes;
+        r->nb_orphan_blocks += workers[i].nb_orphan_blocks;
+        r->nb_bad_entries   += workers[i].nb_bad_entries;
+        }
+
+    /* phase 3 : bilan et reparations (sequentiels) */
+    for(i = 0; i < st.nb_files; i++)
+        {
+        f = &st.files[i];
+        switch (f->problem)
+            {
+            case CHAIN_BAD_LINK: r->nb_bad_links++;   break;
+            case CHAIN_CYCLE:    r->nb_cycles++;      break;
+            case CHAIN_CROSS:    r->nb_cross_links++; break;
+            }
+        if (f->bad_inode) r->nb_bad_inodes++;
+
+        if (verbose  &&  f->problem != CHAIN_OK)
+            printf("fichier \"%s\" (inode %d): %s apres %d bloc(s)\n",
+                   f->name, f->inode,
+                   (f->problem == CHAIN_CYCLE) ? "cycle" :
+                   (f->problem == CHAIN_CROSS) ? "chainage croise" :
+                   "chainage invalide", f->nb_blocks);
+        if (verbose  &&  f->bad_inode)
+            printf("fichier \"%s\" (inode %d): length=%d first=%d last=%d "
+                   "mais %d bloc(s) dans la chaine\n", f->name, f->inode,
+                   f->ino.length, f->ino.first, f->ino.last, f->nb_blocks);
+
+        if (repair  &&  (f->problem != CHAIN_OK  ||  f->bad_inode))
+            {
+            repair_file(&st, f);
+            r->nb_repaired++;
+            }
+        }
+
+    if (verbose  &&  r->nb_orphan_blocks + r->nb_leaked_inodes > 0)
+        printf("%d bloc(s) orphelin(s), %d inode(s) perdu(s)\n",
+               r->nb_orphan_blocks, r->nb_leaked_inodes);
+
+    if (repair)
+        for(k = st.fat_blocks + 1; k < st.disk_size; k++)
+            {
+            if (st.owner[k] != OWNER_NONE) continue;
+            v = get_fat(k);
+            if (v == FAT_FREE  ||  v == FAT_RESERVED  ||  v == FAT_SNAPSHOT) continue;
+            set_fat(k, FAT_FREE);
+            r->nb_repaired++;
+            }
+
+    r->nb_errors = r->nb_dangling_entries + r->nb_bad_inodes + r->nb_bad_links
+                 + r->nb_cycles + r->nb_cross_links + r->nb_leaked_inodes
+                 + r->nb_orphan_blocks + r->nb_bad_entries;
+
+    /* les reparations forment une seule transaction du journal */
+    if (repair) sgf_journal_commit();
+
+    free(st.files);
+    free(st.owner);
+    free(workers);
+    free(threads);
+
+    return (r->nb_errors);
+    }
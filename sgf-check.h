@@ -0,0 +1,47 @@
+
+#ifndef __SGF_CHECK__
+#define __SGF_CHECK__
+
+
+/**********************************************************************
+ *
+ *  VERIFICATION DE LA COHERENCE D'UN DISQUE (fsck)
+ *
+ *  La verification croise la FAT, le repertoire et les INODEs :
+ *  chaque chaine de blocs doit appartenir a un seul fichier, se
+ *  terminer par FAT_EOF et correspondre aux champs first/last/length
+ *  de son INODE. Les parcours de la FAT sont repartis sur plusieurs
+ *  threads.
+ *
+ *********************************************************************/
+
+typedef struct CHECK_REPORT     /* Resultat d'une verification      */
+    {                           /* -------------------------------- */
+    int  nb_files;              /* entrees valides du repertoire    */
+    int  nb_blocks;             /* blocs appartenant a un fichier   */
+    int  nb_dangling_entries;   /* entree -> inode invalide         */
+    int  nb_bad_inodes;         /* first/last/length incoherents    */
+    int  nb_bad_links;          /* chaine vers un bloc non chaine   */
+    int  nb_cycles;             /* chaine qui boucle                */
+    int  nb_cross_links;        /* bloc possede par deux fichiers   */
+    int  nb_leaked_inodes;      /* FAT_INODE sans entree            */
+    int  nb_orphan_blocks;      /* bloc chaine sans proprietaire    */
+    int  nb_bad_entries;        /* valeur de FAT hors limites       */
+    int  nb_errors;             /* total des anomalies              */
+    int  nb_repaired;           /* anomalies corrigees              */
+    }
+    CHECK_REPORT;
+
+
+/**********************************************************************
+ Verifier le disque monte (init_sgf doit avoir ete appele) avec
+ "nb_threads" threads. Si "repair" est non nul les anomalies sont
+ corrigees (troncature des chaines, liberation des orphelins).
+ La fonction renvoie le nombre d'anomalies trouvees.
+ *********************************************************************/
+
+    int sgf_check (int nb_threads, int repair, int verbose,
+                   CHECK_REPORT* report);
+
+
+#endif
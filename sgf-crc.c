@@ -0,0 +1,440 @@
+
+/*
+**  sgf-crc.c
+**
+**  Sommes de controle (CRC32C) des blocs du disque.
+**
+*/
+
+#define _POSIX_C_SOURCE 200112L         /* clock_gettime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-journal.h"
+#include "sgf-crc.h"
+
+
+#define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+
+#define SUMS_PER_BLOCK          (BLOCK_SIZE / sizeof(unsigned int))
+
+#define CASTAGNOLI              (0x82F63B78)    /* polynome (bits inverses) */
+
+#if defined(__GNUC__)  &&  defined(__x86_64__)
+#define CRC_SSE42
+#endif
+
+
+int sgf_verify_checksums = CHECKSUM_REPORT;
+int sgf_scrub_rate = 0;
+
+static CRC_COUNTERS counters;
+
+
+/**********************************************************************
+ *
+ *  CALCUL DU CRC32C
+ *
+ *********************************************************************/
+
+/* tables de la version portable : table[k][x] est le CRC de l'octet x
+   suivi de k octets nuls */
+static unsigned int table[8][256];
+static int table_ready = 0;
+
+static void make_tables (void)
+    {
+    unsigned int c;
+    int k, x;
+
+    for(x = 0; x < 256; x++)
+        {
+        c = x;
+        for(k = 0; k < 8; k++)
+            c = (c & 1) ? (c >> 1) ^ CASTAGNOLI : (c >> 1);
+        table[0][x] = c;
+        }
+    for(x = 0; x < 256; x++)
+        for(k = 1; k < 8; k++)
+            table[k][x] = (table[k - 1][x] >> 8) ^ table[0][table[k - 1][x] & 0xFF];
+
+    table_ready = 1;
+    }
+
+unsigned int crc32c_portable (unsigned int crc, const char* data, int len)
+    {
+    const unsigned char* p = (const unsigned char*) data;
+    unsigned int lo, hi;
+
+    if (!table_ready) make_tables();
+
+    crc = ~crc;
+    for(; len >= 8; len -= 8, p += 8)
+        {
+        lo = crc ^ (p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int) p[3] << 24));
+        hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((unsigned int) p[7] << 24);
+        crc = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF]
+            ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24]
+            ^ table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF]
+            ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        }
+    for(; len > 0; len--, p++)
+        crc = (crc >> 8) ^ table[0][(crc ^ *p) & 0xFF];
+
+    return (~crc);
+    }
+
+#ifdef CRC_SSE42
+/* instruction crc32 de SSE4.2 : 8 octets par instruction, quatre par
+   tour (x86 lit les mots non alignes) */
+__attribute__((target("sse4.2")))
+static unsigned int crc32c_sse42 (unsigned int crc, const char* data, int len)
+    {
+    const unsigned long* w = (const unsigned long*) data;
+    unsigned long c = ~crc & 0xFFFFFFFFUL;
+
+    for(; len >= 32; len -= 32, w += 4)
+        {
+        c = __builtin_ia32_crc32di(c, w[0]);
+        c = __builtin_ia32_crc32di(c, w[1]);
+        c = __builtin_ia32_crc32di(c, w[2]);
+        c = __builtin_ia32_crc32di(c, w[3]);
+        }
+    for(; len >= 8; len -= 8, w++)
+        c = __builtin_ia32_crc32di(c, *w);
+
+    data = (const char*) w;
+    crc = (unsigned int) c;
+    for(; len > 0; len--, data++)
+        crc = __builtin_ia32_crc32qi(crc, (unsigned char) *data);
+
+    return (~crc);
+    }
+#endif
+
+static unsigned int (*crc_impl)(unsigned int crc, const char* data, int len) = NULL;
+
+static void choose_impl (void)
+    {
+    crc_impl = crc32c_portable;
+#ifdef CRC_SSE42
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) crc_impl = crc32c_sse42;
+#endif
+    }
+
+unsigned int crc32c (unsigned int crc, const char* data, int len)
+    {
+    if (crc_impl == NULL) choose_impl();
+    return (crc_impl(crc, data, len));
+    }
+
+int crc32c_hardware (void)
+    {
+    if (crc_impl == NULL) choose_impl();
+    return (crc_impl != crc32c_portable);
+    }
+
+
+/**********************************************************************
+ *
+ *  La table en memoire centrale (NULL si le disque n'en a pas).
+ *
+ *********************************************************************/
+
+static unsigned int* sums = NULL;
+static char* modif = NULL;              /* bloc de la table a ecrire */
+static int adr_table = -1;
+static int nb_table_blocks = 0;
+static int disk_size = 0;
+
+/* le journal n'est pas couvert */
+static int journal_first = 0;
+static int journal_end = 0;
+
+static int scrub_pos = 0;
+static int scrubbing = 0;               /* le parcours verifie lui-meme */
+
+#define COVERED(n)      (!((n) >= adr_table  &&  (n) < adr_table + nb_table_blocks) \
+                         &&  !((n) >= journal_first  &&  (n) < journal_end))
+
+
+/* somme d'un bloc (jamais nulle) */
+static unsigned int block_sum (BLOCK* b)
+    {
+    unsigned int s = crc32c(0, (const char*) b, BLOCK_SIZE);
+    return ((s == 0) ? 1 : s);
+    }
+
+static void set_sum (int n, unsigned int s)
+    {
+    if (sums[n] == s) return;
+    sums[n] = s;
+    modif[n / SUMS_PER_BLOCK] = 1;
+    }
+
+static void report (int n, unsigned int found)
+    {
+    counters.nb_errors++;
+    if (sgf_verify_checksums == CHECKSUM_PANIC  &&  !scrubbing)
+        panic("sgf-crc: bloc %d altere (somme %08x au lieu de %08x).", n, found, sums[n]);
+    fprintf(stderr, "sgf-crc: bloc %d altere (somme %08x au lieu de %08x)\n", n, found, sums[n]);
+    }
+
+
+/**********************************************************************
+ Fonctions appelees par write_block et read_block.
+ *********************************************************************/
+
+static void on_write (int n, BLOCK* b)
+    {
+    if (!COVERED(n)) return;
+
+    set_sum(n, block_sum(b));
+    counters.nb_computed++;
+    }
+
+static void on_read (int n, BLOCK* b)
+    {
+    unsigned int s;
+
+    if (sgf_verify_checksums == CHECKSUM_OFF  ||  scrubbing) return;
+    if (!COVERED(n)  ||  sums[n] == 0) return;
+
+    s = block_sum(b);
+    counters.nb_verified++;
+    if (s != sums[n]) report(n, s);
+    }
+
+
+/**********************************************************************
+ Charger la table.
+ *********************************************************************/
+
+static void note_areas (SUPER_BLOCK* s)
+    {
+    adr_table = s->adr_checksums;
+    nb_table_blocks = s->nb_checksum_blocks;
+    journal_first = journal_end = 0;
+    if (s->adr_journal > 0)
+        {
+        journal_first = s->adr_journal;
+        journal_end = journal_first + s->nb_journal_blocks;
+        }
+    }
+
+void init_sgf_crc (void)
+    {
+    TBLOCK b;
+    int k;
+
+    close_sgf_crc();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT  ||  b.super.adr_checksums <= 0)
+        return;
+
+    disk_size = get_disk_size();
+    note_areas(&b.super);
+    sums = malloc((long) nb_table_blocks * BLOCK_SIZE);
+    modif = calloc(nb_table_blocks, 1);
+    if (sums == NULL  ||  modif == NULL)
+        panic("init_sgf_crc: plus de memoire.");
+
+    for(k = 0; k < nb_table_blocks; k++)
+        read_block(adr_table + k, (BLOCK*) ((char*) sums + (long) k * BLOCK_SIZE));
+
+    scrub_pos = 0;
+    set_checksum_hooks(on_write, on_read);
+    }
+
+void close_sgf_crc (void)
+    {
+    if (sums != NULL) save_checksums();
+
+    set_checksum_hooks(NULL, NULL);
+    free(sums);
+    free(modif);
+    sums = NULL;
+    modif = NULL;
+    adr_table = -1;
+    nb_table_blocks = 0;
+    journal_first = journal_end = 0;
+    }
+
+int has_checksums (void)
+    {
+    return (sums != NULL);
+    }
+
+
+/**********************************************************************
+ Creer la table : une suite de blocs reserves a la suite de la FAT.
+ Tout est d'abord mis en place par le journal, pour que les sommes
+ soient celles des blocs du disque.
+ *********************************************************************/
+
+int create_checksum_table (void)
+    {
+    TBLOCK b;
+    int k, nb, adr;
+
+    if (sums != NULL) return (0);
+
+    disk_size = get_disk_size();
+    nb = PAR_EXCES(disk_size, SUMS_PER_BLOCK);
+    adr = find_free_extent(nb, get_fat_size_in_blocks() + ADR_BLOCK_FAT);
+    if (adr < 0) return (-1);
+
+    for(k = 0; k < nb; k++)
+        set_fat_lazy(adr + k, FAT_RESERVED);
+    save_fat();
+    sgf_journal_checkpoint();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT)
+        {
+        memset((char*) &b + 2 * sizeof(int), 0, BLOCK_SIZE - 2 * sizeof(int));
+        b.super.ext_signature = SIGNATURE_SUPER_EXT;
+        b.super.adr_refcount = -1;
+        b.super.adr_snapshots = -1;
+        b.super.adr_journal = -1;
+        }
+    b.super.adr_checksums = adr;
+    b.super.nb_checksum_blocks = nb;
+    note_areas(&b.super);
+
+    sums = calloc(nb, BLOCK_SIZE);
+    modif = malloc(nb);
+    if (sums == NULL  ||  modif == NULL)
+        panic("create_checksum_table: plus de memoire.");
+    memset(modif, 1, nb);
+
+    /* les sommes des blocs utilises (le super bloc est ecrit ensuite) */
+    for(k = 1; k < disk_size; k++)
+        if (get_fat(k) != FAT_FREE  &&  COVERED(k))
+            {
+            read_block(k, (BLOCK*) &b.data);
+            sums[k] = block_sum(&b.data);
+            counters.nb_computed++;
+            }
+
+    scrub_pos = 0;
+    set_checksum_hooks(on_write, on_read);
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    b.super.adr_checksums = adr;
+    b.super.nb_checksum_blocks = nb;
+    write_block(ADR_BLOCK_DEF, &b.data);
+    save_checksums();
+
+    return (0);
+    }
+
+
+/**********************************************************************
+ Sauver les blocs modifies de la table.
+ *********************************************************************/
+
+void save_checksums (void)
+    {
+    int k;
+
+    for(k = 0; k < nb_table_blocks; k++)
+        if (modif[k])
+            {
+            write_block(adr_table + k, (BLOCK*) ((char*) sums + (long) k * BLOCK_SIZE));
+            modif[k] = 0;
+            }
+    }
+
+
+/**********************************************************************
+ *
+ *  PARCOURS DES BLOCS UTILISES
+ *
+ *********************************************************************/
+
+int scrub_blocks (int nb, int repair)
+    {
+    BLOCK b;
+    unsigned int s;
+    int n, done = 0, bad = 0;
+
+    if (sums == NULL) return (0);
+
+    scrubbing = 1;
+    for(; scrub_pos < disk_size  &&  done < nb; scrub_pos++)
+        {
+        n = scrub_pos;
+        if (!COVERED(n)  ||  sums[n] == 0  ||  get_fat(n) == FAT_FREE) continue;
+
+        /* le bloc tel qu'il est sur le disque, et non la version du journal */
+        read_disk_block(n, &b);
+        s = block_sum(&b);
+        done++;
+        counters.nb_scrubbed++;
+        if (s == sums[n]) continue;
+
+        report(n, s);
+        bad++;
+        if (repair)
+            {
+            set_sum(n, s);
+            counters.nb_repaired++;
+            }
+        }
+    if (scrub_pos >= disk_size) scrub_pos = 0;
+    scrubbing = 0;
+
+    if (repair  &&  bad > 0) save_checksums();
+    return (bad);
+    }
+
+int scrub_position (void)
+    {
+    return (scrub_pos);
+    }
+
+int sgf_scrub_step (void)
+    {
+    static struct timespec last = {0, 0};
+    struct timespec now;
+    double budget;
+
+    if (sgf_scrub_rate <= 0  ||  sums == NULL) return (0);
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if (last.tv_sec == 0  &&  last.tv_nsec == 0)
+        {
+        last = now;
+        return (0);
+        }
+
+    budget = ((now.tv_sec - last.tv_sec) + (now.tv_nsec - last.tv_nsec) / 1e9) * sgf_scrub_rate;
+    if (budget < 1) return (0);
+
+    last = now;
+    return (scrub_blocks((budget > SCRUB_MAX_STEP) ? SCRUB_MAX_STEP : (int) budget, 0));
+    }
+
+
+/**********************************************************************
+ Compteurs.
+ *********************************************************************/
+
+void get_crc_counters (CRC_COUNTERS* c)
+    {
+    *c = counters;
+    }
+
+void reset_crc_counters (void)
+    {
+    memset(&counters, 0, sizeof(counters));
+    }
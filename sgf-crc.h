@@ -0,0 +1,123 @@
+
+#ifndef __SGF_CRC__
+#define __SGF_CRC__
+
+
+/**********************************************************************
+ *
+ *  SOMMES DE CONTROLE DES BLOCS (CRC32C)
+ *
+ *  La table des sommes est parallele a la FAT : quatre octets par
+ *  bloc du disque, dans une suite de blocs FAT_RESERVED notee dans le
+ *  super bloc. Elle n'existe que si elle a ete creee (sgf-scrub -c) ;
+ *  la somme de chaque bloc utilise est alors calculee.
+ *
+ *  write_block met a jour la somme de chaque bloc ecrit et read_block
+ *  verifie celle de chaque bloc lu sur le disque (une version gardee
+ *  en memoire par le journal n'est pas verifiee). Les blocs du journal
+ *  (qui a ses propres sommes) et ceux de la table ne sont pas couverts.
+ *  Une somme nulle signifie "inconnue" (bloc jamais ecrit depuis la
+ *  creation de la table) : une somme calculee nulle est notee 1.
+ *
+ *  La table est ecrite directement (hors journal) a chaque validation
+ *  du journal et a la fermeture du disque : apres un arret brutal,
+ *  les blocs ecrits depuis peuvent avoir une somme perimee. sgf-scrub
+ *  -r les signale puis recalcule leur somme.
+ *
+ *  Le calcul utilise l'instruction crc32 de SSE4.2 quand le processeur
+ *  la possede (le bloc est traite par mots de 8 octets), sinon une
+ *  version portable par tables (8 octets par tour). La verification
+ *  n'est pas gratuite : environ 15 a 20 % sur un read_block servi par
+ *  le cache du systeme (sgf-bench-crc), beaucoup moins vu de sgf_getc.
+ *
+ *********************************************************************/
+
+#define CHECKSUM_OFF            (0)     /* pas de verification          */
+#define CHECKSUM_REPORT         (1)     /* message et compteur (defaut) */
+#define CHECKSUM_PANIC          (2)     /* arret de la simulation       */
+
+#define SCRUB_MAX_STEP          (1024)  /* blocs par etape au plus      */
+
+
+/**********************************************************************
+ Verification a la lecture (CHECKSUM_REPORT par defaut) et debit du
+ parcours de fond en blocs par seconde (0 par defaut : pas de
+ parcours). Le parcours n'avance que lorsque l'application appelle
+ sgf_scrub_step, typiquement quand elle n'a rien d'autre a faire.
+ *********************************************************************/
+
+    extern int sgf_verify_checksums;
+    extern int sgf_scrub_rate;
+
+/**********************************************************************
+ CRC32C (polynome de Castagnoli) de "len" octets, a la suite de "crc"
+ (0 pour commencer). crc32c choisit la version materielle si elle est
+ disponible ; crc32c_hardware indique si c'est le cas.
+ *********************************************************************/
+
+    unsigned int crc32c (unsigned int crc, const char* data, int len);
+    unsigned int crc32c_portable (unsigned int crc, const char* data, int len);
+    int crc32c_hardware (void);
+
+/**********************************************************************
+ Charger la table du disque courant (avant le rejeu du journal), ou
+ l'ecrire et l'oublier (avant un changement de disque).
+ *********************************************************************/
+
+    void init_sgf_crc (void);
+    void close_sgf_crc (void);
+
+/**********************************************************************
+ Creer la table et calculer la somme des blocs utilises. Renvoie -1
+ s'il n'y a pas la place, 0 si elle existe deja.
+ *********************************************************************/
+
+    int create_checksum_table (void);
+    int has_checksums (void);
+
+/**********************************************************************
+ Ecrire sur le disque les blocs modifies de la table.
+ *********************************************************************/
+
+    void save_checksums (void);
+
+/**********************************************************************
+ Verifier au plus "nb" blocs utilises a partir de scrub_position ; le
+ parcours s'arrete au dernier bloc du disque et reprend au bloc 0 a
+ l'appel suivant (scrub_position vaut alors 0). Si "repair" est non
+ nul, la somme des blocs alteres est recalculee. Renvoie le nombre de
+ blocs alteres.
+ *********************************************************************/
+
+    int scrub_blocks (int nb, int repair);
+    int scrub_position (void);
+
+/**********************************************************************
+ Faire une etape du parcours de fond : verifier le nombre de blocs
+ correspondant au temps ecoule depuis l'etape precedente au debit
+ sgf_scrub_rate (SCRUB_MAX_STEP au plus). Le SGF ne l'appelle jamais
+ lui-meme ; c'est a l'application de le faire pendant ses temps morts.
+ Renvoie le nombre de blocs alteres.
+ *********************************************************************/
+
+    int sgf_scrub_step (void);
+
+/**********************************************************************
+ Compteurs (depuis le dernier reset).
+ *********************************************************************/
+
+typedef struct CRC_COUNTERS
+    {
+    long nb_computed;           /* sommes calculees (ecritures)     */
+    long nb_verified;           /* blocs lus et verifies            */
+    long nb_errors;             /* blocs alteres trouves            */
+    long nb_scrubbed;           /* blocs examines par le parcours   */
+    long nb_repaired;           /* sommes recalculees               */
+    }
+    CRC_COUNTERS;
+
+    void get_crc_counters (CRC_COUNTERS* c);
+    void reset_crc_counters (void);
+
+
+#endif
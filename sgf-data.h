@@ -32,14 +32,42 @@ typedef  DIR_ENTRY       BLOCK_DIR [ BLOCK_DIR_SIZE ];
  *
  *********************************************************************/
 
+#define SIGNATURE_HOLES         (0x484F4C45)
+#define INODE_MAX_HOLES         ((BLOCK_SIZE - 6 * sizeof(int)) / sizeof(HOLE))
+
+
+typedef struct HOLE             /* Trou d'un fichier creux          */
+    {                           /* -------------------------------- */
+    int  start;                 /* premier bloc logique du trou     */
+    int  count;                 /* nombre de blocs                  */
+    }
+    HOLE;
+
+/*  Un fichier creux ne chane dans la FAT que ses blocs crits, dans
+ *  l'ordre logique ; ses trous (tris, jamais sur le dernier bloc)
+ *  se lisent comme des zros. Un fichier compress n'a pas de trous :
+ *  sa chane contient ses grappes compresses (length est leur taille
+ *  totale) et zlength est sa taille dcompresse. Les champs qui
+ *  suivent last n'existaient pas sur les premiers disques : ils ne
+ *  sont valides que si hole_signature vaut SIGNATURE_HOLES.           */
+
+
 typedef struct INODE            /* INODE: Descripteur de fichiers   */
     {                           /* -------------------------------- */
     int  length;                /* taille du fichier (en octets)    */
     int  first;                 /* adresse du premier bloc logique  */
     int  last;                  /* adresse du dernier bloc logique  */
+    int  hole_signature;        /* SIGNATURE_HOLES                  */
+    int  nb_holes;              /* trous dcrits dans "holes"       */
+    HOLE holes [ INODE_MAX_HOLES ];
+    int  zlength;               /* taille dcompresse (0 : fichier  */
+                                /* non compress)                    */
     }
     INODE;
 
+#define INODE_SIZE(i)           (((i).hole_signature == SIGNATURE_HOLES  &&  (i).zlength > 0) \
+                                 ? (i).zlength : (i).length)
+
 
 /**********************************************************************
  *
@@ -49,15 +77,88 @@ typedef struct INODE            /* INODE: Descripteur de fichiers   */
  *********************************************************************/
 
 #define SIGNATURE_SUPER_BLOCK   (0xAA88FF33)
+#define SIGNATURE_SUPER_EXT     (0x5E7E0001)
+
+/*  Les champs qui suivent adr_dir n'existaient pas sur les premiers
+ *  disques (le reste du bloc 0 y est quelconque) : ils ne sont valides
+ *  que si ext_signature vaut SIGNATURE_SUPER_EXT.                    */
 
 typedef struct SUPER_BLOCK      /* Bloc d'un <<super bloc>>         */
     {                           /* -------------------------------- */
     int  signature;             /* signature du systme de fichiers */
     int  adr_dir;               /* adr du 1er bloc du rpertoire    */
+    int  ext_signature;         /* SIGNATURE_SUPER_EXT              */
+    int  adr_refcount;          /* table des rfrences (-1 : aucune)*/
+    int  nb_refcount_blocks;    /* taille de cette table (en blocs) */
+    int  adr_snapshots;         /* table des instantans (-1 : aucune)*/
+    int  adr_journal;           /* journal des mta-donnes (-1)    */
+    int  nb_journal_blocks;     /* taille du journal (en blocs)     */
+    int  adr_checksums;         /* table des sommes (-1 : aucune)   */
+    int  nb_checksum_blocks;    /* taille de cette table (en blocs) */
     }
     SUPER_BLOCK;
 
 
+/**********************************************************************
+ *
+ *  Journal des mta-donnes : le premier bloc est l'en-tte
+ *  (numro de la premire transaction  rejouer), suivi des
+ *  transactions : enregistrement de validation, blocs descripteurs
+ *  (adresses des blocs journaliss) puis copies de ces blocs.
+ *
+ *********************************************************************/
+
+#define SIGNATURE_JOURNAL       (0x4A4F5552)
+
+#define JOURNAL_CLEAN           (0)     /* rien  rejouer                */
+#define JOURNAL_COMMITTED       (1)     /* transaction valide           */
+
+typedef struct JOURNAL_HEADER   /* En-tte du journal               */
+    {                           /* -------------------------------- */
+    int  signature;             /* SIGNATURE_JOURNAL                */
+    int  state;                 /* JOURNAL_CLEAN ou _COMMITTED      */
+    int  seq;                   /* numro de la transaction         */
+    int  nb_blocks;             /* blocs journaliss                */
+    unsigned int checksum;      /* somme des descripteurs et copies */
+    }
+    JOURNAL_HEADER;
+
+#define JOURNAL_TARGETS         (BLOCK_SIZE / sizeof(int))
+
+typedef  int             JOURNAL_DESC [ JOURNAL_TARGETS ];
+
+
+/**********************************************************************
+ *
+ *  Instantans : la table (un bloc) dcrit chaque instantan ; un
+ *  instantan note dans un journal d'exceptions (chane de blocs
+ *  relis par "next") o a t recopi chaque bloc modifi depuis
+ *  sa cration.
+ *
+ *********************************************************************/
+
+typedef struct SNAP_ENTRY       /* Un instantan                    */
+    {                           /* -------------------------------- */
+    int  active;                /* entre utilise                  */
+    int  date;                  /* date de cration                 */
+    int  log;                   /* dernier bloc du journal (-1)     */
+    }
+    SNAP_ENTRY;
+
+#define SNAP_MAX                (BLOCK_SIZE / sizeof(SNAP_ENTRY))
+#define SNAP_LOG_PAIRS          ((BLOCK_SIZE / sizeof(int) - 2) / 2)
+
+typedef  SNAP_ENTRY      SNAP_TABLE [ SNAP_MAX ];
+
+typedef struct SNAP_LOG         /* Bloc du journal d'exceptions     */
+    {                           /* -------------------------------- */
+    int  next;                  /* bloc prcdent du journal (-1)   */
+    int  nb;                    /* couples utiliss                 */
+    int  pair [SNAP_LOG_PAIRS][2]; /* bloc d'origine, copie         */
+    }
+    SNAP_LOG;
+
+
 /**********************************************************************
  *
  *  Dfinition d'un bloc typ qui est soit un super-bloc, soit un bloc
@@ -70,6 +171,10 @@ typedef union
     SUPER_BLOCK super;
     BLOCK_DIR   dir;
     INODE       inode;
+    SNAP_TABLE  snaps;
+    SNAP_LOG    log;
+    JOURNAL_HEADER journal;
+    JOURNAL_DESC targets;
     BLOCK       data;
     }
     TBLOCK;
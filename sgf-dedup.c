@@ -0,0 +1,368 @@
+
+/*
+**  sgf-dedup.c
+**
+**  Deduplication des blocs de donnees (partage des fins de chaines).
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-refcount.h"
+#include "sgf-journal.h"
+#include "sgf-dedup.h"
+
+
+#define FNV_OFFSET              (14695981039346656037UL)
+#define FNV_PRIME               (1099511628211UL)
+
+#define INDEX_LOAD(n)           ((n) / 4 * 3)   /* remplissage maximal */
+
+
+int sgf_dedup = 0;
+
+static DEDUP_COUNTERS counters;
+
+
+/**********************************************************************
+ *
+ *  L'index : une table a adressage ouvert (empreinte de fin de chaine
+ *  -> adresse du premier bloc de cette fin). L'empreinte 0 marque une
+ *  case vide.
+ *
+ *********************************************************************/
+
+typedef struct ENTRY
+    {
+    unsigned long key;
+    int           adr;
+    }
+    ENTRY;
+
+typedef struct INDEX
+    {
+    ENTRY* slots;
+    int    size;                /* puissance de 2 (0 : pas allouee) */
+    int    count;
+    }
+    INDEX;
+
+static INDEX suffixes = { NULL, 0, 0 };
+
+
+static void index_free (INDEX* t)
+    {
+    free(t->slots);
+    t->slots = NULL;
+    t->size = t->count = 0;
+    }
+
+/* Case de "key" (vide si elle n'y est pas), NULL si la table n'existe pas */
+static ENTRY* index_slot (INDEX* t, unsigned long key)
+    {
+    int i;
+
+    if (t->slots == NULL) return (NULL);
+
+    for(i = (int) (key & (t->size - 1)); ; i = (i + 1) & (t->size - 1))
+        if (t->slots[i].key == key  ||  t->slots[i].key == 0)
+            return (&t->slots[i]);
+    }
+
+/* Ajouter "key" (si elle n'y est pas). Renvoie l'adresse deja notee pour elle, -1 si aucune */
+static int index_add (INDEX* t, unsigned long key, int adr)
+    {
+    ENTRY* e;
+
+    if (t->slots == NULL)
+        {
+        for(t->size = 1024; t->size < 2 * get_disk_size(); t->size *= 2)
+            ;
+        t->slots = calloc(t->size, sizeof(ENTRY));
+        if (t->slots == NULL)
+            {
+            t->size = 0;
+            return (-1);
+            }
+        }
+
+    e = index_slot(t, key);
+    if (e->key != 0) return (e->adr);
+    if (t->count >= INDEX_LOAD(t->size)) return (-1);
+
+    e->key = key;
+    e->adr = adr;
+    t->count++;
+    return (-1);
+    }
+
+
+void init_sgf_dedup (void)
+    {
+    index_free(&suffixes);
+    }
+
+
+/**********************************************************************
+ Empreintes (FNV-1a sur 64 bits).
+ *********************************************************************/
+
+unsigned long dedup_hash (const char* data, int len)
+    {
+    unsigned long h = FNV_OFFSET;
+    int i;
+
+    for(i = 0; i < len; i++)
+        h = (h ^ (unsigned char) data[i]) * FNV_PRIME;
+
+    counters.nb_hashed_blocks++;
+    return (h);
+    }
+
+/* Empreinte d'une fin de chaine : celle du bloc suivie de celle de la suite */
+static unsigned long fold (unsigned long h, unsigned long next)
+    {
+    int i;
+
+    for(i = 0; i < (int) sizeof(next); i++, next >>= 8)
+        h = (h ^ (next & 0xFF)) * FNV_PRIME;
+
+    return ((h == 0) ? 1 : h);
+    }
+
+/* Empreintes des fins des "n" blocs (a liberer, NULL si plus de memoire) */
+static unsigned long* suffix_hashes (int n, const unsigned long* hashes, int last_len)
+    {
+    unsigned long* sh = malloc(n * sizeof(unsigned long));
+    int k;
+
+    if (sh == NULL) return (NULL);
+
+    sh[n - 1] = fold(hashes[n - 1], (unsigned long) last_len);
+    for(k = n - 2; k >= 0; k--)
+        sh[k] = fold(hashes[k], sh[k + 1]);
+
+    return (sh);
+    }
+
+
+/**********************************************************************
+ Comparer les blocs k..n-1 d'un fichier a la chaine qui commence en
+ "x" : memes octets utiles, et la chaine se termine au meme bloc.
+ *********************************************************************/
+
+static int same_chain (int x, int k, int n, int last_len, const int* adrs,
+                       BLOCK* mem, int nmem, int* x_last)
+    {
+    BLOCK a, b;
+    int i, v, len;
+
+    for(i = k; i < n; i++)
+        {
+        if (x <= 0  ||  x >= get_disk_size()) return (0);
+        v = get_fat(x);
+        if ((i < n - 1  &&  v < 0)  ||  (i == n - 1  &&  v != FAT_EOF)) return (0);
+
+        read_block(x, &a);
+        counters.nb_verify_reads++;
+        len = (i == n - 1) ? last_len : BLOCK_SIZE;
+        if (i < n - nmem)
+            {
+            read_block(adrs[i], &b);
+            counters.nb_verify_reads++;
+            if (memcmp(a, b, len) != 0) return (0);
+            }
+        else if (memcmp(a, mem[i - (n - nmem)], len) != 0)
+            return (0);
+
+        *x_last = x;
+        x = v;
+        }
+
+    return (1);
+    }
+
+
+/**********************************************************************
+ Chercher la plus longue fin deja presente sur le disque.
+ *********************************************************************/
+
+int dedup_find_suffix (int n, const unsigned long* hashes, int last_len,
+                       const int* adrs, BLOCK* mem, int nmem,
+                       int* target, int* target_last)
+    {
+    unsigned long* sh;
+    ENTRY* e;
+    int k;
+
+    if (n <= 0  ||  suffixes.slots == NULL) return (n);
+    sh = suffix_hashes(n, hashes, last_len);
+    if (sh == NULL) return (n);
+
+    for(k = 0; k < n; k++)
+        {
+        e = index_slot(&suffixes, sh[k]);
+        if (e->key != 0)
+            {
+            /* cette fin est deja partagee avec la chaine trouvee */
+            if (e->adr == adrs[k]) break;
+            if (same_chain(e->adr, k, n, last_len, adrs, mem, nmem, target_last))
+                {
+                *target = e->adr;
+                free(sh);
+                return (k);
+                }
+            }
+
+        /* le bloc k sera rechaine : il ne doit pas etre partage */
+        if (adrs[k] >= 0  &&  get_refcount(adrs[k]) > 0) break;
+        }
+
+    free(sh);
+    return (n);
+    }
+
+
+/**********************************************************************
+ Indexer les fins d'une chaine.
+ *********************************************************************/
+
+void dedup_index_chain (int n, const unsigned long* hashes, int last_len, int first)
+    {
+    unsigned long* sh;
+    int k, adr;
+
+    if (n <= 0) return;
+    sh = suffix_hashes(n, hashes, last_len);
+    if (sh == NULL) return;
+
+    for(k = 0, adr = first; k < n  &&  adr >= 0; k++, adr = get_fat(adr))
+        index_add(&suffixes, sh[k], adr);
+
+    free(sh);
+    }
+
+
+/**********************************************************************
+ *
+ *  PARCOURS DU DISQUE
+ *
+ *********************************************************************/
+
+/* Hacher un fichier ferme et partager sa plus longue fin deja vue */
+static int dedup_file (int inode, INDEX* contents, int dry_run)
+    {
+    TBLOCK b;
+    BLOCK data;
+    unsigned long* hashes;
+    int* adrs;
+    int n, k, adr, old, x, x_last, last_len, free0, shared = 0;
+
+    read_block(inode, &b.data);
+    n = 0;
+    for(adr = b.inode.first; adr != FAT_EOF; adr = get_fat(adr))
+        if (adr <= 0  ||  ++n > get_disk_size()) return (0);
+    if (n == 0) return (0);
+
+    hashes = malloc(n * sizeof(unsigned long));
+    adrs = malloc(n * sizeof(int));
+    if (hashes == NULL  ||  adrs == NULL)
+        {
+        free(hashes);
+        free(adrs);
+        return (0);
+        }
+
+    last_len = (b.inode.length % BLOCK_SIZE != 0) ? b.inode.length % BLOCK_SIZE : BLOCK_SIZE;
+    for(k = 0, adr = b.inode.first; k < n; k++, adr = get_fat(adr))
+        {
+        read_block(adr, &data);
+        adrs[k] = adr;
+        hashes[k] = dedup_hash(data, (k == n - 1) ? last_len : BLOCK_SIZE);
+
+        /* un bloc deja partage (clone) n'est pas un doublon */
+        old = index_add(contents, (hashes[k] == 0) ? 1 : hashes[k], adr);
+        if (old >= 0  &&  old != adr) counters.nb_dup_blocks++;
+        }
+
+    k = dedup_find_suffix(n, hashes, last_len, adrs, NULL, 0, &x, &x_last);
+    if (k < n  &&  dry_run)
+        shared = n - k;
+    else if (k < n  &&  ref_block(x) == 0)
+        {
+        /* rechainer devant la fin trouvee, valider par l'INODE, liberer l'ancienne fin */
+        if (k == 0)
+            b.inode.first = x;
+        else
+            set_fat_lazy(adrs[k - 1], x);
+        save_fat();
+        save_refcount();
+        b.inode.last = x_last;
+        write_meta_block(inode, &b.data);
+
+        free0 = get_free_fat_blocks_count();
+        release_chain(adrs[k]);
+        shared = n - k;
+        dedup_count_shared(shared, 0, get_free_fat_blocks_count() - free0);
+        journal_end_op();
+        }
+
+    dedup_index_chain(n, hashes, last_len, b.inode.first);
+    free(hashes);
+    free(adrs);
+    return (shared);
+    }
+
+int sgf_dedup_volume (int dry_run)
+    {
+    TBLOCK b;
+    INDEX contents = { NULL, 0, 0 };
+    int dir, slot, shared = 0;
+
+    /* les fins de fichiers en cache sont d'abord ecrites */
+    sgf_sync();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    for(dir = b.super.adr_dir; dir != FAT_EOF; dir = get_fat(dir))
+        {
+        read_block(dir, &b.data);
+        for(slot = 0; slot < BLOCK_DIR_SIZE; slot++)
+            if (b.dir[slot].inode > 0  &&  !sgf_is_open(b.dir[slot].inode))
+                shared += dedup_file(b.dir[slot].inode, &contents, dry_run);
+        }
+
+    /* les fichiers ouverts ne savent pas quels blocs sont desormais partages */
+    if (shared > 0  &&  !dry_run) sgf_forget_exclusive();
+
+    index_free(&contents);
+    return (shared);
+    }
+
+
+/**********************************************************************
+ Compteurs.
+ *********************************************************************/
+
+void dedup_count_shared (int shared, int skipped, int freed)
+    {
+    counters.nb_shared_blocks += shared;
+    counters.nb_skipped_writes += skipped;
+    counters.nb_freed_blocks += freed;
+    }
+
+void get_dedup_counters (DEDUP_COUNTERS* c)
+    {
+    *c = counters;
+    }
+
+void reset_dedup_counters (void)
+    {
+    memset(&counters, 0, sizeof(counters));
+    }
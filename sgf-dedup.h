@@ -0,0 +1,108 @@
+
+#ifndef __SGF_DEDUP__
+#define __SGF_DEDUP__
+
+
+/**********************************************************************
+ *
+ *  DEDUPLICATION DES BLOCS DE DONNEES
+ *
+ *  Chaque bloc ecrit (ou lu par un parcours du disque) est resume par
+ *  une empreinte de son contenu. Comme une entree de FAT ne designe
+ *  qu'un successeur, deux fichiers ne peuvent partager que des fins
+ *  de chaines (voir sgf-refcount.h) : l'index associe donc a chaque
+ *  place d'une chaine l'empreinte de toute la fin de chaine qui
+ *  commence la (empreintes des blocs suivants et taille utile du
+ *  dernier bloc). Une fin de fichier dont l'empreinte est dans
+ *  l'index est comparee octet par octet a la chaine trouvee, puis
+ *  remplacee par une reference (compteur de references) a celle-ci.
+ *
+ *  Des blocs identiques places au milieu de chaines differentes, ou
+ *  repetes dans un meme fichier, ne peuvent pas etre partages : ils
+ *  sont seulement comptes (nb_dup_blocks) par le parcours du disque.
+ *
+ *  L'index est en memoire et n'est pas conserve sur le disque : il
+ *  contient les fichiers ecrits avec sgf_dedup depuis le montage et
+ *  ceux vus par sgf_dedup_volume. Une entree perimee (bloc libere ou
+ *  modifie) est ecartee par la comparaison.
+ *
+ *********************************************************************/
+
+
+/**********************************************************************
+ Deduplication a l'ecriture (0 par defaut) : les blocs des fichiers
+ ouverts en WRITE_MODE sont haches par sgf_append_block et, a leur
+ vidage, leur plus longue fin deja presente sur le disque est
+ partagee. Les blocs retenus par l'allocation retardee que cette fin
+ couvre ne sont jamais ecrits ; les blocs deja places sont liberes.
+ *********************************************************************/
+
+    extern int sgf_dedup;
+
+/**********************************************************************
+ Vider l'index (nouveau disque).
+ *********************************************************************/
+
+    void init_sgf_dedup (void);
+
+/**********************************************************************
+ Empreinte des "len" premiers octets d'un bloc.
+ *********************************************************************/
+
+    unsigned long dedup_hash (const char* data, int len);
+
+/**********************************************************************
+ Chercher la plus longue fin d'un fichier de "n" blocs deja presente
+ sur le disque. "hashes" contient les empreintes des blocs (le dernier
+ n'ayant que "last_len" octets utiles), "adrs" leurs adresses (-1 pour
+ les "nmem" derniers, encore en memoire dans "mem"). Seules les fins
+ qui suivent des blocs non partages sont essayees.
+
+ Renvoie la place k de la fin trouvee (n si aucune) ; "target" recoit
+ l'adresse du premier bloc de la chaine qui la contient deja et
+ "target_last" celle de son dernier bloc.
+ *********************************************************************/
+
+    int dedup_find_suffix (int n, const unsigned long* hashes, int last_len,
+                           const int* adrs, BLOCK* mem, int nmem,
+                           int* target, int* target_last);
+
+/**********************************************************************
+ Ajouter a l'index les fins de la chaine de "n" blocs qui commence en
+ "first" (les empreintes deja connues gardent leur chaine).
+ *********************************************************************/
+
+    void dedup_index_chain (int n, const unsigned long* hashes, int last_len, int first);
+
+/**********************************************************************
+ Parcourir tout le disque (fichiers fermes seulement) : chaque fichier
+ est hache, indexe, et sa plus longue fin deja vue dans un autre
+ fichier est partagee (sauf si "dry_run" est non nul : elle est
+ seulement comptee). Renvoie le nombre de blocs partages.
+ *********************************************************************/
+
+    int sgf_dedup_volume (int dry_run);
+
+/**********************************************************************
+ Compteurs de la deduplication (depuis le dernier reset). Les octets
+ economises sont nb_shared_blocks * BLOCK_SIZE.
+ *********************************************************************/
+
+typedef struct DEDUP_COUNTERS
+    {
+    long nb_hashed_blocks;      /* blocs haches                     */
+    long nb_dup_blocks;         /* blocs dont le contenu etait deja */
+                                /* vu (parcours du disque)          */
+    long nb_shared_blocks;      /* blocs remplaces par une reference*/
+    long nb_skipped_writes;     /* blocs retenus jamais ecrits      */
+    long nb_freed_blocks;       /* blocs ecrits puis liberes        */
+    long nb_verify_reads;       /* lectures pour les comparaisons   */
+    }
+    DEDUP_COUNTERS;
+
+    void get_dedup_counters (DEDUP_COUNTERS* c);
+    void reset_dedup_counters (void);
+    void dedup_count_shared (int shared, int skipped, int freed);
+
+
+#endif
@@ -0,0 +1,348 @@
+
+/*
+**  sgf-defrag.c
+**
+**  Mesure de la fragmentation et defragmentation incrementale.
+**
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-defrag.h"
+#include "sgf-refcount.h"
+#include "sgf-journal.h"
+
+
+#define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+
+#define DEFRAG_SLICE_NS         (100000000L)    /* 100 ms */
+#define DEFRAG_NO_LIMIT         (INT_MAX)       /* blocs par tranche */
+
+
+/**********************************************************************
+ Compter les extents d'une chaine.
+ *********************************************************************/
+
+int sgf_file_extents (int inode, int* nb_blocks)
+    {
+    TBLOCK b;
+    int adr, prev, n, extents;
+
+    read_block(inode, &b.data);
+
+    n = extents = 0;
+    prev = -1;
+    for(adr = b.inode.first; adr != FAT_EOF; adr = get_fat(adr))
+        {
+        if (adr != prev + 1  ||  prev < 0) extents++;
+        prev = adr;
+        n++;
+        }
+
+    if (nb_blocks != NULL) *nb_blocks = n;
+    return (extents);
+    }
+
+
+/**********************************************************************
+ Passer a l'entree suivante du repertoire. Renvoie l'adresse de l'INODE
+ ou -1 si le repertoire est termine.
+ *********************************************************************/
+
+static int next_entry (DEFRAG_STATE* st)
+    {
+    TBLOCK b;
+    int inode;
+
+    while (st->dir_block != FAT_EOF)
+        {
+        read_block(st->dir_block, &b.data);
+        while (st->slot < BLOCK_DIR_SIZE)
+            {
+            inode = b.dir[st->slot++].inode;
+            if (inode > 0) return (inode);
+            }
+        st->dir_block = get_fat(st->dir_block);
+        st->slot = 0;
+        }
+
+    return (-1);
+    }
+
+
+/**********************************************************************
+ Choisir le prochain fichier a deplacer et reserver sa nouvelle suite
+ de blocs. Renvoie 0 si le repertoire est termine.
+ *********************************************************************/
+
+static int start_file (DEFRAG_STATE* st)
+    {
+    TBLOCK b;
+    int inode, n, k;
+
+    for(;;)
+        {
+        inode = next_entry(st);
+        if (inode < 0) return (0);
+
+        if (sgf_is_open(inode))
+            {
+            st->nb_skipped_files++;
+            continue;
+            }
+        if (sgf_file_extents(inode, &n) <= 1) continue;
+
+        /* deplacer des blocs partages avec un clone les dupliquerait */
+        read_block(inode, &b.data);
+        if (chain_is_shared(b.inode.first))
+            {
+            st->nb_skipped_files++;
+            continue;
+            }
+
+        /* une suite libre, de preference juste apres l'INODE */
+        st->run = find_free_extent(n, inode + 1);
+        if (st->run < 0)
+            {
+            st->nb_skipped_files++;
+            continue;
+            }
+
+        st->inode     = inode;
+        st->length    = b.inode.length;
+        st->first     = b.inode.first;
+        st->last      = b.inode.last;
+        st->nb_blocks = n;
+        st->copied    = 0;
+        st->src       = b.inode.first;
+
+        /* reserver la suite : elle forme deja une chaine complete */
+        for(k = 0; k < n; k++)
+            set_fat_lazy(st->run + k, (k == n - 1) ? FAT_EOF : st->run + k + 1);
+        save_fat();
+        return (1);
+        }
+    }
+
+
+/**********************************************************************
+ Liberer une chaine (ancienne chaine ou suite reservee abandonnee).
+ *********************************************************************/
+
+static void free_chain (int adr)
+    {
+    int next;
+
+    for(; adr != FAT_EOF; adr = next)
+        {
+        next = get_fat(adr);
+        set_fat_lazy(adr, FAT_FREE);
+        }
+    save_fat();
+    }
+
+
+/**********************************************************************
+ Le fichier en cours de deplacement a-t-il change (ou ete ouvert)
+ depuis le debut du deplacement ? Son INODE est relu dans "b".
+ *********************************************************************/
+
+static int file_changed (DEFRAG_STATE* st, TBLOCK* b)
+    {
+    read_block(st->inode, &b->data);
+    return (sgf_is_open(st->inode)  ||  get_fat(st->inode) != FAT_INODE  ||
+            b->inode.length != st->length  ||  b->inode.first != st->first  ||
+            b->inode.last != st->last);
+    }
+
+
+/**********************************************************************
+ Abandonner le deplacement et liberer la suite reservee.
+ *********************************************************************/
+
+static void abandon_file (DEFRAG_STATE* st)
+    {
+    free_chain(st->run);
+    st->nb_skipped_files++;
+    st->inode = -1;
+    journal_end_op();
+    }
+
+
+/**********************************************************************
+ Terminer le deplacement : valider par l'ecriture de l'INODE, puis
+ liberer l'ancienne chaine. Si le fichier a change depuis le debut
+ du deplacement, la copie est abandonnee.
+ *********************************************************************/
+
+static void finish_file (DEFRAG_STATE* st)
+    {
+    TBLOCK b;
+
+    if (file_changed(st, &b))
+        {
+        abandon_file(st);
+        return;
+        }
+
+    b.inode.first = st->run;
+    b.inode.last  = st->run + st->nb_blocks - 1;
+    write_meta_block(st->inode, &b.data);
+    free_chain(st->first);
+    st->nb_moved_files++;
+
+    st->inode = -1;
+    journal_end_op();
+    }
+
+
+/**********************************************************************
+ Initialiser une defragmentation.
+ *********************************************************************/
+
+void sgf_defrag_init (DEFRAG_STATE* st)
+    {
+    TBLOCK b;
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    st->dir_block = b.super.adr_dir;
+    st->slot = 0;
+    st->inode = -1;
+    st->nb_moved_files = 0;
+    st->nb_moved_blocks = 0;
+    st->nb_skipped_files = 0;
+    }
+
+
+/**********************************************************************
+ Avancer la defragmentation d'au plus "max_blocks" blocs copies.
+ *********************************************************************/
+
+int sgf_defrag_step (DEFRAG_STATE* st, int max_blocks)
+    {
+    BLOCK data;
+    TBLOCK b;
+
+    while (max_blocks > 0)
+        {
+        /* le volume reste utilisable entre deux pas : la chaine suivie
+           n'est plus sure si le fichier a change depuis */
+        if (st->inode >= 0  &&  file_changed(st, &b))
+            abandon_file(st);
+
+        if (st->inode < 0  &&  !start_file(st))
+            return (0);
+
+        for(; st->copied < st->nb_blocks  &&  max_blocks > 0; max_blocks--)
+            {
+            read_block(st->src, &data);
+            write_block(st->run + st->copied, &data);
+            st->src = get_fat(st->src);
+            st->copied++;
+            st->nb_moved_blocks++;
+            }
+
+        if (st->copied == st->nb_blocks)
+            finish_file(st);
+        }
+
+    return (1);
+    }
+
+
+/**********************************************************************
+ Defragmenter tout le disque avec une limite de debit.
+ *********************************************************************/
+
+int sgf_defrag (int blocks_per_second)
+    {
+    DEFRAG_STATE st;
+    struct timespec pause;
+    int slice;
+
+    /* le debit est obtenu par tranches de 100 ms */
+    slice = (blocks_per_second > 0) ? PAR_EXCES(blocks_per_second, 10) : DEFRAG_NO_LIMIT;
+    pause.tv_sec = 0;
+    pause.tv_nsec = DEFRAG_SLICE_NS;
+
+    sgf_defrag_init(&st);
+    while (sgf_defrag_step(&st, slice))
+        if (blocks_per_second > 0) nanosleep(&pause, NULL);
+
+    return (st.nb_moved_files);
+    }
+
+
+/**********************************************************************
+ Afficher la fragmentation de chaque fichier.
+ *********************************************************************/
+
+void sgf_fragmentation_report (void)
+    {
+    DEFRAG_STATE st;
+    TBLOCK b;
+    int inode, j, n, extents;
+
+    sgf_defrag_init(&st);
+    while (st.dir_block != FAT_EOF)
+        {
+        read_block(st.dir_block, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++)
+            {
+            inode = b.dir[j].inode;
+            if (inode <= 0) continue;
+            extents = sgf_file_extents(inode, &n);
+            printf("- File : %s : %d bloc(s), %d extent(s)\n",
+                   b.dir[j].name, n, extents);
+            }
+        st.dir_block = get_fat(st.dir_block);
+        }
+    }
+
+
+/**********************************************************************
+ Afficher la carte de la FAT coloriee par fichier.
+ *********************************************************************/
+
+void sgf_display_fat_map_by_file (void)
+    {
+    DEFRAG_STATE st;
+    TBLOCK b, ib;
+    int* owner;
+    int j, k, adr, nb_files;
+
+    owner = malloc(get_disk_size() * sizeof(int));
+    if (owner == NULL)
+        panic("sgf_display_fat_map_by_file: plus de memoire.");
+    for(k = 0; k < get_disk_size(); k++) owner[k] = -1;
+
+    nb_files = 0;
+    sgf_defrag_init(&st);
+    while (st.dir_block != FAT_EOF)
+        {
+        read_block(st.dir_block, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++)
+            {
+            if (b.dir[j].inode <= 0) continue;
+            owner[b.dir[j].inode] = nb_files;
+            read_block(b.dir[j].inode, &ib.data);
+            for(adr = ib.inode.first; adr != FAT_EOF; adr = get_fat(adr))
+                owner[adr] = nb_files;
+            nb_files++;
+            }
+        st.dir_block = get_fat(st.dir_block);
+        }
+
+    displayFatMapByOwner(owner);
+    free(owner);
+    }
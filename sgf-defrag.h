@@ -0,0 +1,91 @@
+
+#ifndef __SGF_DEFRAG__
+#define __SGF_DEFRAG__
+
+
+/**********************************************************************
+ *
+ *  DEFRAGMENTATION DES FICHIERS
+ *
+ *  Un fichier fragmente (plusieurs extents, c'est-a-dire plusieurs
+ *  suites de blocs contigus) est recopie dans une suite de blocs
+ *  libres consecutifs. Le deplacement est incremental : chaque appel
+ *  a sgf_defrag_step copie au plus un nombre donne de blocs, ce qui
+ *  permet de defragmenter pendant l'utilisation du disque.
+ *
+ *  Les fichiers dont la chaine est partagee avec un clone ne sont pas
+ *  deplaces.
+ *
+ *  Ordre des ecritures (coherence en cas d'arret brutal) :
+ *    1. la nouvelle suite est reservee dans la FAT (blocs orphelins
+ *       que sgf-fsck sait recuperer),
+ *    2. les blocs sont copies,
+ *    3. l'INODE est reecrit (un seul bloc : c'est la validation),
+ *    4. l'ancienne chaine est liberee.
+ *
+ *********************************************************************/
+
+typedef struct DEFRAG_STATE     /* Etat d'une defragmentation       */
+    {                           /* -------------------------------- */
+    int   dir_block;            /* bloc repertoire courant          */
+    int   slot;                 /* prochaine entree de ce bloc      */
+    int   inode;                /* fichier en cours (-1 si aucun)   */
+    int   length;               /* taille du fichier a l'origine    */
+    int   first;                /* premier bloc de l'ancienne chaine*/
+    int   last;                 /* dernier bloc de l'ancienne chaine*/
+    int   run;                  /* premier bloc de la suite reservee*/
+    int   nb_blocks;            /* taille de la suite (en blocs)    */
+    int   copied;               /* blocs deja recopies              */
+    int   src;                  /* prochain bloc a recopier         */
+    int   nb_moved_files;       /* fichiers defragmentes            */
+    int   nb_moved_blocks;      /* blocs recopies                   */
+    int   nb_skipped_files;     /* fichiers ouverts ou sans place   */
+    }
+    DEFRAG_STATE;
+
+
+/**********************************************************************
+ Compter les extents d'un fichier (designe par l'adresse de son INODE).
+ Le nombre de blocs de la chaine est renvoye dans "nb_blocks" (si ce
+ pointeur n'est pas NULL).
+ *********************************************************************/
+
+    int sgf_file_extents (int inode, int* nb_blocks);
+
+/**********************************************************************
+ Preparer une defragmentation complete du disque.
+ *********************************************************************/
+
+    void sgf_defrag_init (DEFRAG_STATE* st);
+
+/**********************************************************************
+ Avancer la defragmentation en copiant au plus "max_blocks" blocs.
+ Les fichiers ouverts sont ignores ; un fichier ouvert ou modifie
+ entre deux appels est abandonne. La fonction renvoie 0 lorsque
+ tout le repertoire a ete traite, 1 sinon.
+ *********************************************************************/
+
+    int sgf_defrag_step (DEFRAG_STATE* st, int max_blocks);
+
+/**********************************************************************
+ Defragmenter tout le disque en limitant le debit a "blocks_per_second"
+ blocs copies par seconde (0 : sans limite). Renvoie le nombre de
+ fichiers deplaces.
+ *********************************************************************/
+
+    int sgf_defrag (int blocks_per_second);
+
+/**********************************************************************
+ Afficher, pour chaque fichier, sa taille en blocs et ses extents.
+ *********************************************************************/
+
+    void sgf_fragmentation_report (void);
+
+/**********************************************************************
+ Afficher la carte de la FAT coloriee par fichier.
+ *********************************************************************/
+
+    void sgf_display_fat_map_by_file (void);
+
+
+#endif
@@ -0,0 +1,335 @@
+/*
+**  sgf-device.c
+**
+**  Modeles de peripherique : duree simulee des E/S du disque.
+**
+*/
+
+#define _POSIX_C_SOURCE 200112L         /* nanosleep */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-device.h"
+
+
+#define DELAY_MIN_NS            (100000L)       /* attente reelle minimale */
+
+
+int sgf_device_delay = 0;
+
+HDD_PARAMS hdd_params = { 7200, 4096, 800000L, 15000000L };
+SSD_PARAMS ssd_params = { 32, 64, 50000L, 200000L, 1500000L, 100L, 10000L };
+
+static DEVICE_COUNTERS counters;
+
+static const DEVICE_MODEL* model = &device_ideal;
+static int configured = 0;
+static int queue_depth = 1, channels = 1, stripe = 1;
+
+static long now = 0;                            /* temps simule           */
+static long base = 0;                           /* instant du dernier reset */
+static long completions [ DEVICE_MAX_QUEUE ];   /* ecritures postees      */
+static int nb_pending = 0;
+static long channel_free [ DEVICE_MAX_CHANNELS ];
+static long debt = 0;                           /* attente reelle due (ns) */
+
+
+/**********************************************************************
+ Modele ideal : aucune duree.
+ *********************************************************************/
+
+static long ideal_service (int op, int n, long start)
+    {
+    return (0);
+    }
+
+static void ideal_reset (void)
+    {
+    }
+
+const DEVICE_MODEL device_ideal = { "ideal", ideal_service, ideal_reset };
+
+
+/**********************************************************************
+ Disque rotatif. La tete est sur la piste "head_track" ; le secteur
+ sous la tete a l'instant t est (t mod rotation) / duree d'un secteur.
+ *********************************************************************/
+
+static int head_track = 0;
+
+static long isqrt (long v)
+    {
+    long r = 0, bit = 1L << 30;
+
+    while (bit > v) bit >>= 2;
+    for(; bit != 0; bit >>= 2)
+        if (v >= r + bit)
+            {
+            v -= r + bit;
+            r = (r >> 1) + bit;
+            }
+        else
+            r >>= 1;
+    return (r);
+    }
+
+static long hdd_service (int op, int n, long start)
+    {
+    /* 60 s / rpm en ns, sans depasser un long de 32 bits */
+    long rotation = 60000000L / hdd_params.rpm * 1000
+                  + 60000000L % hdd_params.rpm * 1000 / hdd_params.rpm;
+    long sector_ns = rotation / hdd_params.blocks_per_track;
+    long nb_tracks = get_disk_size() / hdd_params.blocks_per_track + 1;
+    long seek = 0, pos, wait;
+    int track = n / hdd_params.blocks_per_track, dist;
+
+    if (op == DEVICE_TRIM) return (0);
+
+    /* positionnement : croissant avec la racine de la distance */
+    dist = (track > head_track) ? track - head_track : head_track - track;
+    if (dist > 0)
+        seek = hdd_params.track_seek_ns
+             + (hdd_params.full_seek_ns - hdd_params.track_seek_ns) * isqrt(dist * 1024L * 1024L / nb_tracks) / 1024;
+    head_track = track;
+
+    /* rotation jusqu'au debut du secteur vise */
+    pos = (start + seek) % rotation;
+    wait = ((n % hdd_params.blocks_per_track) * sector_ns - pos) % rotation;
+    if (wait < 0) wait += rotation;
+
+    return (seek + wait + sector_ns);
+    }
+
+static void hdd_reset (void)
+    {
+    head_track = 0;
+    }
+
+const DEVICE_MODEL device_hdd = { "hdd", hdd_service, hdd_reset };
+
+
+/**********************************************************************
+ Memoire flash. Les ecritures remplissent la page ouverte ; elle est
+ programmee quand une ecriture vise une autre page (relue d'abord si
+ elle n'a pas ete remplie depuis son debut).
+ *********************************************************************/
+
+static int last_read_page = -1, open_page = -1, open_fresh = 0;
+static long nb_programs = 0;
+
+static long ssd_program (void)
+    {
+    long t;
+
+    if (open_page < 0) return (0);
+    t = ssd_params.program_ns + (open_fresh ? 0 : ssd_params.read_ns);
+    if (++nb_programs % ssd_params.pages_per_erase == 0)
+        {
+        t += ssd_params.erase_ns;
+        counters.nb_erases++;
+        }
+    return (t);
+    }
+
+static long ssd_service (int op, int n, long start)
+    {
+    int page = n / ssd_params.page_blocks;
+    long t = ssd_params.transfer_ns;
+
+    switch (op)
+        {
+        case DEVICE_READ:
+            if (page != open_page  &&  page != last_read_page)
+                {
+                t += ssd_params.read_ns;
+                last_read_page = page;
+                }
+            return (t);
+
+        case DEVICE_WRITE:
+            if (page != open_page)
+                {
+                t += ssd_program();
+                open_page = page;
+                open_fresh = (n % ssd_params.page_blocks == 0);
+                }
+            if (page == last_read_page) last_read_page = -1;
+            return (t);
+
+        default:
+            return (ssd_params.trim_ns);
+        }
+    }
+
+static void ssd_reset (void)
+    {
+    last_read_page = open_page = -1;
+    open_fresh = 0;
+    nb_programs = 0;
+    }
+
+const DEVICE_MODEL device_ssd = { "ssd", ssd_service, ssd_reset };
+
+
+/**********************************************************************
+ Choix du modele.
+ *********************************************************************/
+
+void use_device_model (const DEVICE_MODEL* m, int qd, int ch, int stripe_blocks)
+    {
+    model = (m != NULL) ? m : &device_ideal;
+    queue_depth = (qd < 1) ? 1 : (qd > DEVICE_MAX_QUEUE) ? DEVICE_MAX_QUEUE : qd;
+    channels = (ch < 1) ? 1 : (ch > DEVICE_MAX_CHANNELS) ? DEVICE_MAX_CHANNELS : ch;
+    stripe = (stripe_blocks < 1) ? 1 : stripe_blocks;
+    configured = 1;
+
+    model->reset();
+    now = base = 0;
+    nb_pending = 0;
+    memset(channel_free, 0, sizeof(channel_free));
+    debt = 0;
+    memset(&counters, 0, sizeof(counters));
+    }
+
+
+int set_device_model (const char* spec)
+    {
+    const DEVICE_MODEL* m;
+    const char* p;
+    int qd = 1, ch = 1, st = ssd_params.page_blocks, delay = 0, len;
+
+    len = ((p = strchr(spec, ':')) != NULL) ? p - spec : strlen(spec);
+    if (len == 5  &&  strncmp(spec, "ideal", 5) == 0) m = &device_ideal;
+    else if (len == 3  &&  strncmp(spec, "hdd", 3) == 0) m = &device_hdd;
+    else if (len == 3  &&  strncmp(spec, "ssd", 3) == 0) m = &device_ssd;
+    else return (-1);
+
+    for(; p != NULL; p = strchr(p + 1, ':'))
+        {
+        if (strncmp(p, ":qd=", 4) == 0) qd = atoi(p + 4);
+        else if (strncmp(p, ":ch=", 4) == 0) ch = atoi(p + 4);
+        else if (strncmp(p, ":stripe=", 8) == 0) st = atoi(p + 8);
+        else if (strncmp(p, ":delay=", 7) == 0) delay = atoi(p + 7);
+        else return (-1);
+        }
+
+    use_device_model(m, qd, ch, st);
+    sgf_device_delay = delay;
+    return (0);
+    }
+
+
+const char* device_model_name (void)
+    {
+    return (model->name);
+    }
+
+
+static void configure (void)
+    {
+    const char* spec = getenv("SGF_DEVICE");
+
+    configured = 1;
+    if (spec != NULL  &&  set_device_model(spec) < 0)
+        fprintf(stderr, "sgf-device: SGF_DEVICE=%s ignore\n", spec);
+    }
+
+
+/**********************************************************************
+ Soumettre une operation. Une ecriture avec une profondeur de file
+ superieure a 1 est postee : le temps simule n'avance pas jusqu'a sa
+ fin, seulement jusqu'a ce qu'une place se libere dans la file.
+ *********************************************************************/
+
+void device_access (int op, int n)
+    {
+    long issued = now, start, service, done, latency;
+    int k, ch, oldest;
+
+    if (!configured) configure();
+    counters.nb_ops++;
+    if (model == &device_ideal) return;
+
+    /* les ecritures postees terminees quittent la file */
+    for(k = 0; k < nb_pending; )
+        if (completions[k] <= now)
+            completions[k] = completions[--nb_pending];
+        else
+            k++;
+
+    /* file pleine : attendre la premiere fin */
+    if (nb_pending >= queue_depth)
+        {
+        for(oldest = 0, k = 1; k < nb_pending; k++)
+            if (completions[k] < completions[oldest]) oldest = k;
+        now = completions[oldest];
+        completions[oldest] = completions[--nb_pending];
+        }
+
+    ch = (n / stripe) % channels;
+    start = (channel_free[ch] > now) ? channel_free[ch] : now;
+    service = model->service(op, n, start);
+    done = start + service;
+    channel_free[ch] = done;
+
+    if (op == DEVICE_READ  ||  queue_depth == 1)
+        now = done;
+    else
+        completions[nb_pending++] = done;
+
+    counters.busy_ns += service;
+    if (op == DEVICE_READ) counters.read_ns += service;
+    else if (op == DEVICE_WRITE) counters.write_ns += service;
+    counters.wait_ns += start - issued;
+    latency = done - issued;
+    if (latency > counters.max_ns) counters.max_ns = latency;
+
+    /* attente reelle proportionnelle a l'avance du temps simule */
+    if (sgf_device_delay > 0)
+        {
+        debt += (now - issued) / 100 * sgf_device_delay;
+        if (debt >= DELAY_MIN_NS)
+            {
+            struct timespec t;
+
+            t.tv_sec = debt / 1000000000L;
+            t.tv_nsec = debt % 1000000000L;
+            nanosleep(&t, NULL);
+            debt = 0;
+            }
+        }
+    }
+
+
+static long drained (void)
+    {
+    long t = now;
+    int k;
+
+    for(k = 0; k < nb_pending; k++)
+        if (completions[k] > t) t = completions[k];
+    return (t);
+    }
+
+void device_drain (void)
+    {
+    now = drained();
+    nb_pending = 0;
+    }
+
+
+void get_device_counters (DEVICE_COUNTERS* c)
+    {
+    *c = counters;
+    c->elapsed_ns = drained() - base;
+    }
+
+void reset_device_counters (void)
+    {
+    memset(&counters, 0, sizeof(counters));
+    base = now;
+    }
@@ -0,0 +1,146 @@
+#ifndef __SGF_DEVICE__
+#define __SGF_DEVICE__
+
+
+/**********************************************************************
+ *
+ *  MODELES DE PERIPHERIQUE
+ *
+ *  Chaque E/S physique du disque virtuel (read_block, write_block et
+ *  la liberation de blocs sur le systeme hote) est soumise a un modele
+ *  qui en calcule la duree de service, en temps simule. Le modele par
+ *  defaut (device_ideal) ne coute rien ; deux autres sont fournis :
+ *
+ *  device_hdd  disque rotatif : temps de positionnement croissant avec
+ *              la racine de la distance en pistes, attente de rotation
+ *              jusqu'au secteur vise (la position angulaire suit le
+ *              temps simule), puis transfert. Des blocs consecutifs se
+ *              lisent donc sans attente.
+ *
+ *  device_ssd  memoire flash : lecture d'une page (la derniere page lue
+ *              reste dans le registre de page), ecriture par page
+ *              (programmation quand on quitte la page ouverte, avec
+ *              relecture si elle n'a pas ete remplie depuis son debut)
+ *              et effacement d'un bloc d'effacement toutes les
+ *              "pages_per_erase" programmations.
+ *
+ *  Au-dessus du modele, une file de "queue_depth" requetes reparties
+ *  sur "channels" canaux (par suites de "stripe_blocks" blocs) : une
+ *  ecriture est postee et n'attend que si la file est pleine, une
+ *  lecture attend sa fin. Avec une profondeur de 1 (par defaut) les
+ *  E/S sont strictement synchrones.
+ *
+ *  Si sgf_device_delay est non nul, le temps simule est aussi attendu
+ *  reellement, a raison de sgf_device_delay % (100 : temps reel).
+ *
+ *  Le modele se choisit par set_device_model, ou par la variable
+ *  d'environnement SGF_DEVICE a la premiere E/S, sous la forme
+ *  "ssd", "hdd:qd=8", "ssd:qd=32:ch=8:delay=100"...
+ *
+ *********************************************************************/
+
+#define DEVICE_READ             (0)
+#define DEVICE_WRITE            (1)
+#define DEVICE_TRIM             (2)
+
+#define DEVICE_MAX_QUEUE        (256)
+#define DEVICE_MAX_CHANNELS     (64)
+
+
+/**********************************************************************
+ Un modele : "service" renvoie la duree (ns) d'une operation sur le
+ bloc "n" commencee a l'instant simule "start" ; "reset" revient a
+ l'etat initial (disque change).
+ *********************************************************************/
+
+typedef struct DEVICE_MODEL
+    {
+    const char* name;
+    long (*service)(int op, int n, long start);
+    void (*reset)(void);
+    }
+    DEVICE_MODEL;
+
+extern const DEVICE_MODEL device_ideal;
+extern const DEVICE_MODEL device_hdd;
+extern const DEVICE_MODEL device_ssd;
+
+/**********************************************************************
+ Parametres des modeles fournis (modifiables avant usage).
+ *********************************************************************/
+
+typedef struct HDD_PARAMS
+    {
+    int  rpm;                   /* 7200                             */
+    int  blocks_per_track;      /* 4096 (512 Ko)                    */
+    long track_seek_ns;         /* piste voisine : 800 us           */
+    long full_seek_ns;          /* tout le disque : 15 ms           */
+    }
+    HDD_PARAMS;
+
+typedef struct SSD_PARAMS
+    {
+    int  page_blocks;           /* 32 (page de 4 Ko)                */
+    int  pages_per_erase;       /* 64 (bloc d'effacement de 256 Ko) */
+    long read_ns;               /* lecture d'une page : 50 us       */
+    long program_ns;            /* programmation : 200 us           */
+    long erase_ns;              /* effacement : 1.5 ms              */
+    long transfer_ns;           /* transfert d'un bloc : 100 ns     */
+    long trim_ns;               /* liberation : 10 us               */
+    }
+    SSD_PARAMS;
+
+extern HDD_PARAMS hdd_params;
+extern SSD_PARAMS ssd_params;
+
+/**********************************************************************
+ Choisir le modele et la file (queue_depth et channels >= 1,
+ stripe_blocks : blocs consecutifs sur un meme canal). Le temps
+ simule et les compteurs repartent de zero.
+ *********************************************************************/
+
+extern int sgf_device_delay;
+
+void use_device_model (const DEVICE_MODEL* m, int queue_depth, int channels, int stripe_blocks);
+
+/**********************************************************************
+ Choisir le modele d'apres sa description (voir plus haut) ; -1 si
+ elle est incorrecte.
+ *********************************************************************/
+
+int set_device_model (const char* spec);
+const char* device_model_name (void);
+
+/**********************************************************************
+ Soumettre une operation au modele (appele par sgf-disk.c) et
+ attendre la fin des ecritures postees.
+ *********************************************************************/
+
+void device_access (int op, int n);
+void device_drain (void);
+
+/**********************************************************************
+ Compteurs depuis le dernier reset (reset_disk_counters les remet
+ aussi a zero). "elapsed_ns" est le temps simule ecoule, file videe ;
+ "busy_ns" la somme des durees de service (superieure a elapsed_ns
+ quand des canaux travaillent en parallele).
+ *********************************************************************/
+
+typedef struct DEVICE_COUNTERS
+    {
+    long nb_ops;
+    long elapsed_ns;
+    long busy_ns;
+    long read_ns;               /* service des lectures             */
+    long write_ns;              /* service des ecritures            */
+    long wait_ns;               /* attente d'un canal ou de la file */
+    long max_ns;                /* plus longue operation (attente comprise) */
+    long nb_erases;             /* effacements (device_ssd)         */
+    }
+    DEVICE_COUNTERS;
+
+void get_device_counters (DEVICE_COUNTERS* c);
+void reset_device_counters (void);
+
+
+#endif
@@ -9,10 +9,16 @@
 #include "sgf-fat.h"
 #include "sgf-data.h"
 #include "sgf-dir.h"
+#include "sgf-journal.h"
+#include "sgf-stats.h"
+#include "sgf-record.h"
 
 
 static int directory_first_block = -1;
 
+/* dernier bloc du repertoire consulte ou modifie (voir directory_hint) */
+static int directory_hint_block = -1;
+
 
 /**********************************************************************
  rechercher et renvoyer l'adresse du descripteur d'un fichier.
@@ -24,7 +30,11 @@ int find_inode(const char* name)
     int adr;
     TBLOCK b;
     int j;
+    STATS_DECL;
+    RECORD_DECL;
     
+    STATS_START();
+    RECORD_START();
     if (directory_first_block == -1) {
         read_block(ADR_BLOCK_DEF, & b.data);
         directory_first_block = b.super.adr_dir;
@@ -35,17 +45,43 @@ int find_inode(const char* name)
     while (adr != FAT_EOF)
         {
         read_block(adr, &b.data);
+        directory_hint_block = adr;
         for(j = 0; j < BLOCK_DIR_SIZE; j++)
             if (b.dir[j].inode > 0)
                 if (strcmp(b.dir[j].name, name) == 0)
+                    {
+                    RECORD_STOP(TRACE_FIND_INODE, NULL, 0, 0, b.dir[j].inode, name, NULL);
+                    STATS_STOP(STAT_FIND_INODE);
                     return (b.dir[j].inode);
+                    }
         adr = get_fat(adr);
         }
     
+    RECORD_STOP(TRACE_FIND_INODE, NULL, 0, 0, -1, name, NULL);
+    STATS_STOP(STAT_FIND_INODE);
     return (-1);
     }
 
 
+/**********************************************************************
+ Renvoyer le dernier bloc du rpertoire consult ou modifi (le bloc
+ du super bloc pour un disque encore inutilis). C'est l'indication
+ donne  l'allocateur pour placer un INODE prs de son entre.
+ *********************************************************************/
+
+int directory_hint (void)
+    {
+    TBLOCK b;
+    
+    if (directory_hint_block == -1) {
+        read_block(ADR_BLOCK_DEF, & b.data);
+        directory_hint_block = b.super.adr_dir;
+        }
+    
+    return (directory_hint_block);
+    }
+
+
 /**********************************************************************
  Ajouter un couple <name,inode> au rpertoire. Si un couple existe dj,
  la fonction renvoie l'adresse du descripteur et -1 dans le cas
@@ -79,7 +115,8 @@ int add_inode (const char* name, int inode)
                     {
                     oldinode = b.dir[j].inode;
                     b.dir[j].inode = inode;
-                    write_block(adr, & b.data);
+                    write_meta_block(adr, & b.data);
+                    directory_hint_block = adr;
                     return (oldinode);
                     }
                 else ;
@@ -92,13 +129,15 @@ int add_inode (const char* name, int inode)
         read_block(nadr, & b.data);
         b.dir[nj].inode = inode;
         strcpy(b.dir[nj].name, name);
-        write_block(nadr, & b.data);
+        write_meta_block(nadr, & b.data);
+        directory_hint_block = nadr;
         return (-1);
         }
 
-    /** Allouer un nouveau bloc pour le rpertoire **/
-    adr = alloc_block();
+    /** Allouer un nouveau bloc pour le rpertoire (prs du prcdent) **/
+    adr = alloc_block_near(padr + 1, ALLOC_META);
     if (adr < 0) return (-1);
+    directory_hint_block = adr;
     
     /** Initialiser ce nouveau bloc **/
     for(j = 0; j < BLOCK_DIR_SIZE; j++)
@@ -107,7 +146,7 @@ int add_inode (const char* name, int inode)
     /** Utiliser la 1ere entree de ce bloc **/
     b.dir[0].inode = inode;
     strcpy(b.dir[0].name, name);
-    write_block(adr, & b.data);
+    write_meta_block(adr, & b.data);
     
     /** Mettre  jour la FAT **/
     set_fat(adr, FAT_EOF);
@@ -143,7 +182,7 @@ void delete_inode (const char* name)
                 if (strcmp(b.dir[j].name, name) == 0)
                     {
                     b.dir[j].inode = 0;
-                    write_block(adr, & b.data);
+                    write_meta_block(adr, & b.data);
                     return ;
                     }
         adr = get_fat(adr);
@@ -173,6 +212,17 @@ void create_empty_directory ()
     }
 
 
+/**********************************************************************
+ Oublier l'adresse du repertoire en cache (changement de disque).
+ *********************************************************************/
+
+void init_sgf_dir (void)
+    {
+    directory_first_block = -1;
+    directory_hint_block = -1;
+    }
+
+
 /**********************************************************************
  Lister les fichiers du rpertoire avec leur taille.
  *********************************************************************/
@@ -182,7 +232,9 @@ void list_directory (void)
     TBLOCK b, b2;
     int adr;
     int j;
+    RECORD_DECL;
 
+    RECORD_START();
     read_block(ADR_BLOCK_DEF, &b.data);
     adr = b.super.adr_dir;
 
@@ -191,11 +243,12 @@ void list_directory (void)
         for(j = 0; j< BLOCK_DIR_SIZE; j++){
             if(b.dir[j].inode > 0){
                read_block(b.dir[j].inode, &b2.data);
-                printf("- File : %s : %d\n", b.dir[j].name, b2.inode.length);
+                printf("- File : %s : %d\n", b.dir[j].name, INODE_SIZE(b2.inode));
             }
         }
         adr = get_fat(adr);
     }
+    RECORD_STOP(TRACE_LIST_DIRECTORY, NULL, 0, 0, 0, NULL, NULL);
 }
 
 
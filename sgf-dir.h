@@ -23,6 +23,13 @@ int add_inode (const char* nom, int desc);
 
 void delete_inode (const char* nom);
 
+/**********************************************************************
+ Dernier bloc du rpertoire consult ou modifi (indication pour
+ l'allocation des INODEs).
+ *********************************************************************/
+
+int directory_hint (void);
+
 /**********************************************************************
  Formater un disque et crer un rpertoire vide.
  *********************************************************************/
@@ -35,5 +42,11 @@ void create_empty_directory (void);
 
 void list_directory (void);
 
+/**********************************************************************
+ Oublier l'adresse du repertoire en cache (changement de disque).
+ *********************************************************************/
+
+void init_sgf_dir (void);
+
 
 #endif
@@ -6,14 +6,20 @@
 **
 */
 
+#define _GNU_SOURCE             /* fileno, fallocate */
 
 #include <stdio.h>
 #include <setjmp.h>
 #include <stdlib.h>
 #include <string.h>
 #include <stdarg.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 
 #include "sgf-disk.h"
+#include "sgf-stats.h"
+#include "sgf-device.h"
 
 
 /*****************************************************************
@@ -22,9 +28,6 @@
  *
  ****************************************************************/
 
-int trace_sgf_disk = 0;
-
-
 static struct HARD_DISK {
     FILE*   file;
     int     size;
@@ -35,32 +38,109 @@ static struct HARD_DISK {
     dd = {NULL, 0, 0, 0, ""};
 
 
+static DISK_COUNTERS counters = {0, 0, 0, 0, 0};
+
+static int head = 0;            /* position de la tete simulee  */
+
+
+/*****************************************************************
+ deplacer la tete simulee sur le bloc n.
+ ****************************************************************/
+
+static void move_head (int n)
+    {
+    if (n != head)
+        {
+        counters.nb_seeks++;
+        counters.seek_distance += (n > head) ? (n - head) : (head - n);
+        }
+    head = n + 1;
+    }
+
+
 #define DISK_OK(n)              (((n) >= 0) && ((n) < 4))
 #define DISK_EXIST(n)           (hdisk[(n)].exist != 0)
 #define DISK_SCANED(n)          (hdisk[(n)].scaned != 0)
 #define NU_BLOC_OK(n)           (((n) >= 0) && ((n) < dd.size))
 
 
+/*****************************************************************
+ blocs liberes dont la place doit etre rendue au systeme hote
+ (un bit par bloc, entre discard_lo et discard_hi).
+ ****************************************************************/
+
+int discard_sgf_disk = 0;
+
+static unsigned char* discard_map = NULL;
+static int discard_lo = 0, discard_hi = -1;
+
+#define DISCARD_TEST(n)         (discard_map[(n) >> 3] & (1 << ((n) & 7)))
+#define DISCARD_SET(n)          (discard_map[(n) >> 3] |= (1 << ((n) & 7)))
+#define DISCARD_CLR(n)          (discard_map[(n) >> 3] &= ~(1 << ((n) & 7)))
+
+
+/*****************************************************************
+ le journal des meta-donnees garde des blocs en memoire jusqu'a
+ la validation de sa transaction.
+ ****************************************************************/
+
+static int (*journal_read_hook)(int n, BLOCK* b) = NULL;
+static void (*journal_forget_hook)(int n) = NULL;
+
+void set_journal_hooks (int (*read_hook)(int n, BLOCK* b), void (*forget_hook)(int n))
+    {
+    journal_read_hook = read_hook;
+    journal_forget_hook = forget_hook;
+    }
+
+
+/*****************************************************************
+ les sommes de controle des blocs sont tenues a jour a chaque
+ ecriture et verifiees a chaque lecture.
+ ****************************************************************/
+
+static void (*checksum_write_hook)(int n, BLOCK* b) = NULL;
+static void (*checksum_read_hook)(int n, BLOCK* b) = NULL;
+
+void set_checksum_hooks (void (*write_hook)(int n, BLOCK* b), void (*read_hook)(int n, BLOCK* b))
+    {
+    checksum_write_hook = write_hook;
+    checksum_read_hook = read_hook;
+    }
+
+
 /*****************************************************************
  lire un bloc physique a partir du disque.
  ****************************************************************/
 
 void read_block(int n, BLOCK* bloc)
     {
+    STATS_DECL;
+    
+    STATS_START();
     if (!dd.exist) init_sgf_disk();
     
     if (!NU_BLOC_OK(n))
         {
         panic("sgf-disk: read_block: n de bloc incorrect.");
         }
+    
+    /* version du bloc encore en attente dans le journal */
+    if (journal_read_hook != NULL  &&  journal_read_hook(n, bloc))
+        {
+        STATS_STOP(STAT_READ_BLOCK);
+        return ;
+        }
         
-    if (fseek(dd.file, (n * BLOCK_SIZE), SEEK_SET) == 0)
+    if (fseek(dd.file, ((long) n * BLOCK_SIZE), SEEK_SET) == 0)
         if (BLOCK_SIZE == fread(bloc, 1, BLOCK_SIZE, dd.file))
             {
-            if (trace_sgf_disk)
-                {
-                fprintf(stderr, "read block %d\n", n);
-                }
+            counters.nb_reads++;
+            move_head(n);
+            device_access(DEVICE_READ, n);
+            if (checksum_read_hook != NULL) checksum_read_hook(n, bloc);
+            TRACE_EVENT(EVENT_READ_BLOCK, n, 1);
+            STATS_STOP(STAT_READ_BLOCK);
             return ;
             }
     
@@ -73,31 +153,306 @@ void read_block(int n, BLOCK* bloc)
  ecrire un bloc physique sur disque.
  ************************************************************/
 
+static void (*write_hook)(int n) = NULL;
+
+void set_write_hook (void (*hook)(int n))
+    {
+    write_hook = hook;
+    }
+
 void write_block(int n, BLOCK* b)
     {
+    STATS_DECL;
+    
+    STATS_START();
     if (!dd.exist) init_sgf_disk();
     
     if (n < 0  ||  n >= dd.size)
         {
         panic("sgf-disk: write_block: n de bloc incorrect.");
         }
+    
+    /* une version en attente dans le journal est perimee */
+    if (journal_forget_hook != NULL) journal_forget_hook(n);
+    
+    /* l'ancien contenu du bloc peut devoir etre preserve (instantanes) */
+    if (write_hook != NULL) write_hook(n);
+    
+    /* un bloc de nouveau utilise ne doit plus etre rendu au systeme hote */
+    if (discard_map != NULL  &&  n >= discard_lo  &&  n <= discard_hi) DISCARD_CLR(n);
         
-    if (fseek(dd.file, (n * BLOCK_SIZE), SEEK_SET) == 0)
+    if (fseek(dd.file, ((long) n * BLOCK_SIZE), SEEK_SET) == 0)
         if (BLOCK_SIZE == fwrite(b, 1, BLOCK_SIZE, dd.file))
             {
             fflush(dd.file);
-            if (trace_sgf_disk)
+            counters.nb_writes++;
+            move_head(n);
+            device_access(DEVICE_WRITE, n);
+            if (checksum_write_hook != NULL) checksum_write_hook(n, b);
+            TRACE_EVENT(EVENT_WRITE_BLOCK, n, 1);
+            STATS_STOP(STAT_WRITE_BLOCK);
+            return ;
+            }
+    
+    panic("sgf-disk: impossible d'crire le bloc %d\n", n);
+    exit(EXIT_FAILURE);
+    }
+
+
+/************************************************************
+ ecrire une suite de blocs consecutifs (un seul fwrite).
+ ************************************************************/
+
+void write_blocks (int first, int count, BLOCK* b)
+    {
+    int n;
+    STATS_DECL;
+    
+    STATS_START();
+    if (!dd.exist) init_sgf_disk();
+    if (count <= 0) return;
+    
+    if (first < 0  ||  count > dd.size - first)
+        {
+        panic("sgf-disk: write_blocks: n de bloc incorrect.");
+        }
+    
+    for(n = first; n < first + count; n++)
+        {
+        if (journal_forget_hook != NULL) journal_forget_hook(n);
+        if (write_hook != NULL) write_hook(n);
+        if (discard_map != NULL  &&  n >= discard_lo  &&  n <= discard_hi) DISCARD_CLR(n);
+        }
+    
+    if (fseek(dd.file, ((long) first * BLOCK_SIZE), SEEK_SET) == 0)
+        if ((size_t) count == fwrite(b, BLOCK_SIZE, count, dd.file))
+            {
+            fflush(dd.file);
+            counters.nb_writes += count;
+            for(n = first; n < first + count; n++)
                 {
-                fprintf(stderr, "write block %d\n", n);
+                move_head(n);
+                device_access(DEVICE_WRITE, n);
+                if (checksum_write_hook != NULL) checksum_write_hook(n, & b[n - first]);
                 }
+            TRACE_EVENT(EVENT_WRITE_BLOCK, first, count);
+            STATS_STOP(STAT_WRITE_BLOCK);
             return ;
             }
     
-    panic("sgf-disk: impossible d'crire le bloc %d\n", n);
+    panic("sgf-disk: impossible d'crire les blocs %d a %d\n", first, first + count - 1);
     exit(EXIT_FAILURE);
     }
 
 
+/************************************************************
+ preserver des maintenant l'ancien contenu du bloc n qui sera
+ ecrase plus tard (le journal valide ses transactions apres
+ la recopie des blocs des instantanes).
+ ************************************************************/
+
+void preserve_block (int n)
+    {
+    if (write_hook != NULL) write_hook(n);
+    }
+
+
+/************************************************************
+ rendre au systeme hote la place des blocs first..first+count-1
+ (le fichier image garde sa taille, ces blocs se relisent comme
+ des zeros). Renvoie -1 si le systeme hote ne le permet pas.
+ ************************************************************/
+
+int punch_blocks (int first, int count)
+    {
+    if (!dd.exist) init_sgf_disk();
+    if (count <= 0) return (0);
+    
+#if defined(__linux__) && defined(FALLOC_FL_PUNCH_HOLE)
+    fflush(dd.file);
+    if (fallocate(fileno(dd.file), FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+                  (long) first * BLOCK_SIZE, (long) count * BLOCK_SIZE) == 0)
+        {
+        counters.nb_punched += count;
+        device_access(DEVICE_TRIM, first);
+        TRACE_EVENT(EVENT_PUNCH_BLOCKS, first, count);
+        return (0);
+        }
+#endif
+    return (-1);
+    }
+
+
+/************************************************************
+ noter un bloc libere (si discard_sgf_disk) ; sa place ne sera
+ rendue qu'au prochain flush_discards, une fois sa liberation
+ ecrite sur le disque.
+ ************************************************************/
+
+void discard_block (int n)
+    {
+    if (!discard_sgf_disk  ||  !NU_BLOC_OK(n)) return;
+    
+    if (discard_map == NULL)
+        {
+        discard_map = calloc((dd.size + 7) / 8, 1);
+        if (discard_map == NULL) return;
+        }
+    
+    DISCARD_SET(n);
+    if (discard_hi < discard_lo)
+        discard_lo = discard_hi = n;
+    else if (n < discard_lo)
+        discard_lo = n;
+    else if (n > discard_hi)
+        discard_hi = n;
+    }
+
+
+/************************************************************
+ rendre en une fois la place des blocs notes, par suites de
+ blocs consecutifs.
+ ************************************************************/
+
+void flush_discards (void)
+    {
+    int n, first;
+    
+    if (discard_map == NULL  ||  discard_hi < discard_lo) return;
+    
+    for(n = discard_lo; n <= discard_hi; )
+        {
+        if (discard_map[n >> 3] == 0)
+            {
+            n = (n | 7) + 1;
+            continue;
+            }
+        if (!DISCARD_TEST(n))
+            {
+            n++;
+            continue;
+            }
+        for(first = n; n <= discard_hi  &&  DISCARD_TEST(n); n++)
+            DISCARD_CLR(n);
+        punch_blocks(first, n - first);
+        }
+    
+    discard_lo = 0;
+    discard_hi = -1;
+    }
+
+
+/************************************************************
+ projection en memoire du fichier image (en lecture seule),
+ faite au premier map_blocks et partagee par les vues. Une
+ projection encore utilisee a la fermeture du disque reste en
+ place jusqu'au dernier unmap_blocks.
+ ****************************************************************/
+
+typedef struct DISK_MAP {
+    char*   base;
+    size_t  size;
+    int     refs;               /* vues encore ouvertes         */
+    int     closed;             /* son disque est ferme         */
+    struct DISK_MAP* next;
+    }
+    DISK_MAP;
+
+static DISK_MAP* disk_maps = NULL;      /* la courante en tete  */
+
+static void drop_map (DISK_MAP* m)
+    {
+    DISK_MAP** p;
+    
+    for(p = &disk_maps; *p != m; p = &(*p)->next)
+        ;
+    *p = m->next;
+    munmap(m->base, m->size);
+    free(m);
+    }
+
+const char* map_blocks (int first, int count)
+    {
+    DISK_MAP* m = disk_maps;
+    BLOCK tmp;
+    int n;
+    
+    if (!dd.exist) init_sgf_disk();
+    if (first < 0  ||  count <= 0  ||  count > dd.size - first) return (NULL);
+    
+    /* les blocs en attente dans le journal ne sont pas encore sur le disque */
+    if (journal_read_hook != NULL)
+        for(n = first; n < first + count; n++)
+            if (journal_read_hook(n, &tmp)) return (NULL);
+    
+    if (m == NULL  ||  m->closed)
+        {
+        m = malloc(sizeof(DISK_MAP));
+        if (m == NULL) return (NULL);
+        fflush(dd.file);
+        m->size = (size_t) dd.size * BLOCK_SIZE;
+        m->base = mmap(NULL, m->size, PROT_READ, MAP_SHARED, fileno(dd.file), 0);
+        if (m->base == MAP_FAILED)
+            {
+            free(m);
+            return (NULL);
+            }
+        m->refs = 0;
+        m->closed = 0;
+        m->next = disk_maps;
+        disk_maps = m;
+        }
+    m->refs++;
+    
+    /* les blocs sont lus comme par read_block (compteurs, sommes de controle) */
+    counters.nb_reads += count;
+    for(n = first; n < first + count; n++)
+        {
+        move_head(n);
+        device_access(DEVICE_READ, n);
+        if (checksum_read_hook != NULL)
+            checksum_read_hook(n, (BLOCK*) (m->base + (size_t) n * BLOCK_SIZE));
+        }
+    TRACE_EVENT(EVENT_READ_BLOCK, first, count);
+    return (m->base + (size_t) first * BLOCK_SIZE);
+    }
+
+int unmap_blocks (const char* p)
+    {
+    DISK_MAP* m;
+    
+    for(m = disk_maps; m != NULL; m = m->next)
+        if (p >= m->base  &&  p < m->base + m->size)
+            {
+            if (m->refs <= 0) return (-1);
+            if (--m->refs == 0  &&  m->closed) drop_map(m);
+            return (0);
+            }
+    return (-1);
+    }
+
+
+/************************************************************
+ lire et remettre a zero les compteurs d'E/S.
+ ************************************************************/
+
+void get_disk_counters (DISK_COUNTERS* c)
+    {
+    *c = counters;
+    }
+
+void reset_disk_counters (void)
+    {
+    counters.nb_reads = 0;
+    counters.nb_writes = 0;
+    counters.nb_seeks = 0;
+    counters.seek_distance = 0;
+    counters.nb_punched = 0;
+    reset_device_counters();
+    }
+
+
+
 /************************************************************
  renvoyer la taille du disque en blocs.
  ************************************************************/
@@ -120,6 +475,7 @@ int test_disk(char* name)
     long size;
     FILE* file;
     
+    close_sgf_disk();
     dd.file = NULL;
     dd.exist = 0;
     dd.size = 0;
@@ -140,7 +496,7 @@ int test_disk(char* name)
         return (0);
         }
     
-    if (size > 10000) {
+    if (size > MAX_DISK_SIZE) {
         fclose(file);
 	panic("sgf-disk: test_disk: disque %s trop important.", name);
         return (0);
@@ -150,16 +506,100 @@ int test_disk(char* name)
     dd.exist = 1;
     dd.size = size;
     dd.scaned = 1;
-    strcpy(dd.nom, name);
+    strncpy(dd.nom, name, sizeof(dd.nom) - 1);
+    dd.nom[sizeof(dd.nom) - 1] = '\0';
     
     return (1);
     }
 
 
+/************************************************************
+ creer un disque virtuel creux de "size" blocs dans le fichier
+ "name" et l'utiliser (renvoie 0 en cas d'echec).
+ ************************************************************/
+
+int create_disk (char* name, int size)
+    {
+    FILE* file;
+    
+    if (size <= 0  ||  size > MAX_DISK_SIZE) return (0);
+    
+    /* fixer la taille sans rien ecrire : le systeme hote n'alloue aucun bloc */
+    file = fopen(name, "wb");
+    if (file == NULL) return (0);
+    if (ftruncate(fileno(file), (off_t) size * BLOCK_SIZE) != 0)
+        {
+        fclose(file);
+        return (0);
+        }
+    if (fclose(file) != 0) return (0);
+    
+    return (test_disk(name));
+    }
+
+
+int reserve_blocks (int first, int count)
+    {
+    if (!dd.exist) init_sgf_disk();
+    if (count <= 0) return (0);
+    
+#if defined(__linux__)
+    fflush(dd.file);
+    if (fallocate(fileno(dd.file), FALLOC_FL_KEEP_SIZE,
+                  (long) first * BLOCK_SIZE, (long) count * BLOCK_SIZE) == 0)
+        return (0);
+#endif
+    return (-1);
+    }
+
+
+/************************************************************
+ fermer le disque virtuel courant (s'il existe).
+ ************************************************************/
+
+static void (*close_hook)(void) = NULL;
+
+void set_close_hook (void (*hook)(void))
+    {
+    close_hook = hook;
+    }
+
+void close_sgf_disk (void)
+    {
+    void (*hook)(void) = close_hook;
+    
+    /* laisser les couches superieures vider leurs caches */
+    close_hook = NULL;
+    if (dd.file != NULL  &&  hook != NULL) hook();
+    close_hook = hook;
+    
+    if (dd.file != NULL) flush_discards();
+    free(discard_map);
+    discard_map = NULL;
+    
+    /* la projection du disque ferme disparait avec sa derniere vue */
+    if (disk_maps != NULL  &&  !disk_maps->closed)
+        {
+        disk_maps->closed = 1;
+        if (disk_maps->refs == 0) drop_map(disk_maps);
+        }
+    
+    if (dd.file != NULL) fclose(dd.file);
+    
+    dd.file = NULL;
+    dd.exist = 0;
+    dd.size = 0;
+    dd.scaned = 0;
+    strcpy(dd.nom, "");
+    }
+
+
 /************************************************************
  afficher un message d'erreur et arreter la simulation.
  ************************************************************/
 
+int sgf_failed = 0;
+
 void panic (const char *format, ...)
     {
     va_list ap;
@@ -169,6 +609,10 @@ void panic (const char *format, ...)
     vfprintf(stderr, format, ap);
     va_end(ap);
     fprintf(stderr, "\n");
+    
+    /* exit ne doit pas etre rappele depuis une fonction d'atexit */
+    if (sgf_failed) _exit(EXIT_FAILURE);
+    sgf_failed = 1;
     exit(EXIT_FAILURE);
     /* ARRET DE LA SIMULATION */
     }
@@ -179,6 +623,9 @@ void panic (const char *format, ...)
  ************************************************************/
 
 void init_sgf_disk() {
+	/* un disque a deja ete choisi (par test_disk) */
+	if (dd.exist) return ;
+	
 	/* tester les quatre disques */
 	if (test_disk("disk0")) return ;
 	if (test_disk("disk1")) return ;
@@ -18,6 +18,7 @@
  *********************************************************************/
  
 #define BLOCK_SIZE              (128)    /* 128 octets */
+#define MAX_DISK_SIZE           (1 << 24) /* taille max. en blocs */
 
 typedef char BLOCK[ BLOCK_SIZE ];
 
@@ -37,17 +38,139 @@ int get_disk_size();
 void read_block (int n, BLOCK* b);
 void write_block (int n, BLOCK* b);
 
+/************************************************************
+ Ecrire les "count" blocs consecutifs b[0..count-1] a partir
+ du bloc "first" en une seule E/S (meme effet que "count"
+ appels a write_block).
+ ***********************************************************/
+
+void write_blocks (int first, int count, BLOCK* b);
+
+/************************************************************
+ Acceder sans copie aux "count" blocs consecutifs a partir du
+ bloc "first", par une projection en memoire (mmap) du fichier
+ image, en lecture seule. Les blocs sont comptes et verifies
+ comme par read_block. Renvoie NULL si la projection n'est pas
+ possible ou si un de ces blocs attend dans le journal (il faut
+ alors utiliser read_block). Les ecritures suivantes sont vues
+ par la projection. unmap_blocks rend la projection (-1 si
+ "p" n'en vient pas) ; elle survit a la fermeture du disque
+ tant qu'elle est utilisee.
+ ***********************************************************/
+
+const char* map_blocks (int first, int count);
+int unmap_blocks (const char* p);
+
+/************************************************************
+ Compteurs d'E/S du disque (depuis le dernier reset).
+ Le disque simule une tete de lecture : apres un acces au
+ bloc n elle est placee sur le bloc n+1, et un acces au
+ bloc m cote un dplacement de |m - (n+1)| blocs.
+ ***********************************************************/
+
+typedef struct DISK_COUNTERS
+    {
+    long nb_reads;              /* blocs lus                        */
+    long nb_writes;             /* blocs ecrits                     */
+    long nb_seeks;              /* acces non sequentiels            */
+    long seek_distance;         /* deplacement cumule de la tete    */
+    long nb_punched;            /* blocs rendus au systeme hote     */
+    }
+    DISK_COUNTERS;
+
+void get_disk_counters (DISK_COUNTERS* c);
+void reset_disk_counters (void);
+
+/************************************************************
+ La duree simulee de ces E/S (selon le modele de peripherique
+ choisi) est donnee par sgf-device.h ; reset_disk_counters
+ remet aussi ses compteurs a zero.
+ ***********************************************************/
+
 /************************************************************
  initialisation et dcouverte du disque
  ***********************************************************/
  
 void init_sgf_disk (void);
 
+/************************************************************
+ Utiliser le disque virtuel contenu dans le fichier "name"
+ (renvoie 0 si le fichier n'est pas un disque utilisable).
+ Le disque precedent est ferme.
+ ***********************************************************/
+
+int test_disk (char* name);
+void close_sgf_disk (void);
+
+/************************************************************
+ Creer (et utiliser) un disque virtuel de "size" blocs. Le
+ fichier image est creux : le systeme hote n'alloue de la
+ place qu'aux blocs ecrits. reserve_blocks alloue d'avance
+ la place des blocs first..first+count-1 (fallocate sous
+ Linux, -1 si ce n'est pas possible).
+ ***********************************************************/
+
+int create_disk (char* name, int size);
+int reserve_blocks (int first, int count);
+
+/************************************************************
+ Rendre au systeme hote la place des blocs libres du fichier
+ image (fallocate(FALLOC_FL_PUNCH_HOLE) sous Linux, -1 si ce
+ n'est pas possible). punch_blocks agit immediatement ; si
+ discard_sgf_disk est non nul (0 par defaut), discard_block
+ note un bloc libere dans la FAT et flush_discards rend en
+ une fois la place des blocs notes (a chaque validation du
+ journal et a la fermeture du disque).
+ ***********************************************************/
+
+extern int discard_sgf_disk;
+
+int punch_blocks (int first, int count);
+void discard_block (int n);
+void flush_discards (void);
+
+/************************************************************
+ Fonction appelee par close_sgf_disk avant la fermeture du
+ disque (pour ecrire les donnees encore en memoire).
+ ***********************************************************/
+
+void set_close_hook (void (*hook)(void));
+
+/************************************************************
+ Fonction appelee par write_block avant d'ecraser le bloc "n"
+ (pour recopier son ancien contenu).
+ ***********************************************************/
+
+void set_write_hook (void (*hook)(int n));
+void preserve_block (int n);
+
+/************************************************************
+ Fonctions du journal des meta-donnees : read_block lui
+ demande d'abord le bloc "n" (il renvoie 1 s'il l'a fourni),
+ write_block lui signale que le bloc "n" est ecrit directement.
+ ***********************************************************/
+
+void set_journal_hooks (int (*read_hook)(int n, BLOCK* b), void (*forget_hook)(int n));
+
+/************************************************************
+ Fonctions des sommes de controle : write_block passe a
+ "write_hook" chaque bloc ecrit, read_block passe a
+ "read_hook" chaque bloc lu sur le disque.
+ ***********************************************************/
+
+void set_checksum_hooks (void (*write_hook)(int n, BLOCK* b), void (*read_hook)(int n, BLOCK* b));
+
 
 /************************************************************
  Afficher le message d'erreur et stopper la simulation.
+ panic positionne sgf_failed avant d'appeler exit : les
+ fonctions enregistrees par atexit ne doivent alors plus
+ rien ecrire sur le disque, dont l'etat est incoherent. Une
+ panique pendant cet arret termine aussitot le processus.
  ************************************************************/
 
+extern int sgf_failed;
+
 void panic (const char *format, ...);
 
 #endif
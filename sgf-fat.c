@@ -10,13 +10,20 @@
 #include <stdio.h>
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "sgf-disk.h"
 #include "sgf-data.h"
 #include "sgf-fat.h"
+#include "sgf-journal.h"
+#include "sgf-crc.h"
+#include "sgf-scan.h"
+#include "sgf-stats.h"
 
 
 #define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+#define FAT_PER_BLOCK           (BLOCK_SIZE / sizeof(int))
+#define FAT_CHUNK_BLOCKS        (1024)  /* blocs de FAT par criture (128 Ko) */
 
 
 /**********************************************************************
@@ -33,10 +40,34 @@ typedef struct FAT
     int*   tab;                 /* la FAT en mmoire                    */
     BLOCK* blocks;              /* la FAT vu comme un tab. de blocs     */
     int*   modif;               /* pour chaque bloc un bit de modif     */
+    int    modif_lo, modif_hi;  /* blocs modifis (vide si lo > hi)    */
+    int    nb_free;             /* nombre d'entres FAT_FREE           */
     }
     FAT;
 
-static FAT  fat = {0, 0, 0, NULL, NULL, NULL};
+static FAT  fat = {0, 0, 0, NULL, NULL, NULL, 0, -1, 0};
+
+int sgf_alloc_policy = ALLOC_NEAR_GOAL;
+
+
+/**********************************************************************
+ *
+ *  Blocs librs dans la transaction en cours du journal (un bit
+ *  par bloc, entre held_lo et held_hi). La FAT valide les dsigne
+ *  encore : ils restent FAT_FREE mais ne sont pas rallous avant
+ *  release_freed_blocks.
+ *
+ *********************************************************************/
+
+static unsigned char* held_map = NULL;
+static int held_lo = 0, held_hi = -1;
+static int nb_held = 0;
+
+#define HELD_TEST(n)            (held_map[(n) >> 3] & (1 << ((n) & 7)))
+#define HELD_SET(n)             (held_map[(n) >> 3] |= (1 << ((n) & 7)))
+
+/* bloc libre et rallouable */
+#define BLOCK_FREE(k)           (fat.tab[k] == FAT_FREE  &&  (nb_held == 0  ||  !HELD_TEST(k)))
 
 
 /**********************************************************************
@@ -54,6 +85,7 @@ static void create_memory_fat (void)
         {
         free(fat.tab);
         free(fat.modif);
+        free(held_map);
         fat.in_memory = 0;
         }
     
@@ -65,8 +97,12 @@ static void create_memory_fat (void)
     fat.tab = malloc(fat_size_in_bytes);
     fat.blocks = (BLOCK*) fat.tab;
     fat.modif = malloc(fat.fat_size_in_blocks * sizeof(int));
-    if (fat.tab == NULL || fat.modif == NULL)
+    held_map = calloc((fat.disk_size + 7) / 8, 1);
+    if (fat.tab == NULL || fat.modif == NULL || held_map == NULL)
         panic("impossible d'allouer la FAT en mmoire.");
+    held_lo = 0;
+    held_hi = -1;
+    nb_held = 0;
     
     /* le bloc physique 0 est rserv pour le bloc de dfinition */
     fat.tab[0] = FAT_RESERVED;
@@ -76,6 +112,8 @@ static void create_memory_fat (void)
         fat.tab[k + ADR_BLOCK_FAT] = FAT_RESERVED;
         fat.modif[k] = 1;
         }
+    fat.modif_lo = 0;
+    fat.modif_hi = fat.fat_size_in_blocks - 1;
     
     k = fat.fat_size_in_blocks + ADR_BLOCK_FAT;
     for(; (k < fat.disk_size); k++)
@@ -92,6 +130,7 @@ static void create_memory_fat (void)
 void init_sgf_fat (void)
     {
     TBLOCK block;
+    FAT_SCAN s;
     int k;
     
     create_memory_fat();
@@ -107,11 +146,31 @@ void init_sgf_fat (void)
         read_block(k + ADR_BLOCK_FAT, & fat.blocks[k]);
         fat.modif[k] = 0;
         }
+    fat.modif_lo = 0;
+    fat.modif_hi = -1;
+    
+    fat_scan(fat.tab, fat.disk_size, &s);
+    fat.nb_free = s.nb_free;
     
     fat.in_memory = 1;
     }
 
 
+/**********************************************************************
+ *
+ *  Taille de la FAT sur disque (en blocs)
+ *
+ *********************************************************************/
+
+int get_fat_size_in_blocks (void)
+    {
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialisee.");
+    
+    return (fat.fat_size_in_blocks);
+    }
+
+
 /**********************************************************************
  *
  *  Sauvegarde des blocs modifis de la FAT sur disque
@@ -121,13 +180,19 @@ void init_sgf_fat (void)
 void save_fat (void)
     {
     int k;
+    STATS_DECL;
     
-    for(k = 0; (k < fat.fat_size_in_blocks); k++)
+    STATS_START();
+    /* seuls les blocs entre le premier et le dernier modifis sont examins */
+    for(k = fat.modif_lo; (k <= fat.modif_hi); k++)
         if (fat.modif[k])
             {
-            write_block(k + ADR_BLOCK_FAT, & fat.blocks[k]);
+            write_meta_block(k + ADR_BLOCK_FAT, & fat.blocks[k]);
             fat.modif[k] = 0;
             }
+    fat.modif_lo = fat.fat_size_in_blocks;
+    fat.modif_hi = -1;
+    STATS_STOP(STAT_SAVE_FAT);
     }
 
 
@@ -158,6 +223,29 @@ int get_fat (int n)
 
 void set_fat (int n, int valeur)
     {
+    set_fat_lazy (n, valeur);
+    save_fat ();
+    }
+
+
+/**********************************************************************
+ *
+ *  Changer la valeur d'une entre de la FAT sans la sauver
+ *  (le bloc de FAT est simplement marqu comme modifi).
+ *
+ *********************************************************************/
+
+static int (*free_hook)(int n) = NULL;
+
+void set_free_hook (int (*hook)(int n))
+    {
+    free_hook = hook;
+    }
+
+void set_fat_lazy (int n, int valeur)
+    {
+    int k;
+    
     if (!fat.in_memory)
         panic("La FAT n'est pas initialise.");
     
@@ -166,14 +254,82 @@ void set_fat (int n, int valeur)
     
     assert(
         ((valeur) == FAT_FREE) ||
+        ((valeur) == FAT_RESERVED) ||
+        ((valeur) == FAT_SNAPSHOT) ||
         ((valeur) == FAT_INODE) ||
         ((valeur) == FAT_EOF) ||
         ((valeur) >= 0 && (valeur) < fat.disk_size)
     );
     
+    /* un bloc encore utilise par un instantane n'est pas reellement libere */
+    if (valeur == FAT_FREE  &&  fat.tab[ n ] != FAT_FREE  &&
+        free_hook != NULL  &&  free_hook(n))
+        valeur = FAT_SNAPSHOT;
+    
+    /* sa place dans le fichier image pourra etre rendue au systeme hote,
+       et il ne sera reutilise qu'apres la validation de sa liberation */
+    if (valeur == FAT_FREE  &&  fat.tab[ n ] != FAT_FREE)
+        {
+        discard_block(n);
+        if (!HELD_TEST(n))
+            {
+            HELD_SET(n);
+            nb_held++;
+            if (n < held_lo  ||  held_hi < held_lo) held_lo = n;
+            if (n > held_hi) held_hi = n;
+            }
+        }
+    
+    if (fat.tab[ n ] == FAT_FREE) fat.nb_free--;
+    if (valeur == FAT_FREE) fat.nb_free++;
+    
     fat.tab[ n ] = valeur;
-    fat.modif[ n / (BLOCK_SIZE / sizeof(int)) ] = 1;
-    save_fat ();
+    k = n / (BLOCK_SIZE / sizeof(int));
+    fat.modif[ k ] = 1;
+    if (k < fat.modif_lo) fat.modif_lo = k;
+    if (k > fat.modif_hi) fat.modif_hi = k;
+    }
+
+
+/**********************************************************************
+ *
+ *  La libration des blocs retenus est valide : ils redeviennent
+ *  allouables.
+ *
+ *********************************************************************/
+
+void release_freed_blocks (void)
+    {
+    if (nb_held == 0) return;
+    
+    memset(held_map + (held_lo >> 3), 0, (held_hi >> 3) - (held_lo >> 3) + 1);
+    held_lo = 0;
+    held_hi = -1;
+    nb_held = 0;
+    }
+
+unsigned get_held_blocks_count (void)
+    {
+    return (nb_held);
+    }
+
+
+/**********************************************************************
+ *
+ *  Il ne reste de libres que des blocs retenus : la transaction est
+ *  valide pour les rendre allouables. Renvoie 0 si rien n'a t
+ *  libr (une validation ou une opration est en cours).
+ *
+ *********************************************************************/
+
+static int reclaim_held_blocks (void)
+    {
+    /* une validation au milieu d'une opration la couperait en deux ;
+       des modifications de la FAT pas encore sauves en sont une */
+    if (nb_held == 0  ||  !journal_between_ops()  ||  fat.modif_lo <= fat.modif_hi) return (0);
+    
+    sgf_journal_commit();
+    return (nb_held == 0);
     }
 
 
@@ -185,19 +341,135 @@ void set_fat (int n, int valeur)
  *********************************************************************/
 
 int alloc_block (void)
+    {
+    int n;
+    STATS_DECL;
+    
+    STATS_START();
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialise.");
+    
+    do  {
+        n = fat_find_free(fat.tab, 0, fat.disk_size);
+        while (n >= 0  &&  !BLOCK_FREE(n))
+            n = fat_find_free(fat.tab, n + 1, fat.disk_size);
+        }
+    while (n < 0  &&  reclaim_held_blocks());
+    STATS_STOP(STAT_ALLOC_BLOCK);
+    return (n);
+    }
+
+
+/**********************************************************************
+ *
+ *  Savoir si le bloc "k" appartient  la zone prfre pour les
+ *  allocations de type "kind" (ALLOC_META ou ALLOC_DATA).
+ *
+ *********************************************************************/
+
+static int in_zone (int k, int kind)
+    {
+    if (kind == ALLOC_META)
+        return ((k % ALLOC_GROUP_SIZE) < ALLOC_GROUP_META);
+    return ((k % ALLOC_GROUP_SIZE) >= ALLOC_GROUP_META);
+    }
+
+
+/**********************************************************************
+ *
+ *  Rechercher le bloc libre le plus proche du bloc "goal", en
+ *  s'loignant alternativement vers l'avant puis vers l'arrire,
+ *  d'abord dans la zone "kind" puis n'importe o
+ *  (en cas d'erreur cette fonction renvoie -1).
+ *
+ *********************************************************************/
+
+static int near_block (int goal, int kind)
+    {
+    int d, k, zoned;
+    
+    for(zoned = 1; zoned >= 0; zoned--)
+        for(d = 0; (goal + d < fat.disk_size  ||  goal - d > 0); d++)
+            {
+            k = goal + d;
+            if (k < fat.disk_size  &&  BLOCK_FREE(k)  &&
+                (!zoned  ||  in_zone(k, kind)))
+                return (k);
+            k = goal - d - 1;
+            if (k >= 0  &&  BLOCK_FREE(k)  &&
+                (!zoned  ||  in_zone(k, kind)))
+                return (k);
+            }
+    
+    return (-1);
+    }
+
+int alloc_block_near (int goal, int kind)
     {
     int k;
     
     if (!fat.in_memory)
         panic("La FAT n'est pas initialise.");
     
-    for(k = 0; k < fat.disk_size; k++)
-        if (fat.tab[k] == FAT_FREE)
-            return (k);
+    if (sgf_alloc_policy == ALLOC_FIRST_FIT  ||  goal < 0  ||  goal >= fat.disk_size)
+        return alloc_block();
+    
+    while ((k = near_block(goal, kind)) < 0  &&  reclaim_held_blocks())
+        ;
+    return (k);
+    }
+
+
+/**********************************************************************
+ *
+ *  Rechercher une suite de "nb" blocs libres conscutifs a partir
+ *  du bloc "goal", d'abord dans les zones de donnes puis n'importe
+ *  o (en cas d'chec cette fonction renvoie -1).
+ *
+ *********************************************************************/
 
+static int free_extent (int nb, int goal)
+    {
+    int k, run, pass, zoned;
+    
+    /* une suite plus longue que la zone des donnees d'un groupe n'y tient pas */
+    zoned = (sgf_alloc_policy == ALLOC_NEAR_GOAL  &&  nb <= ALLOC_GROUP_SIZE - ALLOC_GROUP_META);
+    for(; zoned >= 0; zoned--)
+        /* deux passes : de goal a la fin, puis du debut a goal */
+        for(pass = 0; pass < 2; pass++)
+            {
+            run = 0;
+            for(k = (pass == 0) ? goal : 0; k < fat.disk_size; k++)
+                {
+                if (!BLOCK_FREE(k)  ||  (zoned  &&  !in_zone(k, ALLOC_DATA)))
+                    {
+                    run = 0;
+                    if (pass == 1  &&  k >= goal + nb) break;
+                    continue;
+                    }
+                if (++run == nb)
+                    return (k - nb + 1);
+                }
+            }
+    
     return (-1);
     }
 
+int find_free_extent (int nb, int goal)
+    {
+    int k;
+    
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialise.");
+    
+    if (goal < 0  ||  goal >= fat.disk_size) goal = 0;
+    if (sgf_alloc_policy == ALLOC_FIRST_FIT) goal = 0;
+    
+    while ((k = free_extent(nb, goal)) < 0  &&  reclaim_held_blocks())
+        ;
+    return (k);
+    }
+
 
 /**********************************************************************
  *
@@ -212,61 +484,91 @@ void create_empty_fat ()
     TBLOCK super_bloc;
     BLOCK *blocks;
     int *tab;
-    int k;
+    int k, first, count;
     int adr_rep;
+    int adr_journal, nb_journal;
     int disk_size = get_disk_size();
     
+    /* les mta-donnes en attente de l'ancien contenu sont abandonnes */
+    close_sgf_journal();
+    close_sgf_crc();
+    
     fat_size_in_bytes  = (disk_size * sizeof(int));
     fat_size_in_blocks = PAR_EXCES(fat_size_in_bytes, BLOCK_SIZE);
     fat_size_in_bytes  = (fat_size_in_blocks * BLOCK_SIZE);
     
-    tab = malloc(fat_size_in_bytes);
-    blocks = (BLOCK*) tab;
-    if (tab == NULL)
-        panic("FAT: create_empty_fat: impossible d'allouer la FAT en mmoire.");
+    /* Le bloc physique 0 (Super Bloc) et la FAT sont rservs, */
+    /* le journal des mta-donnes suit la FAT et le premier   */
+    /* bloc libre qui reste est pris pour le rpertoire.        */
+    /* ----------------------------------------------------- */
+
+    nb_journal = journal_size(disk_size);
+    adr_journal = (nb_journal > 0) ? fat_size_in_blocks + ADR_BLOCK_FAT : -1;
+    adr_rep = fat_size_in_blocks + ADR_BLOCK_FAT + nb_journal;
+    if (adr_rep >= disk_size)
+        panic("FAT: create_empty_fat: disque trop petit (%d blocs).", disk_size);
     
-    /* le bloc physique 0 est rserv pour le Super Bloc */
-    /* ------------------------------------------------- */
-
-    tab[0] = FAT_RESERVED;
-
-    for(k = 0; (k < fat_size_in_blocks); k++)
-        {
-        tab[k + ADR_BLOCK_FAT] = FAT_RESERVED;
-        }
-    
-    k = fat_size_in_blocks + ADR_BLOCK_FAT;
-    for(; (k < disk_size); k++)
-        {
-        tab[k] = FAT_FREE;
-        }
-    
-    /* Rechercher un bloc libre et le prendre pour le rpertoire */
-    /* --------------------------------------------------------- */
-
-    for(k = 0; (tab[k] != FAT_FREE); k++) ;
-    adr_rep = (k);
-    tab[k] = FAT_EOF ;
+    /* Ecrire la FAT sur le disque par morceaux (elle n'est */
+    /* jamais entirement en mmoire)                      */
+    /* ---------------------------------------------------- */
+
+    count = (fat_size_in_blocks < FAT_CHUNK_BLOCKS) ? fat_size_in_blocks : FAT_CHUNK_BLOCKS;
+    blocks = malloc(count * BLOCK_SIZE);
+    tab = (int*) blocks;
+    if (blocks == NULL)
+        panic("FAT: create_empty_fat: impossible d'allouer la FAT en mmoire.");
     
-    /* Ecrire la FAT sur le disque */
-    /* --------------------------- */
-
-    for(k = 0; (k < fat_size_in_blocks); k++)
+    for(first = 0; (first < fat_size_in_blocks); first += count)
         {
-        write_block(k + ADR_BLOCK_FAT, & blocks[k]);
+        if (count > fat_size_in_blocks - first) count = fat_size_in_blocks - first;
+        for(k = 0; (k < count * (int) FAT_PER_BLOCK); k++)
+            {
+            int n = first * FAT_PER_BLOCK + k;
+            
+            tab[k] = (n < adr_rep  ||  n >= disk_size) ? FAT_RESERVED
+                   : (n == adr_rep) ? FAT_EOF
+                   : FAT_FREE;
+            }
+        write_blocks(first + ADR_BLOCK_FAT, count, blocks);
         }
 
     /* Prparer et crire le Super Bloc sur le disque */
     /* ---------------------------------------------- */
     
+    memset(& super_bloc, 0, sizeof(super_bloc));
     super_bloc.super.signature = SIGNATURE_SUPER_BLOCK;
     super_bloc.super.adr_dir = adr_rep;
+    super_bloc.super.ext_signature = SIGNATURE_SUPER_EXT;
+    super_bloc.super.adr_refcount = -1;
+    super_bloc.super.nb_refcount_blocks = 0;
+    super_bloc.super.adr_snapshots = -1;
+    super_bloc.super.adr_journal = adr_journal;
+    super_bloc.super.nb_journal_blocks = nb_journal;
+    super_bloc.super.adr_checksums = -1;
+    super_bloc.super.nb_checksum_blocks = 0;
     write_block(0, & super_bloc.data);
     
+    /* Un journal vide (l'en-tte d'un ancien journal serait rejou) */
+    /* ------------------------------------------------------------ */
+    
+    if (nb_journal > 0)
+        {
+        memset(& super_bloc, 0, sizeof(super_bloc));
+        write_block(adr_journal, & super_bloc.data);
+        }
+    
+    /* Rendre au systme hte la place des blocs inutiliss (image creuse) */
+    /* ------------------------------------------------------------------- */
+    
+    if (nb_journal > 1) punch_blocks(adr_journal + 1, nb_journal - 1);
+    punch_blocks(adr_rep + 1, disk_size - adr_rep - 1);
+    
     /* Liberer la FAT en mmoire */
     /* ------------------------- */
     
-    printf("writing empty FAT done (block %d to %d)\n", 1, adr_rep - 1);
+    printf("writing empty FAT done (block %d to %d)\n", 1, fat_size_in_blocks);
+    if (nb_journal > 0)
+        printf("metadata journal (block %d to %d)\n", adr_journal, adr_journal + nb_journal - 1);
 
     free(tab);
 }
@@ -278,49 +580,106 @@ void initDiskStats(struct DiskStats* diskStats){
     diskStats->nb_inode_blocks = 0;
     diskStats->nb_data_blocks = 0;
     diskStats->nb_free_bytes = 0;
+    diskStats->nb_extents = 0;
+    diskStats->nb_fragments = 0;
+    diskStats->nb_free_extents = 0;
+    diskStats->largest_free_extent = 0;
 }
 
 unsigned get_free_fat_blocks_count(){
-    unsigned nb_free_blocks = 0;
-    unsigned i;
-    for(i=0;i < fat.disk_size;i++){
-        /*printf("%d\n",i);*/
-        if(get_fat(i) == FAT_FREE) nb_free_blocks++;
-    }
+    /* Le compteur est tenu a jour par set_fat_lazy */
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialisee.");
+
+    return fat.nb_free;
+}
 
-    return nb_free_blocks;
+/* Extents en plus du premier, fichier par fichier (parcours du repertoire) :
+   une fin de chaine partagee par des clones compte pour chacun d'eux */
+static unsigned count_fragments(void){
+    TBLOCK b, ib;
+    int dir, j, adr, prev;
+    unsigned n = 0;
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    for(dir = b.super.adr_dir; dir > 0 && dir < fat.disk_size; dir = fat.tab[dir]){
+        read_block(dir, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++){
+            if(b.dir[j].inode <= 0) continue;
+            read_block(b.dir[j].inode, &ib.data);
+            prev = -1;
+            for(adr = ib.inode.first; adr >= 0 && adr < fat.disk_size; adr = fat.tab[adr]){
+                if(prev >= 0 && adr != prev + 1) n++;
+                prev = adr;
+            }
+        }
+    }
+    return n;
 }
 
 struct DiskStats getDiskStats(){
     struct DiskStats diskStats;
+    FAT_SCAN s;
+
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialisee.");
+
+    /* Un seul parcours de la table par paquets d entrees (sgf-scan.h) */
+    fat_scan(fat.tab, fat.disk_size, &s);
+
     initDiskStats(&diskStats);
-    unsigned i;
-    for(i=0;i < fat.disk_size;i++){
-        int fat_entry = get_fat(i);
-        if(fat_entry > 0) diskStats.nb_data_blocks++;
-        else if(fat_entry == FAT_FREE) diskStats.nb_free_blocks++;
-        else if(fat_entry == FAT_RESERVED) diskStats.nb_reserved_blocks++;
-        else if(fat_entry == FAT_EOF) diskStats.nb_eof_blocks++;
-        else if(fat_entry == FAT_INODE) diskStats.nb_inode_blocks++;
-    }
+    diskStats.nb_free_blocks = s.nb_free;
+    diskStats.nb_reserved_blocks = s.nb_reserved + s.nb_snapshot;
+    diskStats.nb_eof_blocks = s.nb_eof;
+    diskStats.nb_inode_blocks = s.nb_inode;
+    diskStats.nb_data_blocks = s.nb_data;
+    diskStats.nb_extents = s.nb_extents;
+    diskStats.nb_free_extents = s.nb_free_extents;
+    diskStats.largest_free_extent = s.largest_free_extent;
 
     diskStats.nb_free_bytes = BLOCK_SIZE*diskStats.nb_free_blocks;
+    /* nb_extents - nb_eof ne vaut plus rien quand des fichiers partagent leur fin de chaine */
+    diskStats.nb_fragments = count_fragments();
 
     return diskStats;
 }
 
 void displayFatMap(){
-    unsigned i;
-    for(i=0;i < fat.disk_size;i++){
-        if(i%64 == 0) printf("%d ", i);
-        int fat_entry = get_fat(i);
-        if(fat_entry > 0) printf("D");
-        else if(fat_entry == FAT_FREE) printf("F"); 
-        else if(fat_entry == FAT_RESERVED) printf("R");
-        else if(fat_entry == FAT_EOF) printf("E");
-        else if(fat_entry == FAT_INODE) printf("I");
-        if((i+1)%64 == 0){
-            printf("\n");
+    displayFatMapByOwner(NULL);
+}
+
+void displayFatMapByOwner(const int* owner){
+    char* map;
+    char* buf;
+    char* p;
+    int i, j, n;
+
+    if (!fat.in_memory)
+        panic("La FAT n'est pas initialisee.");
+
+    /* Les caracteres de la carte, puis toute la carte dans un seul tampon :
+       au plus 12 octets par ligne de 64 blocs et 10 par bloc colorie */
+    map = malloc(fat.disk_size);
+    buf = malloc((long) fat.disk_size * ((owner != NULL) ? 10 : 1) + (fat.disk_size / 64 + 1) * 13);
+    if (map == NULL || buf == NULL)
+        panic("displayFatMap: plus de memoire.");
+    fat_render(fat.tab, fat.disk_size, map);
+
+    p = buf;
+    for(i = 0; i < fat.disk_size; i += n){
+        n = (fat.disk_size - i < 64) ? fat.disk_size - i : 64;
+        p += sprintf(p, "%d ", i);
+        for(j = i; j < i + n; j++){
+            /* Couleur ANSI (31 a 36) choisie d apres le fichier proprietaire */
+            if(owner != NULL && owner[j] >= 0)
+                p += sprintf(p, "\033[%dm%c\033[0m", 31 + owner[j]%6, map[j]);
+            else
+                *p++ = map[j];
         }
+        if(n == 64) *p++ = '\n';
     }
-}
\ No newline at end of file
+    fwrite(buf, 1, p - buf, stdout);
+
+    free(buf);
+    free(map);
+}
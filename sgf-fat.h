@@ -13,6 +13,7 @@
 #define FAT_RESERVED            (-2)
 #define FAT_INODE               (-3)
 #define FAT_EOF                 (-4)
+#define FAT_SNAPSHOT            (-5)    /* libr, conserv par un instantan */
 
 
 /**********************************************************************
@@ -22,6 +23,34 @@
 
     int alloc_block (void);
 
+/**********************************************************************
+ Allocation dirige : rechercher le bloc libre le plus proche du bloc
+ "goal" (le bloc du rpertoire pour un INODE, le dernier bloc du
+ fichier pour ses donnes...). Avec la politique ALLOC_FIRST_FIT
+ l'indication est ignore (premier bloc libre, comme alloc_block).
+
+ Le disque est dcoup en groupes d'allocation de ALLOC_GROUP_SIZE
+ blocs. Les ALLOC_GROUP_META premiers blocs d'un groupe sont rservs
+ de prfrence aux blocs du rpertoire (ALLOC_META), les autres aux
+ INODEs et aux donnes (ALLOC_DATA) : les blocs du rpertoire restent
+ conscutifs dans chaque groupe, un INODE est plac dans le groupe
+ du bloc rpertoire de son entre et ses donnes juste aprs lui.
+ Une zone pleine dborde sur l'autre.
+ *********************************************************************/
+
+#define ALLOC_FIRST_FIT         (0)
+#define ALLOC_NEAR_GOAL         (1)
+
+#define ALLOC_GROUP_SIZE        (256)
+#define ALLOC_GROUP_META        (8)
+
+#define ALLOC_DATA              (0)
+#define ALLOC_META              (1)
+
+    extern int sgf_alloc_policy;
+
+    int alloc_block_near (int goal, int kind);
+
 /**********************************************************************
  Lire/Ecrire l'entre numro "n" dans la FAT du disque.
  Ces fonctions ne gnrent aucune erreur.
@@ -30,6 +59,46 @@
     int get_fat (int n);
     void set_fat (int n, int valeur);
 
+/**********************************************************************
+ Changer une entree de la FAT sans la sauver (pour grouper plusieurs
+ modifications), puis sauver les blocs modifies de la FAT.
+ *********************************************************************/
+
+    void set_fat_lazy (int n, int valeur);
+    void save_fat (void);
+
+/**********************************************************************
+ Fonction consulte avant de librer le bloc "n" : si elle renvoie une
+ valeur non nulle, le bloc est marqu FAT_SNAPSHOT au lieu de FAT_FREE
+ (il appartient encore  un instantan).
+ *********************************************************************/
+
+    void set_free_hook (int (*hook)(int n));
+
+/**********************************************************************
+ Rechercher "nb" blocs libres consecutifs (pour des donnes), en
+ commencant la recherche au bloc "goal". La fonction renvoie l'adresse
+ du premier bloc de la suite ou -1 si aucune suite assez longue
+ n'existe.
+ *********************************************************************/
+
+    int find_free_extent (int nb, int goal);
+
+/**********************************************************************
+ Un bloc libr n'est pas rallou avant la validation de la
+ transaction du journal qui le libre (la FAT valide le dsigne
+ encore : des donnes crites dedans remplaceraient, aprs une
+ panne, celles de son ancien fichier). Le journal appelle
+ release_freed_blocks aprs chaque validation. Si seuls des blocs
+ retenus restent libres, les fonctions d'allocation valident d'abord
+ la transaction en cours, mais seulement entre deux oprations
+ (journal_between_ops) : au milieu d'une opration, elles chouent.
+ Les blocs retenus sont compts parmi les blocs libres.
+ *********************************************************************/
+
+    void release_freed_blocks (void);
+    unsigned get_held_blocks_count (void);
+
 /**********************************************************************
  Charger la FAT d'un disque en mmoire pour que ce disque soit
  utilisable (mont).
@@ -37,6 +106,12 @@
 
     void init_sgf_fat (void);
 
+/**********************************************************************
+ Taille de la FAT sur disque (en blocs, a partir de ADR_BLOCK_FAT).
+ *********************************************************************/
+
+    int get_fat_size_in_blocks (void);
+
 /**********************************************************************
  Formater le disque en crivant une FAT vide sur disque.
  Ces fonctions ne gnre aucune erreur.
@@ -53,6 +128,12 @@
 
     void displayFatMap();
 
+/*
+* Afficher la carte de la FAT en coloriant chaque bloc selon owner[bloc]
+* (numero du fichier proprietaire, -1 si aucun). owner peut etre NULL.
+*/
+    void displayFatMapByOwner(const int* owner);
+
     struct DiskStats{
     unsigned nb_free_blocks;
     unsigned nb_reserved_blocks;
@@ -60,6 +141,10 @@
     unsigned nb_inode_blocks;
     unsigned nb_data_blocks;
     unsigned nb_free_bytes;
+    unsigned nb_extents;            /* suites de blocs chaines et contigus */
+    unsigned nb_fragments;          /* extents en plus du premier, par fichier */
+    unsigned nb_free_extents;       /* suites de blocs libres */
+    unsigned largest_free_extent;   /* plus longue suite de blocs libres */
 	};
 
 
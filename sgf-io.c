@@ -17,9 +17,234 @@
 #include "sgf-fat.h"
 #include "sgf-dir.h"
 #include "sgf-io.h"
+#include "sgf-refcount.h"
+#include "sgf-snap.h"
+#include "sgf-journal.h"
+#include "sgf-lz.h"
+#include "sgf-dedup.h"
+#include "sgf-crc.h"
+#include "sgf-stats.h"
+#include "sgf-record.h"
 
 
 
+/* Liste des fichiers ouverts (chainee par le champ next_open) */
+static OFILE* open_files = NULL;
+
+/* Fins de fichiers ouverts en append et deja fermes (meme chainage) */
+int sgf_tail_cache_files = TAIL_CACHE_FILES;
+
+static OFILE* tail_cache = NULL;
+static int nb_tails = 0;
+
+
+/**********************************************************************
+ *
+ *  TABLE DES FICHIERS OUVERTS (voir sgf-io.h)
+ *
+ *********************************************************************/
+
+#define OFILE_SLAB      (16)    /* OFILE alloues a la fois              */
+#define OINODE_SLAB     (16)    /* objets partages alloues a la fois    */
+#define OPEN_TABLE_SIZE (64)    /* entrees de la table (par INODE)      */
+#define CHAIN_MAP_MAX   (1 << 16) /* blocs au plus dans une carte       */
+
+typedef struct OINODE          /* "Un fichier ouvert", partage         */
+    {
+    int    inode;              /* adresse de l'INODE                   */
+    int    refs;               /* OFILE qui l'utilisent                */
+    int    listed;             /* present dans la table                */
+    int    version;            /* change a chaque ecriture de l'INODE  */
+    INODE  ino;                /* derniere version ecrite de l'INODE   */
+    int*   chain;              /* chain[k] : adresse du bloc k de la   */
+    int    chain_len;          /* chaine (les chain_len premiers)      */
+    int    chain_capacity;
+    BLOCK  tail;               /* copie du bloc d'adresse tail_adr,    */
+    int    tail_adr;           /* le dernier du fichier (-1 : aucune)  */
+    struct OINODE* next;       /* meme entree de la table, ou reserve  */
+    }
+    OINODE;
+
+static OINODE* open_table[OPEN_TABLE_SIZE];
+static OINODE* unlisted = NULL;         /* INODE libere, encore ouvert */
+
+static OFILE* free_ofiles = NULL;       /* chaines par next_open */
+static OINODE* free_oinodes = NULL;
+
+
+/* Prendre un OFILE dans la reserve (ses tampons ne sont pas encore alloues) */
+static OFILE* sgf_alloc_ofile(void)
+{
+    OFILE* f;
+    int k;
+
+    if(free_ofiles == NULL){
+        f = malloc(OFILE_SLAB * sizeof(OFILE));
+        if(f == NULL) return NULL;
+        for(k = 0; k < OFILE_SLAB; k++){
+            f[k].next_open = free_ofiles;
+            free_ofiles = &f[k];
+        }
+    }
+    f = free_ofiles;
+    free_ofiles = f->next_open;
+    f->dirty = NULL;
+    f->holes = NULL;
+    f->zbuf = NULL;
+    f->ztable = NULL;
+    f->hashes = NULL;
+    f->shared = NULL;
+    f->version = 0;
+    return f;
+}
+
+static OINODE* sgf_find_shared(int inode)
+{
+    OINODE* s;
+
+    for(s = open_table[inode % OPEN_TABLE_SIZE]; s != NULL; s = s->next)
+        if(s->inode == inode) return s;
+    return NULL;
+}
+
+/* Objet partage de l'INODE "inode" (cree avec "ino", ou lu sur le disque si "ino" est NULL) */
+static OINODE* sgf_share_inode(int inode, INODE* ino)
+{
+    OINODE* s = sgf_find_shared(inode);
+    TBLOCK b;
+    int k;
+
+    if(s == NULL){
+        if(free_oinodes == NULL){
+            s = malloc(OINODE_SLAB * sizeof(OINODE));
+            if(s == NULL) return NULL;
+            for(k = 0; k < OINODE_SLAB; k++){
+                s[k].chain = NULL;
+                s[k].chain_capacity = 0;
+                s[k].next = free_oinodes;
+                free_oinodes = &s[k];
+            }
+        }
+        s = free_oinodes;
+        free_oinodes = s->next;
+
+        if(ino == NULL){
+            read_block(inode, &b.data);
+            ino = &b.inode;
+        }
+        s->inode = inode;
+        s->refs = 0;
+        s->listed = 1;
+        s->version = 0;
+        s->ino = *ino;
+        s->chain_len = 0;
+        s->tail_adr = -1;
+        s->next = open_table[inode % OPEN_TABLE_SIZE];
+        open_table[inode % OPEN_TABLE_SIZE] = s;
+    }
+    s->refs++;
+    return s;
+}
+
+static void sgf_unchain_shared(OINODE** p, OINODE* s)
+{
+    for(; *p != s; p = &(*p)->next)
+        ;
+    *p = s->next;
+}
+
+/* Retirer l'objet de la table (l'INODE est libere, les OFILE le gardent) */
+static void sgf_unlist_shared(OINODE* s)
+{
+    sgf_unchain_shared(&open_table[s->inode % OPEN_TABLE_SIZE], s);
+    s->listed = 0;
+    s->next = unlisted;
+    unlisted = s;
+}
+
+static void sgf_release_shared(OINODE* s)
+{
+    if(--s->refs > 0) return;
+    if(s->listed)
+        sgf_unchain_shared(&open_table[s->inode % OPEN_TABLE_SIZE], s);
+    else
+        sgf_unchain_shared(&unlisted, s);
+    s->next = free_oinodes;
+    free_oinodes = s;
+}
+
+/* Les adresses de la chaine ont change : la carte et la copie du dernier bloc sont oubliees */
+static void sgf_chain_moved(OFILE* f)
+{
+    if(f->shared == NULL) return;
+    f->shared->chain_len = 0;
+    f->shared->tail_adr = -1;
+}
+
+/* L'INODE de "f" vient d'etre ecrit : c'est la nouvelle version partagee */
+static void sgf_publish(OFILE* f, INODE* ino)
+{
+    OINODE* s = f->shared;
+    int nb = (ino->hole_signature == SIGNATURE_HOLES) ? ino->nb_holes : 0;
+
+    if(s == NULL) return;
+
+    /* un simple ajout en fin de chaine laisse valides les adresses connues */
+    if(ino->first != s->ino.first || ino->length < s->ino.length ||
+       nb != ((s->ino.hole_signature == SIGNATURE_HOLES) ? s->ino.nb_holes : 0) ||
+       (nb > 0 && memcmp(ino->holes, s->ino.holes, nb * sizeof(HOLE)) != 0))
+        s->chain_len = 0;
+
+    s->ino = *ino;
+    s->version++;
+    s->tail_adr = -1;
+    f->version = s->version;
+}
+
+static int sgf_load_compression(OFILE* f, INODE* ino);
+
+/* Reprendre la derniere version de l'INODE (fichier ouvert en lecture) */
+static void sgf_do_refresh(OFILE* f)
+{
+    INODE* ino = &f->shared->ino;
+    int nb = (ino->hole_signature == SIGNATURE_HOLES) ? ino->nb_holes : 0;
+
+    if(nb > (int) INODE_MAX_HOLES) nb = INODE_MAX_HOLES;
+    if(nb > 0 && f->holes == NULL && (f->holes = malloc(INODE_MAX_HOLES * sizeof(HOLE))) == NULL)
+        return;
+    if(!f->compressed && ino->hole_signature == SIGNATURE_HOLES && ino->zlength > 0 &&
+       sgf_load_compression(f, ino) < 0)
+        return;
+
+    /* la position courante dans la chaine ne reste valable qu'apres un ajout */
+    if(ino->first != f->first || ino->length < f->length || nb != f->nb_holes ||
+       (nb > 0 && memcmp(f->holes, ino->holes, nb * sizeof(HOLE)) != 0))
+        f->currentBlocNum = -1;
+
+    if(nb > 0) memcpy(f->holes, ino->holes, nb * sizeof(HOLE));
+    f->nb_holes = nb;
+    f->length = ino->length;
+    f->first = ino->first;
+    f->last = ino->last;
+    if(f->compressed) f->zlength = ino->zlength;
+
+    /* le dernier bloc a pu etre complete */
+    f->buffer_block = -1;
+    f->version = f->shared->version;
+}
+
+#define SGF_REFRESH(f) \
+    do { \
+        if((f)->shared != NULL && (f)->mode == READ_MODE && (f)->version != (f)->shared->version) \
+            sgf_do_refresh(f); \
+    } while (0)
+
+void sgf_refresh(OFILE* f)
+{
+    SGF_REFRESH(f);
+}
+
+
 /**********************************************************************
  *
  *  FONCTIONS DE LECTURE DANS UN FICHIER
@@ -36,28 +261,110 @@
             qui vous donne l'adresse physique du bloc courant.
  *********************************************************************/
 
-void sgf_read_bloc(OFILE* file, int nubloc)
+/**********************************************************************
+ Fichiers creux : les blocs des trous ne figurent pas dans la chaine
+ de la FAT, le n-ieme bloc de la chaine n'est donc pas forcement le
+ bloc logique n.
+ *********************************************************************/
+
+/* Indice du trou qui contient le bloc logique "nubloc" (-1 : aucun) */
+static int sgf_find_hole(OFILE* f, int nubloc)
 {
-    assert(nubloc < (file->length+BLOCK_SIZE-1)/BLOCK_SIZE);
+    int h;
 
-    /* Working first version */
+    for(h = 0; h < f->nb_holes && f->holes[h].start <= nubloc; h++)
+        if(nubloc < f->holes[h].start + f->holes[h].count) return h;
+    return -1;
+}
 
-    int adr;    
+/* Place du bloc logique "nubloc" dans la chaine (-1 : il est dans un trou) */
+static int sgf_chain_index(OFILE* f, int nubloc)
+{
+    int h, index = nubloc;
 
-    adr = file->first;
+    for(h = 0; h < f->nb_holes && f->holes[h].start <= nubloc; h++){
+        if(nubloc < f->holes[h].start + f->holes[h].count) return -1;
+        index -= f->holes[h].count;
+    }
+    return index;
+}
 
-    while(nubloc-->0){
-        assert(adr>0);
-        adr = get_fat(adr);
+/* Nombre de blocs de la chaine */
+static int sgf_chain_length(OFILE* f)
+{
+    int h, n = (f->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    for(h = 0; h < f->nb_holes; h++)
+        n -= f->holes[h].count;
+    return n;
+}
+
+/* Reprendre les trous decrits par un INODE (-1 si plus de memoire) */
+static int sgf_load_holes(OFILE* f, INODE* ino)
+{
+    f->holes = NULL;
+    f->nb_holes = 0;
+    if(ino->hole_signature != SIGNATURE_HOLES || ino->nb_holes <= 0) return 0;
+
+    f->holes = malloc(INODE_MAX_HOLES * sizeof(HOLE));
+    if(f->holes == NULL) return -1;
+    f->nb_holes = (ino->nb_holes < (int) INODE_MAX_HOLES) ? ino->nb_holes : (int) INODE_MAX_HOLES;
+    memcpy(f->holes, ino->holes, f->nb_holes * sizeof(HOLE));
+    return 0;
+}
+
+/* Adresse du bloc "nubloc" de la chaine d'apres la carte partagee, completee au besoin
+   (-1 si le fichier n'est pas lu a jour sur le volume courant ou si la carte est trop petite) */
+static int sgf_chain_map(OFILE* f, int nubloc)
+{
+    OINODE* s = f->shared;
+    int* chain;
+    int k, adr, capacity;
+
+    if(s == NULL || f->mode != READ_MODE || f->version != s->version || nubloc >= CHAIN_MAP_MAX)
+        return -1;
+    if(nubloc < s->chain_len) return s->chain[nubloc];
+
+    if(nubloc >= s->chain_capacity){
+        capacity = (s->chain_capacity > 0) ? s->chain_capacity : 64;
+        while(capacity <= nubloc) capacity *= 2;
+        if(capacity > CHAIN_MAP_MAX) capacity = CHAIN_MAP_MAX;
+        chain = realloc(s->chain, capacity * sizeof(int));
+        if(chain == NULL) return -1;
+        s->chain = chain;
+        s->chain_capacity = capacity;
     }
-    read_block(adr, &file->buffer);
 
-    /* Working second version, not well tested though */
+    /* la suite de la chaine, a partir du dernier bloc connu */
+    k = s->chain_len;
+    adr = (k == 0) ? f->first : get_fat(s->chain[k - 1]);
+    for(;;){
+        assert(adr > 0);
+        s->chain[k] = adr;
+        s->chain_len = k + 1;
+        if(k++ == nubloc) return adr;
+        adr = get_fat(adr);
+    }
+}
 
-    /*if(nubloc == file->currentBlocNum) return;
+/* Retrouver l adresse physique du bloc "nubloc" de la chaine en partant du bloc courant
+   (currentBlocNum/currentBlocAdr) quand il est avant, du premier bloc sinon */
+static int sgf_locate_bloc(OFILE* file, int nubloc)
+{
     int crtBlocNum;
     int adr;
-    if(nubloc > file->currentBlocNum && file->currentBlocNum != -1){
+
+    assert(nubloc < sgf_chain_length(file));
+
+    /* en lecture la carte partagee de la chaine est lue (ou completee) */
+    if((adr = sgf_chain_map(file, nubloc)) > 0){
+        file->currentBlocNum = nubloc;
+        file->currentBlocAdr = adr;
+        return adr;
+    }
+
+
+    if(nubloc >= file->currentBlocNum && file->currentBlocNum != -1){
         crtBlocNum = file->currentBlocNum;
         adr = file->currentBlocAdr;
     }else{
@@ -65,14 +372,227 @@ void sgf_read_bloc(OFILE* file, int nubloc)
         adr = file->first;
     }
 
-    while(nubloc-- > crtBlocNum){
+    for(; crtBlocNum < nubloc; crtBlocNum++){
         assert(adr>0);
-        adr = get_fat(adr);
+        adr = (file->view != NULL) ? sgf_snapshot_get_fat(file->view, adr) : get_fat(adr);
     }
 
-    read_block(adr, &file->buffer);
     file->currentBlocNum = nubloc;
-    file->currentBlocAdr = adr;*/
+    file->currentBlocAdr = adr;
+    return adr;
+}
+
+void sgf_read_bloc(OFILE* file, int nubloc)
+{
+    int index = sgf_chain_index(file, nubloc);
+    int adr;
+
+    /* un bloc d un trou se lit comme des zeros */
+    if(index < 0){
+        memset(file->buffer, 0, BLOCK_SIZE);
+        file->buffer_block = nubloc;
+        file->buffer_adr = -1;
+        return;
+    }
+
+    adr = sgf_locate_bloc(file, index);
+    if(file->view != NULL)
+        sgf_snapshot_read_block(file->view, adr, &file->buffer);
+    else if(file->shared != NULL && adr == file->shared->tail_adr)
+        memcpy(file->buffer, file->shared->tail, BLOCK_SIZE);
+    else{
+        read_block(adr, &file->buffer);
+        /* le dernier bloc est garde pour les autres ouvertures (ajouts) */
+        if(file->shared != NULL && file->mode == READ_MODE && adr == file->last &&
+           file->version == file->shared->version){
+            memcpy(file->shared->tail, file->buffer, BLOCK_SIZE);
+            file->shared->tail_adr = adr;
+        }
+    }
+    file->buffer_block = nubloc;
+    file->buffer_adr = adr;
+}
+
+
+/**********************************************************************
+ Ecrire en place le bloc du tampon s'il a t modifi (mode
+ READ_WRITE_MODE), puis charger le bloc logique "nubloc" si ce n'est
+ pas celui du tampon.
+ *********************************************************************/
+
+static int sgf_unshare(OFILE* f, int k, int adr, int copy);
+
+static int sgf_sync_bloc(OFILE* file)
+{
+    if(file->buffer_dirty){
+        /* un bloc partage avec un clone est d abord recopie */
+        file->buffer_adr = sgf_unshare(file, sgf_chain_index(file, file->buffer_block), file->buffer_adr, 0);
+        if(file->buffer_adr < 0) return -1;
+        write_block(file->buffer_adr, &file->buffer);
+        file->buffer_dirty = 0;
+        if(file->shared != NULL && file->buffer_adr == file->shared->tail_adr)
+            file->shared->tail_adr = -1;
+    }
+    return 0;
+}
+
+static void sgf_load_bloc(OFILE* file, int nubloc)
+{
+    if(file->buffer_block == nubloc) return;
+    sgf_sync_bloc(file);
+    sgf_read_bloc(file, nubloc);
+}
+
+
+/**********************************************************************
+ Fichiers compresss : le contenu de la chane est une suite de
+ grappes (au plus CLUSTER_SIZE octets dcompresss), chacune
+ prcde d'un en-tte de ZHEADER_SIZE octets : sa taille
+ dcompresse puis sa taille stocke, sur deux octets chacune
+ (poids faible d'abord). Une grappe qui ne se compresse pas est
+ stocke telle quelle (les deux tailles sont gales).
+
+ Les grappes dj traverses sont notes dans ztable (position
+ dcompresse, position dans la chane) : un dplacement ne lit
+ que les en-ttes des grappes qui n'y sont pas encore.
+ *********************************************************************/
+
+#define ZHEADER_SIZE    (4)
+#define ZTABLE_INIT     (16)
+
+static char ztmp[CLUSTER_SIZE];         /* grappe compressee */
+
+/* Mettre en place la compression (-1 si plus de memoire) */
+static int sgf_start_compression(OFILE* f, int zlength)
+{
+    f->zbuf = malloc(CLUSTER_SIZE);
+    f->ztable = malloc(2 * ZTABLE_INIT * sizeof(int));
+    if(f->zbuf == NULL || f->ztable == NULL){
+        free(f->zbuf);
+        free(f->ztable);
+        f->zbuf = NULL;
+        f->ztable = NULL;
+        return -1;
+    }
+    f->compressed = 1;
+    f->zlength = zlength;
+    f->zptr = (f->mode == READ_MODE) ? 0 : zlength;
+    f->ztable[0] = f->ztable[1] = 0;
+    f->nb_zclusters = 1;
+    f->zcapacity = ZTABLE_INIT;
+    return 0;
+}
+
+/* Reprendre la compression decrite par un INODE (-1 si plus de memoire) */
+static int sgf_load_compression(OFILE* f, INODE* ino)
+{
+    f->compressed = 0;
+    f->zlength = f->zptr = 0;
+    f->zbuf = NULL;
+    f->zstart = -1;
+    f->zcount = 0;
+    f->ztable = NULL;
+    f->nb_zclusters = f->zcapacity = 0;
+    if(ino == NULL || ino->hole_signature != SIGNATURE_HOLES || ino->zlength <= 0) return 0;
+
+    return sgf_start_compression(f, ino->zlength);
+}
+
+/* Lire "n" octets de la chaine a partir de "pos" (-1 : au-dela de la fin) */
+static int sgf_raw_read(OFILE* f, int pos, char* dst, int n)
+{
+    int amount;
+
+    if(pos < 0 || n > f->length - pos) return -1;
+    for(; n > 0; pos += amount, dst += amount, n -= amount){
+        amount = BLOCK_SIZE - pos % BLOCK_SIZE;
+        if(amount > n) amount = n;
+        sgf_load_bloc(f, pos / BLOCK_SIZE);
+        memcpy(dst, f->buffer + pos % BLOCK_SIZE, amount);
+    }
+    return 0;
+}
+
+/* Lire l'en-tete de la grappe placee en "pos" */
+static int sgf_z_header(OFILE* f, int pos, int* ulen, int* clen)
+{
+    unsigned char h[ZHEADER_SIZE];
+
+    if(sgf_raw_read(f, pos, (char*) h, ZHEADER_SIZE) < 0) return -1;
+    *ulen = h[0] | (h[1] << 8);
+    *clen = h[2] | (h[3] << 8);
+    if(*ulen <= 0 || *ulen > CLUSTER_SIZE || *clen <= 0 || *clen > *ulen) return -1;
+    return 0;
+}
+
+/* Noter une grappe a la suite des grappes connues */
+static int sgf_z_note(OFILE* f, int zpos, int ppos)
+{
+    int* t;
+
+    if(f->nb_zclusters == f->zcapacity){
+        t = realloc(f->ztable, 4 * f->zcapacity * sizeof(int));
+        if(t == NULL) return -1;
+        f->ztable = t;
+        f->zcapacity *= 2;
+    }
+    f->ztable[2 * f->nb_zclusters] = zpos;
+    f->ztable[2 * f->nb_zclusters + 1] = ppos;
+    f->nb_zclusters++;
+    return 0;
+}
+
+/* Charger dans zbuf la grappe qui contient la position zptr */
+static int sgf_z_load(OFILE* f)
+{
+    int lo, hi, mid, zpos, ppos, ulen, clen;
+
+    /* La derniere grappe connue qui commence avant zptr */
+    lo = 0;
+    hi = f->nb_zclusters - 1;
+    while(lo < hi){
+        mid = (lo + hi + 1) / 2;
+        if(f->ztable[2 * mid] <= f->zptr) lo = mid; else hi = mid - 1;
+    }
+    zpos = f->ztable[2 * lo];
+    ppos = f->ztable[2 * lo + 1];
+
+    /* puis les grappes suivantes, notees au passage */
+    for(;;){
+        if(sgf_z_header(f, ppos, &ulen, &clen) < 0) return -1;
+        if(f->zptr < zpos + ulen) break;
+        zpos += ulen;
+        ppos += ZHEADER_SIZE + clen;
+        if(sgf_z_note(f, zpos, ppos) < 0) return -1;
+    }
+
+    /* La grappe suivante est notee tout de suite : une lecture sequentielle ne relit aucun en-tete */
+    if(f->ztable[2 * (f->nb_zclusters - 1)] == zpos && zpos + ulen < f->zlength &&
+       sgf_z_note(f, zpos + ulen, ppos + ZHEADER_SIZE + clen) < 0)
+        return -1;
+
+    if(clen == ulen){
+        if(sgf_raw_read(f, ppos + ZHEADER_SIZE, f->zbuf, ulen) < 0) return -1;
+    }else if(sgf_raw_read(f, ppos + ZHEADER_SIZE, ztmp, clen) < 0 ||
+             lz_decompress(ztmp, clen, f->zbuf, CLUSTER_SIZE) != ulen){
+        return -1;
+    }
+    f->zstart = zpos;
+    f->zcount = ulen;
+    return 0;
+}
+
+static int sgf_z_getc(OFILE* f)
+{
+    int c;
+
+    if(f->zptr >= f->zlength) return -1;
+    if((f->zptr < f->zstart || f->zptr >= f->zstart + f->zcount) && sgf_z_load(f) < 0)
+        return -1;
+
+    c = f->zbuf[f->zptr - f->zstart];
+    f->zptr++;
+    return c;
 }
 
 
@@ -84,25 +604,81 @@ void sgf_read_bloc(OFILE* file, int nubloc)
 int sgf_getc(OFILE* file)
     {
     int c;
+    STATS_DECL;
+    RECORD_DECL;
     
-    assert (file->mode == READ_MODE);
+    assert (file->mode == READ_MODE || file->mode == READ_WRITE_MODE);
+    STATS_START();
+    RECORD_START();
+    SGF_REFRESH(file);
     
+    /* un fichier compress se lit dans sa grappe dcompresse */
+    if (file->compressed)
+        c = sgf_z_getc(file);
+
     /* dtecter la fin de fichier */
-    if (file->ptr >= file->length)
-        return (-1);
+    else if (file->ptr >= file->length)
+        c = -1;
 
-    /* si le buffer est vide, le remplir */
-    if ((file->ptr % BLOCK_SIZE) == 0)
-    {
-        sgf_read_bloc(file, file->ptr / BLOCK_SIZE);
-    }
-    /* Recupere le caractere courant */
-    c = file->buffer[ (file->ptr % BLOCK_SIZE) ];
-    file->ptr ++;
+    else
+        {
+        /* si le buffer ne contient pas le bloc courant, le remplir */
+        sgf_load_bloc(file, file->ptr / BLOCK_SIZE);
+
+        /* Recupere le caractere courant */
+        c = file->buffer[ (file->ptr % BLOCK_SIZE) ];
+        file->ptr ++;
+        }
+    RECORD_STOP(TRACE_GETC, file, 0, 0, c, NULL, NULL);
+    STATS_STOP(STAT_GETC);
     return (c);
     }
 
 
+/**********************************************************************
+ Lire au plus "size" octets a partir de la position courante, bloc
+ par bloc (grappe par grappe pour un fichier compresse). Renvoie le
+ nombre d'octets lus (0 en fin de fichier).
+ *********************************************************************/
+
+int sgf_read (OFILE* file, char* data, int size)
+    {
+    int n = 0, k;
+    STATS_DECL;
+    RECORD_DECL;
+    
+    assert (file->mode == READ_MODE || file->mode == READ_WRITE_MODE);
+    STATS_START();
+    RECORD_START();
+    SGF_REFRESH(file);
+    
+    if (file->compressed)
+        for(; n < size  &&  file->zptr < file->zlength; n += k)
+            {
+            if ((file->zptr < file->zstart || file->zptr >= file->zstart + file->zcount)
+                &&  sgf_z_load(file) < 0)
+                break;
+            k = file->zstart + file->zcount - file->zptr;
+            if (k > size - n) k = size - n;
+            memcpy(data + n, file->zbuf + (file->zptr - file->zstart), k);
+            file->zptr += k;
+            }
+    else
+        for(; n < size  &&  file->ptr < file->length; n += k)
+            {
+            sgf_load_bloc(file, file->ptr / BLOCK_SIZE);
+            k = BLOCK_SIZE - file->ptr % BLOCK_SIZE;
+            if (k > size - n) k = size - n;
+            if (k > file->length - file->ptr) k = file->length - file->ptr;
+            memcpy(data + n, file->buffer + (file->ptr % BLOCK_SIZE), k);
+            file->ptr += k;
+            }
+    RECORD_STOP(TRACE_READ, file, size, 0, n, NULL, NULL);
+    STATS_STOP(STAT_READ);
+    return (n);
+    }
+
+
 
 /**********************************************************************
  *
@@ -111,55 +687,612 @@ int sgf_getc(OFILE* file)
  *********************************************************************/
 
 /**********************************************************************
- Ajouter le bloc contenu dans le tampon au fichier ouvert dcrit
- par "f".
+ Allocation retarde : les blocs complets sont retenus en mmoire
+ (au plus sgf_delalloc_blocks par fichier ouvert) et ne sont placs
+ sur le disque qu'au moment du vidage. Le placement connat alors le
+ nombre de blocs  crire et peut choisir une suite contigu.
+ Les blocs retenus sont dcompts de l'espace libre (reserved_blocks)
+ pour que le vidage ne puisse pas manquer de place.
  *********************************************************************/
 
-int sgf_append_block(OFILE* f)
+int sgf_delalloc_blocks = DELALLOC_BLOCKS;
+
+static int reserved_blocks = 0;
+
+
+/**********************************************************************
+ Ecrire l'INODE d'un fichier ouvert (avec ses trous).
+ *********************************************************************/
+
+static void sgf_write_inode(OFILE* f)
 {
     TBLOCK b;
-    int adr;
 
-    if(f->mode == WRITE_MODE){
-        /* Si on est en mode ecriture, on cherche un nouveau bloc libre,
-        on verifie bien qu un bloc libre etait disponible, puis on indique que
-        ce nouveau bloc est le dernier bloc du fichier. Ensuite si ce nouveau bloc
-        est le premier bloc du fichier on met l adresse du premier bloc et du dernier
-        bloc a adr sinon on indique que l ancien dernier bloc pointer desormais sur le nouveau
-        dernier bloc et que le dernier bloc est le nouveau bloc */
-        adr = alloc_block();
-        if(adr < 0) return -1;
-        write_block(adr, &f->buffer);
-        set_fat(adr, FAT_EOF);
-        if(f->first == FAT_EOF)
-            f->first = f->last = adr;
-        else{
-            set_fat(f->last, adr);
-            f->last = adr;
-        } 
-    }else if(f->mode == APPEND_MODE){
-        /*Si on est en mode append, on ecrase le dernier bloc avec le buffer complete puis on passe en write mode*/
-        write_block(f->last, &f->buffer);
+    memset(&b, 0, sizeof(b));
+    b.inode.length = f->length;
+    b.inode.first = f->first;
+    b.inode.last = f->last;
+    b.inode.hole_signature = SIGNATURE_HOLES;
+    b.inode.nb_holes = f->nb_holes;
+    if(f->nb_holes > 0) memcpy(b.inode.holes, f->holes, f->nb_holes * sizeof(HOLE));
+    b.inode.zlength = f->compressed ? f->zlength : 0;
+    write_meta_block(f->inode, &b.data);
+    sgf_publish(f, &b.inode);
+}
+
+
+/**********************************************************************
+ Copie sur criture : rendre les blocs 0..k de la chane propres au
+ fichier avant de modifier le bloc k (adresse "adr") ou son chainage.
+
+ Les blocs partags de cette partie sont recopis (sauf le bloc k si
+ "copy" est nul : l'appelant va le rcrire en entier), puis la copie
+ rejoint la fin de chane partage. Renvoie la nouvelle adresse du
+ bloc k, -1 s'il n'y a plus de place.
+ *********************************************************************/
+
+static int sgf_unshare(OFILE* f, int k, int adr, int copy)
+{
+    BLOCK data;
+    int i, prev, cur, next, shared, n;
+
+    if(k < f->exclusive) return adr;
+
+    /* Chercher le premier bloc partage entre les blocs exclusive et k */
+    prev = (f->exclusive > 0) ? sgf_locate_bloc(f, f->exclusive - 1) : -1;
+    cur = (prev < 0) ? f->first : get_fat(prev);
+    for(i = f->exclusive; i <= k && get_refcount(cur) == 0; i++){
+        prev = cur;
+        cur = get_fat(cur);
+    }
+    if(i > k){
+        f->exclusive = k + 1;
+        return adr;
+    }
+
+    if((int) get_free_fat_blocks_count() - reserved_blocks < k - i + 1) return -1;
+
+    /* Recopier les blocs i..k a la suite du dernier bloc propre */
+    shared = cur;
+    sgf_chain_moved(f);
+    for(; i <= k; i++){
+        n = find_free_extent(1, (prev >= 0) ? prev + 1 : f->inode + 1);
+        if(copy || i < k){
+            read_block(cur, &data);
+            write_block(n, &data);
+        }
+        next = get_fat(cur);
+        set_fat_lazy(n, FAT_EOF);
+        if(prev < 0)
+            f->first = n;
+        else
+            set_fat_lazy(prev, n);
+        prev = n;
+        cur = next;
+    }
+
+    /* Rejoindre la fin partagee (une reference de plus), puis valider par l INODE */
+    if(cur != FAT_EOF){
+        set_fat_lazy(prev, cur);
+        ref_block(cur);
+        save_refcount();
+    }else{
+        f->last = prev;
+    }
+    save_fat();
+    sgf_write_inode(f);
+
+    /* Le fichier n utilise plus le premier bloc partage */
+    unref_block(shared);
+    save_refcount();
+
+    f->exclusive = k + 1;
+    f->currentBlocNum = k;
+    f->currentBlocAdr = prev;
+    journal_end_op();
+    return prev;
+}
+
+
+/**********************************************************************
+ Placer et crire les blocs retenus du fichier ouvert "f", puis mettre
+  jour la FAT (une seule sauvegarde) et l'INODE (une seule criture).
+ *********************************************************************/
+
+static int sgf_place_dirty(OFILE* f)
+{
+    int k, j, run, want, goal, adr;
+
+    /* Le dernier bloc va etre reecrit ou rechaine : il ne doit pas etre partage */
+    if(f->last >= 0 && f->nb_dirty > 0 &&
+       sgf_unshare(f, sgf_chain_length(f) - 1, f->last, f->mode != APPEND_MODE) < 0)
+        return -1;
+
+    k = 0;
+    /* En mode append le premier bloc retenu remplace le dernier bloc (incomplet) du fichier */
+    if(f->mode == APPEND_MODE && f->nb_dirty > 0){
+        write_block(f->last, &f->dirty[0]);
         f->mode = WRITE_MODE;
+        k = 1;
     }
+
+    /* Chercher une suite contigue pour tous les blocs, sinon des suites de plus en plus courtes */
+    want = f->nb_dirty - k;
+    while(k < f->nb_dirty){
+        goal = (f->last >= 0) ? f->last + 1 : f->inode + 1;
+        if(want > f->nb_dirty - k) want = f->nb_dirty - k;
+        run = find_free_extent(want, goal);
+        if(run < 0){
+            if(want == 1) return -1;
+            want /= 2;
+            continue;
+        }
+        /* la suite est ecrite en une seule E/S */
+        write_blocks(run, want, &f->dirty[k]);
+        for(j = 0; j < want; j++, k++){
+            adr = run + j;
+            set_fat_lazy(adr, FAT_EOF);
+            if(f->first == FAT_EOF)
+                f->first = adr;
+            else
+                set_fat_lazy(f->last, adr);
+            f->last = adr;
+        }
+    }
+    save_fat();
+
+    reserved_blocks -= f->nb_reserved;
+    f->nb_reserved = 0;
+    f->nb_dirty = 0;
+    return 0;
+}
+
+static int sgf_place_blocks(OFILE* f)
+{
+    if(sgf_place_dirty(f) < 0) return -1;
+
     /* On met a jour la longueur du fichier en memoire et les informations de l inode sur le disque */
     f->length = f->ptr;
-    b.inode.length = f->ptr;
-    b.inode.first = f->first;
-    b.inode.last = f->last;
-    write_block(f->inode, &b.data);
+    sgf_write_inode(f);
+    f->inode_dirty = 0;
+    journal_end_op();
 
     return 0;
 }
 
 
 /**********************************************************************
- Ecrire le caractre "c" dans le fichier ouvert dcrit par "file".
+ Ajouter le bloc contenu dans le tampon au fichier ouvert dcrit
+ par "f". Le bloc est seulement retenu en mmoire ; il est plac sur
+ le disque quand la rserve du fichier est pleine (ou au vidage).
  *********************************************************************/
 
-int sgf_putc(OFILE* file, char  c)
+int sgf_append_block(OFILE* f)
+{
+    unsigned long* hashes;
+
+    /* Un fichier detruit n'alloue plus rien : le bloc est abandonne */
+    if(f->removed) return -1;
+
+    if(f->dirty == NULL){
+        f->dirty_capacity = (sgf_delalloc_blocks > 0) ? sgf_delalloc_blocks : 1;
+        f->dirty = malloc(f->dirty_capacity * sizeof(BLOCK));
+        if(f->dirty == NULL) return -1;
+    }
+
+    /* Seul le bloc qui remplace le dernier bloc en mode append ne consomme pas de place */
+    if(!(f->mode == APPEND_MODE && f->nb_dirty == 0)){
+        if((int) get_free_fat_blocks_count() - reserved_blocks <= 0) return -1;
+        reserved_blocks++;
+        f->nb_reserved++;
+    }
+    memcpy(f->dirty[f->nb_dirty++], f->buffer, BLOCK_SIZE);
+
+    /* Deduplication : l empreinte du bloc (du debut du dernier bloc, incomplet) */
+    if(f->dedup){
+        if(f->nb_hashes == f->hash_capacity){
+            f->hash_capacity = (f->hash_capacity > 0) ? 2 * f->hash_capacity : f->dirty_capacity;
+            hashes = realloc(f->hashes, f->hash_capacity * sizeof(unsigned long));
+            if(hashes == NULL) f->dedup = 0;
+            else f->hashes = hashes;
+        }
+        if(f->dedup)
+            f->hashes[f->nb_hashes++] = dedup_hash(f->buffer, (f->ptr % BLOCK_SIZE != 0) ? f->ptr % BLOCK_SIZE : BLOCK_SIZE);
+    }
+
+    if(f->nb_dirty == f->dirty_capacity)
+        return sgf_place_blocks(f);
+    return 0;
+}
+
+
+/**********************************************************************
+ Abandonner les blocs retenus (fichier dtruit avant d'tre vid) :
+ aucun bloc n'aura t allou pour eux.
+ *********************************************************************/
+
+static void sgf_drop_blocks(OFILE* f)
+{
+    reserved_blocks -= f->nb_reserved;
+    f->nb_reserved = 0;
+    f->nb_dirty = 0;
+    f->buffer_dirty = 0;
+    f->inode_dirty = 0;
+    f->zcount = 0;
+    f->dedup = 0;
+}
+
+
+/**********************************************************************
+ Dduplication (voir sgf-dedup.h) : au vidage, la plus longue fin du
+ fichier dj prsente sur le disque remplace la sienne. Les blocs
+ retenus qu'elle couvre ne sont jamais crits, ceux dj placs
+ sont librs aprs la validation par l'INODE. Le fichier est
+ ensuite index.
+ *********************************************************************/
+
+static int sgf_dedup_tail(OFILE* f)
+{
+    int n = f->nb_hashes, p = n - f->nb_dirty;
+    int last_len = (f->ptr % BLOCK_SIZE != 0) ? f->ptr % BLOCK_SIZE : BLOCK_SIZE;
+    int i, k, x, x_last, adr, skipped, free0, freed = 0;
+    int* adrs;
+
+    if(n == 0) return 0;
+    adrs = malloc(n * sizeof(int));
+    if(adrs == NULL) return 0;
+    for(i = 0, adr = f->first; i < p; i++, adr = get_fat(adr)) adrs[i] = adr;
+    for(; i < n; i++) adrs[i] = -1;
+
+    k = dedup_find_suffix(n, f->hashes, last_len, adrs, f->dirty, f->nb_dirty, &x, &x_last);
+    if(k < n && ref_block(x) == 0){
+        /* Seuls les blocs retenus qui precedent la fin trouvee sont places */
+        skipped = n - ((k > p) ? k : p);
+        f->nb_dirty = (k > p) ? k - p : 0;
+        if(sgf_place_dirty(f) < 0){
+            unref_block(x);
+            free(adrs);
+            return -1;
+        }
+
+        if(k < p && k > 0)
+            set_fat_lazy(adrs[k - 1], x);
+        else if(k == 0 || f->first == FAT_EOF)
+            f->first = x;
+        else
+            set_fat_lazy(f->last, x);
+        save_fat();
+        save_refcount();
+        f->last = x_last;
+        f->length = f->ptr;
+        sgf_write_inode(f);
+        f->inode_dirty = 0;
+
+        if(k < p){
+            free0 = get_free_fat_blocks_count();
+            release_chain(adrs[k]);
+            freed = get_free_fat_blocks_count() - free0;
+        }
+        dedup_count_shared(n - k, skipped, freed);
+        f->currentBlocNum = -1;
+        sgf_chain_moved(f);
+        sgf_forget_exclusive();
+        journal_end_op();
+    }
+
+    dedup_index_chain(n, f->hashes, last_len, f->first);
+    free(adrs);
+    return 0;
+}
+
+
+/**********************************************************************
+ Ajouter les blocs logiques start..start+count-1 aux trous du fichier
+ (en les accolant aux trous voisins). Renvoie -1 si l'INODE ne peut
+ pas dcrire un trou de plus.
+ *********************************************************************/
+
+static int sgf_add_hole(OFILE* f, int start, int count)
+{
+    int h, k;
+
+    if(f->holes == NULL){
+        f->holes = malloc(INODE_MAX_HOLES * sizeof(HOLE));
+        if(f->holes == NULL) return -1;
+    }
+
+    for(h = 0; h < f->nb_holes && f->holes[h].start < start; h++)
+        ;
+    if(h > 0 && f->holes[h - 1].start + f->holes[h - 1].count == start){
+        f->holes[h - 1].count += count;
+        if(h < f->nb_holes && start + count == f->holes[h].start){
+            f->holes[h - 1].count += f->holes[h].count;
+            for(k = h; k < f->nb_holes - 1; k++) f->holes[k] = f->holes[k + 1];
+            f->nb_holes--;
+        }
+    }else if(h < f->nb_holes && start + count == f->holes[h].start){
+        f->holes[h].start = start;
+        f->holes[h].count += count;
+    }else{
+        if(f->nb_holes == (int) INODE_MAX_HOLES) return -1;
+        for(k = f->nb_holes; k > h; k--) f->holes[k] = f->holes[k - 1];
+        f->holes[h].start = start;
+        f->holes[h].count = count;
+        f->nb_holes++;
+    }
+    f->inode_dirty = 1;
+    return 0;
+}
+
+
+/**********************************************************************
+ Ecrire dans un trou : un bloc mis  zro est insr dans la chane
+ pour le bloc logique "nubloc". Si le trou devait tre coup en deux
+ alors que l'INODE n'a plus de place, il est rempli depuis son dbut.
+ Renvoie l'adresse du bloc, -1 s'il n'y a plus de place.
+ *********************************************************************/
+
+static int sgf_fill_hole(OFILE* f, int nubloc)
+{
+    BLOCK zero;
+    int h, k, s, c, from, count, index, prev, next, adr, first_new, last_new;
+
+    h = sgf_find_hole(f, nubloc);
+    s = f->holes[h].start;
+    c = f->holes[h].count;
+    from = (nubloc > s && nubloc < s + c - 1 && f->nb_holes == (int) INODE_MAX_HOLES) ? s : nubloc;
+    count = nubloc - from + 1;
+    if((int) get_free_fat_blocks_count() - reserved_blocks < count) return -1;
+
+    /* Les blocs du trou se placent tous au meme endroit de la chaine */
+    index = s;
+    for(k = 0; k < h; k++) index -= f->holes[k].count;
+    sgf_chain_moved(f);
+
+    /* Le bloc precedent est rechaine : il ne doit pas etre partage */
+    prev = -1;
+    if(index > 0 && (prev = sgf_unshare(f, index - 1, sgf_locate_bloc(f, index - 1), 1)) < 0)
+        return -1;
+    next = (prev < 0) ? f->first : get_fat(prev);
+    if(f->exclusive >= index) f->exclusive += count;
+
+    memset(zero, 0, BLOCK_SIZE);
+    first_new = last_new = -1;
+    for(k = 0; k < count; k++){
+        adr = find_free_extent(1, (last_new >= 0) ? last_new + 1 : (prev >= 0) ? prev + 1 : f->inode + 1);
+        if(adr < 0) return -1;
+        write_block(adr, &zero);
+        set_fat_lazy(adr, FAT_EOF);
+        if(last_new < 0)
+            first_new = adr;
+        else
+            set_fat_lazy(last_new, adr);
+        last_new = adr;
+    }
+    set_fat_lazy(last_new, next);
+    if(prev < 0)
+        f->first = first_new;
+    else
+        set_fat_lazy(prev, first_new);
+    if(next == FAT_EOF) f->last = last_new;
+    save_fat();
+
+    /* Raccourcir (ou couper en deux) le trou */
+    if(from == s && nubloc == s + c - 1){
+        for(k = h; k < f->nb_holes - 1; k++) f->holes[k] = f->holes[k + 1];
+        f->nb_holes--;
+    }else if(from == s){
+        f->holes[h].start = nubloc + 1;
+        f->holes[h].count = s + c - nubloc - 1;
+    }else if(nubloc == s + c - 1){
+        f->holes[h].count = from - s;
+    }else{
+        for(k = f->nb_holes; k > h + 1; k--) f->holes[k] = f->holes[k - 1];
+        f->holes[h].count = from - s;
+        f->holes[h + 1].start = nubloc + 1;
+        f->holes[h + 1].count = s + c - nubloc - 1;
+        f->nb_holes++;
+    }
+    f->inode_dirty = 1;
+
+    f->currentBlocNum = index + count - 1;
+    f->currentBlocAdr = last_new;
+    return last_new;
+}
+
+
+/**********************************************************************
+ Lecture/criture (READ_WRITE_MODE) : les octets sont modifis dans
+ le bloc du tampon, qui n'est rcrit  sa place qu'au changement de
+ bloc ou au vidage. Un bloc n'est allou que lorsque l'criture
+ dpasse le dernier bloc du fichier ou tombe dans un trou.
+ *********************************************************************/
+
+static int sgf_rw_prepare(OFILE* f)
+{
+    int nubloc = f->ptr / BLOCK_SIZE;
+    int adr, index;
+
+    if(f->buffer_block == nubloc) return 0;
+    if(sgf_sync_bloc(f) < 0) return -1;
+
+    if(nubloc < (f->length + BLOCK_SIZE - 1) / BLOCK_SIZE){
+        if(sgf_chain_index(f, nubloc) >= 0){
+            sgf_read_bloc(f, nubloc);
+            return 0;
+        }
+        adr = sgf_fill_hole(f, nubloc);
+        if(adr < 0) return -1;
+    }else{
+        /* Ajouter un bloc en fin de chaine (le dernier bloc est rechaine) */
+        index = sgf_chain_length(f);
+        if(f->last >= 0 && sgf_unshare(f, index - 1, f->last, 1) < 0) return -1;
+        if((int) get_free_fat_blocks_count() - reserved_blocks <= 0) return -1;
+        adr = find_free_extent(1, (f->last >= 0) ? f->last + 1 : f->inode + 1);
+        if(adr < 0) return -1;
+        set_fat_lazy(adr, FAT_EOF);
+        if(f->first == FAT_EOF)
+            f->first = adr;
+        else
+            set_fat_lazy(f->last, adr);
+        save_fat();
+        f->last = adr;
+        f->inode_dirty = 1;
+        f->currentBlocNum = index;
+        f->currentBlocAdr = adr;
+    }
+
+    memset(f->buffer, 0, BLOCK_SIZE);
+    f->buffer_block = nubloc;
+    f->buffer_adr = adr;
+    return 0;
+}
+
+
+/**********************************************************************
+ Ecrire au-del de la fin du fichier : la fin de son dernier bloc est
+ mise  zro et les blocs entirement sauts deviennent un trou (ou
+ des blocs mis  zro si l'INODE n'a plus de place).
+ *********************************************************************/
+
+static int sgf_rw_extend(OFILE* f)
+{
+    int ptr = f->ptr;
+    int nblocks = (f->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    int target = ptr / BLOCK_SIZE;
+
+    if(f->length % BLOCK_SIZE != 0){
+        if(sgf_sync_bloc(f) < 0) return -1;
+        sgf_load_bloc(f, nblocks - 1);
+        memset(f->buffer + f->length % BLOCK_SIZE, 0, BLOCK_SIZE - f->length % BLOCK_SIZE);
+        f->buffer_dirty = 1;
+    }
+
+    if(target > nblocks && sgf_add_hole(f, nblocks, target - nblocks) < 0){
+        for(; nblocks < target; nblocks++){
+            f->ptr = nblocks * BLOCK_SIZE;
+            if(sgf_rw_prepare(f) < 0){
+                f->ptr = ptr;
+                return -1;
+            }
+            f->buffer_dirty = 1;
+            f->length = f->ptr + BLOCK_SIZE;
+        }
+        f->ptr = ptr;
+    }
+
+    if(target * BLOCK_SIZE > f->length) f->length = target * BLOCK_SIZE;
+    f->inode_dirty = 1;
+    return 0;
+}
+
+
+/**********************************************************************
+ Mettre  zro les octets from..to-1 (les blocs des trous le sont
+ dj).
+ *********************************************************************/
+
+static int sgf_zero_range(OFILE* f, int from, int to)
+{
+    int amount;
+
+    for(; from < to; from += amount){
+        amount = BLOCK_SIZE - from % BLOCK_SIZE;
+        if(amount > to - from) amount = to - from;
+        if(sgf_chain_index(f, from / BLOCK_SIZE) < 0) continue;
+
+        if(f->buffer_block != from / BLOCK_SIZE){
+            if(sgf_sync_bloc(f) < 0) return -1;
+            sgf_read_bloc(f, from / BLOCK_SIZE);
+        }
+        memset(f->buffer + from % BLOCK_SIZE, 0, amount);
+        f->buffer_dirty = 1;
+    }
+    return 0;
+}
+
+static int sgf_rw_putc(OFILE* f, char c)
+{
+    if(f->removed) return -1;
+    if(f->ptr > f->length && sgf_rw_extend(f) < 0) return -1;
+    if(sgf_rw_prepare(f) < 0) return -1;
+
+
+    f->buffer[f->ptr % BLOCK_SIZE] = c;
+    f->buffer_dirty = 1;
+    f->ptr++;
+    if(f->ptr > f->length){
+        f->length = f->ptr;
+        f->inode_dirty = 1;
+    }
+    return 0;
+}
+
+static int sgf_rw_write(OFILE* f, char* data, int size)
+{
+    int nblocks, needed, amount, done, index;
+
+    if(f->removed) return -1;
+
+    /* Seuls les blocs au-dela de la chaine actuelle (et ceux des trous) consomment de la place */
+    nblocks = (f->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    needed = (f->ptr + size + BLOCK_SIZE - 1) / BLOCK_SIZE
+             - ((f->ptr / BLOCK_SIZE > nblocks) ? f->ptr / BLOCK_SIZE : nblocks);
+    if(needed > (int) get_free_fat_blocks_count() - reserved_blocks){
+        fprintf(stderr, "[sgf_write] : Not enough space left to write desired data block\n");
+        return -1;
+    }
+    if(size > 0 && f->ptr > f->length){
+        if(sgf_rw_extend(f) < 0) return -1;
+        nblocks = (f->length + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+
+    for(done = 0; done < size; done += amount){
+        amount = BLOCK_SIZE - f->ptr % BLOCK_SIZE;
+        if(amount > size - done) amount = size - done;
+
+        /* Un bloc existant entierement remplace n'a pas besoin d'etre relu */
+        index = (f->ptr / BLOCK_SIZE < nblocks) ? sgf_chain_index(f, f->ptr / BLOCK_SIZE) : -1;
+        if(amount == BLOCK_SIZE && f->buffer_block != f->ptr / BLOCK_SIZE && index >= 0){
+            if(sgf_sync_bloc(f) < 0) return -1;
+            f->buffer_adr = sgf_locate_bloc(f, index);
+            f->buffer_block = f->ptr / BLOCK_SIZE;
+        }else if(sgf_rw_prepare(f) < 0){
+            return -1;
+        }
+
+        memcpy(f->buffer + f->ptr % BLOCK_SIZE, data + done, amount);
+        f->buffer_dirty = 1;
+        f->ptr += amount;
+        if(f->ptr > f->length){
+            f->length = f->ptr;
+            f->inode_dirty = 1;
+        }
+    }
+    return 0;
+}
+
+static int sgf_rw_flush(OFILE* f)
+{
+    if(sgf_sync_bloc(f) < 0) return -1;
+    if(f->inode_dirty){
+        sgf_write_inode(f);
+        f->inode_dirty = 0;
+    }
+
+    journal_end_op();
+    return 0;
+}
+
+
+/**********************************************************************
+ Ajouter un caractre  la chane d'un fichier ouvert en criture.
+ *********************************************************************/
+
+static int sgf_raw_putc(OFILE* file, char c)
 {
-    assert (file->mode == WRITE_MODE || file->mode == APPEND_MODE);
+    if(file->removed) return -1;
 
     /*On insere le caractere dans le buffer*/
     file->buffer[(file->ptr % BLOCK_SIZE)] = c;
@@ -167,7 +1300,6 @@ int sgf_putc(OFILE* file, char  c)
 
     /*On test si le buffer est plein dans quel cas on append le block (ou ecrase suivant le mode)*/
     if((file->ptr % BLOCK_SIZE) == 0){
-        printf("[sgf_putc] : Buffer va etre appended\n");
         if(sgf_append_block(file) < 0){
             return -1;
         }
@@ -177,18 +1309,158 @@ int sgf_putc(OFILE* file, char  c)
 }
 
 
+/**********************************************************************
+ Fichiers compresss : les octets sont accumuls dans zbuf ; une
+ grappe pleine (ou termine par sgf_flush) est compresse puis
+ ajoute  la chane par le chemin d'criture ordinaire. L'INODE
+ ne compte la grappe (zlength) qu'une fois celle-ci entirement
+ crite.
+ *********************************************************************/
+
+static int sgf_z_emit(OFILE* f)
+{
+    char h[ZHEADER_SIZE];
+    char* data = ztmp;
+    int k, n;
+
+    if(f->zcount == 0) return 0;
+    n = lz_compress(f->zbuf, f->zcount, ztmp, f->zcount - 1);
+    if(n < 0){
+        data = f->zbuf;
+        n = f->zcount;
+    }
+
+    h[0] = f->zcount & 0xFF;
+    h[1] = f->zcount >> 8;
+    h[2] = n & 0xFF;
+    h[3] = n >> 8;
+    for(k = 0; k < ZHEADER_SIZE; k++)
+        if(sgf_raw_putc(f, h[k]) < 0) return -1;
+    for(k = 0; k < n; k++)
+        if(sgf_raw_putc(f, data[k]) < 0) return -1;
+
+    f->zlength += f->zcount;
+    f->zcount = 0;
+    f->inode_dirty = 1;
+    return 0;
+}
+
+static int sgf_z_putc(OFILE* f, char c)
+{
+    if(f->removed) return -1;
+    f->zbuf[f->zcount++] = c;
+    f->zptr++;
+    if(f->zcount == CLUSTER_SIZE) return sgf_z_emit(f);
+    return 0;
+}
+
+static int sgf_z_write(OFILE* f, char* data, int size)
+{
+    int amount;
+
+    for(; size > 0; data += amount, size -= amount){
+        amount = CLUSTER_SIZE - f->zcount;
+        if(amount > size) amount = size;
+        memcpy(f->zbuf + f->zcount, data, amount);
+        f->zcount += amount;
+        f->zptr += amount;
+        if(f->zcount == CLUSTER_SIZE && sgf_z_emit(f) < 0) return -1;
+    }
+    return 0;
+}
+
+
+/**********************************************************************
+ Vider un fichier ouvert en criture : placer tous les blocs retenus,
+ y compris le bloc incomplet du tampon. Le fichier reste ouvert ; son
+ dernier bloc est alors incomplet et sera rcrit en place.
+ *********************************************************************/
+
+static int sgf_do_flush(OFILE* f)
+{
+    if(f->removed) return 0;
+    if(f->mode == READ_WRITE_MODE) return sgf_rw_flush(f);
+    if(f->mode != WRITE_MODE && f->mode != APPEND_MODE) return 0;
+
+    /* Un fichier compresse termine d'abord sa grappe */
+    if(f->compressed && sgf_z_emit(f) < 0) return -1;
+    if((f->ptr % BLOCK_SIZE) != 0 && sgf_append_block(f) < 0) return -1;
+
+    /* La deduplication n a lieu qu au premier vidage (toutes les empreintes sont connues) */
+    if(f->dedup){
+        f->dedup = 0;
+        if(f->mode == WRITE_MODE && sgf_dedup_tail(f) < 0) return -1;
+    }
+
+    if(f->nb_dirty > 0 && sgf_place_blocks(f) < 0) return -1;
+
+    /* sa taille est a jour meme si aucun bloc n'etait a placer */
+    if(f->inode_dirty){
+        sgf_write_inode(f);
+        f->inode_dirty = 0;
+        journal_end_op();
+    }
+
+    /* Le dernier bloc est incomplet : les prochains ajouts le completeront en place */
+    if((f->ptr % BLOCK_SIZE) != 0){
+        f->mode = APPEND_MODE;
+        if(f->shared != NULL){
+            memcpy(f->shared->tail, f->buffer, BLOCK_SIZE);
+            f->shared->tail_adr = f->last;
+        }
+    }
+    return 0;
+}
+
+int sgf_flush(OFILE* f)
+{
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_flush(f);
+    RECORD_STOP(TRACE_FLUSH, f, 0, 0, r, NULL, NULL);
+    return r;
+}
+
+
+/**********************************************************************
+ Ecrire le caractre "c" dans le fichier ouvert dcrit par "file".
+ *********************************************************************/
+
+int sgf_putc(OFILE* file, char  c)
+{
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    if (file->mode == READ_WRITE_MODE) r = sgf_rw_putc(file, c);
+    else {
+        assert (file->mode == WRITE_MODE || file->mode == APPEND_MODE);
+        r = file->compressed ? sgf_z_putc(file, c) : sgf_raw_putc(file, c);
+    }
+    RECORD_STOP(TRACE_PUTC, file, 0, 0, r, NULL, NULL);
+    return r;
+}
+
+
 /**********************************************************************
  crire la chane de caractre "s" dans un fichier ouvert en criture
  dcrit par "file".
  *********************************************************************/
 
+static int sgf_do_write(OFILE* f, char *data, int size);
+
 void sgf_puts(OFILE* file, char* s)
     {
-    assert (file->mode == WRITE_MODE);
-    /* On ajoute un caractere au buffer tant que l on a pas atteint la fin de la chaine de caractere */
-    for (; (*s != '\0'); s++) {
-        sgf_putc(file, *s);
-        }
+    int len = strlen(s);
+    RECORD_DECL;
+    
+    assert (file->mode != READ_MODE);
+    RECORD_START();
+    /* toute la chaine est copiee bloc par bloc, comme par sgf_write */
+    if (len > 0) sgf_do_write(file, s, len);
+    RECORD_STOP(TRACE_PUTS, file, len, 0, 0, NULL, NULL);
     }
 
 
@@ -199,6 +1471,107 @@ void sgf_puts(OFILE* file, char* s)
  *
  *********************************************************************/
 
+/************************************************************
+ Cache des fins de fichiers : retirer du cache la fin du
+ fichier "inode" (NULL si elle n'y est pas).
+ ************************************************************/
+
+static OFILE* sgf_take_tail(int inode)
+{
+    OFILE** p;
+    OFILE* f;
+
+    for(p = &tail_cache; *p != NULL; p = &(*p)->next_open)
+        if((*p)->inode == inode){
+            f = *p;
+            *p = f->next_open;
+            nb_tails--;
+            return f;
+        }
+    return NULL;
+}
+
+/* Liberer les tampons d'un fichier ouvert et le rendre a la reserve */
+static void sgf_free_ofile(OFILE* f)
+{
+    free(f->dirty);
+    free(f->holes);
+    free(f->zbuf);
+    free(f->ztable);
+    free(f->hashes);
+    if(f->shared != NULL) sgf_release_shared(f->shared);
+    f->next_open = free_ofiles;
+    free_ofiles = f;
+}
+
+/* Liberer une fin retiree du cache (deja ecrite a la fermeture) */
+static int sgf_land_tail(OFILE* f)
+{
+    int r = sgf_flush(f);
+
+    sgf_free_ofile(f);
+
+    return r;
+}
+
+/* Mettre en cache la fin d'un fichier ferme ; la plus ancienne est liberee si le cache est plein */
+static int sgf_park_tail(OFILE* f)
+{
+    OFILE** p;
+    OFILE* old;
+
+    f->next_open = tail_cache;
+    tail_cache = f;
+    if(++nb_tails <= sgf_tail_cache_files) return 0;
+
+    for(p = &tail_cache; (*p)->next_open != NULL; p = &(*p)->next_open)
+        ;
+    old = *p;
+    *p = NULL;
+    nb_tails--;
+    return sgf_land_tail(old);
+}
+
+static int sgf_do_sync (void)
+{
+    OFILE* f;
+    int r = 0;
+
+    while((f = tail_cache) != NULL){
+        tail_cache = f->next_open;
+        nb_tails--;
+        if(sgf_land_tail(f) < 0) r = -1;
+    }
+
+
+    /* puis la transaction en cours du journal est validee */
+    sgf_journal_commit();
+    return r;
+}
+
+int sgf_sync (void)
+{
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_sync();
+    RECORD_STOP(TRACE_SYNC, NULL, 0, 0, r, NULL, NULL);
+    return r;
+}
+
+static void sgf_sync_on_close(void)
+{
+    /* apres une panique, rien de l'etat en memoire ne doit etre ecrit */
+    if(sgf_failed) return;
+
+    sgf_sync();
+    close_sgf_snap();
+    close_sgf_journal();
+    close_sgf_crc();
+}
+
+
 /************************************************************
  Dtruire un fichier.
  ************************************************************/
@@ -206,26 +1579,27 @@ void sgf_puts(OFILE* file, char* s)
 void sgf_remove(int adr_inode)
 {
     TBLOCK b;
-    int adr, suivant;
-    read_block(adr_inode, &b.data);
-
-    /*Working version might fail if file has no data block yet*/
+    OFILE* f;
+    OINODE* s;
+
+    /* Les fichiers ouverts sur cet inode abandonnent leurs blocs retenus */
+    for(f = open_files; f != NULL; f = f->next_open)
+        if(f->inode == adr_inode){
+            sgf_drop_blocks(f);
+            f->removed = 1;
+        }
+    /* ainsi que sa fin gardee en cache */
+    if((f = sgf_take_tail(adr_inode)) != NULL){
+        sgf_drop_blocks(f);
+        sgf_free_ofile(f);
+    }
+    /* l'INODE va etre libere : une nouvelle ouverture ne doit plus le trouver */
+    if((s = sgf_find_shared(adr_inode)) != NULL) sgf_unlist_shared(s);
 
-    /*adr = b.inode.first;
-    do{
-        suivant = get_fat(adr);
-        set_fat(adr, FAT_FREE);
-        adr = suivant;
-    }while(suivant != FAT_EOF);*/
+    read_block(adr_inode, &b.data);
 
-    /*Second working version just in case file has no data block yet*/
-    /*On met tout les blocs du fichier a Free les rendant a nouveau disponible sur le disque*/
-    suivant = adr = b.inode.first;
-    while(suivant != FAT_EOF){
-        suivant = get_fat(adr);
-        set_fat(adr, FAT_FREE);
-        adr = suivant;
-    }
+    /*On rend libres les blocs du fichier qui ne sont pas partages avec un clone*/
+    release_chain(b.inode.first);
     /*Puis on supprime l inode du disque*/
     set_fat(adr_inode, FAT_FREE);
     /*On affiche des informations sur le disque*/
@@ -244,21 +1618,30 @@ static  OFILE*  sgf_open_write(const char* nom)
     OFILE* file;
     TBLOCK b;
 
-    /* Rechercher un bloc libre sur disque */
-    inode = alloc_block();
+    /* Rechercher un bloc libre sur disque, pres du repertoire */
+    inode = alloc_block_near(directory_hint() + 1, ALLOC_DATA);
     assert (inode >= 0);
 
-    /* Allouer une structure OFILE */
-    file = malloc(sizeof(struct OFILE));
-    if (file == NULL) return (NULL);
-    
     /* prparer un inode vers un fichier vide */
+    memset(&b, 0, sizeof(b));
     b.inode.length = 0;
     b.inode.first  = FAT_EOF;
     b.inode.last   = FAT_EOF;
+    b.inode.hole_signature = SIGNATURE_HOLES;
+
+    /* Prendre une structure OFILE et l'objet partage du nouvel INODE */
+    file = sgf_alloc_ofile();
+    if (file == NULL) return (NULL);
+    file->shared = sgf_share_inode(inode, &b.inode);
+    if (file->shared == NULL)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
+
 
     /* sauver ce inode */
-    write_block(inode, &b.data);
+    write_meta_block(inode, &b.data);
     set_fat(inode, FAT_INODE);
 
     /* mettre a jour le repertoire */
@@ -271,6 +1654,9 @@ static  OFILE*  sgf_open_write(const char* nom)
     file->inode   = inode;
     file->mode    = WRITE_MODE;
     file->ptr     = 0;
+    file->holes   = NULL;
+    file->nb_holes = 0;
+    sgf_load_compression(file, NULL);
 
     return (file);
 }
@@ -284,31 +1670,64 @@ static  OFILE*  sgf_open_read(const char* nom)
 {
     int inode;
     OFILE* file;
-    TBLOCK b;
+    INODE* ino;
     
     /* Chercher le fichier dans le rpertoire */
     inode = find_inode(nom);
     if (inode < 0) return (NULL);
     
-    /* lire le inode */
-    read_block(inode, &b.data);
+    /* une fin de fichier en cache n'est plus a jour apres cette ouverture */
+    if ((file = sgf_take_tail(inode)) != NULL) sgf_land_tail(file);
     
-    /* Allouer une structure OFILE */
-    file = malloc(sizeof(struct OFILE));
+    /* Prendre une structure OFILE ; le inode n'est lu que si le fichier n'est pas deja ouvert */
+    file = sgf_alloc_ofile();
     if (file == NULL) return (NULL);
+    file->shared = sgf_share_inode(inode, NULL);
+    if (file->shared == NULL)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
+    ino = &file->shared->ino;
     
-    file->length  = b.inode.length;
-    file->first   = b.inode.first;
-    file->last    = b.inode.last;
+    file->length  = ino->length;
+    file->first   = ino->first;
+    file->last    = ino->last;
     file->inode   = inode;
     file->mode    = READ_MODE;
     file->ptr     = 0;
+    file->version = file->shared->version;
     file->currentBlocNum = -1;
     file->currentBlocAdr = -1;
+    if (sgf_load_holes(file, ino) < 0  ||  sgf_load_compression(file, ino) < 0)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
     
     return (file);
 }
 
+/************************************************************
+ Ouvrir un fichier en lecture/criture (NULL si chec) :
+ le pointeur est au dbut et le contenu est conserv.
+ ************************************************************/
+
+static  OFILE*  sgf_open_read_write(const char* nom)
+{
+    OFILE* file = sgf_open_read(nom);
+
+    /* les grappes d'un fichier compress ne se rcrivent pas en place */
+    if (file != NULL  &&  file->compressed)
+        {
+        file->dirty = NULL;
+        sgf_free_ofile(file);
+        return (NULL);
+        }
+    if (file != NULL) file->mode = READ_WRITE_MODE;
+    return (file);
+}
+
 /************************************************************
  Ouvrir un fichier en append (NULL si chec).
  ************************************************************/
@@ -317,30 +1736,46 @@ static  OFILE*  sgf_open_append(const char* nom)
 {
     int inode;
     OFILE* file;
-    TBLOCK b;
+    OINODE* s;
     
     /* Chercher le fichier dans le rpertoire */
     inode = find_inode(nom);
     if (inode < 0) return (NULL);
     
-    /* lire le inode */
-    read_block(inode, &b.data);
-    
-    /* Allouer une structure OFILE */
-    file = malloc(sizeof(struct OFILE));
+    /* Prendre une structure OFILE et l'objet partage de son inode */
+    file = sgf_alloc_ofile();
     if (file == NULL) return (NULL);
+    s = file->shared = sgf_share_inode(inode, NULL);
+    if (s == NULL)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
     
-    file->length  = b.inode.length;
-    file->first   = b.inode.first;
-    file->last    = b.inode.last;
+    file->length  = s->ino.length;
+    file->first   = s->ino.first;
+    file->last    = s->ino.last;
     file->inode   = inode;
     file->mode    = APPEND_MODE;
     file->ptr     = file->length;
+    file->version = s->version;
+    if (sgf_load_holes(file, &s->ino) < 0  ||  sgf_load_compression(file, &s->ino) < 0)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
+
 
-    /*Si un bloc est incomplet on le charge sinon on passe directement en mode ecriture*/
+    /*Si un bloc est incomplet on le charge (ou on reprend sa copie partagee) sinon on passe directement en mode ecriture*/
     if((file->length%BLOCK_SIZE) != 0){
         printf("[sgf_open_append] : reading incomplete block\n");
-        read_block(file->last, &file->buffer);
+        if(s->tail_adr == file->last){
+            memcpy(file->buffer, s->tail, BLOCK_SIZE);
+        }else{
+            read_block(file->last, &file->buffer);
+            memcpy(s->tail, file->buffer, BLOCK_SIZE);
+            s->tail_adr = file->last;
+        }
         printf("[sgf_open_append] : sucessfully read incomplete block\n");
     }else{
         file->mode = WRITE_MODE;
@@ -350,19 +1785,249 @@ static  OFILE*  sgf_open_append(const char* nom)
 }
 
 
+/************************************************************
+ Initialiser les champs communs d'un fichier ouvert.
+ ************************************************************/
+
+static void sgf_init_ofile (OFILE* file, int mode)
+    {
+    file->currentBlocNum = -1;
+    file->currentBlocAdr = -1;
+    file->buffer_block = -1;
+    file->buffer_adr = -1;
+    file->buffer_dirty = 0;
+    file->inode_dirty = 0;
+    file->dirty = NULL;
+    file->nb_dirty = 0;
+    file->dirty_capacity = 0;
+    file->nb_reserved = 0;
+    file->removed = 0;
+    file->log_append = (mode == APPEND_MODE);
+    file->exclusive = 0;
+    file->view = NULL;
+    file->dedup = (mode == WRITE_MODE  &&  sgf_dedup);
+    file->hashes = NULL;
+    file->nb_hashes = 0;
+    file->hash_capacity = 0;
+    }
+
+
 /************************************************************
  Ouvrir un fichier (NULL si chec).
  ************************************************************/
 
-OFILE* sgf_open (const char* nom, int mode)
+static OFILE* sgf_do_open (const char* nom, int mode)
     {
+    OFILE* file;
+    int compress = mode & COMPRESSED_MODE;
+    
+    /* la compression ne se choisit qu' la cration */
+    mode &= ~COMPRESSED_MODE;
+    if (compress  &&  mode != WRITE_MODE) return (NULL);
+    
+    /* reprendre la fin d'un fichier encore en cache */
+    if (mode == APPEND_MODE  &&  (file = sgf_take_tail(find_inode(nom))) != NULL)
+        {
+        file->next_open = open_files;
+        open_files = file;
+        return (file);
+        }
+    
     switch (mode)
         {
-        case READ_MODE:  return sgf_open_read(nom);
-        case WRITE_MODE: return sgf_open_write(nom);
-        case APPEND_MODE: return sgf_open_append(nom);
+        case READ_MODE:  file = sgf_open_read(nom);   break;
+        case WRITE_MODE: file = sgf_open_write(nom);  break;
+        case APPEND_MODE: file = sgf_open_append(nom); break;
+        case READ_WRITE_MODE: file = sgf_open_read_write(nom); break;
         default:         return (NULL);
         }
+    
+    if (file != NULL)
+        {
+        sgf_init_ofile(file, mode);
+        if (compress  &&  sgf_start_compression(file, 0) < 0)
+            {
+            sgf_free_ofile(file);
+            journal_end_op();
+            return (NULL);
+            }
+        file->next_open = open_files;
+        open_files = file;
+        journal_end_op();
+        }
+    return (file);
+    }
+
+OFILE* sgf_open (const char* nom, int mode)
+    {
+    OFILE* file;
+    STATS_DECL;
+    RECORD_DECL;
+    
+    STATS_START();
+    RECORD_START();
+    file = sgf_do_open(nom, mode);
+    RECORD_STOP(TRACE_OPEN, file, mode, (file == NULL) ? -1 : file->compressed ? file->zlength : file->length,
+                (file == NULL) ? -1 : 0, nom, NULL);
+    STATS_STOP(STAT_OPEN);
+    return (file);
+    }
+
+
+/************************************************************
+ Ouvrir en lecture un fichier d'un instantane mont (NULL
+ si chec). Ce fichier n'est pas dans la liste des fichiers
+ ouverts : il ne voit jamais les blocs du volume courant.
+ ************************************************************/
+
+OFILE* sgf_open_snapshot (struct SNAP_VIEW* view, const char* nom)
+    {
+    OFILE* file;
+    TBLOCK b;
+    int inode;
+    
+    inode = sgf_snapshot_find_inode(view, nom);
+    if (inode < 0) return (NULL);
+    sgf_snapshot_read_block(view, inode, &b.data);
+    
+    file = sgf_alloc_ofile();
+    if (file == NULL) return (NULL);
+    
+    file->length  = b.inode.length;
+    file->first   = b.inode.first;
+    file->last    = b.inode.last;
+    file->inode   = inode;
+    file->mode    = READ_MODE;
+    file->ptr     = 0;
+    if (sgf_load_holes(file, &b.inode) < 0  ||  sgf_load_compression(file, &b.inode) < 0)
+        {
+        sgf_free_ofile(file);
+        return (NULL);
+        }
+    sgf_init_ofile(file, READ_MODE);
+    file->view    = view;
+
+    file->next_open = NULL;
+    return (file);
+    }
+
+
+/************************************************************
+ Dtruire un fichier d'aprs son nom (-1 s'il n'existe pas).
+ ************************************************************/
+
+static int sgf_do_unlink (const char* nom)
+    {
+    int inode;
+    
+    inode = find_inode(nom);
+    if (inode < 0) return (-1);
+    
+    delete_inode(nom);
+    sgf_remove(inode);
+    journal_end_op();
+    return (0);
+    }
+
+int sgf_unlink (const char* nom)
+    {
+    int r;
+    RECORD_DECL;
+    
+    RECORD_START();
+    r = sgf_do_unlink(nom);
+    RECORD_STOP(TRACE_UNLINK, NULL, 0, 0, r, nom, NULL);
+    return (r);
+    }
+
+
+/************************************************************
+ Cloner un fichier (-1 si "src" n'existe pas ou si la table
+ des rfrences ne peut pas tre cre).
+ ************************************************************/
+
+static int sgf_do_clone (const char* src, const char* dst)
+    {
+    TBLOCK b;
+    OFILE* f;
+    int inode, clone, oldinode;
+    
+    inode = find_inode(src);
+    if (inode < 0) return (-1);
+    
+    /* l'original doit etre a jour sur le disque, et ses blocs sont desormais partages */
+    if ((f = sgf_take_tail(inode)) != NULL) sgf_land_tail(f);
+    for(f = open_files; f != NULL; f = f->next_open)
+        if (f->inode == inode)
+            {
+            if (sgf_flush(f) < 0) return (-1);
+            f->exclusive = 0;
+            }
+    
+    /* une reference de plus sur le premier bloc suffit pour toute la chaine */
+    read_block(inode, &b.data);
+    if (b.inode.first != FAT_EOF  &&  ref_block(b.inode.first) < 0) return (-1);
+    save_refcount();
+    
+    clone = alloc_block_near(directory_hint() + 1, ALLOC_DATA);
+    if (clone < 0)
+        {
+        if (b.inode.first != FAT_EOF) release_chain(b.inode.first);
+        return (-1);
+        }
+    write_meta_block(clone, &b.data);
+    set_fat(clone, FAT_INODE);
+    
+    oldinode = add_inode(dst, clone);
+    if (oldinode > 0) sgf_remove(oldinode);
+    journal_end_op();
+    return (0);
+    }
+
+int sgf_clone (const char* src, const char* dst)
+    {
+    int r;
+    RECORD_DECL;
+    
+    RECORD_START();
+    r = sgf_do_clone(src, dst);
+    RECORD_STOP(TRACE_CLONE, NULL, 0, 0, r, src, dst);
+    return (r);
+    }
+
+
+/************************************************************
+ Des blocs viennent d'tre partags : aucun fichier ouvert
+ ne tient plus sa chane pour exclusive.
+ ************************************************************/
+
+void sgf_forget_exclusive (void)
+    {
+    OFILE* f;
+    
+    for(f = open_files; f != NULL; f = f->next_open)
+        f->exclusive = 0;
+    for(f = tail_cache; f != NULL; f = f->next_open)
+        f->exclusive = 0;
+    }
+
+
+/************************************************************
+ Savoir si un fichier est ouvert.
+ ************************************************************/
+
+int sgf_is_open (int inode)
+    {
+    OINODE* s;
+
+    /* les fins en cache gardent aussi leur objet partage */
+    if (sgf_find_shared(inode) != NULL) return (1);
+
+    /* un fichier supprime reste ouvert tant qu'un OFILE le garde */
+    for(s = unlisted; s != NULL; s = s->next)
+        if (s->inode == inode) return (1);
+
+    return (0);
     }
 
 
@@ -370,22 +2035,50 @@ OFILE* sgf_open (const char* nom, int mode)
  Fermer un fichier ouvert.
  ************************************************************/
 
-int sgf_close(OFILE* file)
+static int sgf_do_close(OFILE* file)
 {
+    OFILE** p;
+    int r = 0;
+
     /* Cette fonction s assure que toutes les donnees dans le buffer n ayant pas encore ete ecrites sur le disque le sont a present */
-    if(file->mode ==  WRITE_MODE || file->mode == APPEND_MODE){
-        if((file->ptr % BLOCK_SIZE) != 0){
-            /*Le append block modifie deja l inode*/
-            if(sgf_append_block(file) < 0){
-                return -1;
-            }
-        }
+    if(file->removed){
+        sgf_drop_blocks(file);
+    }else if(sgf_flush(file) < 0){
+        return -1;
     }
 
-    free(file);
+    /* Retirer le fichier de la liste des fichiers ouverts */
+    for(p = &open_files; *p != NULL; p = &(*p)->next_open)
+        if(*p == file){
+            *p = file->next_open;
+            break;
+        }
+
+    /* Un fichier ouvert en append, deja ecrit, garde sa fin en cache jusqu a la prochaine ouverture */
+    if(!file->removed && file->log_append && sgf_tail_cache_files > 0)
+        r = sgf_park_tail(file);
+    else
+        sgf_free_ofile(file);
     file = NULL;
+    journal_end_op();
 
-    return 0;
+    /* les blocs des instantanes detruits sont rendus petit a petit */
+    sgf_snapshot_reclaim(SNAP_RECLAIM_STEP);
+    return r;
+}
+
+int sgf_close(OFILE* file)
+{
+    int r;
+    STATS_DECL;
+    RECORD_DECL;
+
+    STATS_START();
+    RECORD_START();
+    r = sgf_do_close(file);
+    RECORD_STOP(TRACE_CLOSE, file, 0, 0, r, NULL, NULL);
+    STATS_STOP(STAT_CLOSE);
+    return r;
 }
 
 
@@ -395,8 +2088,25 @@ int sgf_close(OFILE* file)
 
 void init_sgf (void)
     {
+    static int hooked = 0;
+    
     init_sgf_disk();
+    init_sgf_crc();
+    init_sgf_journal();
     init_sgf_fat();
+    init_sgf_refcount();
+    init_sgf_snap();
+    init_sgf_dir();
+    init_sgf_dedup();
+    
+    /* les fins de fichiers en cache sont ecrites avant la fermeture du disque */
+    set_close_hook(sgf_sync_on_close);
+    if (!hooked) atexit(sgf_sync_on_close);
+    hooked = 1;
+    
+    /* enregistrement des appels demande par l'environnement */
+    if (!sgf_recording  &&  getenv("SGF_RECORD") != NULL)
+        sgf_record_start(getenv("SGF_RECORD"));
     }
 
 
@@ -404,44 +2114,271 @@ void init_sgf (void)
  * Ralise le dplacement du pointeur ptr en lecture
  *********************************************************************/
     
-int sgf_seek (OFILE* f, int pos){
-    assert(f->mode == READ_MODE);
-    /*Position hors des bornes, on indique une erreur*/
-    if(pos < 0 || pos > (f->length - 1))
-        return -1;
-    /*Load block if buffer is empty, especially if sgf_seek is used before sgf_getc*/
-    if ((f->ptr % BLOCK_SIZE) == 0)
-    {
-        printf("sgf_seek loaded block into buffer\n");
-        sgf_read_bloc(f, f->ptr / BLOCK_SIZE);
-    }
-    /*La nouvelle position est un multiple de BLOCK_SIZE, la fonction sgf_getc s occupera du chargement du bloc*/
-    if(pos%BLOCK_SIZE == 0){
-        f->ptr = pos;
-        printf("sgf_seek : getchar will load block\n");
+static int sgf_do_seek (OFILE* f, int pos){
+    assert(f->mode == READ_MODE || f->mode == READ_WRITE_MODE);
+    SGF_REFRESH(f);
+    /*Un fichier compresse se deplace dans sa taille decompressee, la grappe est chargee au prochain acces*/
+    if(f->compressed){
+        if(pos < 0 || pos > f->zlength - 1) return -1;
+        f->zptr = pos;
         return 0;
     }
-    /*La nouvelle position se trouve dans le meme bloc, on change uniquement la position du pointeur dans le fichier*/
-    if(pos/BLOCK_SIZE == f->ptr/BLOCK_SIZE){
-        f->ptr = pos;
-        printf("sgf_seek : same block\n");
-        return 0;
+
+    /*Position hors des bornes, on indique une erreur ; en lecture/ecriture on peut aussi
+      se placer a la fin ou au-dela (la prochaine ecriture laissera un trou)*/
+    if(pos < 0 || (f->mode == READ_MODE && pos > f->length - 1))
+        return -1;
+
+    /*Le bloc n est charge (ou recharge) qu au prochain acces, s il n est pas deja dans le buffer*/
+    f->ptr = pos;
+
+    return 0;
+}
+
+int sgf_seek (OFILE* f, int pos){
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_seek(f, pos);
+    RECORD_STOP(TRACE_SEEK, f, pos, 0, r, NULL, NULL);
+    return r;
+}
+
+
+/**********************************************************************
+ * Se placer sur les donnees ou sur un trou a partir de "pos".
+ *********************************************************************/
+
+static int sgf_do_seek_data (OFILE* f, int pos){
+    int h;
+
+    assert(f->mode == READ_MODE || f->mode == READ_WRITE_MODE);
+    SGF_REFRESH(f);
+    if(f->compressed){
+        if(pos < 0 || pos >= f->zlength) return -1;
+        return (f->zptr = pos);
+    }
+
+    if(pos < 0 || pos >= f->length) return -1;
+
+    h = sgf_find_hole(f, pos / BLOCK_SIZE);
+    if(h >= 0) pos = (f->holes[h].start + f->holes[h].count) * BLOCK_SIZE;
+    if(pos >= f->length) return -1;
+
+    f->ptr = pos;
+    return pos;
+}
+
+int sgf_seek_data (OFILE* f, int pos){
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_seek_data(f, pos);
+    RECORD_STOP(TRACE_SEEK_DATA, f, pos, 0, r, NULL, NULL);
+    return r;
+}
+
+static int sgf_do_seek_hole (OFILE* f, int pos){
+    int h;
+
+    assert(f->mode == READ_MODE || f->mode == READ_WRITE_MODE);
+    SGF_REFRESH(f);
+    /*Un fichier compresse n a pas de trous : seule sa fin en est un*/
+    if(f->compressed){
+        if(pos < 0 || pos >= f->zlength) return -1;
+        return (f->zptr = f->zlength);
     }
 
-    /*Derniers recours on charge le nouveau bloc vers le buffer*/
-    sgf_read_bloc(f, pos/BLOCK_SIZE);
+    if(pos < 0 || pos >= f->length) return -1;
+
+    /*Les trous sont tries : le premier qui ne finit pas avant pos, sinon la fin du fichier*/
+    for(h = 0; h < f->nb_holes && f->holes[h].start + f->holes[h].count <= pos / BLOCK_SIZE; h++)
+        ;
+    if(h == f->nb_holes)
+        pos = f->length;
+    else if(f->holes[h].start * BLOCK_SIZE > pos)
+        pos = f->holes[h].start * BLOCK_SIZE;
+
     f->ptr = pos;
-    printf("sgf_seek : load block\n");
+    return pos;
+}
+
+int sgf_seek_hole (OFILE* f, int pos){
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_seek_hole(f, pos);
+    RECORD_STOP(TRACE_SEEK_HOLE, f, pos, 0, r, NULL, NULL);
+    return r;
+}
+
+
+/**********************************************************************
+ * Faire un trou de "len" octets a partir de "pos".
+ *********************************************************************/
+
+static int sgf_do_punch_hole (OFILE* f, int pos, int len){
+    int end, first, stop, b, e, h, n, index, prev, seg, last, after, shared;
+
+    if(f->mode != READ_WRITE_MODE || f->removed) return -1;
+    if(pos < 0 || len < 0) return -1;
+    end = (len > f->length - pos) ? f->length : pos + len;
+    if(pos >= end) return 0;
+
+    /*Seuls les blocs entierement couverts sont liberes, jamais le dernier bloc du fichier*/
+    first = (pos + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    stop = end / BLOCK_SIZE;
+    if(stop > (f->length - 1) / BLOCK_SIZE) stop = (f->length - 1) / BLOCK_SIZE;
+    if(first >= stop){
+        if(sgf_zero_range(f, pos, end) < 0) return -1;
+        return sgf_rw_flush(f);
+    }
+
+    if(sgf_zero_range(f, pos, first * BLOCK_SIZE) < 0) return -1;
+    if(sgf_zero_range(f, stop * BLOCK_SIZE, end) < 0) return -1;
+
+    for(b = first; b < stop; b = e){
+        index = sgf_chain_index(f, b);
+        if(index < 0){
+            h = sgf_find_hole(f, b);
+            e = f->holes[h].start + f->holes[h].count;
+            continue;
+        }
+        /*Une suite de blocs chaines b..e-1 (les blocs index..index+n-1 de la chaine)*/
+        for(e = b + 1; e < stop && sgf_chain_index(f, e) >= 0; e++)
+            ;
+        n = e - b;
+
+        /*Le bloc precedent est rechaine : il ne doit pas etre partage*/
+        prev = -1;
+        if(index > 0 && (prev = sgf_unshare(f, index - 1, sgf_locate_bloc(f, index - 1), 1)) < 0)
+            return -1;
+        seg = (prev < 0) ? f->first : get_fat(prev);
+        shared = (get_refcount(seg) > 0);
+        for(last = seg, h = 1; h < n; h++){
+            last = get_fat(last);
+            if(get_refcount(last) > 0) shared = 1;
+        }
+        after = get_fat(last);
+
+        /*Une suite partagee avec un clone reste chainee a la suite : une reference de plus sur elle*/
+        if(shared && ref_block(after) < 0) return -1;
+        if(sgf_add_hole(f, b, n) < 0){
+            if(shared) unref_block(after);
+            if(sgf_zero_range(f, b * BLOCK_SIZE, e * BLOCK_SIZE) < 0) return -1;
+            continue;
+        }
+        if(f->buffer_block >= b && f->buffer_block < e){
+            f->buffer_dirty = 0;
+            f->buffer_block = -1;
+        }
+
+        if(!shared) set_fat_lazy(last, FAT_EOF);
+        if(prev < 0)
+            f->first = after;
+        else
+            set_fat_lazy(prev, after);
+        save_fat();
+        if(f->exclusive > index) f->exclusive = index;
+        f->currentBlocNum = -1;
+        sgf_chain_moved(f);
+
+        /*L INODE est reecrit avant la liberation : il valide le trou*/
+        sgf_write_inode(f);
+        f->inode_dirty = 0;
+        release_chain(seg);
+    }
+
+    return sgf_rw_flush(f);
+}
+
+int sgf_punch_hole (OFILE* f, int pos, int len){
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_punch_hole(f, pos, len);
+    RECORD_STOP(TRACE_PUNCH_HOLE, f, pos, len, r, NULL, NULL);
+    return r;
+}
+
+
+/**********************************************************************
+ * Ramener un fichier ouvert en lecture/ecriture a "len" octets.
+ *********************************************************************/
+
+static int sgf_do_truncate (OFILE* f, int len){
+    int keep, h, adr;
+
+    if(f->mode != READ_WRITE_MODE || f->removed) return -1;
+    if(len < 0 || len > f->length) return -1;
+
+    keep = (len + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+    /*Le buffer ne doit pas etre reecrit dans un bloc libere*/
+    if(f->buffer_block >= keep){
+        f->buffer_dirty = 0;
+        f->buffer_block = -1;
+    }
+
+
+    /*Le nouveau dernier bloc ne peut pas etre dans un trou ; les trous suivants disparaissent*/
+    if(keep > 0 && sgf_chain_index(f, keep - 1) < 0 && sgf_fill_hole(f, keep - 1) < 0) return -1;
+    for(h = 0; h < f->nb_holes && f->holes[h].start < keep; h++)
+        ;
+    keep = (keep == 0) ? 0 : sgf_chain_index(f, keep - 1) + 1;
+
+    /*Couper la chaine apres le bloc keep-1 de la chaine, seule la fin est parcourue ensuite*/
+    if(keep == 0){
+        adr = f->first;
+        f->first = f->last = FAT_EOF;
+    }else{
+        /*Le nouveau dernier bloc est rechaine : il ne doit pas etre partage*/
+        f->last = sgf_unshare(f, keep - 1, sgf_locate_bloc(f, keep - 1), 1);
+        if(f->last < 0) return -1;
+        adr = get_fat(f->last);
+    }
+    if(f->currentBlocNum >= keep) f->currentBlocNum = -1;
+    sgf_chain_moved(f);
+
+    f->nb_holes = h;
+    f->length = len;
+    if(f->ptr > len) f->ptr = len;
+
+    /*L INODE est reecrit avant la liberation : il valide la troncature*/
+    sgf_write_inode(f);
+    f->inode_dirty = 0;
+
+    if(keep > 0) set_fat_lazy(f->last, FAT_EOF);
+    release_chain(adr);
+    journal_end_op();
 
     return 0;
 }
 
-int sgf_write(OFILE* f, char *data, int size){
+int sgf_truncate (OFILE* f, int len){
+    int r;
+    RECORD_DECL;
+
+    RECORD_START();
+    r = sgf_do_truncate(f, len);
+    RECORD_STOP(TRACE_TRUNCATE, f, len, 0, r, NULL, NULL);
+    return r;
+}
+
+static int sgf_do_write(OFILE* f, char *data, int size){
+    if(f->mode == READ_WRITE_MODE) return sgf_rw_write(f, data, size);
     /*Only allow sgf_write with write mode and append mode*/
     assert(f->mode == WRITE_MODE || f->mode == APPEND_MODE);
+    /*A removed file takes no more data*/
+    if(f->removed) return -1;
+    if(f->compressed) return sgf_z_write(f, data, size);
 
     /*Check weather or not disk space is large enough to fit new data*/
-    unsigned freeBlocksCount = get_free_fat_blocks_count();
+    unsigned freeBlocksCount = get_free_fat_blocks_count() - reserved_blocks;
     if(size >= freeBlocksCount*BLOCK_SIZE){
         fprintf(stderr, "[sgf_write] : Not enough space left to write desired data block\n");
         return -1;
@@ -468,11 +2405,22 @@ int sgf_write(OFILE* f, char *data, int size){
         memcpy(f->buffer+(f->ptr%BLOCK_SIZE), data+writtenBytes, amountToWrite);
         writtenBytes += amountToWrite;
         f->ptr += amountToWrite;
-        printf("[sgf_write] Progress : %d bytes of %d\n",writtenBytes,size);
         if((f->ptr%BLOCK_SIZE) == 0){
-            sgf_append_block(f);
+            if(sgf_append_block(f) < 0) return -1;
         }
     }
 
     return 0;
-}
\ No newline at end of file
+}
+int sgf_write(OFILE* f, char *data, int size){
+    int r;
+    STATS_DECL;
+    RECORD_DECL;
+
+    STATS_START();
+    RECORD_START();
+    r = sgf_do_write(f, data, size);
+    RECORD_STOP(TRACE_WRITE, f, size, 0, r, NULL, NULL);
+    STATS_STOP(STAT_WRITE);
+    return r;
+}
@@ -16,10 +16,18 @@
 #define READ_MODE       (0)
 #define WRITE_MODE      (1)
 #define APPEND_MODE     (2)
+#define READ_WRITE_MODE (3)
+#define COMPRESSED_MODE (8)     /* avec WRITE_MODE : fichier compress */
+
+#define DELALLOC_BLOCKS (64)    /* blocs retenus avant placement        */
+#define TAIL_CACHE_FILES (16)   /* fins de fichiers gardes en cache    */
+#define CLUSTER_BLOCKS  (16)    /* taille maximale d'une grappe         */
+#define CLUSTER_SIZE    (CLUSTER_BLOCKS * BLOCK_SIZE)
 
 struct OFILE            /* "Un fichier ouvert"                  */
     {                   /* ------------------------------------ */
-    int   length;       /* taille du fichier (en octets)        */
+    int   length;       /* taille du fichier (en octets, des    */
+                        /* grappes si le fichier est compress) */
     int   first;        /* adresse du premier bloc logique      */
     int   last;         /* adresse du dernier bloc logique      */
     int   inode;        /* adresse de l'INODE (descripteur)     */
@@ -27,9 +35,41 @@ struct OFILE            /* "Un fichier ouvert"                  */
 
     int   mode;         /* READ_MODE ou WRITE_MODE              */
     BLOCK buffer;       /* buffer contenant le bloc courant     */
+    int   buffer_block; /* n logique du bloc du buffer (-1)    */
+    int   buffer_adr;   /* adresse physique de ce bloc          */
+    int   buffer_dirty; /* buffer modifi (READ_WRITE_MODE)     */
+    int   inode_dirty;  /* INODE  rcrire (READ_WRITE_MODE)  */
 
     int currentBlocNum; /* Numero du bloc logique courant */
     int currentBlocAdr; /* Adresse du bloc physique correspondant au bloc logique courant */
+
+    struct OFILE* next_open; /* liste des fichiers ouverts */
+
+    BLOCK* dirty;       /* blocs complets en attente de placement   */
+    int   nb_dirty;     /* nombre de blocs en attente               */
+    int   dirty_capacity; /* taille de la reserve (en blocs)        */
+    int   nb_reserved;  /* blocs decomptes de l'espace libre        */
+    int   removed;      /* fichier detruit pendant son ouverture    */
+    int   log_append;   /* ouvert en APPEND_MODE : mis en cache a la fermeture */
+    int   exclusive;    /* blocs 0..exclusive-1 de la chaine non partages */
+    struct SNAP_VIEW* view; /* instantane lu (NULL : volume courant) */
+    struct HOLE* holes; /* trous du fichier (NULL : aucun)          */
+    int   nb_holes;     /* nombre de trous                          */
+    int   compressed;   /* fichier compress par grappes            */
+    int   zlength;      /* taille dcompresse                      */
+    int   zptr;         /* n dcompress du prochain caractre    */
+    char* zbuf;         /* grappe courante, dcompresse            */
+    int   zstart;       /* sa position dcompresse (-1 : aucune)   */
+    int   zcount;       /* ses octets                               */
+    int*  ztable;       /* grappes connues : (position, adresse)    */
+    int   nb_zclusters; /* nombre de grappes connues                */
+    int   zcapacity;    /* taille de ztable (en grappes)            */
+    int   dedup;        /* blocs haches pour la deduplication       */
+    unsigned long* hashes; /* leurs empreintes                      */
+    int   nb_hashes;    /* nombre d'empreintes                      */
+    int   hash_capacity; /* taille de hashes                        */
+    struct OINODE* shared; /* INODE partage par les ouvertures (NULL : instantane) */
+    int   version;      /* version de cet INODE deja vue            */
     };
 
 typedef struct OFILE OFILE;
@@ -55,6 +95,13 @@ typedef struct OFILE OFILE;
 
     int sgf_getc (OFILE* f);
 
+/************************************************************
+ *  Lire au plus "size" octets (renvoie le nombre d'octets
+ *  lus, 0 en fin de fichier).
+ ************************************************************/
+
+    int sgf_read (OFILE* f, char* data, int size);
+
 /************************************************************
  *  Ouvrir/Fermer/Partager un fichier.
  ************************************************************/
@@ -62,6 +109,17 @@ typedef struct OFILE OFILE;
     OFILE* sgf_open  (const char *nom, int mode);
     int   sgf_close (OFILE* f);
 
+/**********************************************************************
+ * Compression : un fichier cr par sgf_open(nom, WRITE_MODE |
+ * COMPRESSED_MODE) est crit par grappes d'au plus CLUSTER_SIZE
+ * octets, compresses (voir sgf-lz.h) ou stockes telles quelles
+ * si elles ne rtrcissent pas. sgf_getc, sgf_seek et sgf_write s'en
+ * servent sans rien changer ; un dplacement ne dcompresse que la
+ * grappe vise. Chaque sgf_flush (et chaque fermeture) termine la
+ * grappe en cours ; APPEND_MODE ajoute de nouvelles grappes. Un
+ * fichier compress ne s'ouvre pas en READ_WRITE_MODE.
+ *********************************************************************/
+
 /**********************************************************************
  * Initialiser le Systme de Gestion de Fichiers.
  *********************************************************************/
@@ -70,11 +128,132 @@ typedef struct OFILE OFILE;
 
 
 /**********************************************************************
- * Ralise le dplacement du pointeur ptr en lecture
+ * Ralise le dplacement du pointeur ptr en lecture (et en
+ * lecture/criture, o toute position  partir de la fin du fichier
+ * est aussi valide : une criture au-del de la fin laisse un trou).
  *********************************************************************/
     
     int sgf_seek (OFILE* f, int pos);
 
+/**********************************************************************
+ * Fichiers creux : un trou est une suite de blocs logiques sans bloc
+ * physique, lue comme des zros. sgf_punch_hole (READ_WRITE_MODE)
+ * met  zro "len" octets  partir de "pos" et libre les blocs
+ * entirement couverts (sauf le dernier bloc du fichier). Un INODE
+ * dcrit au plus INODE_MAX_HOLES trous ; au-del les blocs sont
+ * simplement mis  zro.
+ *
+ * sgf_seek_data et sgf_seek_hole placent le pointeur sur la premire
+ * position  partir de "pos" qui est dans les donnes (resp. dans un
+ * trou, la fin du fichier comptant comme un trou) et la renvoient,
+ * ou -1 si "pos" n'est pas dans le fichier ou s'il n'y a plus de
+ * donnes.
+ *********************************************************************/
+
+    int sgf_punch_hole (OFILE* f, int pos, int len);
+    int sgf_seek_data (OFILE* f, int pos);
+    int sgf_seek_hole (OFILE* f, int pos);
+
+/**********************************************************************
+ * Ecrire "size" octets. En READ_WRITE_MODE les octets existants sont
+ * remplacs en place  partir de la position courante (seuls les
+ * blocs partiellement modifis sont relus) et le fichier grandit si
+ * l'criture dpasse sa fin.
+ *********************************************************************/
+
     int sgf_write(OFILE* file, char * data, int size);
 
+/**********************************************************************
+ * Ramener un fichier ouvert en READ_WRITE_MODE  "len" octets
+ * (len <= taille actuelle). Seule la fin de la chane est libre.
+ *********************************************************************/
+
+    int sgf_truncate (OFILE* f, int len);
+
+/**********************************************************************
+ * Savoir si un fichier (designe par l'adresse de son INODE) est
+ * actuellement ouvert.
+ *********************************************************************/
+
+    int sgf_is_open (int inode);
+
+/**********************************************************************
+ * Table des fichiers ouverts : les ouvertures d'un meme fichier
+ * partagent un objet (compte par references) qui tient la derniere
+ * version ecrite de son INODE, la carte des adresses de sa chaine
+ * (remplie par les lectures) et une copie de son dernier bloc. Les
+ * OFILE et ces objets sont pris dans des reserves et ne sont jamais
+ * rendus : ouvrir et fermer un fichier courant n'alloue rien.
+ *
+ * Un fichier ouvert en lecture reprend la taille (et la chaine)
+ * ecrites par les autres ouvertures a chaque sgf_getc, sgf_read ou
+ * sgf_seek : il voit les ajouts d'un ecrivain des qu'ils sont places
+ * (sgf_flush, allocation retardee), jamais une fin en memoire.
+ * sgf_refresh le fait tout de suite.
+ *********************************************************************/
+
+    void sgf_refresh (OFILE* f);
+
+/**********************************************************************
+ * Des blocs viennent d'etre partages (deduplication) : les fichiers
+ * ouverts recopieront desormais avant de modifier leur chaine.
+ *********************************************************************/
+
+    void sgf_forget_exclusive (void);
+
+/**********************************************************************
+ * Allocation retardee : nombre de blocs retenus en memoire par fichier
+ * ouvert avant leur placement sur disque (1 : placement immediat).
+ * sgf_flush place immediatement les blocs retenus d'un fichier.
+ *********************************************************************/
+
+    extern int sgf_delalloc_blocks;
+
+    int sgf_flush (OFILE* f);
+
+/**********************************************************************
+ * Detruire un fichier. Les donnees encore retenues en memoire par les
+ * fichiers ouverts sur lui sont abandonnees sans jamais etre placees.
+ *********************************************************************/
+
+    int sgf_unlink (const char* nom);
+
+/**********************************************************************
+ * Cloner un fichier : "dst" reoit un nouvel INODE qui partage la
+ * chane de "src" (cot constant, aucun bloc de donnes copi). Un
+ * bloc partag n'est recopi que lorsque l'un des fichiers le modifie ;
+ * comme la FAT ne partage que des fins de chanes, la copie s'tend du
+ * dbut du partage jusqu'au bloc modifi (un ajout en fin de fichier
+ * recopie donc toute la partie partage).
+ *********************************************************************/
+
+    int sgf_clone (const char* src, const char* dst);
+
+/**********************************************************************
+ * Ajouts frquents : un fichier ouvert en APPEND_MODE est vid  sa
+ * fermeture comme les autres (blocs placs, INODE crit dans le
+ * journal), mais sa fin (bloc incomplet, INODE) reste en cache et la
+ * prochaine ouverture en APPEND_MODE la reprend sans relire le disque.
+ * La fin en cache est abandonne quand le fichier est ouvert dans un
+ * autre mode, quand le cache dpasse TAIL_CACHE_FILES fichiers, par
+ * sgf_sync et  la fermeture du disque. sgf_tail_cache_files
+ * (TAIL_CACHE_FILES par dfaut) est la taille du cache (0 : pas de
+ * cache). sgf_sync valide ensuite la transaction en cours du journal
+ * (voir sgf-journal.h).
+ *********************************************************************/
+
+    extern int sgf_tail_cache_files;
+
+    int sgf_sync (void);
+
+/**********************************************************************
+ * Ouvrir en lecture un fichier d'un instantane mont par
+ * sgf_snapshot_mount (voir sgf-snap.h). Se lit avec sgf_getc,
+ * sgf_seek et se ferme avec sgf_close.
+ *********************************************************************/
+
+    struct SNAP_VIEW;
+
+    OFILE* sgf_open_snapshot (struct SNAP_VIEW* view, const char* nom);
+
 #endif
@@ -0,0 +1,579 @@
+
+/*
+**  sgf-journal.c
+**
+**  Journal des meta-donnees avec validation groupee.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-journal.h"
+#include "sgf-crc.h"
+
+
+#define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+
+
+int sgf_journal_batch = JOURNAL_BATCH;
+
+
+/**********************************************************************
+ *
+ *  Un ensemble de blocs gardes en memoire centrale : la transaction
+ *  en cours, et les blocs des transactions validees qui ne sont pas
+ *  encore a leur place.
+ *
+ *********************************************************************/
+
+typedef struct JSET
+    {
+    int*   slot;                /* place de chaque bloc (-1)        */
+    int*   target;              /* bloc de chaque place (-1 : oubli)*/
+    BLOCK* copy;                /* contenu de chaque place          */
+    int    nb;                  /* places utilisees                 */
+    int    max;                 /* places allouees                  */
+    int    nb_live;             /* places non oubliees              */
+    }
+    JSET;
+
+static JSET running = {NULL, NULL, NULL, 0, 0, 0};
+static JSET committed = {NULL, NULL, NULL, 0, 0, 0};
+
+static void jset_init (JSET* s, int disk_size)
+    {
+    int k;
+
+    s->slot = malloc(disk_size * sizeof(int));
+    if (s->slot == NULL) panic("sgf-journal: plus de memoire.");
+    for(k = 0; k < disk_size; k++)
+        s->slot[k] = -1;
+    s->target = NULL;
+    s->copy = NULL;
+    s->nb = s->max = s->nb_live = 0;
+    }
+
+static void jset_free (JSET* s)
+    {
+    free(s->slot);
+    free(s->target);
+    free(s->copy);
+    s->slot = s->target = NULL;
+    s->copy = NULL;
+    s->nb = s->max = s->nb_live = 0;
+    }
+
+static void jset_put (JSET* s, int n, BLOCK* b)
+    {
+    if (s->slot[n] < 0)
+        {
+        if (s->nb == s->max)
+            {
+            s->max = (s->max > 0) ? 2 * s->max : 64;
+            s->target = realloc(s->target, s->max * sizeof(int));
+            s->copy = realloc(s->copy, s->max * sizeof(BLOCK));
+            if (s->target == NULL  ||  s->copy == NULL)
+                panic("sgf-journal: plus de memoire.");
+            }
+        s->slot[n] = s->nb;
+        s->target[s->nb++] = n;
+        s->nb_live++;
+        }
+    memcpy(&s->copy[s->slot[n]], b, BLOCK_SIZE);
+    }
+
+static void jset_drop (JSET* s, int n)
+    {
+    if (s->slot[n] < 0) return;
+    s->target[s->slot[n]] = -1;
+    s->slot[n] = -1;
+    s->nb_live--;
+    }
+
+static void jset_clear (JSET* s)
+    {
+    int k;
+
+    for(k = 0; k < s->nb; k++)
+        if (s->target[k] >= 0) s->slot[s->target[k]] = -1;
+    s->nb = s->nb_live = 0;
+    }
+
+
+/**********************************************************************
+ *
+ *  Le journal sur disque.
+ *
+ *********************************************************************/
+
+static int adr_journal = -1;            /* -1 : pas de journal */
+static int nb_journal_blocks = 0;
+static int capacity = 0;                /* blocs par transaction */
+static int pos = 1;                     /* place de la prochaine transaction */
+static int seq = 1;                     /* numero de la prochaine transaction */
+static int* round_idx = NULL;           /* places d'une tranche validee */
+
+static int nb_ops = 0;                  /* operations dans la transaction */
+static int op_dirty = 0;                /* l'operation en cours a ecrit */
+static int op_blocks = 0;               /* blocs qu'elle a ajoutes a la transaction */
+static int largest_op = 0;              /* plus grosse operation vue (place gardee) */
+static int commit_growth = 0;           /* blocs ajoutes par une validation (instantanes) */
+static int raw_reads = 0;               /* read_block lit le disque */
+static int committing = 0;
+static int checkpointing = 0;
+
+static JOURNAL_COUNTERS counters = {0, 0, 0};
+
+static void checkpoint (void);
+
+
+/**********************************************************************
+ Taille du journal d'un disque.
+ *********************************************************************/
+
+int journal_size (int disk_size)
+    {
+    int nb = disk_size / 32;
+
+    if (nb < JOURNAL_MIN_BLOCKS) return ((disk_size >= 8 * JOURNAL_MIN_BLOCKS) ? JOURNAL_MIN_BLOCKS : 0);
+    return ((nb > JOURNAL_MAX_BLOCKS) ? JOURNAL_MAX_BLOCKS : nb);
+    }
+
+
+/**********************************************************************
+ Fonctions appelees par read_block et write_block. Un bloc ecrit
+ directement remplace sa version de la transaction en cours ; s'il a
+ une version validee qui n'est pas a sa place, le journal est d'abord
+ vide (sinon elle serait rejouee par-dessus apres une panne).
+ *********************************************************************/
+
+static int journal_read (int n, BLOCK* b)
+    {
+    JSET* s;
+
+    if (raw_reads) return (0);
+    if (running.slot[n] >= 0) s = &running;
+    else if (committed.slot[n] >= 0) s = &committed;
+    else return (0);
+
+    memcpy(b, &s->copy[s->slot[n]], BLOCK_SIZE);
+    return (1);
+    }
+
+static void journal_forget (int n)
+    {
+    if (checkpointing) return;
+    jset_drop(&running, n);
+    if (committed.slot[n] >= 0) checkpoint();
+    }
+
+void read_disk_block (int n, BLOCK* b)
+    {
+    int raw = raw_reads;
+
+    raw_reads = 1;
+    read_block(n, b);
+    raw_reads = raw;
+    }
+
+
+/**********************************************************************
+ Somme de controle des blocs d'une transaction.
+ *********************************************************************/
+
+static unsigned int checksum (unsigned int sum, BLOCK* b)
+    {
+    int k;
+
+    for(k = 0; k < BLOCK_SIZE; k++)
+        sum = sum * 31 + (unsigned char) (*b)[k];
+    return (sum);
+    }
+
+
+/**********************************************************************
+ Ecrire l'en-tete du journal : les transactions de numero inferieur
+ a "seq" sont a leur place.
+ *********************************************************************/
+
+static void write_header (void)
+    {
+    TBLOCK h;
+
+    memset(&h, 0, sizeof(h));
+    h.journal.signature = SIGNATURE_JOURNAL;
+    h.journal.state = JOURNAL_CLEAN;
+    h.journal.seq = seq;
+    write_block(adr_journal, &h.data);
+    counters.nb_disk_writes++;
+    }
+
+
+/**********************************************************************
+ Rejouer une transaction (en "at", de numero "expect") si elle est
+ complete. Renvoie sa taille dans le journal, 0 sinon.
+ *********************************************************************/
+
+static int replay_one (int at, int expect)
+    {
+    TBLOCK r, d;
+    BLOCK b;
+    unsigned int sum = 0;
+    int nb, nb_desc, k;
+
+    if (at >= nb_journal_blocks) return (0);
+    read_block(adr_journal + at, &r.data);
+    if (r.journal.signature != SIGNATURE_JOURNAL  ||  r.journal.state != JOURNAL_COMMITTED
+        ||  r.journal.seq != expect)
+        return (0);
+
+    nb = r.journal.nb_blocks;
+    nb_desc = PAR_EXCES(nb, JOURNAL_TARGETS);
+    if (nb <= 0  ||  at + 1 + nb_desc + nb > nb_journal_blocks) return (0);
+
+    for(k = 1; k <= nb_desc + nb; k++)
+        {
+        read_block(adr_journal + at + k, &b);
+        sum = checksum(sum, &b);
+        }
+    if (sum != r.journal.checksum) return (0);
+
+    for(k = 0; k < nb; k++)
+        {
+        if (k % JOURNAL_TARGETS == 0)
+            read_block(adr_journal + at + 1 + k / JOURNAL_TARGETS, &d.data);
+        read_block(adr_journal + at + 1 + nb_desc + k, &b);
+        write_block(d.targets[k % JOURNAL_TARGETS], &b);
+        }
+
+    return (1 + nb_desc + nb);
+    }
+
+
+/**********************************************************************
+ Rejouer, dans l'ordre, les transactions validees qui suivent le
+ dernier vidage du journal.
+ *********************************************************************/
+
+static void replay (void)
+    {
+    TBLOCK h;
+    int size, first;
+
+    read_block(adr_journal, &h.data);
+    if (h.journal.signature != SIGNATURE_JOURNAL)
+        {
+        /* journal neuf */
+        seq = 1;
+        write_header();
+        return;
+        }
+
+    seq = first = h.journal.seq;
+    for(pos = 1; (size = replay_one(pos, seq)) > 0; pos += size)
+        seq++;
+
+    if (seq != first)
+        {
+        fprintf(stderr, "sgf-journal: %d transaction(s) rejouee(s)\n", seq - first);
+        write_header();
+        }
+    pos = 1;
+    }
+
+
+/**********************************************************************
+ Monter le journal du disque courant.
+ *********************************************************************/
+
+void init_sgf_journal (void)
+    {
+    TBLOCK b;
+    int disk_size;
+
+    close_sgf_journal();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT  ||  b.super.adr_journal <= 0)
+        return;
+
+    adr_journal = b.super.adr_journal;
+    nb_journal_blocks = b.super.nb_journal_blocks;
+    replay();
+
+    /* plus grande transaction : enregistrement de validation, descripteurs et copies */
+    for(capacity = nb_journal_blocks - 1;
+        capacity > 0  &&  1 + PAR_EXCES(capacity, JOURNAL_TARGETS) + capacity > nb_journal_blocks - 1;
+        capacity--) ;
+
+    disk_size = get_disk_size();
+    jset_init(&running, disk_size);
+    jset_init(&committed, disk_size);
+    round_idx = malloc(capacity * sizeof(int));
+    if (round_idx == NULL)
+        panic("init_sgf_journal: plus de memoire.");
+    largest_op = capacity / 4;
+    commit_growth = 0;
+
+    set_journal_hooks(journal_read, journal_forget);
+    }
+
+
+/**********************************************************************
+ Demonter le journal : tout est valide et mis en place.
+ *********************************************************************/
+
+void close_sgf_journal (void)
+    {
+    if (adr_journal >= 0) sgf_journal_checkpoint();
+
+    set_journal_hooks(NULL, NULL);
+    jset_free(&running);
+    jset_free(&committed);
+    free(round_idx);
+    round_idx = NULL;
+    adr_journal = -1;
+    nb_journal_blocks = 0;
+    capacity = 0;
+    nb_ops = 0;
+    op_dirty = 0;
+    op_blocks = 0;
+    }
+
+
+/**********************************************************************
+ Ecrire un bloc de meta-donnees dans la transaction.
+ *********************************************************************/
+
+void write_meta_block (int n, BLOCK* b)
+    {
+    counters.nb_meta_writes++;
+    if (adr_journal < 0  ||  sgf_journal_batch <= 0)
+        {
+        write_block(n, b);
+        counters.nb_disk_writes++;
+        return;
+        }
+
+    /* une operation plus grosse que la place gardee par journal_end_op est coupee */
+    if (running.slot[n] < 0  &&  !committing)
+        {
+        if (running.nb_live >= capacity) sgf_journal_commit();
+        op_blocks++;
+        }
+
+    jset_put(&running, n, b);
+    op_dirty = 1;
+    }
+
+
+/**********************************************************************
+ Fin d'une operation.
+ *********************************************************************/
+
+void journal_end_op (void)
+    {
+    /* sans journal, les liberations de l'operation sont deja ecrites */
+    if (adr_journal < 0  ||  sgf_journal_batch <= 0)
+        {
+        flush_discards();
+        release_freed_blocks();
+        save_checksums();
+        return;
+        }
+    if (!op_dirty) return;
+    op_dirty = 0;
+
+    /* la place gardee pour une operation : la plus grosse vue, au plus la moitie du journal */
+    if (op_blocks > largest_op) largest_op = (op_blocks < capacity / 2) ? op_blocks : capacity / 2;
+    op_blocks = 0;
+
+    /* la transaction est validee entre deux operations, avant que la
+       suivante ne risque de faire deborder le journal, et quand les
+       blocs retenus sont la plupart des blocs libres */
+    if (++nb_ops >= sgf_journal_batch
+        ||  running.nb_live + largest_op + commit_growth > capacity
+        ||  (get_held_blocks_count() > 0  &&  2 * get_held_blocks_count() > get_free_fat_blocks_count()))
+        sgf_journal_commit();
+    }
+
+
+/**********************************************************************
+ Savoir si aucune operation n'est en cours.
+ *********************************************************************/
+
+int journal_between_ops (void)
+    {
+    return (!op_dirty  &&  !committing);
+    }
+
+
+/**********************************************************************
+ Mettre a leur place les blocs des transactions validees et vider le
+ journal.
+ *********************************************************************/
+
+static void checkpoint (void)
+    {
+    int k;
+
+    if (pos == 1) return;
+    checkpointing = 1;
+
+    for(k = 0; k < committed.nb; k++)
+        if (committed.target[k] >= 0)
+            {
+            write_block(committed.target[k], &committed.copy[k]);
+            counters.nb_disk_writes++;
+            }
+    jset_clear(&committed);
+
+    pos = 1;
+    write_header();
+    checkpointing = 0;
+
+    /* les sommes des blocs mis en place */
+    save_checksums();
+    }
+
+
+/**********************************************************************
+ Valider au plus "capacity" blocs de la transaction en cours a partir
+ de la place "from" : descripteurs et copies a la suite du journal,
+ puis l'enregistrement de validation devant eux. Les blocs passent
+ dans l'ensemble des blocs valides. Renvoie la place suivante.
+ *********************************************************************/
+
+static int commit_round (int from)
+    {
+    TBLOCK r, d;
+    unsigned int sum = 0;
+    int k, j, nb = 0, nb_desc;
+
+    for(k = from; k < running.nb  &&  nb < capacity; k++)
+        if (running.target[k] >= 0) round_idx[nb++] = k;
+    if (nb == 0) return (k);
+
+    nb_desc = PAR_EXCES(nb, JOURNAL_TARGETS);
+    if (pos + 1 + nb_desc + nb > nb_journal_blocks) checkpoint();
+
+    for(j = 0; j < nb_desc; j++)
+        {
+        for(k = 0; k < JOURNAL_TARGETS; k++)
+            d.targets[k] = (j * JOURNAL_TARGETS + k < nb) ? running.target[round_idx[j * JOURNAL_TARGETS + k]] : -1;
+        write_block(adr_journal + pos + 1 + j, &d.data);
+        sum = checksum(sum, &d.data);
+        }
+    for(j = 0; j < nb; j++)
+        {
+        write_block(adr_journal + pos + 1 + nb_desc + j, &running.copy[round_idx[j]]);
+        sum = checksum(sum, &running.copy[round_idx[j]]);
+        }
+
+    /* point de validation */
+    memset(&r, 0, sizeof(r));
+    r.journal.signature = SIGNATURE_JOURNAL;
+    r.journal.state = JOURNAL_COMMITTED;
+    r.journal.seq = seq++;
+    r.journal.nb_blocks = nb;
+    r.journal.checksum = sum;
+    write_block(adr_journal + pos, &r.data);
+    pos += 1 + nb_desc + nb;
+
+    for(j = 0; j < nb; j++)
+        {
+        k = running.target[round_idx[j]];
+        jset_put(&committed, k, &running.copy[round_idx[j]]);
+        jset_drop(&running, k);
+        }
+
+    counters.nb_disk_writes += 1 + nb_desc + nb;
+    counters.nb_commits++;
+    return (round_idx[nb - 1] + 1);
+    }
+
+
+/**********************************************************************
+ Valider la transaction en cours.
+ *********************************************************************/
+
+int sgf_journal_commit (void)
+    {
+    int k, before;
+
+    if (committing) return (0);
+    if (running.nb == 0)
+        {
+        flush_discards();
+        release_freed_blocks();
+        save_checksums();
+        return (0);
+        }
+    committing = 1;
+    before = running.nb_live;
+
+    /* les instantanes recopient d'abord les anciens contenus ; les blocs
+       qu'ils prennent ainsi sont notes dans la FAT de la transaction */
+    for(k = 0; ; )
+        {
+        raw_reads = 1;
+        for(; k < running.nb; k++)
+            if (running.target[k] >= 0) preserve_block(running.target[k]);
+        raw_reads = 0;
+        save_fat();
+        if (k == running.nb) break;
+        }
+    if (running.nb_live - before > commit_growth) commit_growth = running.nb_live - before;
+
+    /* une seule tranche (un seul enregistrement de validation) sauf pour une operation coupee */
+    for(k = 0; k < running.nb; )
+        k = commit_round(k);
+    jset_clear(&running);
+
+    nb_ops = 0;
+    committing = 0;
+
+    /* les liberations sont validees : la place des blocs peut etre rendue,
+       et les blocs reutilises */
+    flush_discards();
+    release_freed_blocks();
+
+    /* puis les sommes des donnees ecrites depuis la derniere validation */
+    save_checksums();
+    return (0);
+    }
+
+
+/**********************************************************************
+ Valider la transaction en cours et mettre tous les blocs a leur
+ place.
+ *********************************************************************/
+
+void sgf_journal_checkpoint (void)
+    {
+    if (adr_journal < 0) return;
+    sgf_journal_commit();
+    checkpoint();
+    }
+
+
+/**********************************************************************
+ Lire et remettre a zero les compteurs.
+ *********************************************************************/
+
+void get_journal_counters (JOURNAL_COUNTERS* c)
+    {
+    *c = counters;
+    }
+
+void reset_journal_counters (void)
+    {
+    counters.nb_meta_writes = 0;
+    counters.nb_disk_writes = 0;
+    counters.nb_commits = 0;
+    }
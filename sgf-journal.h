@@ -0,0 +1,123 @@
+#ifndef __SGF_JOURNAL__
+#define __SGF_JOURNAL__
+
+
+/**********************************************************************
+ *
+ *  JOURNAL DES META-DONNEES
+ *
+ *  Les blocs de la FAT, les INODEs, les blocs du repertoire et le
+ *  super bloc sont ecrits par write_meta_block : ils restent en
+ *  memoire dans la transaction en cours (read_block y trouve leur
+ *  derniere version) et un bloc modifie plusieurs fois n'y figure
+ *  qu'une fois. Les donnees sont toujours ecrites directement, donc
+ *  avant les meta-donnees qui les designent ; un bloc libere n'est
+ *  realloue qu'une fois sa liberation validee.
+ *
+ *  La transaction est validee toutes les sgf_journal_batch operations
+ *  (validation groupee), par sgf_journal_commit et sgf_sync : ses
+ *  blocs sont ajoutes a la suite du journal (une zone reservee a la
+ *  suite de la FAT, notee dans le super bloc), derriere un
+ *  enregistrement de validation ecrit en dernier (c'est le point de
+ *  validation). Ils restent ensuite en memoire et ne sont ecrits a
+ *  leur place que lorsque le journal est plein, avant l'ecriture
+ *  directe de l'un d'eux, a la creation d'un instantane et a la
+ *  fermeture du disque ; l'en-tete du journal (son premier bloc) note
+ *  alors le numero de la prochaine transaction. Au montage, les
+ *  transactions validees qui suivent sont rejouees dans l'ordre.
+ *
+ *  Une transaction ne contient que des operations entieres : apres
+ *  une panne, une operation est rejouee en entier ou pas du tout. Elle
+ *  est donc validee, a la fin d'une operation, des que la suivante
+ *  risque de ne plus tenir dans le journal : il doit rester la place
+ *  de la plus grosse operation vue (au moins le quart et au plus la
+ *  moitie du journal) et des blocs que la validation ajoute pour les
+ *  instantanes. Seule une operation plus grosse que cette place peut
+ *  encore remplir le journal ; elle est alors decoupee en plusieurs
+ *  transactions et n'est plus atomique. Un disque sans journal
+ *  (formate avant lui) est ecrit directement.
+ *
+ *********************************************************************/
+
+#define JOURNAL_BATCH           (64)    /* operations par transaction   */
+#define JOURNAL_MIN_BLOCKS      (16)
+#define JOURNAL_MAX_BLOCKS      (1024)
+
+
+/**********************************************************************
+ Nombre d'operations regroupees dans une transaction (1 : validation a
+ chaque operation, 0 : pas de journal, ecriture directe).
+ *********************************************************************/
+
+    extern int sgf_journal_batch;
+
+/**********************************************************************
+ Taille du journal pour un disque de "disk_size" blocs (0 : disque
+ trop petit pour un journal).
+ *********************************************************************/
+
+    int journal_size (int disk_size);
+
+/**********************************************************************
+ Rejouer les transactions validees du disque courant si besoin (avant
+ le chargement de la FAT), ou oublier le journal (avant un
+ changement de disque).
+ *********************************************************************/
+
+    void init_sgf_journal (void);
+    void close_sgf_journal (void);
+
+/**********************************************************************
+ Ecrire un bloc de meta-donnees dans la transaction en cours.
+ *********************************************************************/
+
+    void write_meta_block (int n, BLOCK* b);
+
+/**********************************************************************
+ Signaler la fin d'une operation (l'etat du disque est coherent) : la
+ transaction est validee si elle regroupe sgf_journal_batch operations
+ ou si le journal est presque plein. journal_between_ops dit si aucune
+ operation n'est en cours (une validation ne couperait rien).
+ *********************************************************************/
+
+    void journal_end_op (void);
+    int journal_between_ops (void);
+
+/**********************************************************************
+ Valider la transaction en cours.
+ *********************************************************************/
+
+    int sgf_journal_commit (void);
+
+/**********************************************************************
+ Valider la transaction en cours et ecrire a leur place tous les
+ blocs valides (le journal est alors vide).
+ *********************************************************************/
+
+    void sgf_journal_checkpoint (void);
+
+/**********************************************************************
+ Lire un bloc tel qu'il est sur le disque, sans les versions gardees
+ par le journal (pour les instantanes).
+ *********************************************************************/
+
+    void read_disk_block (int n, BLOCK* b);
+
+/**********************************************************************
+ Compteurs du journal (depuis le dernier reset).
+ *********************************************************************/
+
+typedef struct JOURNAL_COUNTERS
+    {
+    long nb_meta_writes;        /* blocs de meta-donnees ecrits     */
+    long nb_disk_writes;        /* ecritures sur disque qui en      */
+                                /* resultent (journal compris)      */
+    long nb_commits;            /* transactions validees            */
+    }
+    JOURNAL_COUNTERS;
+
+    void get_journal_counters (JOURNAL_COUNTERS* c);
+    void reset_journal_counters (void);
+
+
+#endif
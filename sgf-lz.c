@@ -0,0 +1,174 @@
+
+/*
+**  sgf-lz.c
+**
+**  Compression rapide des grappes de blocs (fichiers compresses).
+**
+*/
+
+#include <string.h>
+
+#include "sgf-lz.h"
+
+
+#define LZ_HASH_SIZE            (1 << LZ_HASH_BITS)
+
+#define LZ_READ32(p)            ((unsigned long) (unsigned char) (p)[0]         |  \
+                                 (unsigned long) (unsigned char) (p)[1] << 8    |  \
+                                 (unsigned long) (unsigned char) (p)[2] << 16   |  \
+                                 (unsigned long) (unsigned char) (p)[3] << 24)
+
+#define LZ_HASH(v)              ((int) ((((v) * 2654435761UL) & 0xFFFFFFFFUL) >> (32 - LZ_HASH_BITS)))
+
+
+/**********************************************************************
+ Ecrire une longueur : la partie qui ne tient pas dans le token est
+ ecrite en octets de 255 suivis du reste.
+ *********************************************************************/
+
+static int put_length (char* dst, int op, int cap, int len)
+    {
+    for(; len >= 255; len -= 255)
+        {
+        if (op >= cap) return (-1);
+        dst[op++] = (char) 255;
+        }
+    if (op >= cap) return (-1);
+    dst[op++] = (char) len;
+    return (op);
+    }
+
+
+/**********************************************************************
+ Ecrire une sequence : "lit" litteraux a partir de "src", puis (si
+ "len" est non nul) une copie de "len" octets a la distance "off".
+ Renvoie la nouvelle position dans "dst", -1 s'il n'y a plus de place.
+ *********************************************************************/
+
+static int put_sequence (char* dst, int op, int cap, const char* src, int lit, int off, int len)
+    {
+    int token;
+
+    if (op >= cap) return (-1);
+    token = ((lit < 15) ? lit : 15) << 4;
+    if (len > 0) token |= (len - LZ_MIN_MATCH < 15) ? len - LZ_MIN_MATCH : 15;
+    dst[op++] = (char) token;
+
+    if (lit >= 15  &&  (op = put_length(dst, op, cap, lit - 15)) < 0) return (-1);
+    if (op + lit > cap) return (-1);
+    memcpy(dst + op, src, lit);
+    op += lit;
+
+    if (len == 0) return (op);
+    if (op + 2 > cap) return (-1);
+    dst[op++] = (char) (off & 255);
+    dst[op++] = (char) (off >> 8);
+    if (len - LZ_MIN_MATCH >= 15  &&  (op = put_length(dst, op, cap, len - LZ_MIN_MATCH - 15)) < 0)
+        return (-1);
+    return (op);
+    }
+
+
+/**********************************************************************
+ Compresser : chaque position est cherchee (par ses 4 premiers
+ octets) dans une table de hachage des positions deja vues.
+ *********************************************************************/
+
+int lz_compress (const char* src, int n, char* dst, int cap)
+    {
+    int table[LZ_HASH_SIZE];
+    int ip, anchor, op, ref, len, h;
+
+    for(h = 0; h < LZ_HASH_SIZE; h++)
+        table[h] = -1;
+
+    op = 0;
+    for(ip = anchor = 0; ip + LZ_MIN_MATCH <= n; )
+        {
+        h = LZ_HASH(LZ_READ32(src + ip));
+        ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0  ||  ip - ref > LZ_MAX_OFFSET  ||  memcmp(src + ref, src + ip, LZ_MIN_MATCH) != 0)
+            {
+            ip++;
+            continue;
+            }
+
+        for(len = LZ_MIN_MATCH; ip + len < n  &&  src[ref + len] == src[ip + len]; len++)
+            ;
+        op = put_sequence(dst, op, cap, src + anchor, ip - anchor, ip - ref, len);
+        if (op < 0) return (-1);
+        ip += len;
+        anchor = ip;
+        }
+
+    return (put_sequence(dst, op, cap, src + anchor, n - anchor, 0, 0));
+    }
+
+
+/**********************************************************************
+ Lire une longueur ecrite par put_length (-1 si les donnees sont
+ tronquees).
+ *********************************************************************/
+
+static int get_length (const char* src, int* ip, int n)
+    {
+    int len = 0, b;
+
+    do
+        {
+        if (*ip >= n) return (-1);
+        b = (unsigned char) src[(*ip)++];
+        len += b;
+        }
+    while (b == 255);
+    return (len);
+    }
+
+
+/**********************************************************************
+ Decompresser.
+ *********************************************************************/
+
+int lz_decompress (const char* src, int n, char* dst, int cap)
+    {
+    int ip = 0, op = 0, token, lit, len, off, k;
+
+    while (ip < n)
+        {
+        token = (unsigned char) src[ip++];
+
+        lit = token >> 4;
+        if (lit == 15)
+            {
+            if ((k = get_length(src, &ip, n)) < 0) return (-1);
+            lit += k;
+            }
+        if (ip + lit > n  ||  op + lit > cap) return (-1);
+        memcpy(dst + op, src + ip, lit);
+        ip += lit;
+        op += lit;
+
+        /* la derniere sequence n'a pas de copie */
+        if (ip == n) break;
+
+        if (ip + 2 > n) return (-1);
+        off = (unsigned char) src[ip] | (unsigned char) src[ip + 1] << 8;
+        ip += 2;
+        len = token & 15;
+        if (len == 15)
+            {
+            if ((k = get_length(src, &ip, n)) < 0) return (-1);
+            len += k;
+            }
+        len += LZ_MIN_MATCH;
+        if (off == 0  ||  off > op  ||  op + len > cap) return (-1);
+
+        /* la copie peut chevaucher ce qu'elle produit */
+        for(k = 0; k < len; k++, op++)
+            dst[op] = dst[op - off];
+        }
+
+    return (op);
+    }
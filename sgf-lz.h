@@ -0,0 +1,40 @@
+#ifndef __SGF_LZ__
+#define __SGF_LZ__
+
+
+/**********************************************************************
+ *
+ *  COMPRESSION RAPIDE (famille LZ77, format proche de LZ4)
+ *
+ *  Les donnees compressees sont une suite de sequences : un octet
+ *  "token" (4 bits pour le nombre de litteraux, 4 bits pour la
+ *  longueur de la copie moins LZ_MIN_MATCH, 15 annoncant des octets
+ *  d'extension), les litteraux, puis la distance de la copie sur
+ *  deux octets (poids faible d'abord). La derniere sequence n'a que
+ *  des litteraux. Les copies portent sur au plus LZ_MAX_OFFSET
+ *  octets en arriere.
+ *
+ *********************************************************************/
+
+#define LZ_MIN_MATCH            (4)
+#define LZ_MAX_OFFSET           (65535)
+#define LZ_HASH_BITS            (12)
+
+
+/**********************************************************************
+ Compresser les "n" octets de "src" dans "dst" (au plus "cap" octets).
+ Renvoie la taille compressee, -1 si elle depasse "cap".
+ *********************************************************************/
+
+    int lz_compress (const char* src, int n, char* dst, int cap);
+
+/**********************************************************************
+ Decompresser les "n" octets de "src" dans "dst" (au plus "cap"
+ octets). Renvoie la taille decompressee, -1 si les donnees sont
+ incorrectes ou trop grandes.
+ *********************************************************************/
+
+    int lz_decompress (const char* src, int n, char* dst, int cap);
+
+
+#endif
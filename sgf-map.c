@@ -0,0 +1,217 @@
+/*
+**  sgf-map.c
+**
+**  Vues en lecture seule du contenu des fichiers.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-map.h"
+
+
+/**********************************************************************
+ Les vues ouvertes, retrouvees par leur adresse. Plusieurs vues
+ directes peuvent avoir la meme adresse : chacune tient une reference
+ sur la projection du disque, elles sont donc interchangeables.
+ *********************************************************************/
+
+typedef struct SGF_VIEW
+    {
+    const char* data;           /* premier octet de la vue          */
+    char*  buffer;              /* tampon (NULL : vue directe)      */
+    int    refs;
+    struct SGF_VIEW* next;
+    }
+    SGF_VIEW;
+
+static SGF_VIEW* views = NULL;
+
+static MAP_COUNTERS counters = {0, 0, 0};
+
+
+static SGF_VIEW* find_view (const char* p)
+    {
+    SGF_VIEW* v;
+
+    for(v = views; v != NULL; v = v->next)
+        if (v->data == p) return (v);
+    return (NULL);
+    }
+
+
+/**********************************************************************
+ Adresse physique du bloc logique "nubloc" si les blocs logiques
+ nubloc..nubloc+count-1 sont des blocs consecutifs du disque (-1 si
+ la plage touche un trou ou n'est pas contigue). La chaine est suivie
+ a partir du bloc courant du fichier quand il est avant, et le bloc
+ courant devient le dernier de la plage (lecture par fenetres).
+ *********************************************************************/
+
+static int sgf_map_extent (OFILE* f, int nubloc, int count)
+    {
+    int h, k, index = nubloc, adr, next;
+
+    for(h = 0; h < f->nb_holes; h++)
+        {
+        if (f->holes[h].start + f->holes[h].count <= nubloc)
+            index -= f->holes[h].count;
+        else if (f->holes[h].start < nubloc + count)
+            return (-1);
+        }
+
+    if (f->currentBlocNum != -1  &&  f->currentBlocNum <= index)
+        {
+        k = f->currentBlocNum;
+        adr = f->currentBlocAdr;
+        }
+    else
+        {
+        k = 0;
+        adr = f->first;
+        }
+    for(; k < index  &&  adr > 0; k++)
+        adr = get_fat(adr);
+    if (adr <= 0) return (-1);
+
+    for(k = 1, next = adr; k < count; k++)
+        if ((next = get_fat(next)) != adr + k) return (-1);
+
+    f->currentBlocNum = index + count - 1;
+    f->currentBlocAdr = next;
+    return (adr);
+    }
+
+
+/**********************************************************************
+ Lire la plage dans "dst" par sgf_read, puis revenir a la position
+ du fichier (-1 si la plage n'a pas pu etre lue).
+ *********************************************************************/
+
+static int sgf_map_copy (OFILE* f, int offset, int length, char* dst)
+    {
+    int saved = f->compressed ? f->zptr : f->ptr;
+    int n = 0, k;
+
+    if (sgf_seek(f, offset) == 0)
+        for(; n < length; n += k)
+            if ((k = sgf_read(f, dst + n, length - n)) <= 0) break;
+
+    /* en fin de fichier la position n'est pas une place de sgf_seek */
+    if (sgf_seek(f, saved) < 0)
+        {
+        if (f->compressed) f->zptr = saved;
+        else f->ptr = saved;
+        }
+    return ((n == length) ? 0 : -1);
+    }
+
+
+/**********************************************************************
+ Ouvrir une vue.
+ *********************************************************************/
+
+const char* sgf_map (OFILE* f, int offset, int length)
+    {
+    SGF_VIEW* v;
+    const char* p = NULL;
+    char* buffer = NULL;
+    int size, first, count, adr;
+
+    if (f->mode != READ_MODE  &&  f->mode != READ_WRITE_MODE) return (NULL);
+
+    /* la taille et la chaine ecrites par les autres ouvertures */
+    sgf_refresh(f);
+    size = f->compressed ? f->zlength : f->length;
+    if (offset < 0  ||  length <= 0  ||  length > size - offset) return (NULL);
+
+    /* en READ_MODE aucun bloc du fichier n'attend en memoire */
+    if (f->mode == READ_MODE  &&  !f->compressed  &&  f->view == NULL)
+        {
+        first = offset / BLOCK_SIZE;
+        count = (offset + length - 1) / BLOCK_SIZE - first + 1;
+        adr = sgf_map_extent(f, first, count);
+        if (adr > 0  &&  (p = map_blocks(adr, count)) != NULL)
+            p += offset % BLOCK_SIZE;
+        }
+
+    if (p == NULL)
+        {
+        if ((buffer = malloc(length)) == NULL) return (NULL);
+        if (sgf_map_copy(f, offset, length, buffer) < 0)
+            {
+            free(buffer);
+            return (NULL);
+            }
+        p = buffer;
+        }
+
+    if ((v = malloc(sizeof(SGF_VIEW))) == NULL)
+        panic("sgf_map: plus de memoire.");
+    v->data = p;
+    v->buffer = buffer;
+    v->refs = 1;
+    v->next = views;
+    views = v;
+
+    if (buffer == NULL)
+        counters.nb_direct++;
+    else
+        {
+        counters.nb_copied++;
+        counters.nb_bytes_copied += length;
+        }
+    return (p);
+    }
+
+
+/**********************************************************************
+ Gerer les references.
+ *********************************************************************/
+
+const char* sgf_map_retain (const char* view)
+    {
+    SGF_VIEW* v = find_view(view);
+
+    if (v == NULL) return (NULL);
+    v->refs++;
+    return (view);
+    }
+
+int sgf_unmap (const char* view)
+    {
+    SGF_VIEW** pv;
+    SGF_VIEW* v;
+
+    for(pv = &views; *pv != NULL  &&  (*pv)->data != view; pv = &(*pv)->next)
+        ;
+    if ((v = *pv) == NULL) return (-1);
+    if (--v->refs > 0) return (0);
+
+    *pv = v->next;
+    if (v->buffer != NULL)
+        free(v->buffer);
+    else
+        unmap_blocks(v->data);
+    free(v);
+    return (0);
+    }
+
+
+void get_map_counters (MAP_COUNTERS* c)
+    {
+    *c = counters;
+    }
+
+void reset_map_counters (void)
+    {
+    counters.nb_direct = 0;
+    counters.nb_copied = 0;
+    counters.nb_bytes_copied = 0;
+    }
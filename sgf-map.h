@@ -0,0 +1,74 @@
+#ifndef __SGF_MAP__
+#define __SGF_MAP__
+
+#include "sgf-io.h"
+
+
+/**********************************************************************
+ *
+ *  VUES EN LECTURE SEULE DU CONTENU D'UN FICHIER
+ *
+ *  sgf_map donne acces aux octets offset..offset+length-1 d'un
+ *  fichier ouvert en lecture (ou en lecture/ecriture) sans les
+ *  recopier dans un tableau de l'appelant :
+ *
+ *  directe   si le fichier est lu en READ_MODE sur le volume courant,
+ *            n'est pas compresse et que la plage tient dans une suite
+ *            de blocs contigus sans trou, la vue pointe dans la
+ *            projection du fichier image (map_blocks, sgf-disk.h).
+ *            C'est le cas des fichiers places d'un seul tenant par
+ *            l'allocation retardee.
+ *
+ *  copiee    sinon la plage est lue bloc par bloc (grappe par grappe
+ *            pour un fichier compresse) par sgf_read dans un tampon
+ *            propre a la vue ; la position du fichier est retablie.
+ *
+ *  Une vue vit jusqu'a son dernier sgf_unmap, meme apres la fermeture
+ *  du fichier ou du disque ; sgf_map_retain ajoute une reference
+ *  (pour la passer a un autre utilisateur). Une vue copiee garde le
+ *  contenu du moment.
+ *
+ *  Une vue directe ne retient pas les blocs qu'elle montre : elle
+ *  n'est valide que tant que le fichier reste inchange. Apres un
+ *  sgf_unlink, un sgf_truncate ou une reecriture en READ_WRITE_MODE,
+ *  ses blocs peuvent etre liberes puis realloues, et la vue montre
+ *  alors, sans erreur, les octets d'un autre fichier. L'appelant qui
+ *  modifie ou detruit le fichier doit d'abord rendre ses vues.
+ *
+ *********************************************************************/
+
+typedef struct MAP_COUNTERS
+    {
+    long nb_direct;             /* vues directes                    */
+    long nb_copied;             /* vues copiees                     */
+    long nb_bytes_copied;       /* octets recopies dans les tampons */
+    }
+    MAP_COUNTERS;
+
+
+/**********************************************************************
+ Vue des "length" octets a partir de "offset" (NULL si la plage sort
+ du fichier, si le fichier n'est pas ouvert en lecture ou si la
+ lecture echoue). Une vue directe n'est valide que tant que le
+ fichier n'est ni modifie ni detruit (voir plus haut).
+ *********************************************************************/
+
+    const char* sgf_map (OFILE* f, int offset, int length);
+
+/**********************************************************************
+ Ajouter ou rendre une reference sur une vue (-1 si "view" n'est pas
+ une vue ouverte). La vue disparait avec sa derniere reference.
+ *********************************************************************/
+
+    const char* sgf_map_retain (const char* view);
+    int sgf_unmap (const char* view);
+
+/**********************************************************************
+ Compteurs des vues (depuis le dernier reset).
+ *********************************************************************/
+
+    void get_map_counters (MAP_COUNTERS* c);
+    void reset_map_counters (void);
+
+
+#endif
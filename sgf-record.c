@@ -0,0 +1,190 @@
+/*
+**  sgf-record.c
+**
+**  Enregistrement des appels de l'application dans une trace.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-io.h"
+#include "sgf-stats.h"
+#include "sgf-record.h"
+
+
+int sgf_recording = 0;
+
+static FILE* trace = NULL;
+static int depth = 0;                   /* appels publics imbriques     */
+static unsigned long last_start = 0;    /* debut de l'enregistrement precedent */
+
+/* fichiers ouverts numerotes : le numero de handles[k] est k + 1 */
+static OFILE* handles [ TRACE_MAX_HANDLES ];
+static int last_handle = 0;
+
+/* suite de sgf_getc ou de sgf_putc pas encore ecrite */
+static SGF_TRACE_REC pending;
+static int has_pending = 0;
+
+static const char* op_names [ TRACE_OPS ] =
+    {
+    "?", "open", "close", "getc", "putc", "puts", "write", "seek",
+    "seek_data", "seek_hole", "punch_hole", "truncate", "flush",
+    "unlink", "clone", "sync", "find_inode", "list_directory", "read"
+    };
+
+
+const char* sgf_trace_op_name (int op)
+    {
+    return ((op > 0  &&  op < TRACE_OPS) ? op_names[op] : "?");
+    }
+
+
+/**********************************************************************
+ Numero du fichier ouvert "f" (0 s'il n'en a pas).
+ *********************************************************************/
+
+static int handle_of (OFILE* f)
+    {
+    int k;
+
+    if (f == NULL) return (0);
+    if (last_handle > 0  &&  handles[last_handle - 1] == f) return (last_handle);
+    for(k = 0; k < TRACE_MAX_HANDLES; k++)
+        if (handles[k] == f) return (last_handle = k + 1);
+    return (0);
+    }
+
+static int new_handle (OFILE* f)
+    {
+    int k;
+
+    for(k = 0; k < TRACE_MAX_HANDLES; k++)
+        if (handles[k] == NULL)
+            {
+            handles[k] = f;
+            return (last_handle = k + 1);
+            }
+    return (0);
+    }
+
+
+static void flush_pending (void)
+    {
+    if (has_pending) fwrite(&pending, sizeof(pending), 1, trace);
+    has_pending = 0;
+    }
+
+
+/**********************************************************************
+ Debut et fin d'un appel public. Seul l'appel le plus externe est
+ enregistre : record_enter renvoie 1 (et non l'instant) a un appel
+ imbrique, pour que record_leave soit appele et le decompte.
+ *********************************************************************/
+
+unsigned long record_enter (void)
+    {
+    if (depth++ > 0) return (1);
+    return (stats_clock());
+    }
+
+
+void record_leave (int op, unsigned long start, OFILE* f, int a, int b, int result,
+                   const char* name, const char* name2)
+    {
+    SGF_TRACE_REC r;
+    unsigned long now;
+    int n1, n2, handle;
+
+    if (--depth > 0  ||  start == 1  ||  trace == NULL) return;
+    now = stats_clock();
+
+    /* un caractere de plus dans la suite en cours */
+    if ((op == TRACE_GETC  ||  op == TRACE_PUTC)  &&  has_pending
+        &&  pending.op == op  &&  pending.handle == handle_of(f))
+        {
+        pending.a++;
+        if (result < 0) pending.b++;
+        pending.duration_ns += now - start;
+        return;
+        }
+    flush_pending();
+
+    handle = (op == TRACE_OPEN  &&  f != NULL) ? new_handle(f) : handle_of(f);
+    n1 = (name != NULL) ? strlen(name) + 1 : 0;
+    n2 = (name2 != NULL) ? strlen(name2) + 1 : 0;
+    if (n1 + n2 > 255) n1 = n2 = 0;
+
+    memset(&r, 0, sizeof(r));
+    r.op = op;
+    r.name_len = n1 + n2;
+    r.handle = handle;
+    r.delay_us = (last_start == 0) ? 0 : start / 1000 - last_start / 1000;
+    r.duration_ns = now - start;
+    r.a = a;
+    r.b = b;
+    r.result = result;
+    last_start = start;
+
+    if (op == TRACE_GETC  ||  op == TRACE_PUTC)
+        {
+        r.a = 1;
+        r.b = (result < 0);
+        pending = r;
+        has_pending = 1;
+        return;
+        }
+
+    fwrite(&r, sizeof(r), 1, trace);
+    if (n1 > 0) fwrite(name, 1, n1, trace);
+    if (n2 > 0) fwrite(name2, 1, n2, trace);
+
+    /* le numero d'un fichier ferme est libre */
+    if (op == TRACE_CLOSE  &&  handle > 0) handles[handle - 1] = NULL;
+    }
+
+
+/**********************************************************************
+ Commencer et arreter un enregistrement.
+ *********************************************************************/
+
+int sgf_record_start (const char* path)
+    {
+    static int registered = 0;
+    SGF_TRACE_HEADER h;
+
+    sgf_record_stop();
+    trace = fopen(path, "wb");
+    if (trace == NULL) return (-1);
+    setvbuf(trace, NULL, _IOFBF, 1 << 16);
+
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, SGF_TRACE_MAGIC, sizeof(h.magic));
+    h.version = SGF_TRACE_VERSION;
+    h.disk_size = get_disk_size();
+    fwrite(&h, sizeof(h), 1, trace);
+
+    memset(handles, 0, sizeof(handles));
+    last_handle = 0;
+    last_start = 0;
+    depth = 0;
+    has_pending = 0;
+    sgf_recording = 1;
+
+    if (!registered) atexit(sgf_record_stop);
+    registered = 1;
+    return (0);
+    }
+
+
+void sgf_record_stop (void)
+    {
+    if (trace == NULL) return;
+    flush_pending();
+    fclose(trace);
+    trace = NULL;
+    sgf_recording = 0;
+    }
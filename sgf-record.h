@@ -0,0 +1,108 @@
+#ifndef __SGF_RECORD__
+#define __SGF_RECORD__
+
+#include "sgf-io.h"
+
+
+/**********************************************************************
+ *
+ *  ENREGISTREMENT DES APPELS (TRACES REJOUABLES)
+ *
+ *  Pendant un enregistrement, chaque appel des fonctions de sgf-io.h
+ *  et de find_inode/list_directory fait par l'application est note
+ *  dans un fichier trace binaire : operation, fichier ouvert concerne
+ *  (un numero attribue a l'ouverture), arguments, resultat, delai
+ *  depuis l'enregistrement precedent et duree. Les appels faits par le SGF
+ *  lui-meme (sgf_open qui appelle find_inode...) ne sont pas notes.
+ *  Les suites de sgf_getc (ou de sgf_putc) sur un meme fichier sont
+ *  regroupees en un seul enregistrement. Le contenu des donnees
+ *  ecrites n'est pas conserve, seulement leur taille.
+ *
+ *  L'enregistrement commence par sgf_record_start, ou par init_sgf
+ *  si la variable d'environnement SGF_RECORD donne le nom du fichier
+ *  trace. sgf-replay rejoue une trace sur un disque neuf.
+ *
+ *  Le fichier commence par un SGF_TRACE_HEADER, suivi des
+ *  SGF_TRACE_REC (dans l'ordre des octets de la machine), chacun
+ *  suivi de "name_len" octets de noms ("nom\0" ou "src\0dst\0").
+ *
+ *********************************************************************/
+
+#define SGF_TRACE_MAGIC         "SGFTRACE"
+#define SGF_TRACE_VERSION       (1)
+
+#define TRACE_OPEN              (1)     /* a : mode, b : taille (-1 : echec) */
+#define TRACE_CLOSE             (2)
+#define TRACE_GETC              (3)     /* a : appels, b : fins de fichier */
+#define TRACE_PUTC              (4)     /* a : appels                    */
+#define TRACE_PUTS              (5)     /* a : longueur                  */
+#define TRACE_WRITE             (6)     /* a : taille                    */
+#define TRACE_SEEK              (7)     /* a : position                  */
+#define TRACE_SEEK_DATA         (8)     /* a : position                  */
+#define TRACE_SEEK_HOLE         (9)     /* a : position                  */
+#define TRACE_PUNCH_HOLE        (10)    /* a : position, b : longueur    */
+#define TRACE_TRUNCATE          (11)    /* a : longueur                  */
+#define TRACE_FLUSH             (12)
+#define TRACE_UNLINK            (13)
+#define TRACE_CLONE             (14)
+#define TRACE_SYNC              (15)
+#define TRACE_FIND_INODE        (16)
+#define TRACE_LIST_DIRECTORY    (17)
+#define TRACE_READ              (18)    /* a : taille demandee           */
+#define TRACE_OPS               (19)
+
+#define TRACE_MAX_HANDLES       (1024)  /* fichiers ouverts numerotes   */
+
+typedef struct SGF_TRACE_HEADER
+    {
+    char magic [ 8 ];           /* SGF_TRACE_MAGIC                  */
+    int  version;               /* SGF_TRACE_VERSION                */
+    int  disk_size;             /* taille du disque (en blocs)      */
+    }
+    SGF_TRACE_HEADER;
+
+typedef struct SGF_TRACE_REC
+    {
+    unsigned char op;           /* TRACE_xxx                        */
+    unsigned char name_len;     /* octets de noms qui suivent       */
+    unsigned short handle;      /* fichier ouvert (0 : aucun)       */
+    unsigned int delay_us;      /* depuis le debut de l'enregistrement precedent */
+    unsigned int duration_ns;   /* duree de l'appel (des appels regroupes) */
+    int a, b;                   /* arguments                        */
+    int result;                 /* resultat                         */
+    }
+    SGF_TRACE_REC;
+
+
+/**********************************************************************
+ Commencer a enregistrer dans le fichier "path" (-1 s'il ne peut pas
+ etre cree) et arreter (le fichier est complete et ferme). Un
+ enregistrement en cours est arrete a la fin du programme.
+ *********************************************************************/
+
+    extern int sgf_recording;
+
+    int sgf_record_start (const char* path);
+    void sgf_record_stop (void);
+
+    const char* sgf_trace_op_name (int op);
+
+/**********************************************************************
+ Enregistrement dans les fonctions publiques :
+
+     RECORD_DECL;                                 avec les declarations
+     RECORD_START();                              au debut
+     RECORD_STOP(op, f, a, b, result, nom, nom2); a la fin
+ *********************************************************************/
+
+    unsigned long record_enter (void);
+    void record_leave (int op, unsigned long start, OFILE* f, int a, int b, int result,
+                       const char* name, const char* name2);
+
+#define RECORD_DECL             unsigned long record_t0
+#define RECORD_START()          (record_t0 = sgf_recording ? record_enter() : 0)
+#define RECORD_STOP(op, f, a, b, r, n, n2) \
+    do { if (record_t0 != 0) record_leave((op), record_t0, (f), (a), (b), (r), (n), (n2)); } while (0)
+
+
+#endif
@@ -0,0 +1,194 @@
+
+/*
+**  sgf-refcount.c
+**
+**  Compteurs de references des blocs partages (clones).
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-refcount.h"
+#include "sgf-journal.h"
+
+
+#define PAR_EXCES(n,d)          (((n) + (d) - 1) / (d))
+
+#define REFS_PER_BLOCK          (BLOCK_SIZE / sizeof(unsigned short))
+
+
+/**********************************************************************
+ *
+ *  La table en memoire centrale (NULL si le disque n'en a pas).
+ *
+ *********************************************************************/
+
+static unsigned short* refs = NULL;
+static char* modif = NULL;              /* bloc de la table a ecrire */
+static int adr_table = -1;
+static int nb_table_blocks = 0;
+
+
+/**********************************************************************
+ Charger la table.
+ *********************************************************************/
+
+void init_sgf_refcount (void)
+    {
+    TBLOCK b;
+    int k;
+
+    free(refs);
+    free(modif);
+    refs = NULL;
+    modif = NULL;
+    adr_table = -1;
+    nb_table_blocks = 0;
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT  ||  b.super.adr_refcount <= 0)
+        return;
+
+    adr_table = b.super.adr_refcount;
+    nb_table_blocks = b.super.nb_refcount_blocks;
+    refs = malloc((long) nb_table_blocks * BLOCK_SIZE);
+    modif = calloc(nb_table_blocks, 1);
+    if (refs == NULL  ||  modif == NULL)
+        panic("init_sgf_refcount: plus de memoire.");
+
+    for(k = 0; k < nb_table_blocks; k++)
+        read_block(adr_table + k, (BLOCK*) ((char*) refs + (long) k * BLOCK_SIZE));
+    }
+
+
+/**********************************************************************
+ Creer la table au premier partage : une suite de blocs reserves
+ dans la FAT, notee dans le super bloc.
+ *********************************************************************/
+
+static int create_table (void)
+    {
+    TBLOCK b;
+    int k, nb, adr;
+
+    nb = PAR_EXCES(get_disk_size(), REFS_PER_BLOCK);
+    adr = find_free_extent(nb, get_fat_size_in_blocks() + ADR_BLOCK_FAT);
+    if (adr < 0) return (-1);
+
+    refs = calloc(nb, BLOCK_SIZE);
+    modif = malloc(nb);
+    if (refs == NULL  ||  modif == NULL)
+        panic("create_table: plus de memoire.");
+    memset(modif, 1, nb);
+
+    for(k = 0; k < nb; k++)
+        set_fat_lazy(adr + k, FAT_RESERVED);
+    save_fat();
+
+    adr_table = adr;
+    nb_table_blocks = nb;
+    save_refcount();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT)
+        {
+        memset((char*) &b + 2 * sizeof(int), 0, BLOCK_SIZE - 2 * sizeof(int));
+        b.super.ext_signature = SIGNATURE_SUPER_EXT;
+        }
+    b.super.adr_refcount = adr;
+    b.super.nb_refcount_blocks = nb;
+    write_meta_block(ADR_BLOCK_DEF, &b.data);
+
+    return (0);
+    }
+
+
+/**********************************************************************
+ Lire/modifier un compteur.
+ *********************************************************************/
+
+int get_refcount (int n)
+    {
+    return ((refs == NULL) ? 0 : refs[n]);
+    }
+
+static void set_refcount (int n, int v)
+    {
+    refs[n] = v;
+    modif[n / REFS_PER_BLOCK] = 1;
+    }
+
+int ref_block (int n)
+    {
+    if (refs == NULL  &&  create_table() < 0) return (-1);
+    if (refs[n] == REFCOUNT_MAX) return (-1);
+
+    set_refcount(n, refs[n] + 1);
+    return (0);
+    }
+
+void unref_block (int n)
+    {
+    if (get_refcount(n) > 0) set_refcount(n, refs[n] - 1);
+    }
+
+
+/**********************************************************************
+ Abandonner une reference a une chaine.
+ *********************************************************************/
+
+void release_chain (int adr)
+    {
+    int next;
+
+    for(; adr != FAT_EOF; adr = next)
+        {
+        if (get_refcount(adr) > 0)
+            {
+            /* quelqu'un d'autre designe encore ce bloc (et la suite) */
+            unref_block(adr);
+            break;
+            }
+        next = get_fat(adr);
+        set_fat_lazy(adr, FAT_FREE);
+        }
+    save_fat();
+    save_refcount();
+    }
+
+
+/**********************************************************************
+ Rechercher un bloc partage dans une chaine.
+ *********************************************************************/
+
+int chain_is_shared (int adr)
+    {
+    if (refs == NULL) return (0);
+
+    for(; adr != FAT_EOF; adr = get_fat(adr))
+        if (refs[adr] > 0) return (1);
+
+    return (0);
+    }
+
+
+/**********************************************************************
+ Sauver les blocs modifies de la table.
+ *********************************************************************/
+
+void save_refcount (void)
+    {
+    int k;
+
+    for(k = 0; k < nb_table_blocks; k++)
+        if (modif[k])
+            {
+            write_meta_block(adr_table + k, (BLOCK*) ((char*) refs + (long) k * BLOCK_SIZE));
+            modif[k] = 0;
+            }
+    }
@@ -0,0 +1,73 @@
+
+#ifndef __SGF_REFCOUNT__
+#define __SGF_REFCOUNT__
+
+
+/**********************************************************************
+ *
+ *  COMPTEURS DE REFERENCES (partage de blocs entre fichiers)
+ *
+ *  Une entree de FAT ne designe qu'un seul successeur : deux fichiers
+ *  ne peuvent partager que des fins de chaines. Un clone partage toute
+ *  la chaine de son original ; une copie sur ecriture recopie le debut
+ *  de la chaine jusqu'au bloc modifie et rejoint ensuite la fin.
+ *
+ *  Pour chaque bloc la table conserve le nombre de references EN PLUS
+ *  de la premiere (INODE ou bloc precedent qui le designe). Un bloc
+ *  n'est donc compte qu'aux points de jonction : cloner un fichier ne
+ *  modifie que le compteur de son premier bloc. Un bloc est partage
+ *  si lui-meme ou l'un des blocs qui le precedent dans la chaine a un
+ *  compteur non nul.
+ *
+ *  La table (deux octets par bloc du disque) n'est creee qu'au premier
+ *  partage, dans des blocs marques FAT_RESERVED, et son adresse est
+ *  notee dans le super bloc.
+ *
+ *********************************************************************/
+
+#define REFCOUNT_MAX            (65535)
+
+
+/**********************************************************************
+ Charger la table du disque courant (s'il en a une).
+ *********************************************************************/
+
+    void init_sgf_refcount (void);
+
+/**********************************************************************
+ Nombre de references en plus de la premiere pour le bloc "n".
+ *********************************************************************/
+
+    int get_refcount (int n);
+
+/**********************************************************************
+ Ajouter une reference au bloc "n" (la table est creee si besoin).
+ Renvoie -1 si la table ne peut pas etre creee ou si le compteur est
+ au maximum.
+ *********************************************************************/
+
+    int ref_block (int n);
+    void unref_block (int n);
+
+/**********************************************************************
+ Abandonner une reference a la chaine qui commence au bloc "adr" :
+ les blocs qui ne sont plus designes par personne sont liberes, le
+ parcours s'arrete au premier bloc encore partage.
+ *********************************************************************/
+
+    void release_chain (int adr);
+
+/**********************************************************************
+ Savoir si un bloc de la chaine commencant en "adr" est partage.
+ *********************************************************************/
+
+    int chain_is_shared (int adr);
+
+/**********************************************************************
+ Ecrire sur le disque les blocs modifies de la table.
+ *********************************************************************/
+
+    void save_refcount (void);
+
+
+#endif
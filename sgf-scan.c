@@ -0,0 +1,424 @@
+
+/*
+**  sgf-scan.c
+**
+**  Parcours vectoriels de la FAT.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-fat.h"
+#include "sgf-scan.h"
+
+#if defined(__GNUC__)  &&  defined(__x86_64__)
+#define SCAN_X86
+#include <immintrin.h>
+#endif
+
+
+#define CHUNK                   (64)    /* entrees par masque */
+
+int sgf_fat_scan = SCAN_AUTO;
+
+/* caractere de la carte pour -valeur (0 : bloc chaine a un suivant) */
+static const char map_chars[16] = "DFRIES??????????";
+
+
+/**********************************************************************
+ *
+ *  Les suites de blocs libres se comptent sur un masque de 64 bits
+ *  (le bit j concerne l'entree i + j). "run" est la longueur de la
+ *  suite qui atteint le debut du paquet.
+ *
+ *********************************************************************/
+
+static void add_runs (unsigned long free, int nb, FAT_SCAN* s, unsigned* run)
+    {
+    unsigned long r;
+    int j, len;
+
+    /* paquet sans bloc libre (le cas courant) ou entierement libre */
+    if (free == 0)
+        {
+        *run = 0;
+        return;
+        }
+
+    for(j = 0; j < nb; j += len)
+        {
+        r = free >> j;
+        if (r == 0)
+            {
+            *run = 0;
+            break;
+            }
+        if ((r & 1) == 0)
+            {
+            *run = 0;
+            j += __builtin_ctzl(r);
+            r = free >> j;
+            }
+        len = (~r == 0) ? CHUNK - j : __builtin_ctzl(~r);
+        if (len > nb - j) len = nb - j;
+
+        if (*run == 0) s->nb_free_extents++;
+        *run += len;
+        if (*run > s->largest_free_extent) s->largest_free_extent = *run;
+        }
+    }
+
+/* "nb" entrees a partir de i, une a la fois */
+static void scan_scalar (const int* tab, int i, int nb, FAT_SCAN* s, unsigned* run)
+    {
+    unsigned long free = 0, bit;
+    int j, v;
+
+    for(j = 0, bit = 1; j < nb; j++, bit <<= 1)
+        {
+        v = tab[i + j];
+        if (v > 0) s->nb_data++;
+        else if (v == FAT_FREE) free |= bit;
+        else if (v == FAT_EOF) s->nb_eof++;
+        else if (v == FAT_INODE) s->nb_inode++;
+        else if (v == FAT_RESERVED) s->nb_reserved++;
+        else if (v == FAT_SNAPSHOT) s->nb_snapshot++;
+
+        /* un bloc chaine commence un extent sauf si le precedent le designe */
+        if ((v > 0  ||  v == FAT_EOF)  &&  !(i + j > 0  &&  tab[i + j - 1] == i + j))
+            s->nb_extents++;
+        }
+
+    s->nb_free += __builtin_popcountl(free);
+    add_runs(free, nb, s, run);
+    }
+
+#ifdef SCAN_X86
+
+/*  Les versions vectorielles traitent des paquets complets de 64
+ *  entrees qui ont une entree precedente (i > 0) et renvoient la
+ *  premiere entree non traitee. Chaque sorte est comptee dans un
+ *  vecteur d'accumulateurs (une comparaison vaut -1 par entree) ;
+ *  seuls les blocs libres et les debuts d'extents passent par des
+ *  masques.                                                          */
+
+#define MASK4(cmp)      ((unsigned long) _mm_movemask_ps(_mm_castsi128_ps(cmp)))
+#define MASK8(cmp)      ((unsigned long) _mm256_movemask_ps(_mm256_castsi256_ps(cmp)))
+
+static unsigned sum4 (__m128i acc)
+    {
+    int lanes[4];
+
+    _mm_storeu_si128((__m128i*) lanes, acc);
+    return (lanes[0] + lanes[1] + lanes[2] + lanes[3]);
+    }
+
+__attribute__((target("avx2")))
+static unsigned sum8 (__m256i acc)
+    {
+    return (sum4(_mm_add_epi32(_mm256_castsi256_si128(acc), _mm256_extracti128_si256(acc, 1))));
+    }
+
+static int scan_sse (const int* tab, int i, int to, FAT_SCAN* s, unsigned* run)
+    {
+    __m128i v, p, idx, chained;
+    __m128i n_data, n_eof, n_inode, n_res, n_snap, zero = _mm_setzero_si128();
+    __m128i c_free = _mm_set1_epi32(FAT_FREE), c_eof = _mm_set1_epi32(FAT_EOF);
+    __m128i c_inode = _mm_set1_epi32(FAT_INODE), c_res = _mm_set1_epi32(FAT_RESERVED);
+    __m128i c_snap = _mm_set1_epi32(FAT_SNAPSHOT), four = _mm_set1_epi32(4);
+    unsigned long free, starts;
+    int j;
+
+    n_data = n_eof = n_inode = n_res = n_snap = zero;
+    for(; i + CHUNK <= to; i += CHUNK)
+        {
+        free = starts = 0;
+        idx = _mm_setr_epi32(i, i + 1, i + 2, i + 3);
+        for(j = 0; j < CHUNK; j += 4, idx = _mm_add_epi32(idx, four))
+            {
+            v = _mm_loadu_si128((const __m128i*) (tab + i + j));
+            p = _mm_loadu_si128((const __m128i*) (tab + i + j - 1));
+            chained = _mm_or_si128(_mm_cmpgt_epi32(v, zero), _mm_cmpeq_epi32(v, c_eof));
+            n_data = _mm_sub_epi32(n_data, _mm_cmpgt_epi32(v, zero));
+            n_eof = _mm_sub_epi32(n_eof, _mm_cmpeq_epi32(v, c_eof));
+            n_inode = _mm_sub_epi32(n_inode, _mm_cmpeq_epi32(v, c_inode));
+            n_res = _mm_sub_epi32(n_res, _mm_cmpeq_epi32(v, c_res));
+            n_snap = _mm_sub_epi32(n_snap, _mm_cmpeq_epi32(v, c_snap));
+            free |= MASK4(_mm_cmpeq_epi32(v, c_free)) << j;
+            starts |= MASK4(_mm_andnot_si128(_mm_cmpeq_epi32(p, idx), chained)) << j;
+            }
+        s->nb_free += __builtin_popcountl(free);
+        s->nb_extents += __builtin_popcountl(starts);
+        add_runs(free, CHUNK, s, run);
+        }
+
+    s->nb_data += sum4(n_data);
+    s->nb_eof += sum4(n_eof);
+    s->nb_inode += sum4(n_inode);
+    s->nb_reserved += sum4(n_res);
+    s->nb_snapshot += sum4(n_snap);
+
+    return (i);
+    }
+
+__attribute__((target("avx2,popcnt")))
+static int scan_avx2 (const int* tab, int i, int to, FAT_SCAN* s, unsigned* run)
+    {
+    __m256i v, p, idx, chained, data;
+    __m256i n_data, n_eof, n_inode, n_res, n_snap, zero = _mm256_setzero_si256();
+    __m256i c_free = _mm256_set1_epi32(FAT_FREE), c_eof = _mm256_set1_epi32(FAT_EOF);
+    __m256i c_inode = _mm256_set1_epi32(FAT_INODE), c_res = _mm256_set1_epi32(FAT_RESERVED);
+    __m256i c_snap = _mm256_set1_epi32(FAT_SNAPSHOT), eight = _mm256_set1_epi32(8);
+    unsigned long free, starts;
+    int j;
+
+    n_data = n_eof = n_inode = n_res = n_snap = zero;
+    for(; i + CHUNK <= to; i += CHUNK)
+        {
+        free = starts = 0;
+        idx = _mm256_setr_epi32(i, i + 1, i + 2, i + 3, i + 4, i + 5, i + 6, i + 7);
+        for(j = 0; j < CHUNK; j += 8, idx = _mm256_add_epi32(idx, eight))
+            {
+            v = _mm256_loadu_si256((const __m256i*) (tab + i + j));
+            p = _mm256_loadu_si256((const __m256i*) (tab + i + j - 1));
+            data = _mm256_cmpgt_epi32(v, zero);
+            chained = _mm256_or_si256(data, _mm256_cmpeq_epi32(v, c_eof));
+            n_data = _mm256_sub_epi32(n_data, data);
+            n_eof = _mm256_sub_epi32(n_eof, _mm256_cmpeq_epi32(v, c_eof));
+            n_inode = _mm256_sub_epi32(n_inode, _mm256_cmpeq_epi32(v, c_inode));
+            n_res = _mm256_sub_epi32(n_res, _mm256_cmpeq_epi32(v, c_res));
+            n_snap = _mm256_sub_epi32(n_snap, _mm256_cmpeq_epi32(v, c_snap));
+            free |= MASK8(_mm256_cmpeq_epi32(v, c_free)) << j;
+            starts |= MASK8(_mm256_andnot_si256(_mm256_cmpeq_epi32(p, idx), chained)) << j;
+            }
+        s->nb_free += __builtin_popcountl(free);
+        s->nb_extents += __builtin_popcountl(starts);
+        add_runs(free, CHUNK, s, run);
+        }
+
+    s->nb_data += sum8(n_data);
+    s->nb_eof += sum8(n_eof);
+    s->nb_inode += sum8(n_inode);
+    s->nb_reserved += sum8(n_res);
+    s->nb_snapshot += sum8(n_snap);
+
+    return (i);
+    }
+
+#endif
+
+
+/**********************************************************************
+ Jeu d'instructions effectif.
+ *********************************************************************/
+
+int fat_scan_level (void)
+    {
+#ifdef SCAN_X86
+    static int avx2 = -1;
+
+    if (avx2 < 0)
+        {
+        __builtin_cpu_init();
+        avx2 = __builtin_cpu_supports("avx2")  &&  __builtin_cpu_supports("popcnt");
+        }
+    if (sgf_fat_scan == SCAN_SCALAR) return (SCAN_SCALAR);
+    if (sgf_fat_scan == SCAN_SSE  ||  !avx2) return (SCAN_SSE);
+    return (SCAN_AVX2);
+#else
+    return (SCAN_SCALAR);
+#endif
+    }
+
+
+/**********************************************************************
+ Bilan de la table : le premier paquet (sans entree precedente) et la
+ fin de la table se font une entree a la fois.
+ *********************************************************************/
+
+void fat_scan (const int* tab, int n, FAT_SCAN* s)
+    {
+    unsigned run = 0;
+    int i, nb;
+
+    memset(s, 0, sizeof(FAT_SCAN));
+    i = nb = (n < CHUNK) ? n : CHUNK;
+    scan_scalar(tab, 0, nb, s, &run);
+
+#ifdef SCAN_X86
+    switch (fat_scan_level())
+        {
+        case SCAN_AVX2:
+            i = scan_avx2(tab, i, n, s, &run);
+            break;
+        case SCAN_SSE:
+            i = scan_sse(tab, i, n, s, &run);
+            break;
+        }
+#endif
+    for(; i < n; i += nb)
+        {
+        nb = (n - i < CHUNK) ? n - i : CHUNK;
+        scan_scalar(tab, i, nb, s, &run);
+        }
+    }
+
+
+/**********************************************************************
+ Recherche d'une entree libre.
+ *********************************************************************/
+
+#ifdef SCAN_X86
+
+static int find_free_sse (const int* tab, int from, int to)
+    {
+    __m128i f = _mm_set1_epi32(FAT_FREE), a, b;
+    unsigned long m;
+    int i;
+
+    for(i = from; i + 8 <= to; i += 8)
+        {
+        a = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (tab + i)), f);
+        b = _mm_cmpeq_epi32(_mm_loadu_si128((const __m128i*) (tab + i + 4)), f);
+        m = MASK4(a) | (MASK4(b) << 4);
+        if (m != 0) return (i + __builtin_ctzl(m));
+        }
+    for(; i < to; i++)
+        if (tab[i] == FAT_FREE) return (i);
+
+    return (-1);
+    }
+
+__attribute__((target("avx2")))
+static int find_free_avx2 (const int* tab, int from, int to)
+    {
+    __m256i f = _mm256_set1_epi32(FAT_FREE), a, b;
+    unsigned long m;
+    int i;
+
+    for(i = from; i + 16 <= to; i += 16)
+        {
+        a = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (tab + i)), f);
+        b = _mm256_cmpeq_epi32(_mm256_loadu_si256((const __m256i*) (tab + i + 8)), f);
+        m = MASK8(a) | (MASK8(b) << 8);
+        if (m != 0) return (i + __builtin_ctzl(m));
+        }
+    for(; i < to; i++)
+        if (tab[i] == FAT_FREE) return (i);
+
+    return (-1);
+    }
+
+#endif
+
+int fat_find_free (const int* tab, int from, int to)
+    {
+    int i;
+
+#ifdef SCAN_X86
+    switch (fat_scan_level())
+        {
+        case SCAN_AVX2: return (find_free_avx2(tab, from, to));
+        case SCAN_SSE:  return (find_free_sse(tab, from, to));
+        }
+#endif
+    for(i = from; i < to; i++)
+        if (tab[i] == FAT_FREE) return (i);
+
+    return (-1);
+    }
+
+
+/**********************************************************************
+ *
+ *  Carte de la table. Les valeurs sont ramenees a des octets par
+ *  saturation (une adresse devient positive, FAT_FREE..FAT_SNAPSHOT
+ *  restent -1..-5), dont l'oppose (borne a 15) est l'indice du
+ *  caractere dans map_chars, trouve par pshufb.
+ *
+ *********************************************************************/
+
+static char render_one (int v)
+    {
+    if (v > 0) return ('D');
+    if (v < 0  &&  v >= -15) return (map_chars[-v]);
+    return ('?');
+    }
+
+#ifdef SCAN_X86
+
+__attribute__((target("ssse3")))
+static int render_ssse3 (const int* tab, int n, char* out)
+    {
+    __m128i chars = _mm_loadu_si128((const __m128i*) map_chars);
+    __m128i zero = _mm_setzero_si128(), fifteen = _mm_set1_epi8(15);
+    __m128i a, b, c, idx;
+    int i;
+
+    for(i = 0; i + 16 <= n; i += 16)
+        {
+        a = _mm_packs_epi32(_mm_loadu_si128((const __m128i*) (tab + i)),
+                            _mm_loadu_si128((const __m128i*) (tab + i + 4)));
+        b = _mm_packs_epi32(_mm_loadu_si128((const __m128i*) (tab + i + 8)),
+                            _mm_loadu_si128((const __m128i*) (tab + i + 12)));
+        c = _mm_packs_epi16(a, b);
+
+        /* positif : 0 ('D'), nul : 15 ('?'), negatif : son oppose */
+        idx = _mm_andnot_si128(_mm_cmpgt_epi8(c, zero), _mm_sub_epi8(zero, c));
+        idx = _mm_or_si128(idx, _mm_and_si128(_mm_cmpeq_epi8(c, zero), fifteen));
+        idx = _mm_min_epu8(idx, fifteen);
+        _mm_storeu_si128((__m128i*) (out + i), _mm_shuffle_epi8(chars, idx));
+        }
+
+    return (i);
+    }
+
+__attribute__((target("avx2")))
+static int render_avx2 (const int* tab, int n, char* out)
+    {
+    __m256i chars = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) map_chars));
+    __m256i zero = _mm256_setzero_si256(), fifteen = _mm256_set1_epi8(15);
+    __m256i order = _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7);
+    __m256i a, b, c, idx;
+    int i;
+
+    for(i = 0; i + 32 <= n; i += 32)
+        {
+        a = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i*) (tab + i)),
+                               _mm256_loadu_si256((const __m256i*) (tab + i + 8)));
+        b = _mm256_packs_epi32(_mm256_loadu_si256((const __m256i*) (tab + i + 16)),
+                               _mm256_loadu_si256((const __m256i*) (tab + i + 24)));
+        /* les paquets se font par moities de 128 bits : remettre en ordre */
+        c = _mm256_permutevar8x32_epi32(_mm256_packs_epi16(a, b), order);
+
+        idx = _mm256_andnot_si256(_mm256_cmpgt_epi8(c, zero), _mm256_sub_epi8(zero, c));
+        idx = _mm256_or_si256(idx, _mm256_and_si256(_mm256_cmpeq_epi8(c, zero), fifteen));
+        idx = _mm256_min_epu8(idx, fifteen);
+        _mm256_storeu_si256((__m256i*) (out + i), _mm256_shuffle_epi8(chars, idx));
+        }
+
+    return (i);
+    }
+
+#endif
+
+void fat_render (const int* tab, int n, char* out)
+    {
+    int i = 0;
+
+#ifdef SCAN_X86
+    switch (fat_scan_level())
+        {
+        case SCAN_AVX2:
+            i = render_avx2(tab, n, out);
+            break;
+        case SCAN_SSE:
+            if (__builtin_cpu_supports("ssse3")) i = render_ssse3(tab, n, out);
+            break;
+        }
+#endif
+    for(; i < n; i++)
+        out[i] = render_one(tab[i]);
+    }
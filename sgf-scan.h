@@ -0,0 +1,78 @@
+
+#ifndef __SGF_SCAN__
+#define __SGF_SCAN__
+
+
+/**********************************************************************
+ *
+ *  PARCOURS DE LA FAT PAR BLOCS D'ENTREES
+ *
+ *  Les parcours de toute la FAT (statistiques, compte des blocs
+ *  libres, carte, recherche d'un bloc libre) classent les entrees par
+ *  paquets de 64 : un masque de bits par classe (libre, donnee, fin
+ *  de chaine...) est calcule avec des instructions vectorielles
+ *  (AVX2, huit entrees par comparaison, ou SSE2, quatre), puis les
+ *  compteurs et les suites de blocs libres se deduisent des masques.
+ *  La version scalaire sert sur les autres processeurs, pour le
+ *  premier paquet et pour la fin de la table.
+ *
+ *  Ces fonctions travaillent sur un tableau d'entrees quelconque (la
+ *  FAT en memoire, celle d'un instantane, une table de test).
+ *
+ *********************************************************************/
+
+#define SCAN_AUTO               (0)     /* le meilleur disponible       */
+#define SCAN_SCALAR             (1)
+#define SCAN_SSE                (2)     /* SSE2 (et SSSE3 pour la carte)*/
+#define SCAN_AVX2               (3)
+
+
+/**********************************************************************
+ Jeu d'instructions utilise (SCAN_AUTO par defaut). Un jeu que le
+ processeur n'a pas est remplace par le meilleur disponible ;
+ fat_scan_level donne celui qui sera reellement utilise.
+ *********************************************************************/
+
+    extern int sgf_fat_scan;
+
+    int fat_scan_level (void);
+
+/**********************************************************************
+ Bilan des "n" entrees de "tab" : nombre d'entrees de chaque sorte,
+ extents (suites de blocs chaines et contigus : un bloc chaine
+ commence un extent sauf si le precedent designe lui), suites de
+ blocs libres et longueur de la plus longue.
+ *********************************************************************/
+
+typedef struct FAT_SCAN
+    {
+    unsigned nb_free;           /* FAT_FREE                         */
+    unsigned nb_data;           /* blocs chaines a un suivant       */
+    unsigned nb_eof;            /* FAT_EOF                          */
+    unsigned nb_inode;          /* FAT_INODE                        */
+    unsigned nb_reserved;       /* FAT_RESERVED                     */
+    unsigned nb_snapshot;       /* FAT_SNAPSHOT                     */
+    unsigned nb_extents;
+    unsigned nb_free_extents;
+    unsigned largest_free_extent;
+    }
+    FAT_SCAN;
+
+    void fat_scan (const int* tab, int n, FAT_SCAN* s);
+
+/**********************************************************************
+ Premiere entree FAT_FREE de tab[from..to-1] (-1 si aucune).
+ *********************************************************************/
+
+    int fat_find_free (const int* tab, int from, int to);
+
+/**********************************************************************
+ Ecrire dans "out" un caractere par entree : D (donnee), F (libre),
+ R (reserve), I (INODE), E (fin de chaine), S (instantane), ? (entree
+ invalide). "out" n'est pas termine par un '\0'.
+ *********************************************************************/
+
+    void fat_render (const int* tab, int n, char* out);
+
+
+#endif
@@ -0,0 +1,559 @@
+
+/*
+**  sgf-snap.c
+**
+**  Instantanes du volume (copie avant ecriture au niveau des blocs).
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-snap.h"
+#include "sgf-journal.h"
+
+
+#define BIT_GET(m,n)            ((m)[(n) >> 3] & (1 << ((n) & 7)))
+#define BIT_SET(m,n)            ((m)[(n) >> 3] |= (1 << ((n) & 7)))
+#define BIT_CLR(m,n)            ((m)[(n) >> 3] &= ~(1 << ((n) & 7)))
+
+#define FAT_PER_BLOCK           (BLOCK_SIZE / sizeof(int))
+
+
+/**********************************************************************
+ *
+ *  Les instantanes en memoire centrale.
+ *
+ *********************************************************************/
+
+typedef struct SNAPSHOT         /* Un instantane actif              */
+    {                           /* -------------------------------- */
+    unsigned char* pending;     /* blocs utilises, pas encore copies*/
+    int*  remap;                /* copie de chaque bloc (0 : aucune)*/
+    TBLOCK log;                 /* dernier bloc de son journal      */
+    int   nb_exceptions;        /* blocs recopies ou gardes         */
+    }
+    SNAPSHOT;
+
+static SNAPSHOT snaps[SNAP_MAX];
+static TBLOCK table;
+static int adr_table = -1;
+static int nb_active = 0;
+static int disk_size = 0;
+
+/* le journal des meta-donnees n'est pas fige par les instantanes */
+static int journal_first = 0;
+static int journal_end = 0;
+
+#define IN_JOURNAL(n)           ((n) >= journal_first  &&  (n) < journal_end)
+
+/* recuperation paresseuse des blocs des instantanes detruits */
+static unsigned char* needed = NULL;
+static int reclaim_cursor = -1;         /* -1 : rien a recuperer */
+
+
+static void snap_before_write (int n);
+static int snap_on_free (int n);
+
+
+/**********************************************************************
+ Brancher/debrancher la copie avant ecriture.
+ *********************************************************************/
+
+static void set_hooks (void)
+    {
+    set_write_hook((nb_active > 0) ? snap_before_write : NULL);
+    set_free_hook((nb_active > 0) ? snap_on_free : NULL);
+    }
+
+static void free_snapshot (int id)
+    {
+    free(snaps[id].pending);
+    free(snaps[id].remap);
+    snaps[id].pending = NULL;
+    snaps[id].remap = NULL;
+    }
+
+static void save_table (void)
+    {
+    write_block(adr_table, &table.data);
+    }
+
+
+/**********************************************************************
+ Oublier les instantanes du disque courant.
+ *********************************************************************/
+
+void close_sgf_snap (void)
+    {
+    int id;
+
+    for(id = 0; id < SNAP_MAX; id++)
+        free_snapshot(id);
+    memset(&table, 0, sizeof(table));
+    free(needed);
+    needed = NULL;
+    adr_table = -1;
+    nb_active = 0;
+    journal_first = journal_end = 0;
+    reclaim_cursor = -1;
+    set_hooks();
+    }
+
+
+/**********************************************************************
+ Charger un instantane : son journal, puis sa FAT (lue a travers le
+ journal) pour retrouver les blocs qu'il utilise encore sur place.
+ *********************************************************************/
+
+static void load_snapshot (int id)
+    {
+    SNAPSHOT* s = &snaps[id];
+    TBLOCK b;
+    int adr, n, j, k, idx, v, fat_blocks;
+
+    s->pending = calloc(disk_size / 8 + 1, 1);
+    s->remap = calloc(disk_size, sizeof(int));
+    if (s->pending == NULL  ||  s->remap == NULL)
+        panic("load_snapshot: plus de memoire.");
+
+    s->nb_exceptions = 0;
+    for(adr = table.snaps[id].log; adr > 0; adr = b.log.next)
+        {
+        read_block(adr, &b.data);
+        if (adr == table.snaps[id].log) s->log = b;
+        for(j = 0; j < b.log.nb; j++)
+            {
+            s->remap[b.log.pair[j][0]] = b.log.pair[j][1];
+            s->nb_exceptions++;
+            }
+        }
+
+    fat_blocks = get_fat_size_in_blocks();
+    for(k = 0; k < fat_blocks; k++)
+        {
+        n = k + ADR_BLOCK_FAT;
+        read_block(s->remap[n] ? s->remap[n] : n, &b.data);
+        for(j = 0; j < FAT_PER_BLOCK; j++)
+            {
+            idx = k * FAT_PER_BLOCK + j;
+            if (idx >= disk_size) break;
+            v = ((int*) b.data)[j];
+            if (v != FAT_FREE  &&  v != FAT_SNAPSHOT  &&  s->remap[idx] == 0  &&  !IN_JOURNAL(idx))
+                BIT_SET(s->pending, idx);
+            }
+        }
+
+    nb_active++;
+    }
+
+
+/**********************************************************************
+ Charger la table des instantanes (montage).
+ *********************************************************************/
+
+void init_sgf_snap (void)
+    {
+    TBLOCK b;
+    int id;
+
+    close_sgf_snap();
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.ext_signature != SIGNATURE_SUPER_EXT  ||  b.super.adr_snapshots <= 0)
+        return;
+    if (b.super.adr_journal > 0)
+        {
+        journal_first = b.super.adr_journal;
+        journal_end = journal_first + b.super.nb_journal_blocks;
+        }
+
+    adr_table = b.super.adr_snapshots;
+    read_block(adr_table, &table.data);
+    disk_size = get_disk_size();
+
+    for(id = 0; id < SNAP_MAX; id++)
+        if (table.snaps[id].active) load_snapshot(id);
+    set_hooks();
+
+    /* des instantanes detruits avant le demontage ont pu laisser des blocs */
+    reclaim_cursor = 0;
+    }
+
+
+/**********************************************************************
+ Prendre un bloc libre pour un instantane (copie ou journal).
+ *********************************************************************/
+
+static int snap_alloc (int goal)
+    {
+    int adr = find_free_extent(1, goal);
+
+    if (adr < 0) return (-1);
+    set_fat_lazy(adr, FAT_SNAPSHOT);
+    if (needed != NULL) BIT_SET(needed, adr);
+    return (adr);
+    }
+
+
+/**********************************************************************
+ Noter dans le journal de l'instantane "id" que le bloc "orig" est
+ desormais conserve dans "copy". Le journal est ecrit avant que le
+ bloc d'origine ne soit ecrase.
+ *********************************************************************/
+
+static int log_exception (int id, int orig, int copy)
+    {
+    SNAPSHOT* s = &snaps[id];
+    int adr, fresh = 0;
+
+    if (table.snaps[id].log < 0  ||  s->log.log.nb == SNAP_LOG_PAIRS)
+        {
+        adr = snap_alloc(orig + 1);
+        if (adr < 0) return (-1);
+        s->log.log.next = table.snaps[id].log;
+        s->log.log.nb = 0;
+        table.snaps[id].log = adr;
+        fresh = 1;
+        }
+
+    s->log.log.pair[s->log.log.nb][0] = orig;
+    s->log.log.pair[s->log.log.nb][1] = copy;
+    s->log.log.nb++;
+    write_block(table.snaps[id].log, &s->log.data);
+    if (fresh) save_table();
+
+    s->remap[orig] = copy;
+    s->nb_exceptions++;
+    return (0);
+    }
+
+
+/**********************************************************************
+ Un instantane qui ne peut plus etre preserve (disque plein) est
+ abandonne.
+ *********************************************************************/
+
+static void drop_snapshot (int id)
+    {
+    fprintf(stderr, "sgf-snap: instantane %d abandonne (disque plein)\n", id);
+    sgf_snapshot_delete(id);
+    }
+
+
+/**********************************************************************
+ Avant l'ecriture du bloc "n" : recopier son ancien contenu pour les
+ instantanes qui l'utilisent encore sur place (une seule copie pour
+ tous).
+ *********************************************************************/
+
+static void snap_before_write (int n)
+    {
+    TBLOCK old;
+    int id, copy = -1;
+
+    for(id = 0; id < SNAP_MAX; id++)
+        {
+        if (!table.snaps[id].active  ||  !BIT_GET(snaps[id].pending, n)) continue;
+        BIT_CLR(snaps[id].pending, n);
+
+        if (copy < 0)
+            {
+            read_block(n, &old.data);
+            copy = snap_alloc(n + 1);
+            if (copy < 0)
+                {
+                drop_snapshot(id);
+                continue;
+                }
+            write_block(copy, &old.data);
+            }
+        if (log_exception(id, n, copy) < 0) drop_snapshot(id);
+        }
+    }
+
+
+/**********************************************************************
+ Avant la liberation du bloc "n" : s'il est encore utilise sur place
+ par un instantane, il lui est laisse (sans copie).
+ *********************************************************************/
+
+static int snap_on_free (int n)
+    {
+    int id, kept = 0;
+
+    for(id = 0; id < SNAP_MAX; id++)
+        {
+        if (!table.snaps[id].active  ||  !BIT_GET(snaps[id].pending, n)) continue;
+        BIT_CLR(snaps[id].pending, n);
+        if (log_exception(id, n, n) < 0)
+            drop_snapshot(id);
+        else
+            kept = 1;
+        }
+
+    if (kept  &&  needed != NULL) BIT_SET(needed, n);
+    return (kept);
+    }
+
+
+/**********************************************************************
+ Creer un instantane.
+ *********************************************************************/
+
+int sgf_snapshot_create (void)
+    {
+    TBLOCK b;
+    int id, k, v;
+
+    /* l'instantane voit le disque : les fins de fichiers en cache y sont d'abord ecrites */
+    sgf_sync();
+    save_fat();
+    sgf_journal_checkpoint();
+
+    if (adr_table < 0)
+        {
+        disk_size = get_disk_size();
+        adr_table = snap_alloc(get_fat_size_in_blocks() + ADR_BLOCK_FAT);
+        if (adr_table < 0) return (-1);
+        save_fat();
+        memset(&table, 0, sizeof(table));
+        save_table();
+
+        read_block(ADR_BLOCK_DEF, &b.data);
+        if (b.super.ext_signature != SIGNATURE_SUPER_EXT)
+            {
+            memset((char*) &b + 2 * sizeof(int), 0, BLOCK_SIZE - 2 * sizeof(int));
+            b.super.ext_signature = SIGNATURE_SUPER_EXT;
+            }
+        b.super.adr_snapshots = adr_table;
+        write_block(ADR_BLOCK_DEF, &b.data);
+        }
+
+    read_block(ADR_BLOCK_DEF, &b.data);
+    if (b.super.adr_journal > 0)
+        {
+        journal_first = b.super.adr_journal;
+        journal_end = journal_first + b.super.nb_journal_blocks;
+        }
+
+    for(id = 0; id < SNAP_MAX  &&  table.snaps[id].active; id++) ;
+    if (id == SNAP_MAX) return (-1);
+
+    /* seuls les blocs utilises maintenant seront recopies avant d'etre ecrases */
+    snaps[id].pending = calloc(disk_size / 8 + 1, 1);
+    snaps[id].remap = calloc(disk_size, sizeof(int));
+    if (snaps[id].pending == NULL  ||  snaps[id].remap == NULL)
+        panic("sgf_snapshot_create: plus de memoire.");
+    for(k = 0; k < disk_size; k++)
+        {
+        v = get_fat(k);
+        if (v != FAT_FREE  &&  v != FAT_SNAPSHOT  &&  !IN_JOURNAL(k)) BIT_SET(snaps[id].pending, k);
+        }
+    snaps[id].nb_exceptions = 0;
+
+    table.snaps[id].active = 1;
+    table.snaps[id].date = (int) time(NULL);
+    table.snaps[id].log = -1;
+    save_table();
+
+    nb_active++;
+    set_hooks();
+    return (id);
+    }
+
+
+/**********************************************************************
+ Detruire un instantane : seule la table est ecrite, les blocs sont
+ recuperes ensuite par sgf_snapshot_reclaim.
+ *********************************************************************/
+
+int sgf_snapshot_delete (int id)
+    {
+    if (id < 0  ||  id >= SNAP_MAX  ||  !table.snaps[id].active) return (-1);
+
+    table.snaps[id].active = 0;
+    save_table();
+    free_snapshot(id);
+    nb_active--;
+    set_hooks();
+
+    free(needed);
+    needed = NULL;
+    reclaim_cursor = 0;
+    return (0);
+    }
+
+
+/**********************************************************************
+ Recuperation paresseuse : un bloc FAT_SNAPSHOT qui n'est ni la table,
+ ni un bloc de journal, ni une copie d'un instantane actif est libre.
+ *********************************************************************/
+
+static void mark_needed (void)
+    {
+    TBLOCK b;
+    int id, k, adr;
+
+    needed = calloc(disk_size / 8 + 1, 1);
+    if (needed == NULL) panic("mark_needed: plus de memoire.");
+
+    BIT_SET(needed, adr_table);
+    for(id = 0; id < SNAP_MAX; id++)
+        {
+        if (!table.snaps[id].active) continue;
+        for(k = 0; k < disk_size; k++)
+            if (snaps[id].remap[k] > 0) BIT_SET(needed, snaps[id].remap[k]);
+        for(adr = table.snaps[id].log; adr > 0; adr = b.log.next)
+            {
+            BIT_SET(needed, adr);
+            read_block(adr, &b.data);
+            }
+        }
+    }
+
+int sgf_snapshot_reclaim (int max_entries)
+    {
+    int end;
+
+    if (reclaim_cursor < 0) return (0);
+    if (needed == NULL) mark_needed();
+
+    end = (max_entries > disk_size - reclaim_cursor) ? disk_size : reclaim_cursor + max_entries;
+    for(; reclaim_cursor < end; reclaim_cursor++)
+        if (get_fat(reclaim_cursor) == FAT_SNAPSHOT  &&  !BIT_GET(needed, reclaim_cursor))
+            set_fat_lazy(reclaim_cursor, FAT_FREE);
+    save_fat();
+
+    if (reclaim_cursor < disk_size) return (1);
+
+    free(needed);
+    needed = NULL;
+    reclaim_cursor = -1;
+    return (0);
+    }
+
+
+/**********************************************************************
+ Afficher la table des instantanes.
+ *********************************************************************/
+
+void sgf_snapshot_list (void)
+    {
+    time_t date;
+    int id;
+
+    for(id = 0; id < SNAP_MAX; id++)
+        {
+        if (!table.snaps[id].active) continue;
+        date = table.snaps[id].date;
+        printf("- Instantane %d : %d bloc(s) conserve(s), cree le %s",
+               id, snaps[id].nb_exceptions, ctime(&date));
+        }
+    }
+
+
+/**********************************************************************
+ Monter un instantane en lecture seule : sa FAT et l'adresse de son
+ repertoire sont lues a travers son journal.
+ *********************************************************************/
+
+SNAP_VIEW* sgf_snapshot_mount (int id)
+    {
+    SNAP_VIEW* v;
+    TBLOCK b;
+    int k, fat_blocks;
+
+    if (id < 0  ||  id >= SNAP_MAX  ||  !table.snaps[id].active) return (NULL);
+
+    fat_blocks = get_fat_size_in_blocks();
+    v = malloc(sizeof(SNAP_VIEW));
+    if (v == NULL) return (NULL);
+    v->id = id;
+    v->fat = malloc((long) fat_blocks * BLOCK_SIZE);
+    if (v->fat == NULL)
+        {
+        free(v);
+        return (NULL);
+        }
+
+    for(k = 0; k < fat_blocks; k++)
+        sgf_snapshot_read_block(v, k + ADR_BLOCK_FAT, (BLOCK*) (v->fat + k * FAT_PER_BLOCK));
+
+    sgf_snapshot_read_block(v, ADR_BLOCK_DEF, &b.data);
+    v->adr_dir = b.super.adr_dir;
+    return (v);
+    }
+
+void sgf_snapshot_umount (SNAP_VIEW* v)
+    {
+    free(v->fat);
+    free(v);
+    }
+
+
+/**********************************************************************
+ Lire un bloc de l'instantane : sa copie s'il a ete modifie depuis,
+ le bloc lui-meme sinon.
+ *********************************************************************/
+
+void sgf_snapshot_read_block (SNAP_VIEW* v, int n, BLOCK* b)
+    {
+    int copy;
+
+    if (!table.snaps[v->id].active)
+        panic("sgf-snap: l'instantane %d a ete detruit.", v->id);
+
+    /* le disque, et non la version du journal qui n'est pas encore en place */
+    copy = snaps[v->id].remap[n];
+    read_disk_block((copy > 0) ? copy : n, b);
+    }
+
+int sgf_snapshot_get_fat (SNAP_VIEW* v, int n)
+    {
+    return (v->fat[n]);
+    }
+
+
+/**********************************************************************
+ Repertoire d'un instantane.
+ *********************************************************************/
+
+int sgf_snapshot_find_inode (SNAP_VIEW* v, const char* name)
+    {
+    TBLOCK b;
+    int adr, j;
+
+    for(adr = v->adr_dir; adr != FAT_EOF; adr = v->fat[adr])
+        {
+        sgf_snapshot_read_block(v, adr, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++)
+            if (b.dir[j].inode > 0  &&  strcmp(b.dir[j].name, name) == 0)
+                return (b.dir[j].inode);
+        }
+
+    return (-1);
+    }
+
+void sgf_snapshot_list_directory (SNAP_VIEW* v)
+    {
+    TBLOCK b, ib;
+    int adr, j;
+
+    for(adr = v->adr_dir; adr != FAT_EOF; adr = v->fat[adr])
+        {
+        sgf_snapshot_read_block(v, adr, &b.data);
+        for(j = 0; j < BLOCK_DIR_SIZE; j++)
+            {
+            if (b.dir[j].inode <= 0) continue;
+            sgf_snapshot_read_block(v, b.dir[j].inode, &ib.data);
+            printf("- File : %s : %d\n", b.dir[j].name, INODE_SIZE(ib.inode));
+            }
+        }
+    }
@@ -0,0 +1,86 @@
+
+#ifndef __SGF_SNAP__
+#define __SGF_SNAP__
+
+
+/**********************************************************************
+ *
+ *  INSTANTANES DU VOLUME
+ *
+ *  Un instantane fige l'etat de tout le disque (super bloc, FAT,
+ *  repertoire, INODEs et donnees) par copie avant ecriture : a sa
+ *  creation on note seulement quels blocs sont utilises. Avant que le
+ *  volume courant n'ecrase l'un de ces blocs (write_block), son ancien
+ *  contenu est recopie dans un bloc libre et le couple (bloc, copie)
+ *  est ajoute au journal d'exceptions de l'instantane. Un bloc libere
+ *  par le volume courant n'est pas recopie : il est garde tel quel
+ *  (FAT_SNAPSHOT) et devient sa propre copie.
+ *
+ *  La creation ne fait donc qu'ecrire la table des instantanes (dont
+ *  l'adresse est dans le super bloc). La destruction ne fait que
+ *  liberer l'entree de la table : les blocs FAT_SNAPSHOT qui ne
+ *  servent plus a aucun instantane sont rendus libres petit a petit
+ *  par sgf_snapshot_reclaim (appele a chaque fermeture de fichier).
+ *
+ *  Un instantane se monte en lecture seule a cote du volume courant :
+ *  sgf_open_snapshot (sgf-io.h) y ouvre un fichier en lecture.
+ *
+ *********************************************************************/
+
+#define SNAP_RECLAIM_STEP       (4096)  /* entrees de FAT par etape */
+
+typedef struct SNAP_VIEW        /* Un instantane monte              */
+    {                           /* -------------------------------- */
+    int   id;                   /* numero de l'instantane           */
+    int   adr_dir;              /* premier bloc de son repertoire   */
+    int*  fat;                  /* sa FAT                           */
+    }
+    SNAP_VIEW;
+
+
+/**********************************************************************
+ Charger la table des instantanes du disque courant (au montage), ou
+ oublier les instantanes (avant un changement de disque).
+ *********************************************************************/
+
+    void init_sgf_snap (void);
+    void close_sgf_snap (void);
+
+/**********************************************************************
+ Creer un instantane (renvoie son numero ou -1 si la table est pleine
+ ou le disque plein) ; detruire un instantane.
+ *********************************************************************/
+
+    int sgf_snapshot_create (void);
+    int sgf_snapshot_delete (int id);
+
+/**********************************************************************
+ Rendre libres les blocs des instantanes detruits en examinant au
+ plus "max_entries" entrees de la FAT. Renvoie 1 s'il reste des blocs
+ a examiner.
+ *********************************************************************/
+
+    int sgf_snapshot_reclaim (int max_entries);
+
+/**********************************************************************
+ Afficher la table des instantanes.
+ *********************************************************************/
+
+    void sgf_snapshot_list (void);
+
+/**********************************************************************
+ Monter/demonter un instantane en lecture seule, lire l'un de ses
+ blocs, une entree de sa FAT, chercher un fichier dans son repertoire
+ et afficher ce repertoire.
+ *********************************************************************/
+
+    SNAP_VIEW* sgf_snapshot_mount (int id);
+    void sgf_snapshot_umount (SNAP_VIEW* v);
+
+    void sgf_snapshot_read_block (SNAP_VIEW* v, int n, BLOCK* b);
+    int sgf_snapshot_get_fat (SNAP_VIEW* v, int n);
+    int sgf_snapshot_find_inode (SNAP_VIEW* v, const char* name);
+    void sgf_snapshot_list_directory (SNAP_VIEW* v);
+
+
+#endif
@@ -0,0 +1,215 @@
+/*
+**  sgf-stats.c
+**
+**  Mesures internes : durees des fonctions et anneau d'evenements.
+**
+*/
+
+#define _POSIX_C_SOURCE 200112L         /* clock_gettime */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sgf-disk.h"
+#include "sgf-stats.h"
+
+
+#define EVENT_MASK              (EVENT_RING_SIZE - 1)
+
+
+int sgf_stats_enabled = 0;
+int trace_sgf_disk = 0;
+
+static SGF_OP_STATS stats [ STAT_COUNT ];
+
+static SGF_EVENT ring [ EVENT_RING_SIZE ];
+static unsigned long ring_head = 0;     /* evenements deja places */
+
+static const char* names [ STAT_COUNT ] =
+    {
+    "sgf_open", "sgf_close", "sgf_getc", "sgf_write", "find_inode",
+    "alloc_block", "read_block", "write_block", "save_fat", "sgf_read"
+    };
+
+
+/**********************************************************************
+ Instant present en ns (jamais nul : 0 signifie "pas de mesure").
+ *********************************************************************/
+
+unsigned long stats_clock (void)
+    {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((unsigned long) t.tv_sec * 1000000000UL + t.tv_nsec + 1);
+    }
+
+
+/**********************************************************************
+ Intervalle de l'histogramme d'une duree : les 16 premieres valeurs
+ ont chacune le leur, puis chaque puissance de 2 est coupee en 16.
+ *********************************************************************/
+
+static int bucket_of (unsigned long ns)
+    {
+    int e;
+
+    if (ns < STATS_SUB_BUCKETS) return ((int) ns);
+    e = 63 - __builtin_clzl(ns);
+    if (e >= 3 + STATS_BUCKETS / STATS_SUB_BUCKETS) return (STATS_BUCKETS - 1);
+    return ((e - 3) * STATS_SUB_BUCKETS + (int) ((ns >> (e - 4)) & (STATS_SUB_BUCKETS - 1)));
+    }
+
+/* plus grande duree de l'intervalle k */
+static unsigned long bucket_top (int k)
+    {
+    int e;
+
+    if (k < STATS_SUB_BUCKETS) return ((unsigned long) k);
+    e = k / STATS_SUB_BUCKETS + 3;
+    return ((((unsigned long) STATS_SUB_BUCKETS + k % STATS_SUB_BUCKETS + 1) << (e - 4)) - 1);
+    }
+
+
+/**********************************************************************
+ Noter la duree d'un appel commence a l'instant "start".
+ *********************************************************************/
+
+void stats_record (int op, unsigned long start)
+    {
+    SGF_OP_STATS* s = &stats[op];
+    unsigned long ns = stats_clock() - start, max;
+
+    __sync_fetch_and_add(&s->nb_calls, 1);
+    __sync_fetch_and_add(&s->total_ns, ns);
+    __sync_fetch_and_add(&s->hist[bucket_of(ns)], 1);
+    for(max = s->max_ns; ns > max; max = s->max_ns)
+        if (__sync_bool_compare_and_swap(&s->max_ns, max, ns)) break;
+    }
+
+
+void sgf_get_stats (SGF_STATS* s)
+    {
+    memcpy(s->op, stats, sizeof(stats));
+    get_disk_counters(&s->disk);
+    s->nb_events = ring_head;
+    }
+
+
+void sgf_reset_stats (void)
+    {
+    memset(stats, 0, sizeof(stats));
+    reset_disk_counters();
+    }
+
+
+const char* sgf_stats_name (int op)
+    {
+    return ((op >= 0  &&  op < STAT_COUNT) ? names[op] : "?");
+    }
+
+
+unsigned long stats_percentile (const SGF_OP_STATS* s, double p)
+    {
+    unsigned long seen = 0, rank;
+    int k;
+
+    if (s->nb_calls == 0) return (0);
+    rank = (unsigned long) (p / 100.0 * s->nb_calls);
+    if (rank >= s->nb_calls) rank = s->nb_calls - 1;
+    for(k = 0; k < STATS_BUCKETS; k++)
+        {
+        seen += s->hist[k];
+        if (seen > rank)
+            return ((bucket_top(k) < s->max_ns) ? bucket_top(k) : s->max_ns);
+        }
+    return (s->max_ns);
+    }
+
+
+void sgf_print_stats (FILE* out)
+    {
+    SGF_STATS s;
+    int k;
+
+    sgf_get_stats(&s);
+    fprintf(out, "%-12s %10s %10s %10s %10s %10s %10s\n", "fonction", "appels", "moy. ns",
+            "p50 ns", "p99 ns", "p99.9 ns", "max ns");
+    for(k = 0; k < STAT_COUNT; k++)
+        if (s.op[k].nb_calls > 0)
+            fprintf(out, "%-12s %10lu %10lu %10lu %10lu %10lu %10lu\n", names[k], s.op[k].nb_calls,
+                    s.op[k].total_ns / s.op[k].nb_calls, stats_percentile(&s.op[k], 50),
+                    stats_percentile(&s.op[k], 99), stats_percentile(&s.op[k], 99.9), s.op[k].max_ns);
+    fprintf(out, "disque : %ld lu(s), %ld ecrit(s), %ld deplacement(s), %lu evenement(s)\n",
+            s.disk.nb_reads, s.disk.nb_writes, s.disk.nb_seeks, s.nb_events);
+    }
+
+
+/**********************************************************************
+ Anneau d'evenements. Le numero d'un evenement est remis a 0 pendant
+ qu'on le remplit et n'est publie qu'ensuite : un lecteur qui trouve
+ le meme numero avant et apres sa copie a une copie coherente.
+ *********************************************************************/
+
+void sgf_trace_event (int type, int arg, int count)
+    {
+    unsigned long seq = __sync_add_and_fetch(&ring_head, 1);
+    SGF_EVENT* e = &ring[(seq - 1) & EVENT_MASK];
+
+    e->seq = 0;
+    __sync_synchronize();
+    e->time = stats_clock();
+    e->type = type;
+    e->arg = arg;
+    e->count = count;
+    __sync_synchronize();
+    e->seq = seq;
+    }
+
+
+int sgf_read_events (SGF_EVENT* out, int max, unsigned long* cursor)
+    {
+    unsigned long head = ring_head, seq;
+    int nb = 0;
+
+    seq = *cursor + 1;
+    if (head > EVENT_RING_SIZE  &&  seq <= head - EVENT_RING_SIZE)
+        seq = head - EVENT_RING_SIZE + 1;
+
+    for(; seq <= head  &&  nb < max; seq++)
+        {
+        const SGF_EVENT* e = &ring[(seq - 1) & EVENT_MASK];
+
+        if (e->seq != seq) continue;
+        __sync_synchronize();
+        out[nb] = *e;
+        __sync_synchronize();
+        if (e->seq == seq  &&  out[nb].seq == seq) nb++;
+        }
+    *cursor = seq - 1;
+    return (nb);
+    }
+
+
+void sgf_dump_events (FILE* out, unsigned long* cursor)
+    {
+    SGF_EVENT e[64];
+    int nb, k;
+
+    while ((nb = sgf_read_events(e, 64, cursor)) > 0)
+        for(k = 0; k < nb; k++)
+            switch (e[k].type)
+                {
+                case EVENT_READ_BLOCK:
+                    fprintf(out, "%lu read block %d\n", e[k].seq, e[k].arg);
+                    break;
+                case EVENT_WRITE_BLOCK:
+                    fprintf(out, "%lu write block %d\n", e[k].seq, e[k].arg);
+                    break;
+                case EVENT_PUNCH_BLOCKS:
+                    fprintf(out, "%lu punch blocks %d to %d\n", e[k].seq, e[k].arg, e[k].arg + e[k].count - 1);
+                    break;
+                }
+    }
@@ -0,0 +1,148 @@
+#ifndef __SGF_STATS__
+#define __SGF_STATS__
+
+#include "sgf-disk.h"
+
+
+/**********************************************************************
+ *
+ *  MESURES INTERNES DU SGF
+ *
+ *  Pour les principales fonctions (voir STAT_xxx), un compteur
+ *  d'appels, la duree cumulee, la plus longue et un histogramme des
+ *  durees a precision relative constante (a la facon de HdrHistogram :
+ *  16 intervalles par puissance de 2, soit environ 6 %). Les mesures
+ *  ne sont prises que si sgf_stats_enabled est non nul (0 par defaut) :
+ *  sinon chaque appel ne coute qu'un test. Compile avec -DSGF_NO_STATS,
+ *  le SGF ne contient plus aucune mesure.
+ *
+ *  Si trace_sgf_disk est non nul (0 par defaut), chaque E/S du disque
+ *  est notee dans un anneau d'evenements binaires (EVENT_RING_SIZE
+ *  derniers evenements) au lieu d'etre affichee sur stderr. L'anneau
+ *  s'ecrit sans verrou : chaque evenement prend sa place par un
+ *  increment atomique de la tete, et son numero n'est publie qu'une
+ *  fois l'evenement complet, ce qui permet a un lecteur d'ecarter un
+ *  evenement en cours d'ecriture ou deja recouvert.
+ *
+ *  Les compteurs se mettent a jour par operations atomiques et
+ *  peuvent etre lus pendant que d'autres fils travaillent.
+ *
+ *********************************************************************/
+
+#define STAT_OPEN               (0)     /* sgf_open                     */
+#define STAT_CLOSE              (1)     /* sgf_close                    */
+#define STAT_GETC               (2)     /* sgf_getc                     */
+#define STAT_WRITE              (3)     /* sgf_write                    */
+#define STAT_FIND_INODE         (4)     /* find_inode                   */
+#define STAT_ALLOC_BLOCK        (5)     /* alloc_block                  */
+#define STAT_READ_BLOCK         (6)     /* read_block                   */
+#define STAT_WRITE_BLOCK        (7)     /* write_block                  */
+#define STAT_SAVE_FAT           (8)     /* save_fat                     */
+#define STAT_READ               (9)     /* sgf_read                     */
+#define STAT_COUNT              (10)
+
+#define STATS_SUB_BUCKETS       (16)    /* intervalles par puissance de 2 */
+#define STATS_BUCKETS           (37 * STATS_SUB_BUCKETS) /* jusqu'a 2^40 ns */
+
+#define EVENT_READ_BLOCK        (1)
+#define EVENT_WRITE_BLOCK       (2)
+#define EVENT_PUNCH_BLOCKS      (3)
+#define EVENT_RING_SIZE         (1 << 14)
+
+
+/**********************************************************************
+ Activer les mesures et l'anneau d'evenements (0 par defaut).
+ *********************************************************************/
+
+    extern int sgf_stats_enabled;
+    extern int trace_sgf_disk;
+
+/**********************************************************************
+ Les mesures d'une fonction (durees en nanosecondes) et de toutes.
+ *********************************************************************/
+
+typedef struct SGF_OP_STATS
+    {
+    unsigned long nb_calls;
+    unsigned long total_ns;
+    unsigned long max_ns;
+    unsigned long hist [ STATS_BUCKETS ];
+    }
+    SGF_OP_STATS;
+
+typedef struct SGF_STATS
+    {
+    SGF_OP_STATS op [ STAT_COUNT ];
+    DISK_COUNTERS disk;         /* compteurs d'E/S du disque        */
+    unsigned long nb_events;    /* evenements notes dans l'anneau   */
+    }
+    SGF_STATS;
+
+/**********************************************************************
+ Copier les mesures depuis le dernier sgf_reset_stats (qui remet aussi
+ a zero les compteurs du disque). sgf_stats_name donne le nom de la
+ fonction mesuree "op", stats_percentile la duree (ns) en dessous de
+ laquelle se trouvent "p" % des appels, et sgf_print_stats affiche un
+ resume des fonctions appelees.
+ *********************************************************************/
+
+    void sgf_get_stats (SGF_STATS* s);
+    void sgf_reset_stats (void);
+    const char* sgf_stats_name (int op);
+    unsigned long stats_percentile (const SGF_OP_STATS* s, double p);
+    void sgf_print_stats (FILE* out);
+
+/**********************************************************************
+ Un evenement de l'anneau : "seq" est son numero (a partir de 1),
+ "time" l'instant (ns, horloge monotone), "arg" le bloc concerne et
+ "count" le nombre de blocs.
+ *********************************************************************/
+
+typedef struct SGF_EVENT
+    {
+    unsigned long seq;
+    unsigned long time;
+    int type;
+    int arg;
+    int count;
+    }
+    SGF_EVENT;
+
+    void sgf_trace_event (int type, int arg, int count);
+
+/**********************************************************************
+ Copier dans "out" (au plus "max") les evenements de numero superieur
+ a *cursor encore presents dans l'anneau, et avancer *cursor (0 au
+ depart). Renvoie le nombre d'evenements copies ; un saut dans les
+ numeros signale des evenements perdus. sgf_dump_events les affiche
+ sous forme de texte.
+ *********************************************************************/
+
+    int sgf_read_events (SGF_EVENT* out, int max, unsigned long* cursor);
+    void sgf_dump_events (FILE* out, unsigned long* cursor);
+
+/**********************************************************************
+ Prise des mesures dans les fonctions instrumentees :
+
+     STATS_DECL;                    avec les declarations
+     STATS_START();                 au debut
+     STATS_STOP(STAT_xxx);          avant chaque retour
+ *********************************************************************/
+
+    unsigned long stats_clock (void);
+    void stats_record (int op, unsigned long start);
+
+#ifndef SGF_NO_STATS
+#define STATS_DECL              unsigned long stats_t0
+#define STATS_START()           (stats_t0 = sgf_stats_enabled ? stats_clock() : 0)
+#define STATS_STOP(op)          do { if (stats_t0 != 0) stats_record((op), stats_t0); } while (0)
+#define TRACE_EVENT(t, a, n)    do { if (trace_sgf_disk) sgf_trace_event((t), (a), (n)); } while (0)
+#else
+#define STATS_DECL              int stats_t0
+#define STATS_START()           (stats_t0 = 0)
+#define STATS_STOP(op)          ((void) stats_t0)
+#define TRACE_EVENT(t, a, n)    ((void) 0)
+#endif
+
+
+#endif
@@ -0,0 +1,287 @@
+/*
+**  sgf-stream.c
+**
+**  Flots tamponnes au-dessus des fichiers ouverts.
+**
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-io.h"
+#include "sgf-stream.h"
+
+
+int sgf_stream_blocks = STREAM_BLOCKS;
+
+
+/**********************************************************************
+ Le tampon est au repos (rptr = rend = wptr = wend = buffer), en
+ lecture (les octets buffer..rend-1 sont ceux du fichier a partir de
+ "pos", wend = buffer) ou en ecriture (wend = buffer + size, les
+ octets buffer..wptr-1 vont a la position "pos", rend = buffer).
+ *********************************************************************/
+
+#define WRITING(s)      ((s)->wend > (s)->buffer)
+
+
+SGF_STREAM* sgf_stream_open (const char* nom, int mode)
+    {
+    SGF_STREAM* s;
+    OFILE* f;
+    int m = mode & ~COMPRESSED_MODE;
+    int blocks = (sgf_stream_blocks > 0) ? sgf_stream_blocks : 1;
+
+    if ((f = sgf_open(nom, mode)) == NULL) return (NULL);
+
+    s = malloc(sizeof(SGF_STREAM));
+    if (s != NULL) s->buffer = malloc(blocks * BLOCK_SIZE);
+    if (s == NULL  ||  s->buffer == NULL)
+        panic("sgf_stream_open: plus de memoire.");
+
+    s->size = blocks * BLOCK_SIZE;
+    s->rptr = s->rend = s->wptr = s->wend = s->buffer;
+    s->file = f;
+    s->readable = (m == READ_MODE  ||  m == READ_WRITE_MODE);
+    s->writable = (m != READ_MODE);
+    s->error = 0;
+    s->pos = (m == APPEND_MODE) ? (f->compressed ? f->zlength : f->length) : 0;
+    return (s);
+    }
+
+
+int sgf_stream_close (SGF_STREAM* s)
+    {
+    int r = sgf_stream_flush(s);
+
+    if (s->error) r = -1;
+    sgf_close(s->file);
+    free(s->buffer);
+    free(s);
+    return (r);
+    }
+
+
+int sgf_stream_tell (SGF_STREAM* s)
+    {
+    return (s->pos + (WRITING(s) ? s->wptr - s->buffer : s->rptr - s->buffer));
+    }
+
+
+/**********************************************************************
+ Vider le tampon d'ecriture dans le fichier.
+ *********************************************************************/
+
+int sgf_stream_flush (SGF_STREAM* s)
+    {
+    int n = s->wptr - s->buffer;
+
+    if (!WRITING(s)  ||  n == 0) return (0);
+    s->wptr = s->buffer;
+    if (sgf_write(s->file, (char*) s->buffer, n) < 0)
+        {
+        s->error = 1;
+        return (-1);
+        }
+    s->pos += n;
+    return (0);
+    }
+
+
+/**********************************************************************
+ Bords du tampon. sgf_stream_fill vide d'abord les ecritures en
+ attente ; start_write replace le fichier a la position du flot si
+ des octets lus n'ont pas ete consommes (READ_WRITE_MODE).
+ *********************************************************************/
+
+int sgf_stream_fill (SGF_STREAM* s)
+    {
+    int n;
+
+    if (!s->readable) return (-1);
+    if (WRITING(s))
+        {
+        if (sgf_stream_flush(s) < 0) return (-1);
+        s->wptr = s->wend = s->buffer;
+        }
+
+    s->pos += s->rend - s->buffer;
+    n = sgf_read(s->file, (char*) s->buffer, s->size);
+    s->rptr = s->buffer;
+    s->rend = s->buffer + ((n > 0) ? n : 0);
+    return ((n > 0) ? *s->rptr++ : -1);
+    }
+
+
+static int start_write (SGF_STREAM* s)
+    {
+    if (!s->writable) return (-1);
+    if (WRITING(s))
+        return ((s->wptr == s->wend) ? sgf_stream_flush(s) : 0);
+
+    if (s->rptr < s->rend  &&  sgf_seek(s->file, sgf_stream_tell(s)) < 0) return (-1);
+    s->pos += s->rptr - s->buffer;
+    s->rptr = s->rend = s->wptr = s->buffer;
+    s->wend = s->buffer + s->size;
+    return (0);
+    }
+
+
+int sgf_stream_flushc (SGF_STREAM* s, int c)
+    {
+    if (start_write(s) < 0) return (-1);
+    *s->wptr++ = (unsigned char) c;
+    return ((unsigned char) c);
+    }
+
+
+/**********************************************************************
+ Se deplacer (sans relire si la position est dans le tampon lu).
+ *********************************************************************/
+
+int sgf_stream_seek (SGF_STREAM* s, int pos)
+    {
+    if (!WRITING(s)  &&  pos >= s->pos  &&  pos < s->pos + (s->rend - s->buffer))
+        {
+        s->rptr = s->buffer + (pos - s->pos);
+        return (0);
+        }
+
+    if (sgf_stream_flush(s) < 0  ||  sgf_seek(s->file, pos) < 0) return (-1);
+    s->pos = pos;
+    s->rptr = s->rend = s->wptr = s->wend = s->buffer;
+    return (0);
+    }
+
+
+/**********************************************************************
+ Lectures et ecritures en bloc : une taille d'au moins un tampon passe
+ directement entre le fichier et l'appelant.
+ *********************************************************************/
+
+int sgf_stream_read (SGF_STREAM* s, char* data, int size)
+    {
+    int n = 0, k;
+
+    if (!s->readable) return (0);
+    while (n < size)
+        {
+        k = s->rend - s->rptr;
+        if (k == 0)
+            {
+            if (!WRITING(s)  &&  size - n >= s->size)
+                {
+                s->pos += s->rend - s->buffer;
+                s->rptr = s->rend = s->buffer;
+                if ((k = sgf_read(s->file, data + n, size - n)) <= 0) break;
+                s->pos += k;
+                n += k;
+                continue;
+                }
+            if (sgf_stream_fill(s) < 0) break;
+            k = s->rend - --s->rptr;
+            }
+        if (k > size - n) k = size - n;
+        memcpy(data + n, s->rptr, k);
+        s->rptr += k;
+        n += k;
+        }
+    return (n);
+    }
+
+
+int sgf_stream_write (SGF_STREAM* s, const char* data, int size)
+    {
+    int n = 0, k;
+
+    while (n < size)
+        {
+        if (s->wptr == s->wend  &&  start_write(s) < 0) return (-1);
+        if (s->wptr == s->buffer  &&  size - n >= s->size)
+            {
+            if (sgf_write(s->file, (char*) data + n, size - n) < 0)
+                {
+                s->error = 1;
+                return (-1);
+                }
+            s->pos += size - n;
+            return (0);
+            }
+        k = s->wend - s->wptr;
+        if (k > size - n) k = size - n;
+        memcpy(s->wptr, data + n, k);
+        s->wptr += k;
+        n += k;
+        }
+    return (0);
+    }
+
+
+int sgf_stream_puts (SGF_STREAM* s, const char* str)
+    {
+    return (sgf_stream_write(s, str, strlen(str)));
+    }
+
+
+/**********************************************************************
+ Lignes : le '\n' est cherche par memchr dans le tampon.
+ *********************************************************************/
+
+char* sgf_gets (SGF_STREAM* s, char* buf, int size)
+    {
+    unsigned char* nl = NULL;
+    int n = 0, k;
+
+    if (size <= 0) return (NULL);
+    while (n < size - 1  &&  nl == NULL)
+        {
+        if (s->rptr >= s->rend)
+            {
+            if (sgf_stream_fill(s) < 0) break;
+            s->rptr--;
+            }
+        k = s->rend - s->rptr;
+        if (k > size - 1 - n) k = size - 1 - n;
+        if ((nl = memchr(s->rptr, '\n', k)) != NULL) k = nl - s->rptr + 1;
+        memcpy(buf + n, s->rptr, k);
+        s->rptr += k;
+        n += k;
+        }
+    buf[n] = '\0';
+    return ((n > 0) ? buf : NULL);
+    }
+
+
+int sgf_getline (SGF_STREAM* s, char** line, int* capacity)
+    {
+    unsigned char* nl = NULL;
+    char* p;
+    int n = 0, k, cap;
+
+    while (nl == NULL)
+        {
+        if (s->rptr >= s->rend)
+            {
+            if (sgf_stream_fill(s) < 0) break;
+            s->rptr--;
+            }
+        k = s->rend - s->rptr;
+        if ((nl = memchr(s->rptr, '\n', k)) != NULL) k = nl - s->rptr + 1;
+        if (n + k + 1 > *capacity)
+            {
+            for(cap = (*capacity > 0) ? *capacity : 128; cap < n + k + 1; cap *= 2) ;
+            if ((p = realloc(*line, cap)) == NULL)
+                panic("sgf_getline: plus de memoire.");
+            *line = p;
+            *capacity = cap;
+            }
+        memcpy(*line + n, s->rptr, k);
+        s->rptr += k;
+        n += k;
+        }
+    if (n == 0) return (-1);
+    (*line)[n] = '\0';
+    return (n);
+    }
@@ -0,0 +1,106 @@
+#ifndef __SGF_STREAM__
+#define __SGF_STREAM__
+
+#include "sgf-io.h"
+
+
+/**********************************************************************
+ *
+ *  FLOTS TAMPONNES (A LA MANIERE DE STDIO)
+ *
+ *  Un SGF_STREAM ajoute a un fichier ouvert un tampon de
+ *  sgf_stream_blocks blocs. sgf_stream_getc et sgf_stream_putc sont
+ *  des macros : le cas courant avance un pointeur dans le tampon,
+ *  comme getc_unlocked, et seul le passage d'un bord du tampon appelle
+ *  une fonction (sgf_stream_fill remplit le tampon par sgf_read,
+ *  sgf_stream_flushc le vide par sgf_write).
+ *
+ *  Le tampon sert a la lecture ou a l'ecriture. En READ_WRITE_MODE on
+ *  peut passer de l'une a l'autre : le tampon est vide et le fichier
+ *  replace a la position du flot. Comme sgf_seek, sgf_stream_seek
+ *  n'est permis qu'en lecture et en lecture/ecriture.
+ *
+ *  Le flot n'est pas protege contre les acces concurrents et le
+ *  fichier ouvert ne doit pas etre utilise directement pendant que
+ *  le flot existe.
+ *
+ *********************************************************************/
+
+#define STREAM_BLOCKS           (64)    /* tampon de 8 Ko               */
+
+typedef struct SGF_STREAM
+    {
+    unsigned char* rptr;        /* prochain octet a lire            */
+    unsigned char* rend;        /* fin des octets lus               */
+    unsigned char* wptr;        /* prochaine place a ecrire         */
+    unsigned char* wend;        /* fin du tampon en ecriture        */
+    unsigned char* buffer;
+    int    size;                /* taille du tampon (octets)        */
+    int    pos;                 /* position du debut du tampon      */
+    OFILE* file;
+    int    readable;
+    int    writable;
+    int    error;               /* une ecriture a echoue            */
+    }
+    SGF_STREAM;
+
+
+/**********************************************************************
+ Taille du tampon des flots ouverts ensuite (en blocs).
+ *********************************************************************/
+
+    extern int sgf_stream_blocks;
+
+/**********************************************************************
+ Ouvrir un fichier (memes modes que sgf_open) et son flot, ou fermer
+ le flot (le tampon est vide) et le fichier : -1 si une ecriture a
+ echoue.
+ *********************************************************************/
+
+    SGF_STREAM* sgf_stream_open (const char* nom, int mode);
+    int sgf_stream_close (SGF_STREAM* s);
+
+/**********************************************************************
+ Lire un octet (0..255, -1 en fin de fichier) ou l'ecrire (renvoie
+ l'octet, -1 en cas d'erreur).
+ *********************************************************************/
+
+#define sgf_stream_getc(s) \
+    (((s)->rptr < (s)->rend) ? *(s)->rptr++ : sgf_stream_fill(s))
+
+#define sgf_stream_putc(s, c) \
+    (((s)->wptr < (s)->wend) ? (*(s)->wptr++ = (unsigned char) (c)) : sgf_stream_flushc((s), (c)))
+
+    int sgf_stream_fill (SGF_STREAM* s);
+    int sgf_stream_flushc (SGF_STREAM* s, int c);
+
+/**********************************************************************
+ Lire ou ecrire "size" octets (par copies de blocs entiers du tampon,
+ ou directement pour les grandes tailles). sgf_stream_read renvoie le
+ nombre d'octets lus, sgf_stream_write et sgf_stream_puts 0 ou -1.
+ *********************************************************************/
+
+    int sgf_stream_read (SGF_STREAM* s, char* data, int size);
+    int sgf_stream_write (SGF_STREAM* s, const char* data, int size);
+    int sgf_stream_puts (SGF_STREAM* s, const char* str);
+
+/**********************************************************************
+ Lire une ligne. sgf_gets copie au plus size - 1 octets, jusqu'au
+ '\n' compris, et termine la chaine (NULL en fin de fichier).
+ sgf_getline agrandit au besoin *line (de taille *capacity, alloue
+ par malloc) et renvoie la longueur lue, ou -1 en fin de fichier.
+ *********************************************************************/
+
+    char* sgf_gets (SGF_STREAM* s, char* buf, int size);
+    int sgf_getline (SGF_STREAM* s, char** line, int* capacity);
+
+/**********************************************************************
+ Ecrire le tampon dans le fichier, se deplacer, position courante.
+ *********************************************************************/
+
+    int sgf_stream_flush (SGF_STREAM* s);
+    int sgf_stream_seek (SGF_STREAM* s, int pos);
+    int sgf_stream_tell (SGF_STREAM* s);
+
+
+#endif
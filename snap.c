@@ -0,0 +1,96 @@
+/*
+**  snap.c
+**
+**  Instantanes d'un disque du mini SGF.
+**
+**  sgf-snap [-d disque] create
+**  sgf-snap [-d disque] delete numero
+**  sgf-snap [-d disque] list
+**  sgf-snap [-d disque] ls numero
+**  sgf-snap [-d disque] cat numero fichier
+**  sgf-snap [-d disque] reclaim
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sgf-disk.h"
+#include "sgf-fat.h"
+#include "sgf-io.h"
+#include "sgf-snap.h"
+
+static int usage (void)
+	{
+	fprintf(stderr, "usage: sgf-snap [-d disque] create | delete n | list | ls n | cat n fichier | reclaim\n");
+	return (EXIT_FAILURE);
+	}
+
+static SNAP_VIEW* mount (const char* id)
+	{
+	SNAP_VIEW* v = sgf_snapshot_mount(atoi(id));
+
+	if (v == NULL) fprintf(stderr, "sgf-snap: pas d'instantane %s\n", id);
+	return (v);
+	}
+
+int main(int argc, char* argv[]) {
+	char* name = NULL;
+	SNAP_VIEW* v;
+	OFILE* f;
+	int i = 1, c, id;
+
+	if (i + 1 < argc && strcmp(argv[i], "-d") == 0) {
+		name = argv[i + 1];
+		i += 2;
+	}
+	if (i >= argc) return (usage());
+
+	if (name != NULL && !test_disk(name)) {
+		fprintf(stderr, "sgf-snap: %s n'est pas un disque utilisable\n", name);
+		return (EXIT_FAILURE);
+	}
+	init_sgf();
+
+	if (strcmp(argv[i], "create") == 0) {
+		id = sgf_snapshot_create();
+		if (id < 0) {
+			fprintf(stderr, "sgf-snap: table des instantanes ou disque plein\n");
+			return (EXIT_FAILURE);
+		}
+		printf("instantane %d cree\n", id);
+	}
+	else if (strcmp(argv[i], "delete") == 0 && i + 1 < argc) {
+		if (sgf_snapshot_delete(atoi(argv[i + 1])) < 0) {
+			fprintf(stderr, "sgf-snap: pas d'instantane %s\n", argv[i + 1]);
+			return (EXIT_FAILURE);
+		}
+		while (sgf_snapshot_reclaim(SNAP_RECLAIM_STEP)) ;
+	}
+	else if (strcmp(argv[i], "list") == 0) {
+		sgf_snapshot_list();
+	}
+	else if (strcmp(argv[i], "ls") == 0 && i + 1 < argc) {
+		if ((v = mount(argv[i + 1])) == NULL) return (EXIT_FAILURE);
+		sgf_snapshot_list_directory(v);
+		sgf_snapshot_umount(v);
+	}
+	else if (strcmp(argv[i], "cat") == 0 && i + 2 < argc) {
+		if ((v = mount(argv[i + 1])) == NULL) return (EXIT_FAILURE);
+		f = sgf_open_snapshot(v, argv[i + 2]);
+		if (f == NULL) {
+			fprintf(stderr, "sgf-snap: pas de fichier %s dans l'instantane\n", argv[i + 2]);
+			return (EXIT_FAILURE);
+		}
+		while ((c = sgf_getc(f)) > 0)
+			putchar(c);
+		sgf_close(f);
+		sgf_snapshot_umount(v);
+	}
+	else if (strcmp(argv[i], "reclaim") == 0) {
+		while (sgf_snapshot_reclaim(SNAP_RECLAIM_STEP)) ;
+	}
+	else return (usage());
+
+	return (EXIT_SUCCESS);
+}
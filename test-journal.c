@@ -0,0 +1,188 @@
+/*
+**  test-journal.c
+**
+**  Atomicite des transactions du journal. Une suite d'operations
+**  (creations de fichiers de plusieurs blocs et destructions) est
+**  faite avec sgf_journal_batch = INT_MAX, comme par sgf-import, sur
+**  un disque dont le journal ne peut pas contenir toute la suite. Le
+**  processus est tue avant sa k-ieme ecriture sur le disque, pour
+**  k = 1, 2, ... jusqu'a ce qu'il aille au bout : la panne tombe ainsi
+**  partout, entre autres entre deux validations. Apres le rejeu du
+**  journal, le disque doit etre coherent et son contenu celui d'un
+**  debut de la suite d'operations : chaque fichier est complet, sauf
+**  le dernier cree qui peut n'avoir que le debut de son contenu (son
+**  ouverture, le placement de ses blocs et sa fermeture sont des
+**  operations distinctes du SGF).
+**
+**  sgf-test-journal [operations]   (150 par defaut, 200 au plus)
+**
+**  Code de retour : 0 tous les essais sont corrects, 1 sinon.
+*/
+
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "sgf-disk.h"
+#include "sgf-data.h"
+#include "sgf-fat.h"
+#include "sgf-dir.h"
+#include "sgf-io.h"
+#include "sgf-journal.h"
+#include "sgf-check.h"
+
+#define IMAGE           "test-journal.img"
+#define DISK_BLOCKS     (2048)
+#define MAX_OPS         (200)
+#define KILLED          (3)     /* code de retour du processus tue */
+
+static int nb_ops = 150;
+static int kill_at, nb_writes;
+
+/* L'operation "t" detruit le fichier t-2 (une fois sur trois) ou cree le fichier t */
+#define IS_UNLINK(t)    ((t) % 3 == 2)
+#define FILE_SIZE(i)    (((i) % 5 + 1) * BLOCK_SIZE + 7 * (i))
+#define MAX_SIZE        (5 * BLOCK_SIZE + 7 * MAX_OPS)
+
+static char pattern(int i, int k) {
+	return ('a' + (i + k) % 26);
+}
+
+static void kill_hook(int n) {
+	if (++nb_writes == kill_at) _exit(KILLED);
+}
+
+/* Faire la suite d'operations ; le processus est tue avant sa kill_at-ieme ecriture */
+static void run_ops(void) {
+	char name[16], data[MAX_SIZE];
+	OFILE* f;
+	int t, k;
+
+	create_disk(IMAGE, DISK_BLOCKS);
+	create_empty_fat();
+	init_sgf();
+	create_empty_directory();
+	sgf_journal_batch = INT_MAX;
+	sgf_journal_commit();
+
+	nb_writes = 0;
+	set_write_hook(kill_hook);
+	for (t = 0; t < nb_ops; t++) {
+		if (IS_UNLINK(t)) {
+			sprintf(name, "f%d", t - 2);
+			sgf_unlink(name);
+			continue;
+		}
+		for (k = 0; k < FILE_SIZE(t); k++)
+			data[k] = pattern(t, k);
+		sprintf(name, "f%d", t);
+		f = sgf_open(name, WRITE_MODE);
+		if (f == NULL || sgf_write(f, data, FILE_SIZE(t)) < 0 || sgf_close(f) < 0) {
+			fprintf(stderr, "sgf-test-journal: operation %d impossible\n", t);
+			exit(EXIT_FAILURE);
+		}
+	}
+	close_sgf_disk();
+	exit(EXIT_SUCCESS);
+}
+
+/* Le fichier "i" doit exister apres "m" operations */
+static int expected(int i, int m) {
+	return (i < m && !IS_UNLINK(i) && !(IS_UNLINK(i + 2) && i + 2 < m));
+}
+
+/* Le contenu d'un fichier doit etre juste, et complet si "whole" */
+static int check_file(int i, int whole) {
+	char name[16], data[MAX_SIZE + 1];
+	OFILE* f;
+	int k, n;
+
+	sprintf(name, "f%d", i);
+	f = sgf_open(name, READ_MODE);
+	if (f == NULL) return (0);
+	n = sgf_read(f, data, sizeof(data));
+	sgf_close(f);
+	if (n > FILE_SIZE(i) || (whole && n != FILE_SIZE(i))) return (0);
+	for (k = 0; k < n; k++)
+		if (data[k] != pattern(i, k)) return (0);
+	return (1);
+}
+
+/* Verifier le disque apres le rejeu ; renvoie le nombre d'operations retrouvees (-1 : incoherent) */
+static int check_disk(void) {
+	CHECK_REPORT r;
+	char name[16];
+	int present[MAX_OPS];
+	int i, m;
+
+	test_disk(IMAGE);
+	init_sgf();
+	sgf_check(1, 0, 0, &r);
+
+	for (i = 0; i < nb_ops; i++) {
+		sprintf(name, "f%d", i);
+		present[i] = (find_inode(name) >= 0);
+	}
+
+	/* l'etat est celui d'un debut de la suite */
+	for (m = nb_ops; m >= 0; m--) {
+		for (i = 0; i < nb_ops && present[i] == expected(i, m); i++)
+			;
+		if (i == nb_ops) break;
+	}
+
+	for (i = 0; i < nb_ops && m >= 0; i++)
+		if (present[i] && !check_file(i, i != m - 1)) m = -1;
+	close_sgf_disk();
+
+	return ((r.nb_errors > 0) ? -1 : m);
+}
+
+int main(int argc, char* argv[]) {
+	int status, m, nb_bad = 0;
+	pid_t pid;
+
+	if (argc > 1) nb_ops = atoi(argv[1]);
+	if (nb_ops <= 0 || nb_ops > MAX_OPS) {
+		fprintf(stderr, "usage: sgf-test-journal [operations (1 a %d)]\n", MAX_OPS);
+		return (8);
+	}
+
+	/* les messages de creation et de montage du disque sont inutiles ici */
+	freopen("/dev/null", "w", stdout);
+
+	for (kill_at = 1; ; kill_at++) {
+		pid = fork();
+		if (pid < 0) {
+			perror("sgf-test-journal");
+			return (EXIT_FAILURE);
+		}
+		if (pid == 0) run_ops();
+		waitpid(pid, &status, 0);
+		if (!WIFEXITED(status) || (WEXITSTATUS(status) != KILLED && WEXITSTATUS(status) != EXIT_SUCCESS))
+			return (EXIT_FAILURE);
+
+		m = check_disk();
+		if (WEXITSTATUS(status) == EXIT_SUCCESS) {
+			if (m != nb_ops) {
+				fprintf(stderr, "sans panne : %d operation(s) retrouvee(s) sur %d\n", m, nb_ops);
+				nb_bad++;
+			}
+			break;
+		}
+		if (m < 0) {
+			fprintf(stderr, "panne avant l'ecriture %d : disque incoherent apres le rejeu\n", kill_at);
+			nb_bad++;
+		}
+	}
+
+	fprintf(stderr, "%d panne(s) simulee(s), %d incorrecte(s)\n", kill_at - 1, nb_bad);
+	remove(IMAGE);
+	return (nb_bad > 0);
+}